@@ -0,0 +1,360 @@
+// End-to-end latency/throughput benchmark for the inference engine.
+//
+// Drives Transformer with synthetic requests: prompt and output lengths
+// drawn from fixed/uniform/normal distributions, arriving all at once or
+// as a Poisson process, served by a single-threaded continuous-batching
+// loop (prefill on admission, then one decode step per active sequence).
+// Reports TTFT, time per output token, inter-token latency and end-to-end
+// latency percentiles, tokens/sec and peak RSS for each configuration.
+
+#include "bench_util.hpp"
+#include "loaders/onnx_loader.hpp"
+#include "transformer/transformer.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+struct Options {
+    std::string model_path;
+    std::vector<std::string> prompt_lens = {"128"};
+    std::vector<std::string> output_lens = {"64"};
+    std::vector<int> batch_sizes = {1};
+    int num_requests = 16;
+    double rate = 0.0;  // Requests/sec for Poisson arrivals, 0 = all at start
+    int seed = 1234;
+    std::string json_path;
+};
+
+struct Request {
+    double arrival;
+    int prompt_len;
+    int output_len;
+};
+
+struct Sequence {
+    const Request* request;
+    KVCache cache;
+    double first_token_time = 0.0;
+    double last_token_time = 0.0;
+    int generated = 0;
+};
+
+struct RunResult {
+    std::string prompt_spec;
+    std::string output_spec;
+    int batch_size;
+    double duration;
+    long prompt_tokens = 0;
+    long output_tokens = 0;
+    double prefill_time = 0.0;
+    double mean_batch = 0.0;
+    size_t peak_rss = 0;
+    bool peak_rss_per_run = false;  // Otherwise the peak over the whole process
+    bench::Samples ttft;  // Arrival to first token
+    bench::Samples tpot;  // Mean decode time per output token, per request
+    bench::Samples itl;   // Every gap between consecutive tokens
+    bench::Samples e2e;   // Arrival to last token
+};
+
+std::vector<Request> make_workload(const Options& opts, const bench::LengthDistribution& prompt,
+                                   const bench::LengthDistribution& output, std::mt19937& rng) {
+    std::vector<Request> requests;
+    std::exponential_distribution<double> gap(opts.rate > 0.0 ? opts.rate : 1.0);
+    double t = 0.0;
+    for (int i = 0; i < opts.num_requests; ++i) {
+        if (opts.rate > 0.0 && i > 0) t += gap(rng);
+        requests.push_back({t, prompt.sample(rng), output.sample(rng)});
+    }
+    return requests;
+}
+
+// Greedy pick; real sampling cost is small next to the forward pass
+int argmax_last(const Tensor& logits) {
+    auto shape = logits.shape();
+    int vocab = shape.back();
+    const float* row = logits.data<float>() + static_cast<size_t>(shape[1] - 1) * vocab;
+    return static_cast<int>(std::max_element(row, row + vocab) - row);
+}
+
+int run_forward(Transformer& model, KVCache& cache, int num_tokens, int last_token) {
+    Tensor input_ids(std::vector<int>{1, num_tokens}, DType::FP32);
+    float* ids = input_ids.data<float>();
+    for (int i = 0; i < num_tokens; ++i) {
+        ids[i] = static_cast<float>((last_token + i) % model.vocab_size());
+    }
+    return argmax_last(model.forward(input_ids, &cache));
+}
+
+RunResult run_workload(Transformer& model, const std::vector<Request>& requests, int batch_size) {
+    RunResult result;
+    result.batch_size = batch_size;
+    // Without a reset every config after the largest would repeat its peak
+    result.peak_rss_per_run = bench::reset_peak_rss();
+
+    std::vector<std::unique_ptr<Sequence>> active;
+    std::vector<int> last_tokens;
+    size_t next = 0;
+    size_t finished = 0;
+    long decode_steps = 0;
+    long decode_rows = 0;
+
+    double start = bench::now_seconds();
+    auto elapsed = [&]() { return bench::now_seconds() - start; };
+
+    auto finish = [&](Sequence& seq) {
+        const Request& req = *seq.request;
+        result.e2e.add(seq.last_token_time - req.arrival);
+        if (seq.generated > 1) {
+            result.tpot.add((seq.last_token_time - seq.first_token_time) / (seq.generated - 1));
+        }
+        result.output_tokens += seq.generated;
+        ++finished;
+    };
+
+    while (finished < requests.size()) {
+        // Admit arrived requests while there is room; prefill produces the first token
+        while (next < requests.size() && requests[next].arrival <= elapsed() &&
+               static_cast<int>(active.size()) < batch_size) {
+            const Request& req = requests[next++];
+            KVCacheConfig config;
+            config.max_seq_len = req.prompt_len + req.output_len;
+
+            auto seq = std::make_unique<Sequence>(Sequence{&req, model.create_cache(config)});
+            double t0 = elapsed();
+            int token = run_forward(model, seq->cache, req.prompt_len, 0);
+            double t1 = elapsed();
+
+            result.prefill_time += t1 - t0;
+            result.prompt_tokens += req.prompt_len;
+            result.ttft.add(t1 - req.arrival);
+            seq->first_token_time = seq->last_token_time = t1;
+            seq->generated = 1;
+
+            if (seq->generated >= req.output_len) {
+                finish(*seq);
+            } else {
+                active.push_back(std::move(seq));
+                last_tokens.push_back(token);
+            }
+        }
+
+        if (active.empty()) {
+            if (next < requests.size()) {
+                double wait = requests[next].arrival - elapsed();
+                if (wait > 0) std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+            }
+            continue;
+        }
+
+        // One decode step for every active sequence
+        ++decode_steps;
+        decode_rows += static_cast<long>(active.size());
+        for (size_t i = 0; i < active.size(); ++i) {
+            Sequence& seq = *active[i];
+            last_tokens[i] = run_forward(model, seq.cache, 1, last_tokens[i]);
+            double now = elapsed();
+            result.itl.add(now - seq.last_token_time);
+            seq.last_token_time = now;
+            ++seq.generated;
+        }
+
+        for (size_t i = 0; i < active.size();) {
+            if (active[i]->generated >= active[i]->request->output_len) {
+                finish(*active[i]);
+                active.erase(active.begin() + i);
+                last_tokens.erase(last_tokens.begin() + i);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    result.duration = elapsed();
+    result.mean_batch = decode_steps > 0 ? static_cast<double>(decode_rows) / decode_steps : 0.0;
+    result.peak_rss = bench::peak_rss_bytes();
+    return result;
+}
+
+void print_percentiles(const RunResult& r) {
+    std::cout << "  " << std::left << std::setw(10) << "ms" << std::right
+              << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90"
+              << std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << "\n";
+
+    auto row = [](const char* name, const bench::Samples& s) {
+        std::cout << "  " << std::left << std::setw(10) << name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(10) << s.mean() * 1e3
+                  << std::setw(10) << s.percentile(50) * 1e3 << std::setw(10) << s.percentile(90) * 1e3
+                  << std::setw(10) << s.percentile(95) * 1e3 << std::setw(10) << s.percentile(99) * 1e3
+                  << std::setw(10) << s.max() * 1e3 << "\n";
+    };
+    row("TTFT", r.ttft);
+    row("TPOT", r.tpot);
+    row("ITL", r.itl);
+    row("E2E", r.e2e);
+}
+
+void print_result(const RunResult& r) {
+    std::cout << "\n== prompt " << r.prompt_spec << ", output " << r.output_spec
+              << ", batch " << r.batch_size << " ==\n"
+              << std::fixed << std::setprecision(2)
+              << "  duration " << r.duration << " s, mean decode batch " << r.mean_batch << "\n"
+              << "  output " << r.output_tokens / r.duration << " tok/s, prefill "
+              << (r.prefill_time > 0 ? r.prompt_tokens / r.prefill_time : 0.0) << " tok/s, "
+              << r.ttft.size() / r.duration << " req/s\n"
+              << (r.peak_rss_per_run ? "  peak RSS " : "  process peak RSS ")
+              << r.peak_rss / (1024.0 * 1024.0) << " MB\n";
+    print_percentiles(r);
+}
+
+void write_samples(std::ostream& out, const char* name, const bench::Samples& s, bool last) {
+    out << "\"" << name << "_ms\": {\"mean\": " << s.mean() * 1e3
+        << ", \"p50\": " << s.percentile(50) * 1e3 << ", \"p90\": " << s.percentile(90) * 1e3
+        << ", \"p95\": " << s.percentile(95) * 1e3 << ", \"p99\": " << s.percentile(99) * 1e3
+        << ", \"max\": " << s.max() * 1e3 << "}" << (last ? "" : ", ");
+}
+
+void write_json(const std::string& path, const Options& opts, const std::vector<RunResult>& results) {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+
+    out << std::setprecision(6);
+    out << "{\n  \"requests\": " << opts.num_requests << ",\n  \"rate\": " << opts.rate
+        << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const RunResult& r = results[i];
+        out << "    {\"prompt_len\": \"" << bench::json_escape(r.prompt_spec) << "\""
+            << ", \"output_len\": \"" << bench::json_escape(r.output_spec) << "\""
+            << ", \"batch_size\": " << r.batch_size
+            << ", \"duration_s\": " << r.duration
+            << ", \"prompt_tokens\": " << r.prompt_tokens
+            << ", \"output_tokens\": " << r.output_tokens
+            << ", \"output_tokens_per_sec\": " << r.output_tokens / r.duration
+            << ", \"prefill_tokens_per_sec\": "
+            << (r.prefill_time > 0 ? r.prompt_tokens / r.prefill_time : 0.0)
+            << ", \"mean_decode_batch\": " << r.mean_batch
+            << ", \"peak_rss_bytes\": " << r.peak_rss
+            << ", \"peak_rss_scope\": \"" << (r.peak_rss_per_run ? "run" : "process") << "\", ";
+        write_samples(out, "ttft", r.ttft, false);
+        write_samples(out, "tpot", r.tpot, false);
+        write_samples(out, "itl", r.itl, false);
+        write_samples(out, "e2e", r.e2e, true);
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+std::vector<std::string> split(const std::string& s, char delim) {
+    std::vector<std::string> parts;
+    std::stringstream ss(s);
+    std::string part;
+    while (std::getline(ss, part, delim)) {
+        if (!part.empty()) parts.push_back(part);
+    }
+    return parts;
+}
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "Options:\n"
+              << "  --model PATH        ONNX model (default: built-in dummy model)\n"
+              << "  --prompt-len LIST   Comma-separated length specs: N, uniform:A:B, normal:MEAN:STD (default: 128)\n"
+              << "  --output-len LIST   Output length specs, same format (default: 64)\n"
+              << "  --batch-sizes LIST  Max concurrent sequences, e.g. 1,4,8 (default: 1)\n"
+              << "  --requests N        Requests per configuration (default: 16)\n"
+              << "  --rate R            Poisson arrivals at R req/s (default: 0, all at start)\n"
+              << "  --seed N            Workload random seed (default: 1234)\n"
+              << "  --json PATH         Also write results as JSON\n"
+              << "  --help              Show this help message\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--model" && i + 1 < argc) {
+                opts.model_path = argv[++i];
+            } else if (arg == "--prompt-len" && i + 1 < argc) {
+                opts.prompt_lens = split(argv[++i], ',');
+            } else if (arg == "--output-len" && i + 1 < argc) {
+                opts.output_lens = split(argv[++i], ',');
+            } else if (arg == "--batch-sizes" && i + 1 < argc) {
+                opts.batch_sizes.clear();
+                for (const auto& b : split(argv[++i], ',')) opts.batch_sizes.push_back(std::stoi(b));
+            } else if (arg == "--requests" && i + 1 < argc) {
+                opts.num_requests = std::stoi(argv[++i]);
+            } else if (arg == "--rate" && i + 1 < argc) {
+                opts.rate = std::stod(argv[++i]);
+            } else if (arg == "--seed" && i + 1 < argc) {
+                opts.seed = std::stoi(argv[++i]);
+            } else if (arg == "--json" && i + 1 < argc) {
+                opts.json_path = argv[++i];
+            } else if (arg == "--help") {
+                print_usage(argv[0]);
+                return 0;
+            } else {
+                std::cerr << "Unknown argument: " << arg << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+
+        std::unordered_map<std::string, Tensor> weights;
+        if (!opts.model_path.empty()) {
+            weights = load_onnx_initializers(opts.model_path);
+        }
+        ModelWeights model_weights{std::move(weights)};
+        Transformer model(model_weights);
+
+        std::cout << "Model: hidden " << model.hidden_size() << ", layers " << model.num_layers()
+                  << ", heads " << model.num_heads() << "\n"
+                  << "Workload: " << opts.num_requests << " requests, "
+                  << (opts.rate > 0 ? "Poisson " + std::to_string(opts.rate) + " req/s" : "all at start")
+                  << std::endl;
+
+        std::vector<RunResult> results;
+        for (const auto& prompt_spec : opts.prompt_lens) {
+            for (const auto& output_spec : opts.output_lens) {
+                bench::LengthDistribution prompt(prompt_spec);
+                bench::LengthDistribution output(output_spec);
+                if (prompt.max_value() + output.max_value() > model.max_seq_len()) {
+                    std::cerr << "Skipping prompt " << prompt_spec << ", output " << output_spec
+                              << ": may exceed max_seq_len " << model.max_seq_len() << std::endl;
+                    continue;
+                }
+
+                for (int batch_size : opts.batch_sizes) {
+                    // Same workload for every batch size
+                    std::mt19937 rng(opts.seed);
+                    auto requests = make_workload(opts, prompt, output, rng);
+
+                    RunResult r = run_workload(model, requests, std::max(1, batch_size));
+                    r.prompt_spec = prompt_spec;
+                    r.output_spec = output_spec;
+                    print_result(r);
+                    results.push_back(std::move(r));
+                }
+            }
+        }
+
+        if (!opts.json_path.empty()) {
+            write_json(opts.json_path, opts, results);
+            std::cout << "\nWrote " << opts.json_path << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
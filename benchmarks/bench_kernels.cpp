@@ -0,0 +1,414 @@
+// Kernel microbenchmarks at LLM shapes.
+//
+// Reports per-kernel median time, GFLOP/s, GB/s, percent of a measured
+// single-core roofline and run-to-run variation; --json writes the same
+// results for tracking regressions across commits. The bandwidth roof is
+// DRAM (STREAM triad), so cache-resident shapes can exceed 100%.
+
+#include "bench_util.hpp"
+#include "alloc.hpp"
+#include "kernels/gemm_ref.hpp"
+#include "kernels/q4_rowwise.hpp"
+#include "kernels/autotune.hpp"
+#include "kernels/optimized/simd_gemm.hpp"
+#include "kernels/optimized/flash_attention.hpp"
+#include "transformer/kv_cache.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#if defined(ENABLE_SIMD) && (defined(__AVX2__) || defined(__AVX512F__))
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct Options {
+    std::string model = "7b";     // Shape preset: 7b or small
+    std::string filter;           // Only run cases whose name contains this
+    std::string json_path;
+    int min_reps = 5;
+    double min_time = 0.5;
+};
+
+struct ModelShape {
+    int hidden;
+    int ffn;
+    int num_heads;
+    int prefill_rows;  // Tokens per prefill chunk
+    int context;       // Cached tokens for decode attention
+};
+
+struct KernelCase {
+    std::string name;
+    std::string shape;
+    double flops;   // Per call
+    double bytes;   // Minimum memory traffic per call
+    std::function<void()> run;
+};
+
+struct Result {
+    const KernelCase* kernel;
+    bench::Samples samples;
+    double gflops;
+    double gbps;
+    double roofline_pct;
+};
+
+struct Peaks {
+    double gflops;
+    double gbps;
+};
+
+std::vector<float> random_floats(size_t n, float scale = 1.0f) {
+    std::vector<float> v(n);
+    for (float& x : v) {
+        x = scale * (static_cast<float>(rand()) / RAND_MAX - 0.5f);
+    }
+    return v;
+}
+
+// Register-resident FMA chains: an upper bound for one core
+double measure_peak_gflops() {
+    const long iters = 20000000;
+    double start = bench::now_seconds();
+    float checksum = 0.0f;
+
+    // Read once through volatile so the compiler cannot fold the chains
+    volatile float multiplier = 0.999999f;
+    volatile float addend = 1e-6f;
+    const float mul = multiplier;
+    const float add = addend;
+
+#if defined(ENABLE_SIMD) && defined(__AVX512F__)
+    __m512 acc[10];
+    for (auto& a : acc) a = _mm512_set1_ps(1.0f);
+    const __m512 m = _mm512_set1_ps(mul);
+    const __m512 c = _mm512_set1_ps(add);
+    for (long i = 0; i < iters; ++i) {
+        for (auto& a : acc) a = _mm512_fmadd_ps(a, m, c);
+    }
+    for (auto& a : acc) checksum += _mm512_reduce_add_ps(a);
+    const double flops_per_iter = 10 * 16 * 2;
+    const int lanes = 16;
+#elif defined(ENABLE_SIMD) && defined(__AVX2__) && defined(__FMA__)
+    __m256 acc[10];
+    for (auto& a : acc) a = _mm256_set1_ps(1.0f);
+    const __m256 m = _mm256_set1_ps(mul);
+    const __m256 c = _mm256_set1_ps(add);
+    for (long i = 0; i < iters; ++i) {
+        for (auto& a : acc) a = _mm256_fmadd_ps(a, m, c);
+    }
+    float lanes_out[8];
+    for (auto& a : acc) {
+        _mm256_storeu_ps(lanes_out, a);
+        for (float l : lanes_out) checksum += l;
+    }
+    const double flops_per_iter = 10 * 8 * 2;
+    const int lanes = 8;
+#else
+    float acc[8];
+    for (float& a : acc) a = 1.0f;
+    for (long i = 0; i < iters; ++i) {
+        for (float& a : acc) a = a * mul + add;
+    }
+    for (float a : acc) checksum += a;
+    const double flops_per_iter = 8 * 2;
+    const int lanes = 1;
+#endif
+
+    double elapsed = bench::now_seconds() - start;
+    if (checksum == 42.0f) std::cout << "";  // Keep the loop alive
+    double gflops = iters * flops_per_iter / elapsed / 1e9;
+
+    // Two FMA ports at 6 GHz bound any current core; more means the loop
+    // was optimized away and every roofline percentage would be wrong
+    const double ceiling = 2.0 * lanes * 2 * 6.0;
+    if (gflops > ceiling) {
+        std::cerr << "Warning: measured peak " << gflops << " GFLOP/s exceeds the "
+                  << ceiling << " GFLOP/s a core can reach" << std::endl;
+    }
+    return gflops;
+}
+
+// STREAM-style triad over buffers well beyond the LLC
+double measure_peak_gbps() {
+    const size_t n = 16 * 1024 * 1024;
+    std::vector<float> a(n), b(n, 1.0f), c(n, 2.0f);
+    bench::Samples samples = bench::measure([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            a[i] = b[i] + 0.5f * c[i];
+        }
+    }, 5, 0.2);
+    return 3.0 * n * sizeof(float) / samples.min() / 1e9;
+}
+
+std::string dims(std::initializer_list<int> values) {
+    std::ostringstream out;
+    bool first = true;
+    for (int v : values) {
+        out << (first ? "" : "x") << v;
+        first = false;
+    }
+    return out.str();
+}
+
+std::vector<KernelCase> build_cases(const ModelShape& s) {
+    std::vector<KernelCase> cases;
+
+    // GemmRef matvec: decode projections
+    for (auto mk : {std::make_pair(s.hidden, s.hidden), std::make_pair(s.ffn, s.hidden)}) {
+        int M = mk.first, K = mk.second;
+        auto A = std::make_shared<Tensor>(std::vector<int>{M, K}, DType::FP32);
+        auto x = std::make_shared<Tensor>(std::vector<int>{K}, DType::FP32);
+        auto y = std::make_shared<Tensor>(std::vector<int>{M}, DType::FP32);
+        auto a_data = random_floats(static_cast<size_t>(M) * K);
+        std::memcpy(A->raw(), a_data.data(), a_data.size() * sizeof(float));
+        cases.push_back({"gemm_ref.matvec", dims({M, K}), 2.0 * M * K,
+                         4.0 * (static_cast<double>(M) * K + K + M),
+                         [A, x, y]() { GemmRef::matvec(*A, *x, *y); }});
+    }
+
+    // GemmRef matmul: prefill projections
+    for (auto kn : {std::make_pair(s.hidden, s.hidden), std::make_pair(s.hidden, s.ffn)}) {
+        int M = s.prefill_rows, K = kn.first, N = kn.second;
+        auto A = std::make_shared<Tensor>(std::vector<int>{M, K}, DType::FP32);
+        auto B = std::make_shared<Tensor>(std::vector<int>{K, N}, DType::FP32);
+        auto C = std::make_shared<Tensor>(std::vector<int>{M, N}, DType::FP32);
+        cases.push_back({"gemm_ref.matmul", dims({M, K, N}), 2.0 * M * K * N,
+                         4.0 * (static_cast<double>(M) * K + static_cast<double>(K) * N +
+                                static_cast<double>(M) * N),
+                         [A, B, C]() { GemmRef::matmul(*A, *B, *C); }});
+    }
+
+    // Q4 row-wise matvec: packed weights are half a byte per element
+    for (auto mk : {std::make_pair(s.hidden, s.hidden), std::make_pair(s.ffn, s.hidden)}) {
+        int M = mk.first, K = mk.second;
+        auto q = std::make_shared<std::vector<uint8_t>>(static_cast<size_t>(M) * K / 2);
+        for (auto& b : *q) b = static_cast<uint8_t>(rand());
+        auto scales = std::make_shared<std::vector<float>>(M, 0.01f);
+        auto x = std::make_shared<std::vector<float>>(random_floats(K));
+        auto y = std::make_shared<std::vector<float>>(M);
+        double bytes = static_cast<double>(M) * K / 2 + 4.0 * (M + K + M);
+
+        cases.push_back({"matvec_q4_rowwise", dims({M, K}), 2.0 * M * K, bytes,
+                         [=]() { matvec_q4_rowwise(q->data(), scales->data(), x->data(), y->data(), M, K); }});
+#ifdef ENABLE_SIMD
+        if (simd::has_avx2()) {
+            cases.push_back({"simd::matvec_q4_avx2", dims({M, K}), 2.0 * M * K, bytes,
+                             [=]() { simd::matvec_q4_avx2(q->data(), scales->data(), x->data(), y->data(), M, K); }});
+        }
+#endif
+    }
+
+#ifdef ENABLE_SIMD
+    {
+        int M = s.prefill_rows, K = s.hidden, N = s.hidden;
+        auto A = std::make_shared<std::vector<float>>(random_floats(static_cast<size_t>(M) * K));
+        auto B = std::make_shared<std::vector<float>>(random_floats(static_cast<size_t>(K) * N));
+        auto C = std::make_shared<std::vector<float>>(static_cast<size_t>(M) * N);
+        double flops = 2.0 * M * K * N;
+        double bytes = 4.0 * (static_cast<double>(M) * K + static_cast<double>(K) * N +
+                              static_cast<double>(M) * N);
+        if (simd::has_avx2()) {
+            cases.push_back({"simd::matmul_avx2_f32", dims({M, K, N}), flops, bytes,
+                             [=]() { simd::matmul_avx2_f32(A->data(), B->data(), C->data(), M, K, N); }});
+        }
+#ifdef __AVX512F__
+        if (simd::has_avx512()) {
+            cases.push_back({"simd::matmul_avx512_f32", dims({M, K, N}), flops, bytes,
+                             [=]() { simd::matmul_avx512_f32(A->data(), B->data(), C->data(), M, K, N); }});
+        }
+#endif
+
+        // 64 MB, aligned for the streaming path
+        size_t size = 64u << 20;
+        auto src = std::shared_ptr<void>(AlignedAllocator::allocate(size), AlignedAllocator::deallocate);
+        auto dst = std::shared_ptr<void>(AlignedAllocator::allocate(size), AlignedAllocator::deallocate);
+        std::memset(src.get(), 1, size);
+        cases.push_back({"simd::memcpy_aligned", "64MiB", 0.0, 2.0 * size,
+                         [=]() { simd::memcpy_aligned(dst.get(), src.get(), size); }});
+    }
+#endif
+
+    // FlashAttention prefill: causal over the whole chunk
+    int head_dim = s.hidden / s.num_heads;
+    float scale = 1.0f / std::sqrt(static_cast<float>(head_dim));
+    {
+        int S = s.prefill_rows;
+        auto attn = std::make_shared<flash::FlashAttention>(s.hidden, s.num_heads, head_dim, scale);
+        auto qkv = std::make_shared<Tensor>(std::vector<int>{1, S, s.hidden}, DType::FP32);
+        auto data = random_floats(static_cast<size_t>(S) * s.hidden);
+        std::memcpy(qkv->raw(), data.data(), data.size() * sizeof(float));
+        // Causal: each query sees on average S/2 keys, QK^T and PV both count
+        double flops = 2.0 * 2.0 * s.num_heads * (S * (S + 1) / 2.0) * head_dim;
+        cases.push_back({"FlashAttention::forward", dims({1, S, s.hidden}), flops,
+                         4.0 * 4.0 * S * s.hidden,
+                         [=]() { attn->forward(*qkv, *qkv, *qkv); }});
+    }
+
+    // FlashAttention decode: one query against a populated KV cache. The
+    // cache is never advanced so every call sees the same context length.
+    {
+        int L = s.context;
+        KVCacheConfig config;
+        config.max_seq_len = L + 1;
+        auto cache = std::make_shared<KVCache>(1, s.hidden, config);
+        auto attn = std::make_shared<flash::FlashAttention>(s.hidden, s.num_heads, head_dim, scale);
+        auto row = random_floats(s.hidden);
+        for (int p = 0; p < L; ++p) {
+            cache->store(0, p, row.data(), row.data());
+        }
+        cache->advance(L);
+
+        auto qkv = std::make_shared<Tensor>(std::vector<int>{1, 1, s.hidden}, DType::FP32);
+        std::memcpy(qkv->raw(), row.data(), row.size() * sizeof(float));
+        double flops = 2.0 * 2.0 * (L + 1) * s.hidden;
+        cases.push_back({"FlashAttention::forward(cached)", dims({1, 1, s.hidden}) + "@" + std::to_string(L),
+                         flops, 2.0 * 4.0 * (L + 1) * s.hidden,
+                         [=]() { attn->forward(*qkv, *qkv, *qkv, cache.get()); }});
+    }
+
+    return cases;
+}
+
+Result run_case(const KernelCase& kernel, const Options& opts, const Peaks& peaks) {
+    Result r{&kernel, bench::measure(kernel.run, opts.min_reps, opts.min_time), 0.0, 0.0, 0.0};
+    double t = r.samples.median();
+    r.gflops = kernel.flops / t / 1e9;
+    r.gbps = kernel.bytes / t / 1e9;
+
+    // Attainable = min(compute peak, arithmetic intensity * bandwidth)
+    if (kernel.flops > 0.0) {
+        double intensity = kernel.flops / kernel.bytes;
+        double attainable = std::min(peaks.gflops, intensity * peaks.gbps);
+        r.roofline_pct = 100.0 * r.gflops / attainable;
+    } else {
+        r.roofline_pct = 100.0 * r.gbps / peaks.gbps;
+    }
+    return r;
+}
+
+void write_json(const std::string& path, const Options& opts, const Peaks& peaks,
+                const std::vector<Result>& results) {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+
+    out << std::setprecision(6);
+    out << "{\n";
+    out << "  \"cpu\": \"" << bench::json_escape(KernelAutotuner::cpu_model()) << "\",\n";
+    out << "  \"model\": \"" << bench::json_escape(opts.model) << "\",\n";
+    out << "  \"peak_gflops\": " << peaks.gflops << ",\n";
+    out << "  \"peak_gbps\": " << peaks.gbps << ",\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        out << "    {\"name\": \"" << bench::json_escape(r.kernel->name) << "\""
+            << ", \"shape\": \"" << r.kernel->shape << "\""
+            << ", \"runs\": " << r.samples.size()
+            << ", \"median_ms\": " << r.samples.median() * 1e3
+            << ", \"mean_ms\": " << r.samples.mean() * 1e3
+            << ", \"min_ms\": " << r.samples.min() * 1e3
+            << ", \"stddev_ms\": " << r.samples.stddev() * 1e3
+            << ", \"cv\": " << r.samples.cv()
+            << ", \"gflops\": " << r.gflops
+            << ", \"gbps\": " << r.gbps
+            << ", \"roofline_pct\": " << r.roofline_pct << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "Options:\n"
+              << "  --model NAME     Shape preset: 7b (hidden 4096) or small (hidden 768), default 7b\n"
+              << "  --filter TEXT    Only run kernels whose name contains TEXT\n"
+              << "  --min-reps N     Minimum timed runs per kernel (default: 5)\n"
+              << "  --min-time S     Minimum timed seconds per kernel (default: 0.5)\n"
+              << "  --json PATH      Also write results as JSON\n"
+              << "  --help           Show this help message\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--model" && i + 1 < argc) {
+            opts.model = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            opts.filter = argv[++i];
+        } else if (arg == "--min-reps" && i + 1 < argc) {
+            opts.min_reps = std::stoi(argv[++i]);
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            opts.min_time = std::stod(argv[++i]);
+        } else if (arg == "--json" && i + 1 < argc) {
+            opts.json_path = argv[++i];
+        } else if (arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    ModelShape shape;
+    if (opts.model == "small") {
+        shape = {768, 3072, 12, 64, 512};
+    } else if (opts.model == "7b") {
+        shape = {4096, 11008, 32, 32, 2048};
+    } else {
+        std::cerr << "Unknown model preset: " << opts.model << std::endl;
+        return 1;
+    }
+
+    try {
+        srand(1234);
+        Peaks peaks{measure_peak_gflops(), measure_peak_gbps()};
+        std::cout << "CPU: " << KernelAutotuner::cpu_model() << "\n"
+                  << std::fixed << std::setprecision(1)
+                  << "Single-core roofline: " << peaks.gflops << " GFLOP/s, "
+                  << peaks.gbps << " GB/s\n\n";
+
+        std::cout << std::left << std::setw(34) << "kernel" << std::setw(20) << "shape"
+                  << std::right << std::setw(11) << "median ms" << std::setw(9) << "cv %"
+                  << std::setw(10) << "GFLOP/s" << std::setw(9) << "GB/s"
+                  << std::setw(11) << "roofline %" << "\n";
+
+        std::vector<KernelCase> cases = build_cases(shape);
+        std::vector<Result> results;
+        for (const KernelCase& kernel : cases) {
+            if (!opts.filter.empty() && kernel.name.find(opts.filter) == std::string::npos) {
+                continue;
+            }
+            results.push_back(run_case(kernel, opts, peaks));
+            const Result& r = results.back();
+            std::cout << std::left << std::setw(34) << kernel.name << std::setw(20) << kernel.shape
+                      << std::right << std::setprecision(3) << std::setw(11) << r.samples.median() * 1e3
+                      << std::setprecision(1) << std::setw(9) << r.samples.cv() * 100.0
+                      << std::setw(10) << r.gflops << std::setw(9) << r.gbps
+                      << std::setw(11) << r.roofline_pct << std::endl;
+        }
+
+        if (!opts.json_path.empty()) {
+            write_json(opts.json_path, opts, peaks, results);
+            std::cout << "\nWrote " << opts.json_path << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
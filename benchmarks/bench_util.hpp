@@ -0,0 +1,192 @@
+#ifndef BENCH_UTIL_HPP
+#define BENCH_UTIL_HPP
+
+// Shared helpers for the benchmark binaries: timing loops, summary
+// statistics and minimal JSON emission (no external dependencies)
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+inline double now_seconds() {
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+// A set of measurements (seconds, or any other unit) with summary stats
+class Samples {
+public:
+    void add(double value) { values_.push_back(value); sorted_ = false; }
+    size_t size() const { return values_.size(); }
+    bool empty() const { return values_.empty(); }
+    const std::vector<double>& values() const { return values_; }
+
+    double mean() const {
+        if (values_.empty()) return 0.0;
+        double sum = 0.0;
+        for (double v : values_) sum += v;
+        return sum / values_.size();
+    }
+
+    double stddev() const {
+        if (values_.size() < 2) return 0.0;
+        double m = mean();
+        double sq = 0.0;
+        for (double v : values_) sq += (v - m) * (v - m);
+        return std::sqrt(sq / (values_.size() - 1));
+    }
+
+    // Coefficient of variation: run-to-run noise relative to the mean
+    double cv() const {
+        double m = mean();
+        return m > 0.0 ? stddev() / m : 0.0;
+    }
+
+    // Linear interpolation between closest ranks, p in [0, 100]
+    double percentile(double p) const {
+        if (values_.empty()) return 0.0;
+        sort();
+        double rank = p / 100.0 * (values_.size() - 1);
+        size_t lo = static_cast<size_t>(rank);
+        size_t hi = std::min(lo + 1, values_.size() - 1);
+        return values_[lo] + (rank - lo) * (values_[hi] - values_[lo]);
+    }
+
+    double median() const { return percentile(50.0); }
+    double min() const { sort(); return values_.empty() ? 0.0 : values_.front(); }
+    double max() const { sort(); return values_.empty() ? 0.0 : values_.back(); }
+
+private:
+    void sort() const {
+        if (!sorted_) {
+            std::sort(values_.begin(), values_.end());
+            sorted_ = true;
+        }
+    }
+
+    mutable std::vector<double> values_;
+    mutable bool sorted_ = true;
+};
+
+// Run fn once to warm up, then repeatedly until both min_reps runs and
+// min_time seconds have elapsed. Returns per-run wall time in seconds.
+template<typename F>
+Samples measure(F&& fn, int min_reps, double min_time, int max_reps = 1000) {
+    fn();
+
+    Samples samples;
+    double start = now_seconds();
+    while (static_cast<int>(samples.size()) < max_reps &&
+           (static_cast<int>(samples.size()) < min_reps || now_seconds() - start < min_time)) {
+        double t0 = now_seconds();
+        fn();
+        samples.add(now_seconds() - t0);
+    }
+    return samples;
+}
+
+// "N", "uniform:A:B" or "normal:MEAN:STD"; samples are clamped to >= 1
+class LengthDistribution {
+public:
+    explicit LengthDistribution(const std::string& spec) : spec_(spec) {
+        std::vector<std::string> parts;
+        std::stringstream ss(spec);
+        std::string part;
+        while (std::getline(ss, part, ':')) parts.push_back(part);
+
+        if (parts.size() == 1) {
+            kind_ = Kind::Fixed;
+            a_ = std::stod(parts[0]);
+        } else if (parts.size() == 3 && parts[0] == "uniform") {
+            kind_ = Kind::Uniform;
+            a_ = std::stod(parts[1]);
+            b_ = std::stod(parts[2]);
+        } else if (parts.size() == 3 && parts[0] == "normal") {
+            kind_ = Kind::Normal;
+            a_ = std::stod(parts[1]);
+            b_ = std::stod(parts[2]);
+        } else {
+            throw std::runtime_error("Invalid length distribution: " + spec);
+        }
+    }
+
+    int sample(std::mt19937& rng) const {
+        double value = a_;
+        if (kind_ == Kind::Uniform) {
+            value = std::uniform_int_distribution<int>(static_cast<int>(a_), static_cast<int>(b_))(rng);
+        } else if (kind_ == Kind::Normal) {
+            value = std::round(std::normal_distribution<double>(a_, b_)(rng));
+        }
+        return std::max(1, std::min(max_value(), static_cast<int>(value)));
+    }
+
+    int max_value() const {
+        if (kind_ == Kind::Fixed) return static_cast<int>(a_);
+        if (kind_ == Kind::Uniform) return static_cast<int>(b_);
+        return static_cast<int>(a_ + 4 * b_);
+    }
+
+    const std::string& spec() const { return spec_; }
+
+private:
+    enum class Kind { Fixed, Uniform, Normal };
+    Kind kind_ = Kind::Fixed;
+    double a_ = 0.0;
+    double b_ = 0.0;
+    std::string spec_;
+};
+
+inline std::string json_escape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size() + 2);
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+// Restart VmHWM from the current RSS (Linux 4.0+), so peak_rss_bytes()
+// covers only what runs after this. False where the kernel refuses, in
+// which case the peak stays the whole process's.
+inline bool reset_peak_rss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    return static_cast<bool>(clear_refs << "5" << std::flush);
+}
+
+// Peak resident set size of this process in bytes (VmHWM)
+inline size_t peak_rss_bytes() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return static_cast<size_t>(std::stoull(line.substr(6))) * 1024;
+        }
+    }
+    return 0;
+}
+
+} // namespace bench
+
+#endif // BENCH_UTIL_HPP
@@ -0,0 +1,565 @@
+// HTTP load generator for the inference server (infer --serve PORT).
+//
+// Replays a trace of requests against POST /generate over a fixed pool of
+// keep-alive connections, one worker thread per connection. Arrivals follow
+// the trace timestamps (or a Poisson process) and latency is measured from
+// the scheduled arrival, so time spent waiting for a free connection counts
+// against the server just as a real client's queueing would. With --stream
+// every server-sent event is timestamped to get TTFT and inter-token gaps.
+// Reports latency percentiles, throughput, goodput under the given SLOs and
+// errors by kind.
+
+#include "bench_util.hpp"
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int connections = 8;
+    int num_requests = 64;
+    double rate = 0.0;  // Requests/sec for Poisson arrivals, 0 = all at start
+    std::string prompt_len = "128";
+    std::string output_len = "64";
+    std::string trace_path;
+    bool stream = true;
+    int seed = 1234;
+    double timeout = 60.0;   // Per-request receive timeout, seconds
+    double slo_ttft = 0.0;   // SLO thresholds in seconds, 0 = unconstrained
+    double slo_tpot = 0.0;
+    double slo_e2e = 0.0;
+    std::string json_path;
+};
+
+struct TraceEntry {
+    double arrival;
+    int prompt_len;
+    int output_len;
+};
+
+struct RequestResult {
+    bool ok = false;
+    std::string error;
+    int tokens = 0;
+    double ttft = 0.0;
+    double e2e = 0.0;
+    std::vector<double> token_times;  // Seconds since arrival, streaming only
+};
+
+// "arrival_s prompt_tokens output_tokens" per line; '#' starts a comment
+std::vector<TraceEntry> load_trace(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot open trace " + path);
+    }
+
+    std::vector<TraceEntry> trace;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(in, line)) {
+        ++line_number;
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+
+        std::istringstream fields(line);
+        TraceEntry entry;
+        if (!(fields >> entry.arrival >> entry.prompt_len >> entry.output_len) ||
+            entry.prompt_len < 1 || entry.output_len < 1) {
+            throw std::runtime_error(path + ":" + std::to_string(line_number) +
+                                     ": expected \"arrival_s prompt_tokens output_tokens\"");
+        }
+        trace.push_back(entry);
+    }
+
+    std::stable_sort(trace.begin(), trace.end(),
+                     [](const TraceEntry& a, const TraceEntry& b) { return a.arrival < b.arrival; });
+    return trace;
+}
+
+std::vector<TraceEntry> make_trace(const Options& opts) {
+    bench::LengthDistribution prompt(opts.prompt_len);
+    bench::LengthDistribution output(opts.output_len);
+    std::mt19937 rng(opts.seed);
+    std::exponential_distribution<double> gap(opts.rate > 0.0 ? opts.rate : 1.0);
+
+    std::vector<TraceEntry> trace;
+    double t = 0.0;
+    for (int i = 0; i < opts.num_requests; ++i) {
+        if (opts.rate > 0.0 && i > 0) t += gap(rng);
+        trace.push_back({t, prompt.sample(rng), output.sample(rng)});
+    }
+    return trace;
+}
+
+// The server's default byte-level vocabulary gives each ASCII byte one
+// token, plus BOS, so num_tokens - 1 bytes prefill exactly num_tokens.
+// Models with their own tokenizer merge bytes and see shorter prompts.
+std::string make_prompt(int num_tokens) {
+    std::string prompt;
+    size_t bytes = static_cast<size_t>(std::max(0, num_tokens - 1));
+    while (prompt.size() < bytes) {
+        prompt += prompt.empty() ? "hello" : " hello";
+    }
+    prompt.resize(bytes);
+    return prompt;
+}
+
+// One keep-alive HTTP/1.1 connection with a receive buffer
+class Connection {
+public:
+    Connection(const Options& opts) : opts_(opts) {}
+    ~Connection() { disconnect(); }
+
+    void disconnect() {
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+        buffer_.clear();
+    }
+
+    // Sends one /generate request and reads the whole response; throws
+    // std::runtime_error("<kind>: detail") on failure
+    void generate(const TraceEntry& entry, double arrival, RequestResult& result) {
+        if (fd_ < 0) connect_to_server();
+
+        std::ostringstream body;
+        body << "{\"prompt\": \"" << make_prompt(entry.prompt_len) << "\", \"max_tokens\": "
+             << entry.output_len << ", \"stream\": " << (opts_.stream ? "true" : "false")
+             << ", \"ignore_eos\": true}";
+        std::string payload = body.str();
+
+        std::ostringstream request;
+        request << "POST /generate HTTP/1.1\r\n"
+                << "Host: " << opts_.host << ":" << opts_.port << "\r\n"
+                << "Content-Type: application/json\r\n"
+                << "Content-Length: " << payload.size() << "\r\n"
+                << "Connection: keep-alive\r\n\r\n"
+                << payload;
+        send_all(request.str());
+
+        std::string head = read_until("\r\n\r\n");
+        int status = 0;
+        std::istringstream status_line(head);
+        std::string version;
+        status_line >> version >> status;
+
+        std::string lower = head;
+        std::transform(lower.begin(), lower.end(), lower.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        if (status != 200) {
+            read_body(lower, arrival, nullptr);
+            throw std::runtime_error("http_" + std::to_string(status) + ": unexpected status");
+        }
+        bool keep_alive = lower.find("connection: close") == std::string::npos;
+
+        std::string response = read_body(lower, arrival, opts_.stream ? &result : nullptr);
+        result.e2e = bench::now_seconds() - arrival;
+
+        if (opts_.stream) {
+            if (!result.error.empty()) {
+                throw std::runtime_error("server:" + result.error);
+            }
+            if (result.token_times.empty()) {
+                throw std::runtime_error("empty: no tokens streamed");
+            }
+            result.tokens = static_cast<int>(result.token_times.size());
+            result.ttft = result.token_times.front();
+        } else {
+            size_t pos = response.find("\"tokens\":");
+            if (pos == std::string::npos) {
+                throw std::runtime_error("parse: no token count in response");
+            }
+            result.tokens = std::stoi(response.substr(pos + 9));
+            result.ttft = result.e2e;
+        }
+
+        if (!keep_alive) disconnect();
+        result.ok = true;
+    }
+
+private:
+    void connect_to_server() {
+        addrinfo hints;
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(opts_.host.c_str(), std::to_string(opts_.port).c_str(), &hints,
+                        &addresses) != 0) {
+            throw std::runtime_error("connect: cannot resolve " + opts_.host);
+        }
+
+        for (addrinfo* a = addresses; a != nullptr; a = a->ai_next) {
+            fd_ = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd_ < 0) continue;
+            if (connect(fd_, a->ai_addr, a->ai_addrlen) == 0) break;
+            close(fd_);
+            fd_ = -1;
+        }
+        freeaddrinfo(addresses);
+        if (fd_ < 0) {
+            throw std::runtime_error(std::string("connect: ") + std::strerror(errno));
+        }
+
+        int no_delay = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        timeval tv;
+        tv.tv_sec = static_cast<time_t>(opts_.timeout);
+        tv.tv_usec = static_cast<suseconds_t>((opts_.timeout - tv.tv_sec) * 1e6);
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
+    void send_all(const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                throw std::runtime_error(std::string("send: ") + std::strerror(errno));
+            }
+            sent += static_cast<size_t>(n);
+        }
+    }
+
+    void fill() {
+        char chunk[16384];
+        ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+        if (n == 0) {
+            throw std::runtime_error("closed: server closed the connection");
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                throw std::runtime_error("timeout: no response within " +
+                                         std::to_string(opts_.timeout) + " s");
+            }
+            throw std::runtime_error(std::string("recv: ") + std::strerror(errno));
+        }
+        buffer_.append(chunk, static_cast<size_t>(n));
+    }
+
+    // Consumes and returns everything up to and including delim
+    std::string read_until(const std::string& delim) {
+        size_t pos;
+        while ((pos = buffer_.find(delim)) == std::string::npos) fill();
+        std::string out = buffer_.substr(0, pos + delim.size());
+        buffer_.erase(0, pos + delim.size());
+        return out;
+    }
+
+    std::string read_exact(size_t count) {
+        while (buffer_.size() < count) fill();
+        std::string out = buffer_.substr(0, count);
+        buffer_.erase(0, count);
+        return out;
+    }
+
+    // Reads a Content-Length or chunked body. For streams, each "data:"
+    // event carrying a "token" is one token (the "final" flush of held-back
+    // text carries none); an "error" event, sent when generation fails
+    // after the headers, is kept in stream->error.
+    std::string read_body(const std::string& lower_head, double arrival, RequestResult* stream) {
+        if (lower_head.find("transfer-encoding: chunked") == std::string::npos) {
+            size_t pos = lower_head.find("content-length:");
+            if (pos == std::string::npos) {
+                throw std::runtime_error("parse: response has no length");
+            }
+            return read_exact(std::stoul(lower_head.substr(pos + 15)));
+        }
+
+        std::string body;
+        std::string events;
+        while (true) {
+            std::string size_line = read_until("\r\n");
+            size_t size = std::stoul(size_line, nullptr, 16);
+            std::string data = read_exact(size + 2);
+            if (size == 0) break;
+            body.append(data, 0, size);
+            if (!stream) continue;
+
+            events.append(data, 0, size);
+            size_t end;
+            while ((end = events.find("\n\n")) != std::string::npos) {
+                std::string event = events.substr(0, end);
+                events.erase(0, end + 2);
+                if (event.compare(0, 5, "data:") != 0) continue;
+                if (event.find("\"error\":") != std::string::npos) {
+                    stream->error = event.substr(5);
+                } else if (event.find("\"token\":") != std::string::npos) {
+                    stream->token_times.push_back(bench::now_seconds() - arrival);
+                }
+            }
+        }
+        return body;
+    }
+
+    const Options& opts_;
+    int fd_ = -1;
+    std::string buffer_;
+};
+
+struct Report {
+    double duration = 0.0;
+    int completed = 0;
+    int good = 0;
+    long output_tokens = 0;
+    std::map<std::string, int> errors;
+    bench::Samples ttft;
+    bench::Samples tpot;
+    bench::Samples itl;
+    bench::Samples e2e;
+};
+
+bool meets_slo(const Options& opts, const RequestResult& r, double tpot) {
+    return (opts.slo_ttft <= 0.0 || r.ttft <= opts.slo_ttft) &&
+           (opts.slo_tpot <= 0.0 || tpot <= opts.slo_tpot) &&
+           (opts.slo_e2e <= 0.0 || r.e2e <= opts.slo_e2e);
+}
+
+Report run_trace(const Options& opts, const std::vector<TraceEntry>& trace) {
+    std::vector<RequestResult> results(trace.size());
+    std::atomic<size_t> next{0};
+    double start = bench::now_seconds() + 0.05;  // Let every worker reach its first wait
+
+    auto worker = [&]() {
+        Connection connection(opts);
+        for (size_t i = next++; i < trace.size(); i = next++) {
+            double arrival = start + trace[i].arrival;
+            double wait = arrival - bench::now_seconds();
+            if (wait > 0) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+            }
+
+            try {
+                connection.generate(trace[i], arrival, results[i]);
+            } catch (const std::exception& e) {
+                std::string what = e.what();
+                results[i].ok = false;
+                results[i].error = what.substr(0, what.find(':'));
+                results[i].e2e = bench::now_seconds() - arrival;
+                // Reconnect for the next request
+                connection.disconnect();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int c = 0; c < std::max(1, opts.connections); ++c) {
+        workers.emplace_back(worker);
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    Report report;
+    report.duration = bench::now_seconds() - start;
+    for (const RequestResult& r : results) {
+        if (!r.ok) {
+            report.errors[r.error]++;
+            continue;
+        }
+        report.completed++;
+        report.output_tokens += r.tokens;
+        report.ttft.add(r.ttft);
+        report.e2e.add(r.e2e);
+
+        // Without streaming the first token is only seen with the last
+        double tpot = opts.stream && r.tokens > 1 ? (r.e2e - r.ttft) / (r.tokens - 1) : 0.0;
+        if (opts.stream && r.tokens > 1) report.tpot.add(tpot);
+        for (size_t t = 1; t < r.token_times.size(); ++t) {
+            report.itl.add(r.token_times[t] - r.token_times[t - 1]);
+        }
+        if (meets_slo(opts, r, tpot)) report.good++;
+    }
+    return report;
+}
+
+int total_errors(const Report& r) {
+    int total = 0;
+    for (const auto& e : r.errors) total += e.second;
+    return total;
+}
+
+void print_report(const Options& opts, const Report& r, size_t num_requests) {
+    double n = static_cast<double>(num_requests);
+    std::cout << "\n== " << num_requests << " requests over " << opts.connections
+              << " connections ==\n"
+              << std::fixed << std::setprecision(2)
+              << "  duration " << r.duration << " s, " << r.completed / r.duration << " req/s, "
+              << r.output_tokens / r.duration << " output tok/s\n"
+              << "  goodput " << r.good / r.duration << " req/s (" << 100.0 * r.good / n
+              << "% within SLO)\n"
+              << "  errors " << total_errors(r) << " (" << 100.0 * total_errors(r) / n << "%)";
+    for (const auto& e : r.errors) {
+        std::cout << ", " << e.first << " " << e.second;
+    }
+    std::cout << "\n";
+
+    std::cout << "  " << std::left << std::setw(10) << "ms" << std::right
+              << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90"
+              << std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(10) << "max" << "\n";
+    auto row = [](const char* name, const bench::Samples& s) {
+        if (s.size() == 0) return;
+        std::cout << "  " << std::left << std::setw(10) << name << std::right
+                  << std::setw(10) << s.mean() * 1e3 << std::setw(10) << s.percentile(50) * 1e3
+                  << std::setw(10) << s.percentile(90) * 1e3 << std::setw(10) << s.percentile(99) * 1e3
+                  << std::setw(10) << s.percentile(99.9) * 1e3 << std::setw(10) << s.max() * 1e3
+                  << "\n";
+    };
+    row("TTFT", r.ttft);
+    row("TPOT", r.tpot);
+    row("ITL", r.itl);
+    row("E2E", r.e2e);
+}
+
+void write_samples(std::ostream& out, const char* name, const bench::Samples& s) {
+    out << "  \"" << name << "_ms\": ";
+    if (s.size() == 0) {
+        out << "null,\n";
+        return;
+    }
+    out << "{\"mean\": " << s.mean() * 1e3 << ", \"p50\": " << s.percentile(50) * 1e3
+        << ", \"p90\": " << s.percentile(90) * 1e3 << ", \"p99\": " << s.percentile(99) * 1e3
+        << ", \"p999\": " << s.percentile(99.9) * 1e3 << ", \"max\": " << s.max() * 1e3 << "},\n";
+}
+
+void write_json(const std::string& path, const Options& opts, const Report& r, size_t num_requests) {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Cannot write " + path);
+    }
+
+    out << std::setprecision(6);
+    out << "{\n  \"requests\": " << num_requests << ",\n"
+        << "  \"connections\": " << opts.connections << ",\n"
+        << "  \"stream\": " << (opts.stream ? "true" : "false") << ",\n"
+        << "  \"duration_s\": " << r.duration << ",\n"
+        << "  \"completed\": " << r.completed << ",\n"
+        << "  \"output_tokens_per_sec\": " << r.output_tokens / r.duration << ",\n"
+        << "  \"slo_ms\": {\"ttft\": " << opts.slo_ttft * 1e3 << ", \"tpot\": " << opts.slo_tpot * 1e3
+        << ", \"e2e\": " << opts.slo_e2e * 1e3 << "},\n"
+        << "  \"goodput_req_per_sec\": " << r.good / r.duration << ",\n"
+        << "  \"goodput_fraction\": " << static_cast<double>(r.good) / num_requests << ",\n";
+    write_samples(out, "ttft", r.ttft);
+    write_samples(out, "tpot", r.tpot);
+    write_samples(out, "itl", r.itl);
+    write_samples(out, "e2e", r.e2e);
+    out << "  \"error_rate\": " << static_cast<double>(total_errors(r)) / num_requests << ",\n"
+        << "  \"errors\": {";
+    bool first = true;
+    for (const auto& e : r.errors) {
+        out << (first ? "" : ", ") << "\"" << bench::json_escape(e.first) << "\": " << e.second;
+        first = false;
+    }
+    out << "}\n}\n";
+}
+
+void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "Load-tests a running server started with: infer --model M --serve PORT\n"
+              << "Options:\n"
+              << "  --host HOST         Server host (default: 127.0.0.1)\n"
+              << "  --port N            Server port (default: 8080)\n"
+              << "  --connections N     Concurrent keep-alive connections (default: 8)\n"
+              << "  --requests N        Synthetic requests to send (default: 64)\n"
+              << "  --rate R            Poisson arrivals at R req/s (default: 0, all at start)\n"
+              << "  --prompt-len SPEC   N, uniform:A:B or normal:MEAN:STD tokens (default: 128)\n"
+              << "  --output-len SPEC   Output tokens, same format (default: 64)\n"
+              << "  --trace PATH        Replay \"arrival_s prompt_tokens output_tokens\" lines instead\n"
+              << "  --no-stream         Request whole responses instead of token streams\n"
+              << "  --slo-ttft MS       Goodput SLO on time to first token\n"
+              << "  --slo-tpot MS       Goodput SLO on time per output token\n"
+              << "  --slo-e2e MS        Goodput SLO on end-to-end latency\n"
+              << "  --timeout S         Per-request receive timeout (default: 60)\n"
+              << "  --seed N            Workload random seed (default: 1234)\n"
+              << "  --json PATH         Also write results as JSON\n"
+              << "  --help              Show this help message\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options opts;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--host" && i + 1 < argc) {
+                opts.host = argv[++i];
+            } else if (arg == "--port" && i + 1 < argc) {
+                opts.port = std::stoi(argv[++i]);
+            } else if (arg == "--connections" && i + 1 < argc) {
+                opts.connections = std::stoi(argv[++i]);
+            } else if (arg == "--requests" && i + 1 < argc) {
+                opts.num_requests = std::stoi(argv[++i]);
+            } else if (arg == "--rate" && i + 1 < argc) {
+                opts.rate = std::stod(argv[++i]);
+            } else if (arg == "--prompt-len" && i + 1 < argc) {
+                opts.prompt_len = argv[++i];
+            } else if (arg == "--output-len" && i + 1 < argc) {
+                opts.output_len = argv[++i];
+            } else if (arg == "--trace" && i + 1 < argc) {
+                opts.trace_path = argv[++i];
+            } else if (arg == "--no-stream") {
+                opts.stream = false;
+            } else if (arg == "--slo-ttft" && i + 1 < argc) {
+                opts.slo_ttft = std::stod(argv[++i]) / 1e3;
+            } else if (arg == "--slo-tpot" && i + 1 < argc) {
+                opts.slo_tpot = std::stod(argv[++i]) / 1e3;
+            } else if (arg == "--slo-e2e" && i + 1 < argc) {
+                opts.slo_e2e = std::stod(argv[++i]) / 1e3;
+            } else if (arg == "--timeout" && i + 1 < argc) {
+                opts.timeout = std::stod(argv[++i]);
+            } else if (arg == "--seed" && i + 1 < argc) {
+                opts.seed = std::stoi(argv[++i]);
+            } else if (arg == "--json" && i + 1 < argc) {
+                opts.json_path = argv[++i];
+            } else if (arg == "--help") {
+                print_usage(argv[0]);
+                return 0;
+            } else {
+                std::cerr << "Unknown argument: " << arg << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+
+        auto trace = opts.trace_path.empty() ? make_trace(opts) : load_trace(opts.trace_path);
+        if (trace.empty()) {
+            throw std::runtime_error("No requests to send");
+        }
+
+        std::cout << "Target: http://" << opts.host << ":" << opts.port << "/generate, "
+                  << opts.connections << " connections, "
+                  << (opts.stream ? "streaming" : "non-streaming") << "\n"
+                  << "Workload: " << trace.size() << " requests"
+                  << (opts.trace_path.empty() ? "" : " from " + opts.trace_path) << ", last arrival at "
+                  << trace.back().arrival << " s" << std::endl;
+
+        Report report = run_trace(opts, trace);
+        print_report(opts, report, trace.size());
+
+        if (!opts.json_path.empty()) {
+            write_json(opts.json_path, opts, report, trace.size());
+            std::cout << "\nWrote " << opts.json_path << std::endl;
+        }
+        return total_errors(report) == static_cast<int>(trace.size()) ? 1 : 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -2,12 +2,88 @@
 #include <stdexcept>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <iterator>
+
+#include <atomic>
 
 #ifdef _WIN32
 #include <malloc.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #else
 #include <stdlib.h>
+#include <sys/mman.h>
+#endif
+
+namespace {
+    std::atomic<HugePageMode> g_huge_page_mode{HugePageMode::Transparent};
+
+    bool use_huge_pages(size_t size) {
+#ifdef _WIN32
+        return false;
+#else
+        return size >= AlignedAllocator::kHugePageSize &&
+               g_huge_page_mode.load(std::memory_order_relaxed) != HugePageMode::Off;
+#endif
+    }
+
+    // Index of the highest set bit; value must be nonzero
+    int floor_log2(uint64_t value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return static_cast<int>(index);
+#else
+        return 63 - __builtin_clzll(static_cast<unsigned long long>(value));
+#endif
+    }
+
+    size_t round_to_huge_page(size_t size) {
+        return (size + AlignedAllocator::kHugePageSize - 1) / AlignedAllocator::kHugePageSize *
+               AlignedAllocator::kHugePageSize;
+    }
+
+#ifndef _WIN32
+    void* map_huge(size_t size) {
+        size_t mapped = round_to_huge_page(size);
+
+#ifdef MAP_HUGETLB
+        if (g_huge_page_mode.load(std::memory_order_relaxed) == HugePageMode::Explicit) {
+            void* ptr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (ptr != MAP_FAILED) return ptr;
+            // No reserved huge pages; fall through to transparent huge pages
+        }
+#endif
+
+        // Over-map by one huge page and trim so the region is 2MB aligned,
+        // which THP needs to back it with huge pages from the first byte
+        size_t padded = mapped + AlignedAllocator::kHugePageSize;
+        void* raw = mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+
+        uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t aligned = (start + AlignedAllocator::kHugePageSize - 1) &
+                            ~(uintptr_t(AlignedAllocator::kHugePageSize) - 1);
+        if (aligned > start) {
+            munmap(raw, aligned - start);
+        }
+        size_t tail = (start + padded) - (aligned + mapped);
+        if (tail > 0) {
+            munmap(reinterpret_cast<void*>(aligned + mapped), tail);
+        }
+
+        void* ptr = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, mapped, MADV_HUGEPAGE);
 #endif
+        return ptr;
+    }
+#endif
+}
 
 void* AlignedAllocator::allocate(size_t size, size_t alignment) {
     if (size == 0) return nullptr;
@@ -33,69 +109,130 @@ void AlignedAllocator::deallocate(void* ptr) {
 #endif
 }
 
-TensorPool::TensorPool(size_t initial_size) : total_allocated_(0), total_used_(0) {
-    head_ = new Chunk{
-        AlignedAllocator::allocate(initial_size),
-        initial_size,
-        nullptr
-    };
-    total_allocated_ = initial_size;
+void* AlignedAllocator::allocate_storage(size_t size, bool* huge_pages, bool prefer_huge_pages) {
+    *huge_pages = false;
+    if (size == 0) return nullptr;
+
+#ifndef _WIN32
+    if (prefer_huge_pages && use_huge_pages(size)) {
+        *huge_pages = true;
+        return map_huge(size); // Anonymous mappings are already zeroed
+    }
+#endif
+
+    void* ptr = allocate(size, kDefaultAlignment);
+    std::memset(ptr, 0, size);
+    return ptr;
+}
+
+void AlignedAllocator::deallocate_storage(void* ptr, size_t size, bool huge_pages) {
+    if (!ptr) return;
+
+#ifndef _WIN32
+    if (huge_pages) {
+        munmap(ptr, round_to_huge_page(size));
+        return;
+    }
+#endif
+
+    deallocate(ptr);
+}
+
+void AlignedAllocator::set_huge_page_mode(HugePageMode mode) {
+    g_huge_page_mode.store(mode, std::memory_order_relaxed);
+}
+
+HugePageMode AlignedAllocator::huge_page_mode() {
+    return g_huge_page_mode.load(std::memory_order_relaxed);
+}
+
+TensorPool::TensorPool(size_t initial_size, size_t alignment)
+    : offset_(0), alignment_(alignment) {
+    std::fill(std::begin(free_lists_), std::end(free_lists_), nullptr);
+    add_block(initial_size);
 }
 
 TensorPool::~TensorPool() {
-    reset();
-
-    Chunk* current = head_;
-    while (current) {
-        Chunk* next = current->next;
-        AlignedAllocator::deallocate(current->data);
-        delete current;
-        current = next;
+    release_blocks();
+}
+
+void TensorPool::release_blocks() {
+    for (const Block& block : blocks_) {
+        AlignedAllocator::deallocate_storage(block.data, block.size, block.huge_pages);
     }
+    blocks_.clear();
+}
+
+// Four classes per power of two, so rounding wastes at most 25%
+int TensorPool::size_class(size_t size, size_t* class_bytes) {
+    size_t s = std::max<size_t>(size, 64);
+    int p = floor_log2(s - 1);
+    size_t base = size_t(1) << p;
+    size_t step = base / 4;
+    size_t j = (s - base + step - 1) / step;
+    *class_bytes = base + j * step;
+    return (p - 5) * 4 + static_cast<int>(j) - 1;
+}
+
+void TensorPool::add_block(size_t min_size) {
+    size_t size = std::max(min_size, blocks_.empty() ? min_size : blocks_.back().size * 2);
+    // Blocks outlive many steps, so they are worth huge pages
+    bool huge_pages = false;
+    void* data = alignment_ <= AlignedAllocator::kDefaultAlignment
+                     ? AlignedAllocator::allocate_storage(size, &huge_pages, true)
+                     : AlignedAllocator::allocate(size, alignment_);
+    blocks_.push_back({static_cast<uint8_t*>(data), size, huge_pages});
+    offset_ = 0;
+    stats_.bytes_reserved += size;
+    stats_.num_blocks = blocks_.size();
 }
 
 void* TensorPool::allocate(size_t size) {
-    // Simple first-fit allocation for now
-    Chunk* current = head_;
-    while (current) {
-        if (current->size >= size && current->data) {
-            void* result = current->data;
-            if (current->size > size) {
-                // Split chunk
-                Chunk* remainder = new Chunk{
-                    static_cast<char*>(current->data) + size,
-                    current->size - size,
-                    current->next
-                };
-                current->next = remainder;
-            }
-            current->data = nullptr;
-            current->size = 0;
-            total_used_ += size;
-            return result;
-        }
-        current = current->next;
+    size_t class_bytes;
+    int cls = size_class(size, &class_bytes);
+
+    stats_.num_allocations++;
+    stats_.bytes_in_use += class_bytes;
+    stats_.high_water_mark = std::max(stats_.high_water_mark, stats_.bytes_in_use);
+
+    // Reuse a freed range of the same class first
+    if (FreeNode* node = free_lists_[cls]) {
+        free_lists_[cls] = node->next;
+        stats_.free_list_hits++;
+        return node;
     }
 
-    // Need to allocate new chunk
-    size_t new_size = std::max(size, total_allocated_ / 2);
-    Chunk* new_chunk = new Chunk{
-        AlignedAllocator::allocate(new_size),
-        new_size,
-        head_
-    };
-    head_ = new_chunk;
-    total_allocated_ += new_size;
-
-    return allocate(size); // Recursive call will succeed
+    size_t aligned = (offset_ + alignment_ - 1) / alignment_ * alignment_;
+    if (aligned + class_bytes > blocks_.back().size) {
+        add_block(class_bytes);
+        aligned = 0;
+    }
+
+    offset_ = aligned + class_bytes;
+    return blocks_.back().data + aligned;
+}
+
+void TensorPool::deallocate(void* ptr, size_t size) {
+    if (!ptr) return;
+
+    size_t class_bytes;
+    int cls = size_class(size, &class_bytes);
+
+    FreeNode* node = static_cast<FreeNode*>(ptr);
+    node->next = free_lists_[cls];
+    free_lists_[cls] = node;
+    stats_.bytes_in_use -= class_bytes;
 }
 
 void TensorPool::reset() {
-    Chunk* current = head_;
-    while (current) {
-        current->data = nullptr;
-        current->size = 0;
-        current = current->next;
+    if (blocks_.size() > 1) {
+        size_t total = stats_.bytes_reserved;
+        release_blocks();
+        stats_.bytes_reserved = 0;
+        add_block(total);
     }
-    total_used_ = 0;
+
+    offset_ = 0;
+    std::fill(std::begin(free_lists_), std::end(free_lists_), nullptr);
+    stats_.bytes_in_use = 0;
 }
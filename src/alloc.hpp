@@ -2,14 +2,38 @@
 #define ALLOC_HPP
 
 #include <memory>
+#include <vector>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 
+// How large allocations are backed
+enum class HugePageMode {
+    Off,          // Regular pages
+    Transparent,  // 2MB-aligned mmap + madvise(MADV_HUGEPAGE)
+    Explicit      // MAP_HUGETLB from the reserved pool, falling back to Transparent
+};
+
 class AlignedAllocator {
 public:
-    static void* allocate(size_t size, size_t alignment = 32);
+    // One cache line, and a full AVX-512 register
+    static constexpr size_t kDefaultAlignment = 64;
+    static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+    static void* allocate(size_t size, size_t alignment = kDefaultAlignment);
     static void deallocate(void* ptr);
 
+    // Tensor storage: zeroed and 64-byte aligned. With prefer_huge_pages it
+    // is huge-page backed once size reaches kHugePageSize; that is for
+    // long-lived buffers (weights, KV blocks, arenas), since the mmap and
+    // munmap would dominate short-lived ones. `huge_pages` reports which path
+    // was taken; pass it and the same size back to deallocate_storage.
+    static void* allocate_storage(size_t size, bool* huge_pages, bool prefer_huge_pages = false);
+    static void deallocate_storage(void* ptr, size_t size, bool huge_pages);
+
+    static void set_huge_page_mode(HugePageMode mode);
+    static HugePageMode huge_page_mode();
+
     template<typename T>
     static std::unique_ptr<T[], decltype(&deallocate)> make_unique_aligned(size_t count) {
         auto* ptr = static_cast<T*>(allocate(count * sizeof(T)));
@@ -17,25 +41,60 @@ public:
     }
 };
 
-// Memory pool for frequently allocated tensors
+// Arena for frequently allocated tensors. Allocations are aligned bumps out
+// of large blocks; freed ranges go onto size-class free lists so recurring
+// shapes are reused within a step, and reset() releases everything in O(1)
+// between decode steps.
 class TensorPool {
 public:
-    TensorPool(size_t initial_size = 1024 * 1024); // 1MB default
+    TensorPool(size_t initial_size = 1024 * 1024, size_t alignment = 64); // 1MB default
     ~TensorPool();
 
+    TensorPool(const TensorPool&) = delete;
+    TensorPool& operator=(const TensorPool&) = delete;
+
     void* allocate(size_t size);
+
+    // Return an allocation for reuse by a later request of the same size class
+    void deallocate(void* ptr, size_t size);
+
+    // Invalidate every allocation. If the last step spilled into extra blocks
+    // they are merged into one so later steps bump through contiguous memory.
     void reset();
 
+    struct Stats {
+        size_t bytes_reserved = 0;   // Capacity of all blocks
+        size_t bytes_in_use = 0;     // Allocated and not yet returned
+        size_t high_water_mark = 0;  // Peak bytes_in_use
+        size_t num_blocks = 0;
+        size_t num_allocations = 0;
+        size_t free_list_hits = 0;
+    };
+
+    const Stats& stats() const { return stats_; }
+
 private:
-    struct Chunk {
-        void* data;
+    static constexpr int kNumSizeClasses = 256;
+
+    struct Block {
+        uint8_t* data;
         size_t size;
-        Chunk* next;
+        bool huge_pages;
     };
 
-    Chunk* head_;
-    size_t total_allocated_;
-    size_t total_used_;
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    static int size_class(size_t size, size_t* class_bytes);
+    void add_block(size_t min_size);
+    void release_blocks();
+
+    std::vector<Block> blocks_;
+    size_t offset_;  // Bump offset within blocks_.back()
+    size_t alignment_;
+    FreeNode* free_lists_[kNumSizeClasses];
+    Stats stats_;
 };
 
 #endif // ALLOC_HPP
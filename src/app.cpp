@@ -1,14 +1,41 @@
 #include "app.hpp"
 #include "loaders/onnx_loader.hpp"
 #include "transformer/transformer.hpp"
+#include "transformer/speculative.hpp"
+#include "transformer/sampling.hpp"
+#include "grammar/json_schema.hpp"
+#include "grammar/token_grammar.hpp"
 #include "tokenizer/sentencepiece_wrapper.hpp"
+#include "alloc.hpp"
+#include "kernels/autotune.hpp"
+#include "http_server.hpp"
+#include "util/profiler.hpp"
+#include <csignal>
+#include <fstream>
 #include <iostream>
 #include <random>
 #include <algorithm>
 #include <cmath>
+#include <limits>
+#include <memory>
+#include <sstream>
 
 int App::run(const InferenceArgs& args) {
     try {
+        // Must be set before any weights are allocated
+        if (args.huge_pages == "off") {
+            AlignedAllocator::set_huge_page_mode(HugePageMode::Off);
+        } else if (args.huge_pages == "explicit") {
+            AlignedAllocator::set_huge_page_mode(HugePageMode::Explicit);
+        } else {
+            AlignedAllocator::set_huge_page_mode(HugePageMode::Transparent);
+        }
+
+        if (args.profile) {
+            // Falls back to timings only without perf_event access
+            Profiler::instance().enable_hardware_counters(true);
+        }
+
         std::cout << "Loading model from: " << args.model_path << std::endl;
 
         // Load model weights
@@ -17,8 +44,7 @@ int App::run(const InferenceArgs& args) {
             std::cout << "Warning: No initializers loaded. Using dummy model for testing.\n";
         }
 
-        // Initialize tokenizer (would need actual tokenizer model path)
-        Tokenizer tokenizer("dummy_tokenizer.model");
+        Tokenizer tokenizer(args.tokenizer_path);
 
         // Initialize transformer
         ModelWeights model_weights{weights};
@@ -29,6 +55,29 @@ int App::run(const InferenceArgs& args) {
         std::cout << "Hidden size: " << transformer.hidden_size() << std::endl;
         std::cout << "Num layers: " << transformer.num_layers() << std::endl;
 
+        // Tilings tuned on an earlier run of this CPU model
+        KernelAutotuner& tuner = KernelAutotuner::instance();
+        if (tuner.load(args.autotune_cache) && args.verbose) {
+            std::cout << "Loaded " << tuner.size() << " tuned GEMM shapes from "
+                      << args.autotune_cache << std::endl;
+        }
+
+        if (args.autotune) {
+            std::cout << "Autotuning GEMM kernels for " << KernelAutotuner::cpu_model() << std::endl;
+            // Decode and a typical prefill chunk
+            for (int rows : {1, 128}) {
+                for (const auto& shape : transformer.gemm_shapes(rows)) {
+                    if (tuner.has(shape[0], shape[1], shape[2])) continue;
+                    GemmTiling best = tuner.tune_matmul(shape[0], shape[1], shape[2]);
+                    std::cout << "  " << shape[0] << "x" << shape[1] << "x" << shape[2]
+                              << ": block " << best.block_m << "/" << best.block_n << "/"
+                              << best.block_k << ", " << best.num_threads << " threads, "
+                              << best.gflops << " GFLOP/s" << std::endl;
+                }
+            }
+            tuner.save(args.autotune_cache);
+        }
+
         if (args.verbose) {
             std::cout << "Prompt: " << args.prompt << std::endl;
         }
@@ -40,6 +89,42 @@ int App::run(const InferenceArgs& args) {
         std::string generated_text = tokenizer.decode(generated_tokens);
         std::cout << "\nGenerated text: " << generated_text << std::endl;
 
+        if (args.profile) {
+            Profiler::instance().print_summary();
+        }
+
+        return 0;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+int App::serve(const InferenceArgs& args) {
+    try {
+        // Block the shutdown signals before any server thread exists, so
+        // they are all delivered to the sigwait below
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        HTTPServer server(args.serve_port);
+        server.load_model(args.model_path, args.tokenizer_path);
+        if (args.session_cache_mb > 0 || !args.session_dir.empty()) {
+            SessionCacheConfig sessions;
+            sessions.max_memory_bytes = static_cast<size_t>(args.session_cache_mb) << 20;
+            sessions.spill_dir = args.session_dir;
+            server.enable_sessions(sessions);
+        }
+        server.start();
+
+        int signal_number = 0;
+        sigwait(&signals, &signal_number);
+        std::cout << "Shutting down HTTP server" << std::endl;
+        server.stop();
         return 0;
 
     } catch (const std::exception& e) {
@@ -50,7 +135,7 @@ int App::run(const InferenceArgs& args) {
 
 std::vector<int> App::generate(const InferenceArgs& args) {
     // Initialize tokenizer and transformer (simplified for this demo)
-    Tokenizer tokenizer("dummy_tokenizer.model");
+    Tokenizer tokenizer(args.tokenizer_path);
     auto weights = load_onnx_initializers(args.model_path);
     ModelWeights model_weights{weights};
     Transformer transformer(model_weights);
@@ -72,20 +157,102 @@ std::vector<int> App::generate(const InferenceArgs& args) {
     std::mt19937 gen(args.seed >= 0 ? args.seed : std::random_device{}());
     std::uniform_real_distribution<float> dist(0.0f, 1.0f);
 
+    // KV cache lives across steps; windowed modes keep memory constant
+    KVCacheConfig cache_config;
+    cache_config.max_seq_len = transformer.max_seq_len();
+    if (args.kv_window > 0) {
+        cache_config.mode = args.kv_sinks > 0 ? KVCacheMode::AttentionSink
+                                              : KVCacheMode::SlidingWindow;
+        cache_config.window_size = args.kv_window;
+        cache_config.num_sink_tokens = args.kv_sinks;
+    }
+
+    // Constrained decoding: a byte DFA lifted to per-state token masks
+    std::unique_ptr<TokenGrammar> grammar;
+    if (!args.regex.empty() || !args.json_schema.empty()) {
+        std::string pattern = args.regex;
+        if (!args.json_schema.empty()) {
+            std::ifstream file(args.json_schema);
+            if (!file) {
+                throw std::runtime_error("Cannot open JSON schema: " + args.json_schema);
+            }
+            std::stringstream schema;
+            schema << file.rdbuf();
+            pattern = json_schema_to_regex(schema.str());
+        }
+        std::vector<std::string> token_bytes(tokenizer.vocab_size());
+        for (int id = 0; id < tokenizer.vocab_size(); ++id) {
+            token_bytes[id] = tokenizer.token_bytes(id);
+        }
+        grammar = std::make_unique<TokenGrammar>(RegexDFA(pattern), token_bytes,
+                                                 tokenizer.eos_token_id());
+        if (args.verbose) {
+            std::cout << "Grammar: " << pattern << std::endl;
+        }
+    }
+
+    if (!args.draft_model.empty() || args.prompt_lookup) {
+        if (grammar) {
+            throw std::runtime_error("Constrained decoding does not combine with speculation");
+        }
+        // A draft model or prompt lookup proposes num_draft tokens, the
+        // target checks them in one pass
+        SpeculativeConfig spec_config;
+        spec_config.num_draft_tokens = args.num_draft;
+        spec_config.sampling = {args.temperature, args.top_k, args.top_p};
+        spec_config.max_ngram = args.ngram;
+
+        std::unique_ptr<Transformer> draft;
+        std::unique_ptr<SpeculativeDecoder> decoder;
+        if (!args.draft_model.empty()) {
+            ModelWeights draft_weights{load_onnx_initializers(args.draft_model)};
+            draft = std::make_unique<Transformer>(draft_weights);
+            decoder = std::make_unique<SpeculativeDecoder>(transformer, *draft, cache_config,
+                                                           spec_config);
+        } else {
+            decoder = std::make_unique<SpeculativeDecoder>(transformer, cache_config, spec_config);
+        }
+
+        size_t limit = input_tokens.size() + args.max_tokens;
+        while (all_tokens.size() < limit) {
+            size_t before = all_tokens.size();
+            decoder->step(all_tokens, gen);
+            auto eos = std::find(all_tokens.begin() + before, all_tokens.end(),
+                                 tokenizer.eos_token_id());
+            if (eos != all_tokens.end()) {
+                all_tokens.erase(eos, all_tokens.end());
+                break;
+            }
+        }
+        all_tokens.resize(std::min(all_tokens.size(), limit));
+
+        if (args.verbose) {
+            const auto& stats = decoder->stats();
+            std::cout << (draft ? "Speculative decoding: " : "Prompt lookup: ")
+                      << stats.accepted << "/" << stats.proposed << " draft tokens accepted (" << stats.acceptance_rate() * 100.0 << "%), "
+                      << stats.tokens_per_round() << " tokens per target pass" << std::endl;
+        }
+        return all_tokens;
+    }
+
+    KVCache cache = transformer.create_cache(cache_config);
+    SamplingParams sampling{args.temperature, args.top_k, args.top_p};
+    int grammar_state = grammar ? grammar->initial_state() : 0;
+
     // Autoregressive generation
     for (int step = 0; step < args.max_tokens; ++step) {
-        // Create input tensor for current sequence
-        std::vector<int> current_input_shape = {1, static_cast<int>(all_tokens.size())};
+        // Feed only the tokens the cache has not seen yet
+        int num_new = static_cast<int>(all_tokens.size()) - cache.length();
+        std::vector<int> current_input_shape = {1, num_new};
         Tensor input_ids(current_input_shape, DType::FP32);
 
         // Copy tokens to tensor (simplified - would need proper token ID handling)
         float* input_data = input_ids.data<float>();
-        for (size_t i = 0; i < all_tokens.size(); ++i) {
-            input_data[i] = static_cast<float>(all_tokens[i]);
+        for (int i = 0; i < num_new; ++i) {
+            input_data[i] = static_cast<float>(all_tokens[cache.length() + i]);
         }
 
         // Forward pass through transformer
-        KVCache cache; // Simplified - would need proper KV cache management
         Tensor logits = transformer.forward(input_ids, &cache);
 
         // Get logits for last position
@@ -95,20 +262,30 @@ std::vector<int> App::generate(const InferenceArgs& args) {
 
         // Extract logits for the last token
         std::vector<float> last_logits;
-        int last_token_idx = static_cast<int>(all_tokens.size()) - 1;
+        int last_token_idx = num_new - 1;
         for (int i = 0; i < vocab_size; ++i) {
             last_logits.push_back(logits_data[last_token_idx * vocab_size + i]);
         }
 
-        // Apply temperature
-        if (args.temperature > 0.0f) {
-            for (float& logit : last_logits) {
-                logit /= args.temperature;
+        if (grammar) {
+            // Tokens the tokenizer has no bytes for never match
+            int allowed = std::min(vocab_size, grammar->vocab_size());
+            apply_token_mask(last_logits.data(), grammar->mask(grammar_state), allowed);
+            std::fill(last_logits.begin() + allowed, last_logits.end(),
+                      -std::numeric_limits<float>::infinity());
+            if (*std::max_element(last_logits.begin(), last_logits.end()) ==
+                -std::numeric_limits<float>::infinity()) {
+                throw std::runtime_error("No token can continue the constrained output");
             }
         }
 
         // Sample next token
-        int next_token = sample_token(last_logits, args);
+        std::vector<float> probs;
+        token_probabilities(last_logits.data(), vocab_size, sampling, probs);
+        int next_token = ::sample_token(probs, gen);
+        if (grammar) {
+            grammar_state = grammar->next_state(grammar_state, next_token);
+        }
 
         // Check for EOS
         if (next_token == tokenizer.eos_token_id()) {
@@ -126,83 +303,33 @@ std::vector<int> App::generate(const InferenceArgs& args) {
     return all_tokens;
 }
 
-int App::sample_token(const std::vector<float>& logits, const InferenceArgs& args) {
-    int vocab_size = static_cast<int>(logits.size());
-
-    // Convert logits to probabilities
-    std::vector<float> probs = logits;
-
-    // Apply softmax
-    float max_logit = *std::max_element(probs.begin(), probs.end());
-    float sum_exp = 0.0f;
-    for (float& prob : probs) {
-        prob = std::exp(prob - max_logit);
-        sum_exp += prob;
-    }
-    for (float& prob : probs) {
-        prob /= sum_exp;
-    }
-
-    // Top-k sampling
-    std::vector<int> top_k_indices;
-    std::vector<float> top_k_probs;
-    for (int i = 0; i < vocab_size; ++i) {
-        top_k_indices.push_back(i);
-        top_k_probs.push_back(probs[i]);
-    }
-
-    // Sort by probability (descending)
-    std::sort(top_k_indices.begin(), top_k_indices.end(),
-              [&](int a, int b) { return top_k_probs[a] > top_k_probs[b]; });
-
-    // Keep only top-k
-    if (args.top_k > 0 && args.top_k < vocab_size) {
-        top_k_indices.resize(args.top_k);
-        top_k_probs.resize(args.top_k);
-    }
-
-    // Top-p (nucleus) sampling
-    if (args.top_p < 1.0f) {
-        // Sort by probability
-        std::vector<int> sorted_indices = top_k_indices;
-        std::sort(sorted_indices.begin(), sorted_indices.end(),
-                  [&](int a, int b) { return top_k_probs[a] > top_k_probs[b]; });
-
-        // Find cumulative probability cutoff
-        float cumulative_prob = 0.0f;
-        size_t cutoff_idx = 0;
-        for (size_t i = 0; i < sorted_indices.size(); ++i) {
-            cumulative_prob += top_k_probs[sorted_indices[i]];
-            if (cumulative_prob >= args.top_p) {
-                cutoff_idx = i + 1;
-                break;
-            }
-        }
-
-        if (cutoff_idx < sorted_indices.size()) {
-            sorted_indices.resize(cutoff_idx);
-        }
-
-        top_k_indices = sorted_indices;
-    }
-
-    // Sample from filtered distribution
-    std::discrete_distribution<int> distribution(top_k_probs.begin(), top_k_probs.end());
-    int sampled_idx = top_k_indices[distribution(std::mt19937(args.seed >= 0 ? args.seed : std::random_device{}()))];
-
-    return sampled_idx;
-}
-
 void App::print_usage(const char* program_name) {
     std::cout << "Usage: " << program_name << " [options]\n"
               << "Options:\n"
               << "  --model PATH       Path to ONNX model file (required)\n"
               << "  --prompt TEXT      Input prompt text (required)\n"
+              << "  --tokenizer PATH   SentencePiece .model, tokenizer.json or .gguf (default: a .gguf\n"
+              << "                     model's own, else one token per byte)\n"
               << "  --max-tokens N     Maximum number of tokens to generate (default: 16)\n"
               << "  --temperature F    Sampling temperature (default: 0.8)\n"
               << "  --top-k N          Top-k sampling parameter (default: 40)\n"
               << "  --top-p F          Top-p (nucleus) sampling parameter (default: 0.9)\n"
               << "  --seed N           Random seed (-1 for random, default: -1)\n"
+              << "  --kv-window N      Attend only to the last N tokens (default: 0, unlimited)\n"
+              << "  --kv-sinks N       With --kv-window, keep the first N tokens as attention sinks\n"
+              << "  --huge-pages MODE  Back weights, KV and arenas with huge pages: off, thp, explicit (default: thp)\n"
+              << "  --autotune         Benchmark GEMM tilings for this model and save the winners\n"
+              << "  --autotune-cache P Tuning cache file, keyed by CPU model (default: autotune.cache)\n"
+              << "  --serve PORT       Serve POST /generate over HTTP instead of running --prompt\n"
+              << "  --profile          Print per-scope latency, IPC, GB/s and GFLOP/s when done\n"
+              << "  --draft-model PATH Speculative decoding: a smaller model proposes, --model verifies\n"
+              << "  --num-draft N      Draft tokens proposed per verification pass (default: 4)\n"
+              << "  --prompt-lookup    Speculate by copying what followed the last n-gram earlier in the text\n"
+              << "  --ngram N          Longest n-gram --prompt-lookup matches (default: 3)\n"
+              << "  --regex PATTERN    Only generate text the regular expression matches in full\n"
+              << "  --json-schema PATH Only generate JSON valid under the schema in this file\n"
+              << "  --session-cache N  With --serve, keep up to N MB of session KV caches for later turns\n"
+              << "  --session-dir P    Spill evicted sessions to files here, mapped back on reuse\n"
               << "  --verbose          Enable verbose output\n"
               << "  --help             Show this help message\n";
 }
@@ -6,6 +6,7 @@
 
 struct InferenceArgs {
     std::string model_path;
+    std::string tokenizer_path;     // SentencePiece .model, tokenizer.json or .gguf; empty uses bytes
     std::string prompt;
     int max_tokens = 16;
     float temperature = 0.8f;
@@ -13,15 +14,32 @@ struct InferenceArgs {
     float top_p = 0.9f;
     int seed = -1;
     bool verbose = false;
+    int kv_window = 0;  // > 0 limits attention to the last N tokens
+    int kv_sinks = 0;   // With kv_window, keep the first N tokens as attention sinks
+    std::string huge_pages = "thp"; // off, thp or explicit
+    bool autotune = false;          // Tune GEMM tilings for the model's shapes
+    std::string autotune_cache = "autotune.cache";
+    int serve_port = -1;            // >= 0 runs the HTTP server instead of one prompt
+    bool profile = false;           // Print per-scope timings and hardware counters
+    std::string draft_model;        // Non-empty enables speculative decoding with this model
+    int num_draft = 4;              // Draft tokens proposed per speculative round
+    bool prompt_lookup = false;     // Speculate from n-gram matches in the text instead of a draft
+    int ngram = 3;                  // Longest n-gram prompt lookup matches
+    std::string regex;              // Constrain output to match this regular expression
+    std::string json_schema;        // Constrain output to JSON valid under the schema in this file
+    int session_cache_mb = 0;       // > 0 keeps /generate session KV caches in memory, LRU
+    std::string session_dir;        // Spill evicted sessions here instead of dropping them
 };
 
 class App {
 public:
     static int run(const InferenceArgs& args);
 
+    // Serve /generate over HTTP until SIGINT or SIGTERM
+    static int serve(const InferenceArgs& args);
+
 private:
     static std::vector<int> generate(const InferenceArgs& args);
-    static int sample_token(const std::vector<float>& logits, const InferenceArgs& args);
     static void print_usage(const char* program_name);
 };
 
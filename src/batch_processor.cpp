@@ -1,9 +1,31 @@
 #include "batch_processor.hpp"
 #include "loaders/onnx_loader.hpp"
+#include "transformer/sampling.hpp"
 #include "util/profiler.hpp"
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <iostream>
 #include <numeric>
+#include <random>
+
+namespace {
+
+// Feed tokens through the model and keep the logits of the last position
+void forward_last(Transformer& transformer, const int* tokens, int count, KVCache& cache,
+                  std::vector<float>& logits) {
+    Tensor input_ids(std::vector<int>{1, count}, DType::FP32);
+    float* ids = input_ids.data<float>();
+    for (int i = 0; i < count; ++i) {
+        ids[i] = static_cast<float>(tokens[i]);
+    }
+    Tensor output = transformer.forward(input_ids, &cache);
+    int vocab_size = output.shape().back();
+    const float* last = output.data<float>() + static_cast<size_t>(count - 1) * vocab_size;
+    logits.assign(last, last + vocab_size);
+}
+
+} // namespace
 
 BatchProcessor::BatchProcessor(size_t max_batch_size, size_t queue_size)
     : max_batch_size_(max_batch_size), queue_size_(queue_size), running_(false) {
@@ -21,17 +43,21 @@ BatchProcessor::~BatchProcessor() {
     stop();
 }
 
-std::future<std::vector<int>> BatchProcessor::submit_request(const BatchRequest& request) {
+std::future<Completions> BatchProcessor::submit_request(BatchRequest request) {
     std::lock_guard<std::mutex> lock(queue_mutex_);
 
     if (request_queue_.size() >= queue_size_) {
         throw std::runtime_error("Request queue is full");
     }
+    if (request.input_tokens.empty() || request.n < 1 || request.beam_width < 0) {
+        throw std::runtime_error("Request needs input tokens, n >= 1 and beam_width >= 0");
+    }
 
-    request_queue_.push(request);
+    std::future<Completions> result = request.result_promise.get_future();
+    request_queue_.push(std::move(request));
     queue_cv_.notify_one();
 
-    return std::move(request.result_promise.get_future());
+    return result;
 }
 
 void BatchProcessor::start() {
@@ -88,7 +114,7 @@ void BatchProcessor::processing_loop() {
 
                 // Fulfill promises
                 for (size_t i = 0; i < batch.size() && i < results.size(); ++i) {
-                    batch[i].result_promise.set_value(results[i].generated_tokens);
+                    batch[i].result_promise.set_value(std::move(results[i].completions));
                 }
             } catch (const std::exception& e) {
                 std::cerr << "Error processing batch: " << e.what() << std::endl;
@@ -118,34 +144,22 @@ std::vector<BatchResult> BatchProcessor::process_batch(const std::vector<BatchRe
 
     for (const auto& request : requests) {
         PROFILE_SCOPE("single_inference");
+        auto request_start = std::chrono::high_resolution_clock::now();
 
+        BatchResult result;
         try {
-            // Simulate inference (would use actual transformer forward pass)
-            std::vector<int> generated_tokens = request.input_tokens;
-
-            // Add some dummy generated tokens
-            for (int i = 0; i < request.max_tokens; ++i) {
-                generated_tokens.push_back(1000 + i); // Dummy token IDs
-            }
-
-            auto end_time = std::chrono::high_resolution_clock::now();
-            float inference_time = std::chrono::duration_cast<std::chrono::microseconds>(
-                end_time - start_time).count() / 1000.0f;
-
-            results.push_back({
-                generated_tokens,
-                inference_time,
-                1024 * 1024 // 1MB dummy memory usage
-            });
-
+            result = run_request(request);
         } catch (const std::exception& e) {
             std::cerr << "Error in single inference: " << e.what() << std::endl;
-            results.push_back({
-                request.input_tokens, // Return original tokens on error
-                0.0f,
-                0
-            });
+            result.completions = {request.input_tokens}; // Return original tokens on error
+            result.scores = {0.0f};
+            result.memory_used_bytes = 0;
         }
+
+        auto request_end = std::chrono::high_resolution_clock::now();
+        result.inference_time_ms = std::chrono::duration_cast<std::chrono::microseconds>(
+            request_end - request_start).count() / 1000.0f;
+        results.push_back(std::move(result));
     }
 
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -157,3 +171,187 @@ std::vector<BatchResult> BatchProcessor::process_batch(const std::vector<BatchRe
 
     return results;
 }
+
+KVCache BatchProcessor::prefill(const BatchRequest& request, std::vector<float>& logits) {
+    PROFILE_SCOPE("batch_prefill");
+    KVCacheConfig config;
+    config.max_seq_len = std::min(transformer_->max_seq_len(),
+                                  static_cast<int>(request.input_tokens.size()) + request.max_tokens);
+    KVCache cache = transformer_->create_cache(config);
+    forward_last(*transformer_, request.input_tokens.data(),
+                 static_cast<int>(request.input_tokens.size()), cache, logits);
+    return cache;
+}
+
+BatchResult BatchProcessor::run_request(const BatchRequest& request) {
+    std::vector<float> prompt_logits;
+    KVCache prompt_cache = prefill(request, prompt_logits);
+    auto next_logits = [this](int token, KVCache& cache, std::vector<float>& logits) {
+        forward_last(*transformer_, &token, 1, cache, logits);
+    };
+    if (request.beam_width > 0) {
+        return beam_search(request, std::move(prompt_cache), prompt_logits, next_logits);
+    }
+    return sample_completions(request, prompt_cache, prompt_logits, next_logits);
+}
+
+BatchResult BatchProcessor::sample_completions(const BatchRequest& request, const KVCache& prompt_cache,
+                                               const std::vector<float>& prompt_logits,
+                                               const NextLogits& next_logits) {
+    struct Branch {
+        std::vector<int> tokens;
+        KVCache cache;
+        std::vector<float> logits;
+        float log_prob = 0.0f;
+        bool done = false;
+    };
+
+    // Every branch starts from the same prefill; only sampling differs
+    std::vector<Branch> branches(request.n);
+    for (Branch& branch : branches) {
+        branch.tokens = request.input_tokens;
+        branch.cache = prompt_cache.fork();
+        branch.logits = prompt_logits;
+    }
+
+    std::mt19937 rng(request.seed >= 0 ? request.seed : std::random_device{}());
+    SamplingParams params{request.temperature, request.top_k, request.top_p};
+    std::vector<float> probs;
+
+    for (int step = 0; step < request.max_tokens; ++step) {
+        for (Branch& branch : branches) {
+            if (branch.done) continue;
+
+            token_probabilities(branch.logits.data(), static_cast<int>(branch.logits.size()),
+                                params, probs);
+            int token = sample_token(probs, rng);
+            branch.log_prob += std::log(probs[token]);
+            if (token == request.eos_token_id) {
+                branch.done = true;
+                continue;
+            }
+            branch.tokens.push_back(token);
+
+            bool room = branch.cache.length() < branch.cache.capacity();
+            if (step + 1 < request.max_tokens && room) {
+                next_logits(token, branch.cache, branch.logits);
+            } else {
+                branch.done = true;
+            }
+        }
+    }
+
+    BatchResult result;
+    std::vector<const KVCache*> caches = {&prompt_cache};
+    for (const Branch& branch : branches) caches.push_back(&branch.cache);
+    result.memory_used_bytes = KVCache::byte_size(caches);
+    for (Branch& branch : branches) {
+        result.scores.push_back(branch.log_prob);
+        result.completions.push_back(std::move(branch.tokens));
+    }
+    return result;
+}
+
+BatchResult BatchProcessor::beam_search(const BatchRequest& request, KVCache prompt_cache,
+                                        const std::vector<float>& prompt_logits,
+                                        const NextLogits& next_logits) {
+    struct Beam {
+        std::vector<int> tokens;
+        KVCache cache;
+        std::vector<float> logits;
+        double log_prob = 0.0;
+    };
+    struct Candidate {
+        int beam;
+        int token;
+        double log_prob;
+    };
+
+    int prompt_length = static_cast<int>(request.input_tokens.size());
+    auto score = [&](const std::vector<int>& tokens, double log_prob) {
+        int generated = std::max(1, static_cast<int>(tokens.size()) - prompt_length);
+        return log_prob / std::pow(generated, request.length_penalty);
+    };
+
+    std::vector<Beam> beams(1);
+    beams[0].tokens = request.input_tokens;
+    beams[0].cache = std::move(prompt_cache);
+    beams[0].logits = prompt_logits;
+    size_t memory_used = beams[0].cache.byte_size();
+
+    std::vector<std::pair<double, std::vector<int>>> finished;
+    std::vector<float> log_probs;
+    std::vector<int> order;
+
+    for (int step = 0; step < request.max_tokens && !beams.empty(); ++step) {
+        // Each live beam contributes its beam_width best continuations
+        std::vector<Candidate> candidates;
+        for (int b = 0; b < static_cast<int>(beams.size()); ++b) {
+            int vocab_size = static_cast<int>(beams[b].logits.size());
+            log_softmax(beams[b].logits.data(), vocab_size, log_probs);
+            int top = std::min(request.beam_width, vocab_size);
+            order.resize(vocab_size);
+            std::iota(order.begin(), order.end(), 0);
+            std::partial_sort(order.begin(), order.begin() + top, order.end(),
+                              [&](int x, int y) { return log_probs[x] > log_probs[y]; });
+            for (int i = 0; i < top; ++i) {
+                candidates.push_back({b, order[i], beams[b].log_prob + log_probs[order[i]]});
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Candidate& x, const Candidate& y) { return x.log_prob > y.log_prob; });
+
+        // Survivors fork their parent's cache; a parent picked twice is
+        // shared until each child writes its own token
+        std::vector<Beam> next;
+        for (const Candidate& candidate : candidates) {
+            if (static_cast<int>(next.size()) == request.beam_width) break;
+            const Beam& parent = beams[candidate.beam];
+            std::vector<int> tokens = parent.tokens;
+            if (candidate.token == request.eos_token_id) {
+                finished.emplace_back(score(tokens, candidate.log_prob), std::move(tokens));
+                continue;
+            }
+            tokens.push_back(candidate.token);
+            Beam child;
+            child.tokens = std::move(tokens);
+            child.cache = parent.cache.fork();
+            child.log_prob = candidate.log_prob;
+            next.push_back(std::move(child));
+        }
+        beams = std::move(next);  // Drops unpicked parents and their private blocks
+
+        if (static_cast<int>(finished.size()) >= request.beam_width) break;
+        if (step + 1 == request.max_tokens) break;
+
+        for (Beam& beam : beams) {
+            if (beam.cache.length() >= beam.cache.capacity()) {
+                finished.emplace_back(score(beam.tokens, beam.log_prob), std::move(beam.tokens));
+                beam.tokens.clear();
+                continue;
+            }
+            next_logits(beam.tokens.back(), beam.cache, beam.logits);
+        }
+        beams.erase(std::remove_if(beams.begin(), beams.end(),
+                                   [](const Beam& beam) { return beam.tokens.empty(); }),
+                    beams.end());
+
+        std::vector<const KVCache*> caches;
+        for (const Beam& beam : beams) caches.push_back(&beam.cache);
+        memory_used = std::max(memory_used, KVCache::byte_size(caches));
+    }
+
+    for (Beam& beam : beams) {
+        finished.emplace_back(score(beam.tokens, beam.log_prob), std::move(beam.tokens));
+    }
+    std::stable_sort(finished.begin(), finished.end(),
+                     [](const auto& x, const auto& y) { return x.first > y.first; });
+
+    BatchResult result;
+    result.memory_used_bytes = memory_used;
+    for (int i = 0; i < request.n && i < static_cast<int>(finished.size()); ++i) {
+        result.scores.push_back(static_cast<float>(finished[i].first));
+        result.completions.push_back(std::move(finished[i].second));
+    }
+    return result;
+}
@@ -3,28 +3,39 @@
 
 #include "tensor.hpp"
 #include "transformer/transformer.hpp"
+#include <atomic>
 #include <vector>
 #include <string>
 #include <future>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <functional>
+#include <thread>
+
+// Prompt plus generated tokens, one entry per completion
+using Completions = std::vector<std::vector<int>>;
 
 struct BatchRequest {
     std::vector<int> input_tokens;
     std::string prompt;
-    int max_tokens;
-    float temperature;
-    int top_k;
-    int top_p;
-    int seed;
-    std::promise<std::vector<int>> result_promise;
+    int max_tokens = 16;
+    float temperature = 0.8f;
+    int top_k = 40;
+    float top_p = 0.9f;
+    int seed = -1;
+    int n = 1;                     // Completions to return
+    int beam_width = 0;            // > 0 runs beam search and returns the n best beams
+    float length_penalty = 1.0f;   // Beam score is log_prob / generated_length^length_penalty
+    int eos_token_id = -1;         // Ends a completion early; -1 never does
+    std::promise<Completions> result_promise;
 };
 
 struct BatchResult {
-    std::vector<int> generated_tokens;
+    Completions completions;    // Best first for beam search
+    std::vector<float> scores;  // Beam scores, or log-probability of each sample
     float inference_time_ms;
-    size_t memory_used_bytes;
+    size_t memory_used_bytes;   // KV cache: the shared prompt plus each branch's own blocks
 };
 
 class BatchProcessor {
@@ -33,7 +44,7 @@ public:
     ~BatchProcessor();
 
     // Submit a batch request for processing
-    std::future<std::vector<int>> submit_request(const BatchRequest& request);
+    std::future<Completions> submit_request(BatchRequest request);
 
     // Start processing requests
     void start();
@@ -44,14 +55,33 @@ public:
     // Get current queue size
     size_t queue_size() const;
 
+    // Feeds one token of a branch through the model, advancing its cache,
+    // and leaves the logits for the position after it
+    using NextLogits = std::function<void(int token, KVCache& cache, std::vector<float>& logits)>;
+
+    // Both start from one prefilled prompt and fork its KV cache per branch,
+    // so branches share the prompt's blocks and copy only what they rewrite
+    static BatchResult sample_completions(const BatchRequest& request, const KVCache& prompt_cache,
+                                          const std::vector<float>& prompt_logits,
+                                          const NextLogits& next_logits);
+    static BatchResult beam_search(const BatchRequest& request, KVCache prompt_cache,
+                                   const std::vector<float>& prompt_logits,
+                                   const NextLogits& next_logits);
+
 private:
     void processing_loop();
     std::vector<BatchResult> process_batch(const std::vector<BatchRequest>& requests);
 
+    // Prefills the prompt once and runs the request on this processor's model
+    BatchResult run_request(const BatchRequest& request);
+
+    // Prefill cache sized for the request; leaves the last position's logits
+    KVCache prefill(const BatchRequest& request, std::vector<float>& logits);
+
     size_t max_batch_size_;
     size_t queue_size_;
     std::queue<BatchRequest> request_queue_;
-    std::mutex queue_mutex_;
+    mutable std::mutex queue_mutex_;
     std::condition_variable queue_cv_;
     std::atomic<bool> running_;
 
@@ -0,0 +1,220 @@
+#include "json_schema.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+const char* kWhitespace = "[ ]?";
+// One character of a JSON string: ASCII other than quote, backslash and
+// controls, an escape, or a well-formed UTF-8 sequence. The DFA runs over
+// bytes, so non-ASCII is spelled out per lead byte rather than as [^...],
+// which would admit lone or overlong bytes; length bounds then count
+// characters, not bytes.
+const char* kStringChar =
+    R"((?:[^"\\\x00-\x1f\x80-\xff]|\\["\\/bfnrt]|\\u[0-9a-fA-F]{4})"
+    R"(|[\xc2-\xdf][\x80-\xbf]|\xe0[\xa0-\xbf][\x80-\xbf]|[\xe1-\xec\xee\xef][\x80-\xbf]{2})"
+    R"(|\xed[\x80-\x9f][\x80-\xbf]|\xf0[\x90-\xbf][\x80-\xbf]{2}|[\xf1-\xf3][\x80-\xbf]{3})"
+    R"(|\xf4[\x80-\x8f][\x80-\xbf]{2}))";
+const char* kInteger = "-?(?:0|[1-9][0-9]{0,15})";
+const char* kNumber = R"(-?(?:0|[1-9][0-9]{0,15})(?:\.[0-9]{1,16})?(?:[eE][+-]?[0-9]{1,3})?)";
+
+std::string escape_literal(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (std::string("\\.^$|?*+()[]{}").find(c) != std::string::npos) out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+// Compact JSON text of a literal value, as it must appear in the output
+std::string serialize(const JsonValue& value) {
+    switch (value.type) {
+        case JsonValue::Type::Null: return "null";
+        case JsonValue::Type::Bool: return value.boolean ? "true" : "false";
+        case JsonValue::Type::String: return json_quote(value.string);
+        case JsonValue::Type::Number: {
+            if (value.number == std::floor(value.number) && std::fabs(value.number) < 1e15) {
+                return std::to_string(static_cast<long long>(value.number));
+            }
+            std::ostringstream oss;
+            oss.precision(17);
+            oss << value.number;
+            return oss.str();
+        }
+        case JsonValue::Type::Array: {
+            std::string out = "[";
+            for (size_t i = 0; i < value.array.size(); ++i) {
+                out += (i ? "," : "") + serialize(value.array[i]);
+            }
+            return out + "]";
+        }
+        case JsonValue::Type::Object: {
+            std::string out = "{";
+            for (size_t i = 0; i < value.object.size(); ++i) {
+                out += (i ? "," : "") + json_quote(value.object[i].first) + ":" +
+                       serialize(value.object[i].second);
+            }
+            return out + "}";
+        }
+    }
+    return "null";
+}
+
+int count_field(const JsonValue& schema, const char* key, int fallback) {
+    const JsonValue* value = schema.find(key);
+    if (!value) return fallback;
+    if (value->type != JsonValue::Type::Number || value->number < 0 || value->number > 1000) {
+        throw std::runtime_error(std::string("json_schema_to_regex: bad ") + key);
+    }
+    return static_cast<int>(value->number);
+}
+
+std::string bounds(int min, int max) {
+    if (max < 0) return min == 0 ? "*" : "{" + std::to_string(min) + ",}";
+    return "{" + std::to_string(min) + "," + std::to_string(max) + "}";
+}
+
+std::string schema_regex(const JsonValue& schema, int depth);
+
+std::string object_regex(const JsonValue& schema, int depth) {
+    std::vector<std::string> members;
+    std::vector<bool> required;
+    if (const JsonValue* properties = schema.find("properties")) {
+        const JsonValue* required_list = schema.find("required");
+        for (const auto& property : properties->object) {
+            members.push_back(escape_literal(json_quote(property.first)) + kWhitespace + ":" +
+                              kWhitespace + schema_regex(property.second, depth + 1));
+            bool is_required = false;
+            if (required_list) {
+                for (const JsonValue& name : required_list->array) {
+                    is_required |= name.string == property.first;
+                }
+            }
+            required.push_back(is_required);
+        }
+    }
+
+    // Alternatives by which member comes first, so commas only ever
+    // separate members that are present. Nothing before a required member
+    // can be first.
+    std::string alternatives;
+    bool all_optional = true;
+    for (size_t first = 0; first < members.size(); ++first) {
+        std::string sequence = members[first];
+        for (size_t next = first + 1; next < members.size(); ++next) {
+            std::string tail = "(?:" + std::string(kWhitespace) + "," + kWhitespace + members[next] + ")";
+            sequence += required[next] ? tail : tail + "?";
+        }
+        alternatives += (first ? "|" : "") + sequence;
+        if (required[first]) {
+            all_optional = false;
+            break;
+        }
+    }
+
+    std::string body = alternatives.empty() ? "" : "(?:" + alternatives + ")" + (all_optional ? "?" : "");
+    return "\\{" + std::string(kWhitespace) + body + kWhitespace + "\\}";
+}
+
+std::string array_regex(const JsonValue& schema, int depth) {
+    const JsonValue* items = schema.find("items");
+    if (!items) {
+        throw std::runtime_error("json_schema_to_regex: arrays need an items schema");
+    }
+    std::string item = schema_regex(*items, depth + 1);
+    int min_items = count_field(schema, "minItems", 0);
+    int max_items = count_field(schema, "maxItems", -1);
+    if (max_items == 0) {
+        return "\\[" + std::string(kWhitespace) + "\\]";
+    }
+
+    std::string rest = "(?:" + std::string(kWhitespace) + "," + kWhitespace + item + ")" +
+                       bounds(std::max(min_items - 1, 0), max_items < 0 ? -1 : max_items - 1);
+    std::string body = "(?:" + item + rest + ")" + (min_items == 0 ? "?" : "");
+    return "\\[" + std::string(kWhitespace) + body + kWhitespace + "\\]";
+}
+
+std::string string_regex(const JsonValue& schema) {
+    if (const JsonValue* pattern = schema.find("pattern")) {
+        // JSON Schema patterns are unanchored; the common anchored form is
+        // what constrained output needs anyway
+        std::string body = pattern->string;
+        if (!body.empty() && body.front() == '^') body.erase(0, 1);
+        if (!body.empty() && body.back() == '$') body.pop_back();
+        return "\"(?:" + body + ")\"";
+    }
+    int min_length = count_field(schema, "minLength", 0);
+    int max_length = count_field(schema, "maxLength", -1);
+    return "\"" + std::string(kStringChar) + bounds(min_length, max_length) + "\"";
+}
+
+std::string type_regex(const std::string& type, const JsonValue& schema, int depth) {
+    if (type == "string") return string_regex(schema);
+    if (type == "integer") return kInteger;
+    if (type == "number") return kNumber;
+    if (type == "boolean") return "(?:true|false)";
+    if (type == "null") return "null";
+    if (type == "array") return array_regex(schema, depth);
+    if (type == "object") return object_regex(schema, depth);
+    throw std::runtime_error("json_schema_to_regex: unknown type \"" + type + "\"");
+}
+
+std::string schema_regex(const JsonValue& schema, int depth) {
+    if (depth > 32) {
+        throw std::runtime_error("json_schema_to_regex: schema nested too deeply");
+    }
+    if (!schema.is_object()) {
+        throw std::runtime_error("json_schema_to_regex: schema must be an object");
+    }
+    if (schema.find("$ref")) {
+        throw std::runtime_error("json_schema_to_regex: $ref is not supported");
+    }
+
+    if (const JsonValue* constant = schema.find("const")) {
+        return escape_literal(serialize(*constant));
+    }
+    if (const JsonValue* values = schema.find("enum")) {
+        std::string out;
+        for (size_t i = 0; i < values->array.size(); ++i) {
+            out += (i ? "|" : "") + escape_literal(serialize(values->array[i]));
+        }
+        return "(?:" + out + ")";
+    }
+    for (const char* key : {"anyOf", "oneOf"}) {
+        if (const JsonValue* options = schema.find(key)) {
+            std::string out;
+            for (size_t i = 0; i < options->array.size(); ++i) {
+                out += (i ? "|" : "") + schema_regex(options->array[i], depth + 1);
+            }
+            return "(?:" + out + ")";
+        }
+    }
+
+    const JsonValue* type = schema.find("type");
+    if (!type) {
+        if (schema.find("properties")) return object_regex(schema, depth);
+        if (schema.find("items")) return array_regex(schema, depth);
+        throw std::runtime_error("json_schema_to_regex: a schema accepting any value is not supported");
+    }
+    if (type->is_array()) {
+        std::string out;
+        for (size_t i = 0; i < type->array.size(); ++i) {
+            out += (i ? "|" : "") + type_regex(type->array[i].string, schema, depth);
+        }
+        return "(?:" + out + ")";
+    }
+    return type_regex(type->string, schema, depth);
+}
+
+} // namespace
+
+std::string json_schema_to_regex(const JsonValue& schema) {
+    return schema_regex(schema, 0);
+}
+
+std::string json_schema_to_regex(const std::string& schema_json) {
+    return json_schema_to_regex(parse_json(schema_json));
+}
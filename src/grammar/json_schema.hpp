@@ -0,0 +1,20 @@
+#ifndef JSON_SCHEMA_HPP
+#define JSON_SCHEMA_HPP
+
+#include "../util/json.hpp"
+#include <string>
+
+// Regular expression (RegexDFA syntax) matching the JSON documents a
+// schema accepts, for constrained decoding. Supported: type (string,
+// integer, number, boolean, null, array, object, or a list of these),
+// enum, const, anyOf/oneOf, string minLength/maxLength/pattern, array
+// items/minItems/maxItems, and object properties/required. Object
+// members are emitted in the schema's property order, optional ones may
+// be left out, and no others are allowed. Recursive schemas ($ref) and
+// schemas that accept any value are not regular and throw
+// std::runtime_error. Numbers are capped at 16 digits so generation
+// always has a way to finish them.
+std::string json_schema_to_regex(const JsonValue& schema);
+std::string json_schema_to_regex(const std::string& schema_json);
+
+#endif // JSON_SCHEMA_HPP
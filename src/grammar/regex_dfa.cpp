@@ -0,0 +1,384 @@
+#include "regex_dfa.hpp"
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <stdexcept>
+
+namespace {
+
+using ByteSet = std::bitset<256>;
+
+struct Node {
+    enum Kind { Set, Concat, Alt, Repeat };
+
+    explicit Node(Kind k) : kind(k) {}
+
+    Kind kind;
+    ByteSet set;
+    std::vector<int> children;
+    int min = 1;
+    int max = 1;  // -1 is unbounded
+};
+
+constexpr int kMaxRepeat = 1000;
+
+class Parser {
+public:
+    explicit Parser(const std::string& pattern) : pattern_(pattern) {}
+
+    int parse(std::vector<Node>& nodes) {
+        nodes_ = &nodes;
+        int root = parse_alternation();
+        if (pos_ != pattern_.size()) fail("unmatched ')'");
+        return root;
+    }
+
+private:
+    [[noreturn]] void fail(const std::string& what) const {
+        throw std::runtime_error("RegexDFA: " + what + " at offset " + std::to_string(pos_) +
+                                 " in \"" + pattern_ + "\"");
+    }
+
+    bool at_end() const { return pos_ >= pattern_.size(); }
+    char peek() const { return pattern_[pos_]; }
+
+    int add(Node node) {
+        nodes_->push_back(std::move(node));
+        return static_cast<int>(nodes_->size()) - 1;
+    }
+
+    int parse_alternation() {
+        Node alt{Node::Alt};
+        alt.children.push_back(parse_concatenation());
+        while (!at_end() && peek() == '|') {
+            ++pos_;
+            alt.children.push_back(parse_concatenation());
+        }
+        return alt.children.size() == 1 ? alt.children[0] : add(std::move(alt));
+    }
+
+    int parse_concatenation() {
+        Node concat{Node::Concat};
+        while (!at_end() && peek() != '|' && peek() != ')') {
+            concat.children.push_back(parse_repeat());
+        }
+        return concat.children.size() == 1 ? concat.children[0] : add(std::move(concat));
+    }
+
+    int parse_repeat() {
+        int atom = parse_atom();
+        while (!at_end()) {
+            int min, max;
+            char c = peek();
+            if (c == '*') { min = 0; max = -1; ++pos_; }
+            else if (c == '+') { min = 1; max = -1; ++pos_; }
+            else if (c == '?') { min = 0; max = 1; ++pos_; }
+            else if (c == '{') { parse_bounds(min, max); }
+            else break;
+
+            Node repeat{Node::Repeat};
+            repeat.children.push_back(atom);
+            repeat.min = min;
+            repeat.max = max;
+            atom = add(std::move(repeat));
+        }
+        return atom;
+    }
+
+    void parse_bounds(int& min, int& max) {
+        ++pos_;  // '{'
+        min = parse_number();
+        max = min;
+        if (!at_end() && peek() == ',') {
+            ++pos_;
+            max = !at_end() && peek() == '}' ? -1 : parse_number();
+        }
+        if (at_end() || peek() != '}') fail("expected '}'");
+        ++pos_;
+        if (min > kMaxRepeat || max > kMaxRepeat || (max >= 0 && max < min)) {
+            fail("bad repetition bounds");
+        }
+    }
+
+    int parse_number() {
+        size_t start = pos_;
+        while (!at_end() && peek() >= '0' && peek() <= '9') ++pos_;
+        if (pos_ == start || pos_ - start > 4) fail("expected a repetition count");
+        return std::stoi(pattern_.substr(start, pos_ - start));
+    }
+
+    int parse_atom() {
+        if (at_end()) fail("expected an expression");
+        char c = pattern_[pos_++];
+        Node set{Node::Set};
+        switch (c) {
+            case '(': {
+                if (pattern_.compare(pos_, 2, "?:") == 0) pos_ += 2;
+                int inner = parse_alternation();
+                if (at_end() || peek() != ')') fail("expected ')'");
+                ++pos_;
+                return inner;
+            }
+            case '[':
+                set.set = parse_class();
+                break;
+            case '.':
+                set.set.set();
+                set.set.reset('\n');
+                break;
+            case '\\':
+                set.set = parse_escape();
+                break;
+            case '*': case '+': case '?': case '{':
+                --pos_;
+                fail("quantifier without an expression");
+            default:
+                set.set.set(static_cast<uint8_t>(c));
+        }
+        return add(std::move(set));
+    }
+
+    // After '\': a class shorthand or one literal byte
+    ByteSet parse_escape() {
+        if (at_end()) fail("trailing '\\'");
+        char c = pattern_[pos_++];
+        ByteSet set;
+        auto range = [&set](int lo, int hi) { for (int b = lo; b <= hi; ++b) set.set(b); };
+        switch (c) {
+            case 'd': case 'D': range('0', '9'); break;
+            case 'w': case 'W': range('0', '9'); range('a', 'z'); range('A', 'Z'); set.set('_'); break;
+            case 's': case 'S': for (char w : {' ', '\t', '\n', '\r', '\f', '\v'}) set.set(static_cast<uint8_t>(w)); break;
+            case 'n': set.set('\n'); return set;
+            case 't': set.set('\t'); return set;
+            case 'r': set.set('\r'); return set;
+            case 'f': set.set('\f'); return set;
+            case 'v': set.set('\v'); return set;
+            case 'x': {
+                if (pos_ + 2 > pattern_.size()) fail("expected two hex digits");
+                set.set(std::stoi(pattern_.substr(pos_, 2), nullptr, 16));
+                pos_ += 2;
+                return set;
+            }
+            default:
+                set.set(static_cast<uint8_t>(c));
+                return set;
+        }
+        if (c == 'D' || c == 'W' || c == 'S') set.flip();
+        return set;
+    }
+
+    ByteSet parse_class() {
+        ByteSet set;
+        bool negate = !at_end() && peek() == '^';
+        if (negate) ++pos_;
+
+        bool first = true;
+        while (!at_end() && (peek() != ']' || first)) {
+            first = false;
+            int lo;
+            if (peek() == '\\') {
+                ++pos_;
+                ByteSet escaped = parse_escape();
+                if (escaped.count() != 1) {  // \d and friends can't start a range
+                    set |= escaped;
+                    continue;
+                }
+                lo = static_cast<int>(escaped._Find_first());
+            } else {
+                lo = static_cast<uint8_t>(pattern_[pos_++]);
+            }
+
+            int hi = lo;
+            if (pos_ + 1 < pattern_.size() && peek() == '-' && pattern_[pos_ + 1] != ']') {
+                ++pos_;
+                if (peek() == '\\') {
+                    ++pos_;
+                    ByteSet escaped = parse_escape();
+                    if (escaped.count() != 1) fail("bad class range");
+                    hi = static_cast<int>(escaped._Find_first());
+                } else {
+                    hi = static_cast<uint8_t>(pattern_[pos_++]);
+                }
+                if (hi < lo) fail("bad class range");
+            }
+            for (int b = lo; b <= hi; ++b) set.set(b);
+        }
+        if (at_end()) fail("expected ']'");
+        ++pos_;
+        return negate ? ~set : set;
+    }
+
+    const std::string& pattern_;
+    size_t pos_ = 0;
+    std::vector<Node>* nodes_ = nullptr;
+};
+
+// Thompson NFA: each state has epsilon edges and at most one byte-set edge
+struct NFA {
+    struct State {
+        std::vector<int> epsilon;
+        int set = -1;  // Index into sets
+        int target = -1;
+    };
+    std::vector<State> states;
+    std::vector<ByteSet> sets;
+
+    int add_state() {
+        states.emplace_back();
+        return static_cast<int>(states.size()) - 1;
+    }
+
+    // Returns (start, end) of a fragment matching node
+    std::pair<int, int> build(const std::vector<Node>& nodes, int index) {
+        const Node& node = nodes[index];
+        int start = add_state();
+        int end = add_state();
+        switch (node.kind) {
+            case Node::Set:
+                states[start].set = static_cast<int>(sets.size());
+                states[start].target = end;
+                sets.push_back(node.set);
+                break;
+            case Node::Concat: {
+                int tail = start;
+                for (int child : node.children) {
+                    auto fragment = build(nodes, child);
+                    states[tail].epsilon.push_back(fragment.first);
+                    tail = fragment.second;
+                }
+                states[tail].epsilon.push_back(end);
+                break;
+            }
+            case Node::Alt:
+                for (int child : node.children) {
+                    auto fragment = build(nodes, child);
+                    states[start].epsilon.push_back(fragment.first);
+                    states[fragment.second].epsilon.push_back(end);
+                }
+                break;
+            case Node::Repeat: {
+                int tail = start;
+                for (int i = 0; i < node.min; ++i) {
+                    auto fragment = build(nodes, node.children[0]);
+                    states[tail].epsilon.push_back(fragment.first);
+                    tail = fragment.second;
+                }
+                if (node.max < 0) {
+                    auto fragment = build(nodes, node.children[0]);
+                    states[tail].epsilon.push_back(fragment.first);
+                    states[fragment.second].epsilon.push_back(fragment.first);
+                    states[fragment.second].epsilon.push_back(end);
+                } else {
+                    // Each optional copy may be skipped straight to the end
+                    for (int i = node.min; i < node.max; ++i) {
+                        auto fragment = build(nodes, node.children[0]);
+                        states[tail].epsilon.push_back(fragment.first);
+                        states[tail].epsilon.push_back(end);
+                        tail = fragment.second;
+                    }
+                }
+                states[tail].epsilon.push_back(end);
+                break;
+            }
+        }
+        return {start, end};
+    }
+
+    void closure(std::vector<int>& set) const {
+        std::vector<bool> seen(states.size(), false);
+        std::vector<int> stack = set;
+        for (int s : set) seen[s] = true;
+        while (!stack.empty()) {
+            int s = stack.back();
+            stack.pop_back();
+            for (int next : states[s].epsilon) {
+                if (!seen[next]) {
+                    seen[next] = true;
+                    set.push_back(next);
+                    stack.push_back(next);
+                }
+            }
+        }
+        std::sort(set.begin(), set.end());
+    }
+};
+
+} // namespace
+
+RegexDFA::RegexDFA(const std::string& pattern, int max_states) {
+    std::vector<Node> nodes;
+    int root = pattern.empty() ? -1 : Parser(pattern).parse(nodes);
+
+    NFA nfa;
+    int start, accept;
+    if (root < 0) {
+        start = nfa.add_state();
+        accept = start;
+    } else {
+        std::tie(start, accept) = nfa.build(nodes, root);
+    }
+
+    // Bytes no set tells apart share one column of the subset construction
+    std::vector<int> byte_class(256, 0);
+    int num_classes = 1;
+    for (const ByteSet& set : nfa.sets) {
+        std::map<std::pair<int, bool>, int> refined;
+        for (int b = 0; b < 256; ++b) {
+            auto key = std::make_pair(byte_class[b], static_cast<bool>(set[b]));
+            auto it = refined.emplace(key, static_cast<int>(refined.size())).first;
+            byte_class[b] = it->second;
+        }
+        num_classes = static_cast<int>(refined.size());
+    }
+    std::vector<int> representative(num_classes, -1);
+    for (int b = 0; b < 256; ++b) {
+        if (representative[byte_class[b]] < 0) representative[byte_class[b]] = b;
+    }
+
+    std::map<std::vector<int>, int> ids;
+    std::vector<std::vector<int>> pending;
+    std::vector<int> initial = {start};
+    nfa.closure(initial);
+    ids.emplace(initial, 0);
+    pending.push_back(initial);
+    accepting_.push_back(std::binary_search(initial.begin(), initial.end(), accept));
+    transitions_.assign(256, kDead);
+
+    for (size_t current = 0; current < pending.size(); ++current) {
+        std::vector<int> source = pending[current];
+        for (int cls = 0; cls < num_classes; ++cls) {
+            int byte = representative[cls];
+            std::vector<int> moved;
+            for (int s : source) {
+                const NFA::State& state = nfa.states[s];
+                if (state.set >= 0 && nfa.sets[state.set][byte]) moved.push_back(state.target);
+            }
+            if (moved.empty()) continue;
+            nfa.closure(moved);
+            moved.erase(std::unique(moved.begin(), moved.end()), moved.end());
+
+            auto it = ids.find(moved);
+            if (it == ids.end()) {
+                if (static_cast<int>(ids.size()) >= max_states) {
+                    throw std::runtime_error("RegexDFA: pattern needs more than " +
+                                             std::to_string(max_states) + " states");
+                }
+                it = ids.emplace(moved, static_cast<int>(ids.size())).first;
+                accepting_.push_back(std::binary_search(moved.begin(), moved.end(), accept));
+                transitions_.resize(transitions_.size() + 256, kDead);
+                pending.push_back(moved);
+            }
+            for (int b = 0; b < 256; ++b) {
+                if (byte_class[b] == cls) transitions_[current * 256 + b] = it->second;
+            }
+        }
+    }
+}
+
+int RegexDFA::walk(int state, const std::string& bytes) const {
+    for (char c : bytes) {
+        if (state == kDead) break;
+        state = next(state, static_cast<uint8_t>(c));
+    }
+    return state;
+}
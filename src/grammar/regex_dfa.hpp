@@ -0,0 +1,46 @@
+#ifndef REGEX_DFA_HPP
+#define REGEX_DFA_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Deterministic automaton over bytes compiled from a regular expression
+// (Thompson NFA, then subset construction). The whole pattern must match,
+// i.e. it is implicitly anchored at both ends.
+//
+// Supported syntax: literals, '.', escapes (\d \w \s \D \W \S \n \t \r
+// \xHH and escaped metacharacters), classes with ranges and negation
+// ([a-z_], [^"\\]), groups ((...) and (?:...)), alternation, and the
+// quantifiers * + ? {n} {n,} {n,m}. Patterns work on bytes, so UTF-8
+// literals match as byte sequences and '.' or a negated class accepts
+// any single byte, letting multi-byte characters through.
+class RegexDFA {
+public:
+    static constexpr int kDead = -1;
+
+    // Throws std::runtime_error on syntax errors or past max_states
+    explicit RegexDFA(const std::string& pattern, int max_states = 1 << 16);
+
+    int initial_state() const { return 0; }
+    int num_states() const { return static_cast<int>(accepting_.size()); }
+
+    int next(int state, uint8_t byte) const {
+        return transitions_[static_cast<size_t>(state) * 256 + byte];
+    }
+    bool is_accepting(int state) const { return accepting_[state]; }
+
+    // State after consuming bytes, or kDead
+    int walk(int state, const std::string& bytes) const;
+
+    bool matches(const std::string& text) const {
+        int state = walk(initial_state(), text);
+        return state != kDead && is_accepting(state);
+    }
+
+private:
+    std::vector<int> transitions_;  // num_states x 256, kDead where no match is possible
+    std::vector<bool> accepting_;
+};
+
+#endif // REGEX_DFA_HPP
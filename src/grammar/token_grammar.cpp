@@ -0,0 +1,56 @@
+#include "token_grammar.hpp"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+TokenGrammar::TokenGrammar(RegexDFA dfa, const std::vector<std::string>& token_bytes,
+                           int eos_token_id)
+    : dfa_(std::move(dfa)), tokens_(token_bytes), eos_token_id_(eos_token_id),
+      vocab_size_(static_cast<int>(token_bytes.size())),
+      words_((static_cast<int>(token_bytes.size()) + 63) / 64) {
+    // Visiting tokens in byte order walks a virtual trie: each token only
+    // re-walks the bytes past its common prefix with the previous one
+    std::vector<int> order;
+    for (int id = 0; id < vocab_size_; ++id) {
+        if (!tokens_[id].empty() && id != eos_token_id_) order.push_back(id);
+    }
+    std::sort(order.begin(), order.end(),
+              [this](int a, int b) { return tokens_[a] < tokens_[b]; });
+
+    std::vector<size_t> shared(order.size(), 0);
+    for (size_t i = 1; i < order.size(); ++i) {
+        const std::string& a = tokens_[order[i - 1]];
+        const std::string& b = tokens_[order[i]];
+        auto mismatch = std::mismatch(a.begin(), a.end(), b.begin(), b.end());
+        shared[i] = static_cast<size_t>(mismatch.first - a.begin());
+    }
+
+    masks_.assign(static_cast<size_t>(dfa_.num_states()) * words_, 0);
+    std::vector<int> path;  // path[d]: state after the first d bytes of the current token
+    for (int state = 0; state < dfa_.num_states(); ++state) {
+        uint64_t* bits = masks_.data() + static_cast<size_t>(state) * words_;
+        path.assign(1, state);
+        for (size_t i = 0; i < order.size(); ++i) {
+            const std::string& bytes = tokens_[order[i]];
+            path.resize(std::min(path.size(), shared[i] + 1));
+            while (path.size() <= bytes.size() && path.back() != RegexDFA::kDead) {
+                path.push_back(dfa_.next(path.back(), static_cast<uint8_t>(bytes[path.size() - 1])));
+            }
+            // A dead prefix stays on the path so tokens sharing it fail fast
+            if (path.size() == bytes.size() + 1 && path.back() != RegexDFA::kDead) {
+                bits[order[i] >> 6] |= uint64_t{1} << (order[i] & 63);
+            }
+        }
+        if (eos_token_id_ >= 0 && eos_token_id_ < vocab_size_ && dfa_.is_accepting(state)) {
+            bits[eos_token_id_ >> 6] |= uint64_t{1} << (eos_token_id_ & 63);
+        }
+    }
+}
+
+int TokenGrammar::next_state(int state, int token) const {
+    if (!allows(state, token)) {
+        throw std::runtime_error("TokenGrammar: token " + std::to_string(token) +
+                                 " is not allowed here");
+    }
+    return token == eos_token_id_ ? state : dfa_.walk(state, tokens_[token]);
+}
@@ -0,0 +1,47 @@
+#ifndef TOKEN_GRAMMAR_HPP
+#define TOKEN_GRAMMAR_HPP
+
+#include "regex_dfa.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Lifts a byte-level RegexDFA to a tokenizer vocabulary for constrained
+// decoding. For every DFA state the set of tokens whose bytes keep the
+// match alive is precomputed once as a bitmask, so each decode step costs
+// one apply_token_mask() over the logits and a walk over the sampled
+// token's bytes. EOS is allowed only where the text so far is a full
+// match; tokens with no bytes (other special tokens) are never allowed.
+class TokenGrammar {
+public:
+    // token_bytes[id] is what token id appends to the output
+    TokenGrammar(RegexDFA dfa, const std::vector<std::string>& token_bytes, int eos_token_id);
+
+    int initial_state() const { return dfa_.initial_state(); }
+    int vocab_size() const { return vocab_size_; }
+    bool is_accepting(int state) const { return dfa_.is_accepting(state); }
+
+    // words_per_mask() uint64 words, bit t of word t / 64 set when allowed
+    const uint64_t* mask(int state) const {
+        return masks_.data() + static_cast<size_t>(state) * words_;
+    }
+    int words_per_mask() const { return words_; }
+
+    bool allows(int state, int token) const {
+        return token >= 0 && token < vocab_size_ && ((mask(state)[token >> 6] >> (token & 63)) & 1);
+    }
+
+    // State after emitting an allowed token; EOS leaves it unchanged.
+    // Throws std::runtime_error for a token the mask rules out.
+    int next_state(int state, int token) const;
+
+private:
+    RegexDFA dfa_;
+    std::vector<std::string> tokens_;
+    int eos_token_id_;
+    int vocab_size_;
+    int words_;
+    std::vector<uint64_t> masks_;  // num_states x words_
+};
+
+#endif // TOKEN_GRAMMAR_HPP
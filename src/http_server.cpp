@@ -1,40 +1,149 @@
 #include "http_server.hpp"
+#include "loaders/onnx_loader.hpp"
+#include "tokenizer/streaming_decoder.hpp"
+#include "util/profiler.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <cstring>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
-#include <json.hpp> // Assuming nlohmann/json or similar
 
 // For now, we'll use a simple JSON-like response format
 namespace {
-    std::string create_json_response(const std::string& status, const std::string& message = "") {
+    constexpr size_t kMaxHeaderBytes = 64 * 1024;
+    constexpr size_t kMaxBodyBytes = 16 * 1024 * 1024;
+
+    std::string json_escape(const std::string& s) {
+        std::string out;
+        for (char c : s) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) >= 0x20) out += c;
+            }
+        }
+        return out;
+    }
+
+    std::string http_response(const std::string& status, const std::string& content_type,
+                              const std::string& body, bool keep_alive) {
         std::ostringstream oss;
-        oss << "HTTP/1.1 200 OK\r\n";
-        oss << "Content-Type: application/json\r\n";
+        oss << "HTTP/1.1 " << status << "\r\n";
+        oss << "Content-Type: " << content_type << "\r\n";
         oss << "Access-Control-Allow-Origin: *\r\n";
+        oss << "Content-Length: " << body.size() << "\r\n";
+        oss << "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n";
         oss << "\r\n";
+        oss << body;
+        return oss.str();
+    }
+
+    std::string create_json_response(const std::string& status, const std::string& message,
+                                     bool keep_alive, const std::string& http_status = "200 OK") {
+        std::ostringstream oss;
         oss << "{\n";
         oss << "  \"status\": \"" << status << "\"";
         if (!message.empty()) {
-            oss << ",\n  \"message\": \"" << message << "\"";
+            oss << ",\n  \"message\": \"" << json_escape(message) << "\"";
         }
         oss << "\n}\n";
-        return oss.str();
+        return http_response(http_status, "application/json", oss.str(), keep_alive);
     }
 
-    std::string create_completion_response(const std::string& text) {
+    std::string create_completion_response(const std::string& text, size_t num_tokens,
+                                           bool keep_alive) {
         std::ostringstream oss;
-        oss << "HTTP/1.1 200 OK\r\n";
-        oss << "Content-Type: application/json\r\n";
-        oss << "Access-Control-Allow-Origin: *\r\n";
-        oss << "\r\n";
         oss << "{\n";
-        oss << "  \"text\": \"" << text << "\"\n";
+        oss << "  \"text\": \"" << json_escape(text) << "\",\n";
+        oss << "  \"tokens\": " << num_tokens << "\n";
         oss << "}\n";
-        return oss.str();
+        return http_response("200 OK", "application/json", oss.str(), keep_alive);
+    }
+
+    bool send_all(int socket, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // One chunk of a Transfer-Encoding: chunked body
+    bool send_chunk(int socket, const std::string& data) {
+        std::ostringstream oss;
+        oss << std::hex << data.size() << "\r\n" << data << "\r\n";
+        return send_all(socket, oss.str());
+    }
+
+    // Minimal field extraction from a flat JSON object
+    size_t find_json_value(const std::string& body, const std::string& key) {
+        size_t pos = body.find("\"" + key + "\"");
+        if (pos == std::string::npos) return std::string::npos;
+        pos = body.find(':', pos + key.size() + 2);
+        if (pos == std::string::npos) return std::string::npos;
+        return body.find_first_not_of(" \t\r\n", pos + 1);
+    }
+
+    bool json_string_field(const std::string& body, const std::string& key, std::string& out) {
+        size_t pos = find_json_value(body, key);
+        if (pos == std::string::npos || body[pos] != '"') return false;
+        out.clear();
+        for (size_t i = pos + 1; i < body.size(); ++i) {
+            if (body[i] == '\\' && i + 1 < body.size()) {
+                char c = body[++i];
+                out += (c == 'n') ? '\n' : (c == 't') ? '\t' : c;
+            } else if (body[i] == '"') {
+                return true;
+            } else {
+                out += body[i];
+            }
+        }
+        return false;
+    }
+
+    int json_int_field(const std::string& body, const std::string& key, int fallback) {
+        size_t pos = find_json_value(body, key);
+        if (pos == std::string::npos) return fallback;
+        try {
+            return std::stoi(body.substr(pos, 16));
+        } catch (const std::exception&) {
+            return fallback;
+        }
+    }
+
+    bool json_bool_field(const std::string& body, const std::string& key, bool fallback) {
+        size_t pos = find_json_value(body, key);
+        if (pos == std::string::npos) return fallback;
+        return body.compare(pos, 4, "true") == 0;
+    }
+
+    std::string query_param(const std::string& query, const std::string& name) {
+        size_t pos = 0;
+        while (pos < query.size()) {
+            size_t end = query.find('&', pos);
+            if (end == std::string::npos) end = query.size();
+            std::string pair = query.substr(pos, end - pos);
+            size_t eq = pair.find('=');
+            if (pair.substr(0, eq) == name) {
+                return eq == std::string::npos ? "" : pair.substr(eq + 1);
+            }
+            pos = end + 1;
+        }
+        return "";
     }
 }
 
@@ -51,6 +160,9 @@ void HTTPServer::start() {
         throw std::runtime_error("Failed to create socket");
     }
 
+    int reuse = 1;
+    setsockopt(server_socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
     // Bind to port
     sockaddr_in server_addr;
     memset(&server_addr, 0, sizeof(server_addr));
@@ -63,8 +175,13 @@ void HTTPServer::start() {
         throw std::runtime_error("Failed to bind to port " + std::to_string(port_));
     }
 
-    // Listen for connections
-    if (listen(server_socket_, 5) < 0) {
+    socklen_t addr_len = sizeof(server_addr);
+    if (getsockname(server_socket_, (sockaddr*)&server_addr, &addr_len) == 0) {
+        port_ = ntohs(server_addr.sin_port);
+    }
+
+    // Listen for connections; load tests open many at once
+    if (listen(server_socket_, SOMAXCONN) < 0) {
         close(server_socket_);
         throw std::runtime_error("Failed to listen on socket");
     }
@@ -72,21 +189,72 @@ void HTTPServer::start() {
     running_ = true;
     server_thread_ = std::make_unique<std::thread>(&HTTPServer::server_loop, this);
 
+#ifdef ENABLE_PROFILING
+    // Keeps the last seconds of events available to /trace
+    Profiler::instance().start_collector();
+#endif
+
     std::cout << "🚀 HTTP server started on port " << port_ << std::endl;
 }
 
 void HTTPServer::stop() {
-    running_ = false;
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    // Unblock accept() and every connection blocked in recv()
+    if (server_socket_ >= 0) {
+        shutdown(server_socket_, SHUT_RDWR);
+    }
     if (server_thread_ && server_thread_->joinable()) {
         server_thread_->join();
     }
+
+    std::unique_lock<std::mutex> lock(connections_mutex_);
+    for (int client_socket : client_sockets_) {
+        shutdown(client_socket, SHUT_RDWR);
+    }
+    connections_cv_.wait(lock, [this]() { return client_sockets_.empty(); });
+    lock.unlock();
+
     if (server_socket_ >= 0) {
         close(server_socket_);
         server_socket_ = -1;
     }
 }
 
+void HTTPServer::load_model(const std::string& model_path, const std::string& tokenizer_path) {
+    std::unordered_map<std::string, Tensor> weights;
+    if (!model_path.empty() && model_path != "dummy") {
+        weights = load_onnx_initializers(model_path);
+    }
+    if (weights.empty()) {
+        std::cout << "Warning: No initializers loaded. Using dummy model for serving.\n";
+    }
+
+    ModelWeights model_weights{std::move(weights)};
+    auto transformer = std::make_unique<Transformer>(model_weights);
+    // A GGUF model carries its own vocabulary
+    bool gguf = model_path.size() > 5 && model_path.compare(model_path.size() - 5, 5, ".gguf") == 0;
+    auto tokenizer = std::make_shared<const Tokenizer>(
+        tokenizer_path.empty() && gguf ? model_path : tokenizer_path);
+
+    std::lock_guard<std::mutex> lock(model_mutex_);
+    transformer_ = std::move(transformer);
+    tokenizer_ = std::move(tokenizer);
+    if (sessions_ && !current_model_path_.empty() && current_model_path_ != model_path) {
+        sessions_->clear();  // Caches of another model's weights
+    }
+    current_model_path_ = model_path;
+    model_loaded_ = true;
+}
+
+void HTTPServer::enable_sessions(const SessionCacheConfig& config) {
+    sessions_ = std::make_unique<SessionCache>(config);
+}
+
 void HTTPServer::server_loop() {
+    PROFILE_THREAD_NAME("http accept");
     std::cout << "HTTP server listening for connections..." << std::endl;
 
     while (running_) {
@@ -101,87 +269,528 @@ void HTTPServer::server_loop() {
             continue;
         }
 
-        // Handle client request in a simple way
-        char buffer[4096];
-        memset(buffer, 0, sizeof(buffer));
-
-        ssize_t bytes_read = read(client_socket, buffer, sizeof(buffer) - 1);
-        if (bytes_read > 0) {
-            std::string request(buffer, bytes_read);
-            std::string response = handle_request(request);
+        // Streamed tokens are small writes; don't let Nagle hold them back
+        int no_delay = 1;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
 
-            write(client_socket, response.c_str(), response.length());
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            client_sockets_.insert(client_socket);
         }
+        std::thread(&HTTPServer::handle_connection, this, client_socket).detach();
+    }
+}
 
-        close(client_socket);
+void HTTPServer::handle_connection(int client_socket) {
+    PROFILE_THREAD_NAME("http connection " + std::to_string(client_socket));
+    std::string buffer;
+    HTTPRequest request;
+
+    try {
+        while (running_ && read_request(client_socket, buffer, request)) {
+            handle_request(client_socket, request);
+            if (!request.keep_alive) {
+                break;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Connection error: " << e.what() << std::endl;
     }
+
+    close(client_socket);
+
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    client_sockets_.erase(client_socket);
+    connections_cv_.notify_all();
 }
 
-std::string HTTPServer::handle_request(const std::string& request) {
-    std::istringstream iss(request);
-    std::string method, path, http_version;
+bool HTTPServer::read_request(int client_socket, std::string& buffer, HTTPRequest& request) {
+    char chunk[4096];
+
+    // Headers; buffer may already hold a pipelined request
+    size_t header_end;
+    while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (buffer.size() > kMaxHeaderBytes) return false;
+        ssize_t n = recv(client_socket, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+
+    request = HTTPRequest();
+    std::istringstream head(buffer.substr(0, header_end));
+    std::string target;
+    head >> request.method >> target >> request.version;
+
+    size_t query_pos = target.find('?');
+    request.path = target.substr(0, query_pos);
+    if (query_pos != std::string::npos) {
+        request.query = target.substr(query_pos + 1);
+    }
+
+    std::string line;
+    std::getline(head, line);
+    while (std::getline(head, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        size_t value_start = line.find_first_not_of(" \t", colon + 1);
+        request.headers[name] = value_start == std::string::npos ? "" : line.substr(value_start);
+    }
+
+    // HTTP/1.1 defaults to keep-alive, HTTP/1.0 to close
+    auto connection = request.headers.find("connection");
+    std::string connection_value = connection != request.headers.end() ? connection->second : "";
+    std::transform(connection_value.begin(), connection_value.end(), connection_value.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    request.keep_alive = request.version == "HTTP/1.0" ? connection_value == "keep-alive"
+                                                       : connection_value != "close";
+
+    size_t content_length = 0;
+    auto length = request.headers.find("content-length");
+    if (length != request.headers.end()) {
+        content_length = std::stoul(length->second);
+        if (content_length > kMaxBodyBytes) return false;
+    }
+
+    size_t body_start = header_end + 4;
+    while (buffer.size() < body_start + content_length) {
+        ssize_t n = recv(client_socket, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+
+    request.body = buffer.substr(body_start, content_length);
+    buffer.erase(0, body_start + content_length);
+    return true;
+}
 
-    iss >> method >> path >> http_version;
+void HTTPServer::handle_request(int client_socket, const HTTPRequest& request) {
+    const std::string& path = request.path;
+    bool keep_alive = request.keep_alive;
 
     // Simple routing
     if (path == "/health") {
-        return create_json_response("healthy");
+        send_all(client_socket, create_json_response("healthy", "", keep_alive));
+        return;
     }
     else if (path == "/load") {
-        // Extract model path from query parameters (simplified)
-        size_t model_pos = request.find("model=");
-        if (model_pos != std::string::npos) {
-            size_t start = model_pos + 6;
-            size_t end = request.find("&", start);
-            if (end == std::string::npos) end = request.find(" ", start);
-            std::string model_path = request.substr(start, end - start);
-
-            try {
-                // Load model (simplified - would need proper implementation)
-                model_loaded_ = true;
-                current_model_path_ = model_path;
-                return create_json_response("loaded", "Model loaded successfully");
-            } catch (const std::exception& e) {
-                return create_json_response("error", e.what());
-            }
+        std::string model_path = query_param(request.query, "model");
+        try {
+            load_model(model_path, query_param(request.query, "tokenizer"));
+            send_all(client_socket, create_json_response("loaded", "Model loaded successfully", keep_alive));
+        } catch (const std::exception& e) {
+            send_all(client_socket, create_json_response("error", e.what(), keep_alive,
+                                                         "500 Internal Server Error"));
+        }
+        return;
+    }
+    else if (path == "/trace") {
+        // Chrome/Perfetto trace of the last N seconds; open in ui.perfetto.dev
+        double seconds = 10.0;
+        std::string seconds_param = query_param(request.query, "seconds");
+        if (!seconds_param.empty()) {
+            seconds = std::atof(seconds_param.c_str());
+        }
+        std::ostringstream trace;
+        Profiler::instance().write_chrome_trace(trace, seconds);
+        send_all(client_socket, http_response("200 OK", "application/json", trace.str(), keep_alive));
+        return;
+    }
+    else if (path == "/metrics") {
+        send_all(client_socket, http_response("200 OK", "text/plain; version=0.0.4",
+                                              render_metrics(), keep_alive));
+        return;
+    }
+    else if (path == "/generate" && request.method == "POST") {
+        handle_generate(client_socket, request);
+        return;
+    }
+
+    // Default response
+    send_all(client_socket, http_response("404 Not Found", "application/json",
+                                          "{\n  \"error\": \"Endpoint not found\"\n}\n", keep_alive));
+}
+
+void HTTPServer::handle_generate(int client_socket, const HTTPRequest& request) {
+    bool keep_alive = request.keep_alive;
+    PROFILE_REQUEST(next_request_id_++);
+
+    if (!model_loaded_) {
+        send_all(client_socket, create_json_response("error", "No model loaded", keep_alive,
+                                                     "503 Service Unavailable"));
+        return;
+    }
+
+    std::string prompt;
+    if (!json_string_field(request.body, "prompt", prompt)) {
+        send_all(client_socket, create_json_response("error", "Missing \"prompt\"", keep_alive,
+                                                     "400 Bad Request"));
+        return;
+    }
+    int max_tokens = std::max(1, json_int_field(request.body, "max_tokens", 16));
+    bool stream = json_bool_field(request.body, "stream", false);
+    bool ignore_eos = json_bool_field(request.body, "ignore_eos", false);
+    std::string session_id;
+    json_string_field(request.body, "session_id", session_id);
+    if (session_id.size() > SessionCache::kMaxIdLength) {
+        send_all(client_socket, create_json_response(
+            "error", "\"session_id\" is longer than " + std::to_string(SessionCache::kMaxIdLength) +
+            " bytes", keep_alive, "400 Bad Request"));
+        return;
+    }
+
+    // Tokenizers are immutable, so after taking a reference none of the
+    // tokenizing below needs the model lock
+    std::shared_ptr<const Tokenizer> tokenizer;
+    {
+        std::lock_guard<std::mutex> lock(model_mutex_);
+        tokenizer = tokenizer_;
+        // No more than the context holds, which also keeps the prompt
+        // length plus max_tokens within an int
+        max_tokens = std::min(max_tokens, transformer_->max_seq_len());
+    }
+    // Once the event-stream headers are out, errors have to be SSE events
+    bool headers_sent = false;
+    try {
+        std::vector<int> prompt_tokens = tokenizer->encode(prompt);
+        if (!stream) {
+            auto tokens = generate_tokens(prompt_tokens, max_tokens, ignore_eos, session_id,
+                                          [](int) { return true; });
+            std::string text = tokenizer->decode(tokens);
+            send_all(client_socket, create_completion_response(text, tokens.size(), keep_alive));
+            return;
+        }
+
+        // Server-sent events over a chunked response, one event per token
+        std::ostringstream head;
+        head << "HTTP/1.1 200 OK\r\n"
+             << "Content-Type: text/event-stream\r\n"
+             << "Cache-Control: no-cache\r\n"
+             << "Access-Control-Allow-Origin: *\r\n"
+             << "Transfer-Encoding: chunked\r\n"
+             << "Connection: " << (keep_alive ? "keep-alive" : "close") << "\r\n\r\n";
+        headers_sent = true;
+        if (!send_all(client_socket, head.str())) return;
+
+        // One event per token; text split across tokens arrives with the
+        // token that completes it
+        StreamingDecoder detokenizer(*tokenizer);
+        bool connected = true;
+        generate_tokens(prompt_tokens, max_tokens, ignore_eos, session_id, [&](int token) {
+            std::string piece = detokenizer.push(token);
+            connected = send_chunk(client_socket, "data: {\"token\": " + std::to_string(token) +
+                                                  ", \"text\": \"" + json_escape(piece) + "\"}\n\n");
+            return connected;
+        });
+        // Text still held back (e.g. an incomplete UTF-8 sequence) goes in
+        // a final event without a token, so clients counting tokens skip it
+        std::string rest = detokenizer.flush();
+        if (connected && !rest.empty()) {
+            send_chunk(client_socket, "data: {\"text\": \"" + json_escape(rest) +
+                                      "\", \"final\": true}\n\n");
+        }
+        send_chunk(client_socket, "data: [DONE]\n\n");
+        send_all(client_socket, "0\r\n\r\n");
+    } catch (const std::exception& e) {
+        if (headers_sent) {
+            send_chunk(client_socket, "data: {\"error\": \"" + json_escape(e.what()) + "\"}\n\n");
+            send_chunk(client_socket, "data: [DONE]\n\n");
+            send_all(client_socket, "0\r\n\r\n");
+        } else {
+            send_all(client_socket, create_json_response("error", e.what(), keep_alive,
+                                                         "500 Internal Server Error"));
         }
     }
-    else if (path == "/generate" && method == "POST") {
-        if (!model_loaded_) {
-            return create_json_response("error", "No model loaded");
+}
+
+std::vector<int> HTTPServer::generate_tokens(const std::vector<int>& prompt_tokens, int max_tokens,
+                                             bool ignore_eos, const std::string& session_id,
+                                             const std::function<bool(int)>& on_token) {
+    using Clock = std::chrono::steady_clock;
+    auto arrival = Clock::now();
+    Clock::time_point first_token_time;
+
+    // Gauges must come back down on every exit path, including a throwing forward
+    struct GaugeGuard {
+        HTTPServer& server;
+        bool started = false;
+        int64_t allocated = 0;
+        int64_t used = 0;
+        ~GaugeGuard() {
+            (started ? server.active_sequences_ : server.queued_requests_)--;
+            server.kv_cache_allocated_bytes_ -= allocated;
+            server.kv_cache_used_bytes_ -= used;
         }
+    } gauges{*this};
+    requests_total_++;
+    queued_requests_++;
 
-        // Extract prompt from JSON body (simplified parsing)
-        size_t body_start = request.find("\r\n\r\n");
-        if (body_start != std::string::npos) {
-            std::string body = request.substr(body_start + 4);
+    std::vector<int> generated;
+    std::vector<int> history;  // Every token of the sequence, the session's included
+    KVCache cache;
+    int eos_token;
+    bool use_session = sessions_ && !session_id.empty();
+    bool resumed = use_session && sessions_->restore(session_id, history, cache);
+    {
+        std::lock_guard<std::mutex> lock(model_mutex_);
+        if (resumed && (cache.num_layers() != transformer_->num_layers() ||
+                        cache.kv_dim() != transformer_->hidden_size())) {
+            resumed = false;  // Saved by a different model
+        }
+        if (!resumed) {
+            // Blocks are allocated as the sequence grows, so a session can
+            // take the model's whole context without reserving it
+            KVCacheConfig config;
+            config.max_seq_len = use_session ? transformer_->max_seq_len()
+                                             : std::min(transformer_->max_seq_len(),
+                                                        static_cast<int>(prompt_tokens.size()) + max_tokens);
+            cache = transformer_->create_cache(config);
+            history.clear();
+        }
+        eos_token = tokenizer_->eos_token_id();
 
-            // Simple JSON parsing (would use proper JSON library in production)
-            size_t prompt_start = body.find("\"prompt\":\"");
-            if (prompt_start != std::string::npos) {
-                prompt_start += 10;
-                size_t prompt_end = body.find("\"", prompt_start);
-                std::string prompt = body.substr(prompt_start, prompt_end - prompt_start);
+        // Clients may resend the whole conversation (possibly rewound to an
+        // earlier turn) or only the new turn
+        std::vector<int> stored = std::move(history);
+        auto starts_with = [](const std::vector<int>& a, const std::vector<int>& b) {
+            return a.size() >= b.size() && std::equal(b.begin(), b.end(), a.begin());
+        };
+        if (!resumed || starts_with(prompt_tokens, stored) || starts_with(stored, prompt_tokens)) {
+            history = prompt_tokens;
+        } else {
+            bool bos = !prompt_tokens.empty() && prompt_tokens[0] == tokenizer_->bos_token_id();
+            history = stored;
+            history.insert(history.end(), prompt_tokens.begin() + bos, prompt_tokens.end());
+        }
+
+        // Rows past the shared prefix belong to another continuation
+        size_t shared = std::mismatch(stored.begin(), stored.end(), history.begin(), history.end()).first -
+                        stored.begin();
+        cache.truncate(std::min(cache.length(), static_cast<int>(shared)));
+        if (cache.length() > 0 && cache.length() >= static_cast<int>(history.size())) {
+            // Nothing new to feed; recompute the last position for its logits
+            cache.truncate(static_cast<int>(history.size()) - 1);
+        }
+    }
+    session_tokens_reused_total_ += cache.length();
+
+    std::vector<int> pending(history.begin() + cache.length(), history.end());
+    while (static_cast<int>(generated.size()) < max_tokens &&
+           cache.length() + static_cast<int>(pending.size()) <= cache.capacity()) {
+        bool prefill = generated.empty();
+        int next_token;
+        {
+            // Held per forward pass so concurrent requests interleave
+            std::lock_guard<std::mutex> lock(model_mutex_);
+            if (!gauges.started) {
+                gauges.started = true;
+                queued_requests_--;
+                active_sequences_++;
+            }
+            auto forward_start = Clock::now();
+            PROFILE_SCOPE(prefill ? "prefill" : "decode");
+            Tensor input_ids(std::vector<int>{1, static_cast<int>(pending.size())}, DType::FP32);
+            float* ids = input_ids.data<float>();
+            for (size_t i = 0; i < pending.size(); ++i) {
+                ids[i] = static_cast<float>(pending[i]);
+            }
+
+            // Greedy decoding (simplified - sampling parameters are not wired up)
+            Tensor logits = transformer_->forward(input_ids, &cache);
+            int vocab_size = logits.shape().back();
+            const float* last = logits.data<float>() + (pending.size() - 1) * vocab_size;
+            next_token = static_cast<int>(std::max_element(last, last + vocab_size) - last);
+
+            uint64_t forward_ns = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - forward_start).count());
+            (prefill ? prefill_tokens_total_ : decode_tokens_total_) += pending.size();
+            (prefill ? prefill_ns_total_ : decode_ns_total_) += forward_ns;
+        }
 
-                try {
-                    // Generate text (simplified - would use actual inference)
-                    std::string generated_text = "Generated response for: " + prompt;
+        // The cache allocates blocks as it fills, so measure after the pass
+        int64_t allocated = static_cast<int64_t>(cache.byte_size());
+        int64_t used = static_cast<int64_t>(std::min(cache.length(), cache.capacity()) *
+                                            cache.bytes_per_token());
+        kv_cache_allocated_bytes_ += allocated - gauges.allocated;
+        kv_cache_used_bytes_ += used - gauges.used;
+        gauges.allocated = allocated;
+        gauges.used = used;
 
-                    return create_completion_response(generated_text);
-                } catch (const std::exception& e) {
-                    return create_json_response("error", e.what());
-                }
+        auto now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(metrics_mutex_);
+            batch_tokens_histogram_.record(pending.size());
+            if (prefill) {
+                ttft_histogram_.record_seconds(std::chrono::duration<double>(now - arrival).count());
             }
         }
+        if (prefill) {
+            first_token_time = now;
+        }
+
+        if (next_token == eos_token && !ignore_eos) {
+            break;
+        }
+        generated.push_back(next_token);
+        history.push_back(next_token);
+        if (!on_token(next_token)) {
+            break;
+        }
+        pending.assign(1, next_token);
     }
 
-    // Default response
-    std::ostringstream oss;
-    oss << "HTTP/1.1 404 Not Found\r\n";
-    oss << "Content-Type: application/json\r\n";
-    oss << "\r\n";
-    oss << "{\n";
-    oss << "  \"error\": \"Endpoint not found\"\n";
-    oss << "}\n";
-    return oss.str();
+    if (use_session) {
+        // The cache holds all of history but the last token, which the next
+        // turn feeds first
+        sessions_->save(session_id, history, cache);
+    }
+
+    if (generated.size() > 1) {
+        double decode_seconds = std::chrono::duration<double>(Clock::now() - first_token_time).count();
+        std::lock_guard<std::mutex> lock(metrics_mutex_);
+        tpot_histogram_.record_seconds(decode_seconds / (generated.size() - 1));
+    }
+
+    return generated;
+}
+
+namespace {
+    void write_metric_header(std::ostream& out, const char* name, const char* type,
+                             const char* help) {
+        out << "# HELP " << name << " " << help << "\n";
+        out << "# TYPE " << name << " " << type << "\n";
+    }
+
+    // Prometheus histogram from a LatencyHistogram; bounds and scale are in
+    // the exported unit (e.g. seconds with scale 1e9 for nanosecond values)
+    void write_histogram(std::ostream& out, const char* name, const char* help,
+                         const LatencyHistogram& histogram, const std::vector<double>& bounds,
+                         double scale) {
+        write_metric_header(out, name, "histogram", help);
+        for (double bound : bounds) {
+            out << name << "_bucket{le=\"" << bound << "\"} "
+                << histogram.count_at_or_below(static_cast<uint64_t>(bound * scale)) << "\n";
+        }
+        out << name << "_bucket{le=\"+Inf\"} " << histogram.count() << "\n";
+        out << name << "_sum " << histogram.sum() / scale << "\n";
+        out << name << "_count " << histogram.count() << "\n";
+    }
+
+    // Label values escape backslash, quote and newline
+    std::string label_escape(const std::string& s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '\\' || c == '"') out += '\\';
+            if (c == '\n') {
+                out += "\\n";
+                continue;
+            }
+            out += c;
+        }
+        return out;
+    }
+
+    uint64_t resident_set_bytes() {
+        std::ifstream statm("/proc/self/statm");
+        uint64_t size = 0, resident = 0;
+        if (!(statm >> size >> resident)) return 0;
+        return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    }
+}
+
+std::string HTTPServer::render_metrics() {
+    std::ostringstream out;
+    out.precision(9);
+
+    write_metric_header(out, "llm_queue_depth", "gauge",
+                        "Requests waiting for their first forward pass");
+    out << "llm_queue_depth " << queued_requests_.load() << "\n";
+    write_metric_header(out, "llm_active_sequences", "gauge",
+                        "Sequences being decoded");
+    out << "llm_active_sequences " << active_sequences_.load() << "\n";
+    write_metric_header(out, "llm_kv_cache_used_bytes", "gauge",
+                        "KV cache bytes holding tokens of live sequences");
+    out << "llm_kv_cache_used_bytes " << kv_cache_used_bytes_.load() << "\n";
+    write_metric_header(out, "llm_kv_cache_allocated_bytes", "gauge",
+                        "KV cache bytes allocated for live sequences");
+    out << "llm_kv_cache_allocated_bytes " << kv_cache_allocated_bytes_.load() << "\n";
+
+    write_metric_header(out, "llm_requests_total", "counter", "Generation requests started");
+    out << "llm_requests_total " << requests_total_.load() << "\n";
+    // rate() of the token counters gives prefill and decode throughput
+    write_metric_header(out, "llm_tokens_total", "counter", "Tokens run through the model");
+    out << "llm_tokens_total{phase=\"prefill\"} " << prefill_tokens_total_.load() << "\n";
+    out << "llm_tokens_total{phase=\"decode\"} " << decode_tokens_total_.load() << "\n";
+    write_metric_header(out, "llm_forward_seconds_total", "counter",
+                        "Time spent in forward passes");
+    out << "llm_forward_seconds_total{phase=\"prefill\"} " << prefill_ns_total_.load() * 1e-9 << "\n";
+    out << "llm_forward_seconds_total{phase=\"decode\"} " << decode_ns_total_.load() * 1e-9 << "\n";
+
+    if (sessions_) {
+        SessionCache::Stats sessions = sessions_->stats();
+        write_metric_header(out, "llm_session_lookups_total", "counter",
+                            "Requests naming a session, by whether its cache was found");
+        out << "llm_session_lookups_total{result=\"hit\"} " << sessions.hits << "\n";
+        out << "llm_session_lookups_total{result=\"miss\"} " << sessions.misses << "\n";
+        write_metric_header(out, "llm_session_reused_tokens_total", "counter",
+                            "Tokens restored from a session cache instead of prefilled");
+        out << "llm_session_reused_tokens_total " << session_tokens_reused_total_.load() << "\n";
+        write_metric_header(out, "llm_sessions", "gauge", "Saved sessions");
+        out << "llm_sessions " << sessions.sessions << "\n";
+        write_metric_header(out, "llm_session_cache_bytes", "gauge", "Saved session KV bytes by tier");
+        out << "llm_session_cache_bytes{tier=\"memory\"} " << sessions.memory_bytes << "\n";
+        out << "llm_session_cache_bytes{tier=\"disk\"} " << sessions.disk_bytes << "\n";
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(metrics_mutex_);
+        write_histogram(out, "llm_time_to_first_token_seconds",
+                        "Request arrival to first generated token", ttft_histogram_,
+                        {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30}, 1e9);
+        write_histogram(out, "llm_time_per_output_token_seconds",
+                        "Mean time between output tokens, per request", tpot_histogram_,
+                        {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1}, 1e9);
+        write_histogram(out, "llm_batch_size_tokens",
+                        "Tokens per forward pass", batch_tokens_histogram_,
+                        {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096}, 1.0);
+    }
+
+    // Per-scope kernel time from the profiler, cumulative since startup
+    auto timings = Profiler::instance().get_timings();
+    std::vector<std::string> names;
+    for (const auto& entry : timings) names.push_back(entry.first);
+    std::sort(names.begin(), names.end());
+
+    write_metric_header(out, "llm_profile_seconds_total", "counter",
+                        "Time spent in profiled scopes");
+    for (const auto& name : names) {
+        out << "llm_profile_seconds_total{scope=\"" << label_escape(name) << "\"} "
+            << timings[name].total_time << "\n";
+    }
+    write_metric_header(out, "llm_profile_calls_total", "counter", "Profiled scope executions");
+    for (const auto& name : names) {
+        out << "llm_profile_calls_total{scope=\"" << label_escape(name) << "\"} "
+            << timings[name].count << "\n";
+    }
+    write_metric_header(out, "llm_profile_latency_seconds", "summary",
+                        "Profiled scope durations");
+    for (const auto& name : names) {
+        const Profiler::Timing& timing = timings[name];
+        std::string scope = label_escape(name);
+        for (double q : {0.5, 0.9, 0.99, 0.999}) {
+            out << "llm_profile_latency_seconds{scope=\"" << scope << "\",quantile=\"" << q
+                << "\"} " << timing.percentile(q * 100.0) << "\n";
+        }
+        out << "llm_profile_latency_seconds_sum{scope=\"" << scope << "\"} "
+            << timing.total_time << "\n";
+        out << "llm_profile_latency_seconds_count{scope=\"" << scope << "\"} "
+            << timing.count << "\n";
+    }
+
+    write_metric_header(out, "process_resident_memory_bytes", "gauge", "Resident set size");
+    out << "process_resident_memory_bytes " << resident_set_bytes() << "\n";
+    return out.str();
 }
@@ -2,10 +2,19 @@
 #define HTTP_SERVER_HPP
 
 #include "app.hpp"
+#include "transformer/transformer.hpp"
+#include "transformer/session_cache.hpp"
+#include "tokenizer/sentencepiece_wrapper.hpp"
+#include "util/histogram.hpp"
 #include <string>
 #include <thread>
 #include <atomic>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
 
 class HTTPServer {
 public:
@@ -21,9 +30,49 @@ public:
     // Check if server is running
     bool is_running() const { return running_; }
 
+    // Bound port; useful when constructed with port 0
+    int port() const { return port_; }
+
+    // Load weights for /generate; an empty path or "dummy" uses the built-in
+    // dummy model, and an empty tokenizer path one token per byte
+    void load_model(const std::string& model_path, const std::string& tokenizer_path = "");
+
+    // Keep KV caches of requests with a "session_id" so the next turn
+    // prefills only its new tokens. Call before start().
+    void enable_sessions(const SessionCacheConfig& config);
+
 private:
+    struct HTTPRequest {
+        std::string method;
+        std::string path;
+        std::string query;
+        std::string version;
+        std::unordered_map<std::string, std::string> headers; // Lower-case names
+        std::string body;
+        bool keep_alive = true;
+    };
+
     void server_loop();
-    std::string handle_request(const std::string& request);
+
+    // Serves requests on one keep-alive connection until either side closes
+    void handle_connection(int client_socket);
+    bool read_request(int client_socket, std::string& buffer, HTTPRequest& request);
+    void handle_request(int client_socket, const HTTPRequest& request);
+    void handle_generate(int client_socket, const HTTPRequest& request);
+
+    // Runs the model for one request. Each forward pass takes the model lock,
+    // so concurrent requests interleave token by token. on_token returns
+    // false to stop early (e.g. the client went away). ignore_eos keeps
+    // going to max_tokens, so load tests get the output lengths they asked for.
+    // With a session_id the request continues that session's history (the
+    // prompt may be just the new turn or the whole conversation so far) and
+    // its cache is saved under the ID for the next turn.
+    std::vector<int> generate_tokens(const std::vector<int>& prompt_tokens, int max_tokens,
+                                     bool ignore_eos, const std::string& session_id,
+                                     const std::function<bool(int)>& on_token);
+
+    // Prometheus text exposition for GET /metrics
+    std::string render_metrics();
 
     int port_;
     int server_socket_;
@@ -33,10 +82,33 @@ private:
     // Model state
     std::string current_model_path_;
     bool model_loaded_;
+    std::mutex model_mutex_;
+    std::unique_ptr<Transformer> transformer_;
+    std::shared_ptr<const Tokenizer> tokenizer_;  // Requests keep the one they started with
+    std::atomic<uint64_t> next_request_id_{1};  // Tags profiler events per request
+    std::unique_ptr<SessionCache> sessions_;    // Null unless enable_sessions() was called
+
+    // Serving metrics. Gauges track requests between generate_tokens entry
+    // and exit: queued until their first forward pass, active after it.
+    std::atomic<int64_t> queued_requests_{0};
+    std::atomic<int64_t> active_sequences_{0};
+    std::atomic<int64_t> kv_cache_allocated_bytes_{0};
+    std::atomic<int64_t> kv_cache_used_bytes_{0};
+    std::atomic<uint64_t> requests_total_{0};
+    std::atomic<uint64_t> prefill_tokens_total_{0};
+    std::atomic<uint64_t> session_tokens_reused_total_{0};  // Prefill skipped thanks to sessions
+    std::atomic<uint64_t> decode_tokens_total_{0};
+    std::atomic<uint64_t> prefill_ns_total_{0};
+    std::atomic<uint64_t> decode_ns_total_{0};
+    std::mutex metrics_mutex_;  // Guards the histograms
+    LatencyHistogram ttft_histogram_;          // Nanoseconds, generate_tokens entry to first token
+    LatencyHistogram tpot_histogram_;          // Nanoseconds per output token after the first
+    LatencyHistogram batch_tokens_histogram_;  // Tokens per forward pass
 
-    // Simple JSON response helpers
-    std::string json_response(const std::string& data);
-    std::string json_error(const std::string& message);
+    // Open client connections, so stop() can unblock and wait for them
+    std::mutex connections_mutex_;
+    std::condition_variable connections_cv_;
+    std::unordered_set<int> client_sockets_;
 };
 
 #endif // HTTP_SERVER_HPP
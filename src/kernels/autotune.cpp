@@ -0,0 +1,265 @@
+#include "autotune.hpp"
+#include "../util/threadpool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Rows [m_begin, m_end) of C; loops are ordered i-k-j so the innermost
+// loop streams contiguous rows of B and C and vectorizes
+void matmul_tiled_rows(const float* A, const float* B, float* C, int m_begin, int m_end,
+                       int K, int N, float alpha, float beta, const GemmTiling& tiling) {
+    for (int m0 = m_begin; m0 < m_end; m0 += tiling.block_m) {
+        int m1 = std::min(m0 + tiling.block_m, m_end);
+
+        for (int i = m0; i < m1; ++i) {
+            float* c_row = C + static_cast<size_t>(i) * N;
+            if (beta == 0.0f) {
+                std::fill(c_row, c_row + N, 0.0f);
+            } else if (beta != 1.0f) {
+                for (int j = 0; j < N; ++j) c_row[j] *= beta;
+            }
+        }
+
+        for (int k0 = 0; k0 < K; k0 += tiling.block_k) {
+            int k1 = std::min(k0 + tiling.block_k, K);
+            for (int n0 = 0; n0 < N; n0 += tiling.block_n) {
+                int n1 = std::min(n0 + tiling.block_n, N);
+                for (int i = m0; i < m1; ++i) {
+                    float* c_row = C + static_cast<size_t>(i) * N;
+                    const float* a_row = A + static_cast<size_t>(i) * K;
+                    for (int k = k0; k < k1; ++k) {
+                        float a = alpha * a_row[k];
+                        const float* b_row = B + static_cast<size_t>(k) * N;
+                        for (int j = n0; j < n1; ++j) {
+                            c_row[j] += a * b_row[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+const int kBlockM[] = {16, 64};
+const int kBlockN[] = {64, 256, 1024};
+const int kBlockK[] = {64, 256};
+
+} // namespace
+
+void matmul_tiled(const float* A, const float* B, float* C, int M, int K, int N,
+                  float alpha, float beta, const GemmTiling& tiling, ThreadPool* pool) {
+    int num_threads = pool ? std::min(tiling.num_threads, static_cast<int>(pool->size()) + 1) : 1;
+    num_threads = std::max(1, std::min(num_threads, (M + tiling.block_m - 1) / tiling.block_m));
+
+    if (num_threads == 1) {
+        matmul_tiled_rows(A, B, C, 0, M, K, N, alpha, beta, tiling);
+        return;
+    }
+
+    // Whole row blocks per thread; the caller takes the first range
+    int blocks = (M + tiling.block_m - 1) / tiling.block_m;
+    int blocks_per_thread = (blocks + num_threads - 1) / num_threads;
+    int rows_per_thread = blocks_per_thread * tiling.block_m;
+
+    std::vector<std::future<void>> pending;
+    for (int m = rows_per_thread; m < M; m += rows_per_thread) {
+        int m_end = std::min(M, m + rows_per_thread);
+        pending.push_back(pool->submit([=, &tiling]() {
+            matmul_tiled_rows(A, B, C, m, m_end, K, N, alpha, beta, tiling);
+        }));
+    }
+    matmul_tiled_rows(A, B, C, 0, std::min(M, rows_per_thread), K, N, alpha, beta, tiling);
+    for (auto& f : pending) f.get();
+}
+
+KernelAutotuner& KernelAutotuner::instance() {
+    static KernelAutotuner tuner;
+    return tuner;
+}
+
+uint64_t KernelAutotuner::key(int M, int K, int N, DType dtype) {
+    // 20 bits per dimension, 4 for the dtype
+    return (static_cast<uint64_t>(M) << 44) | (static_cast<uint64_t>(K) << 24) |
+           (static_cast<uint64_t>(N) << 4) | static_cast<uint64_t>(dtype);
+}
+
+GemmTiling KernelAutotuner::lookup(int M, int K, int N, DType dtype) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key(M, K, N, dtype));
+    return it != entries_.end() ? it->second.tiling : GemmTiling();
+}
+
+bool KernelAutotuner::has(int M, int K, int N, DType dtype) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.count(key(M, K, N, dtype)) > 0;
+}
+
+ThreadPool* KernelAutotuner::thread_pool() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pool_) {
+        size_t workers = std::thread::hardware_concurrency();
+        pool_ = std::make_unique<ThreadPool>(workers > 1 ? workers - 1 : 1);
+    }
+    return pool_.get();
+}
+
+double KernelAutotuner::benchmark(int M, int K, int N, const GemmTiling& tiling, ThreadPool* pool) {
+    std::vector<float> A(static_cast<size_t>(M) * K, 0.5f);
+    std::vector<float> B(static_cast<size_t>(K) * N, 0.25f);
+    std::vector<float> C(static_cast<size_t>(M) * N);
+
+    // Warm-up, then best of a few runs so one preemption doesn't pick the winner
+    matmul_tiled(A.data(), B.data(), C.data(), M, K, N, 1.0f, 0.0f, tiling, pool);
+    double best = 1e30;
+    for (int run = 0; run < 3; ++run) {
+        auto start = std::chrono::high_resolution_clock::now();
+        matmul_tiled(A.data(), B.data(), C.data(), M, K, N, 1.0f, 0.0f, tiling, pool);
+        auto end = std::chrono::high_resolution_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+
+    return 2.0 * M * K * N / best / 1e9;
+}
+
+GemmTiling KernelAutotuner::tune_matmul(int M, int K, int N, DType dtype, int max_threads) {
+    if (dtype != DType::FP32) {
+        throw std::runtime_error("KernelAutotuner: only FP32 GEMM is tunable");
+    }
+
+    ThreadPool* pool = thread_pool();
+    if (max_threads <= 0) {
+        max_threads = static_cast<int>(pool->size()) + 1;
+    }
+
+    // Tilings first at full width, then the thread count for the winner
+    GemmTiling best;
+    best.num_threads = max_threads;
+    best.gflops = 0.0;
+    for (int bm : kBlockM) {
+        for (int bn : kBlockN) {
+            for (int bk : kBlockK) {
+                GemmTiling candidate{bm, bn, bk, max_threads};
+                candidate.gflops = benchmark(M, K, N, candidate, pool);
+                if (candidate.gflops > best.gflops) best = candidate;
+            }
+        }
+    }
+
+    for (int threads = 1; threads < max_threads; threads *= 2) {
+        GemmTiling candidate = best;
+        candidate.num_threads = threads;
+        candidate.gflops = benchmark(M, K, N, candidate, pool);
+        if (candidate.gflops > best.gflops) best = candidate;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[key(M, K, N, dtype)] = Entry{M, K, N, dtype, best};
+    return best;
+}
+
+std::string KernelAutotuner::cpu_model() {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.compare(0, 10, "model name") == 0) {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                size_t start = line.find_first_not_of(" \t", colon + 1);
+                return start != std::string::npos ? line.substr(start) : "unknown";
+            }
+        }
+    }
+    return "unknown";
+}
+
+// File layout:
+//   [cpu model name]
+//   M K N dtype block_m block_n block_k num_threads gflops
+bool KernelAutotuner::load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    std::string cpu = "[" + cpu_model() + "]";
+    bool in_section = false;
+    size_t loaded = 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        if (line[0] == '[') {
+            in_section = (line == cpu);
+            continue;
+        }
+        if (!in_section) continue;
+
+        std::istringstream fields(line);
+        Entry entry;
+        int dtype;
+        GemmTiling& t = entry.tiling;
+        if (fields >> entry.M >> entry.K >> entry.N >> dtype >> t.block_m >> t.block_n >>
+                t.block_k >> t.num_threads >> t.gflops) {
+            if (t.block_m <= 0 || t.block_n <= 0 || t.block_k <= 0 || t.num_threads <= 0) continue;
+            entry.dtype = static_cast<DType>(dtype);
+            entries_[key(entry.M, entry.K, entry.N, entry.dtype)] = entry;
+            ++loaded;
+        }
+    }
+
+    return loaded > 0;
+}
+
+void KernelAutotuner::save(const std::string& path) const {
+    std::string cpu = "[" + cpu_model() + "]";
+
+    // Keep sections written by other machines sharing the file
+    std::ostringstream others;
+    {
+        std::ifstream existing(path);
+        std::string line;
+        bool in_section = false;
+        while (std::getline(existing, line)) {
+            if (!line.empty() && line[0] == '[') {
+                in_section = (line == cpu);
+            }
+            if (!in_section && !line.empty() && line[0] != '#') {
+                others << line << "\n";
+            }
+        }
+    }
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("KernelAutotuner: cannot write " + path);
+    }
+
+    file << "# M K N dtype block_m block_n block_k num_threads gflops\n";
+    file << others.str();
+    file << cpu << "\n";
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [k, entry] : entries_) {
+        const GemmTiling& t = entry.tiling;
+        file << entry.M << " " << entry.K << " " << entry.N << " " << static_cast<int>(entry.dtype)
+             << " " << t.block_m << " " << t.block_n << " " << t.block_k << " "
+             << t.num_threads << " " << t.gflops << "\n";
+    }
+}
+
+void KernelAutotuner::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+}
+
+size_t KernelAutotuner::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
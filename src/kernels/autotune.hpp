@@ -0,0 +1,73 @@
+#ifndef AUTOTUNE_HPP
+#define AUTOTUNE_HPP
+
+#include "../tensor.hpp"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+
+// Cache blocking and thread split for the tiled FP32 GEMM
+struct GemmTiling {
+    int block_m = 64;
+    int block_n = 256;
+    int block_k = 256;
+    int num_threads = 1;
+    double gflops = 0.0; // Measured when tuned, 0 for defaults
+};
+
+// C[M, N] = alpha * A[M, K] * B[K, N] + beta * C. Row blocks are split
+// across pool workers when tiling.num_threads > 1.
+void matmul_tiled(const float* A, const float* B, float* C, int M, int K, int N,
+                  float alpha, float beta, const GemmTiling& tiling, ThreadPool* pool = nullptr);
+
+// Benchmarks candidate tilings per GEMM shape and remembers the winners.
+// Results are persisted per CPU model, since the best blocking follows the
+// cache hierarchy of the SKU.
+class KernelAutotuner {
+public:
+    static KernelAutotuner& instance();
+
+    // Best known tiling, or the defaults if the shape was never tuned
+    GemmTiling lookup(int M, int K, int N, DType dtype = DType::FP32) const;
+    bool has(int M, int K, int N, DType dtype = DType::FP32) const;
+
+    // Time every candidate for this shape, store and return the fastest.
+    // Only FP32 is tunable; other dtypes throw.
+    GemmTiling tune_matmul(int M, int K, int N, DType dtype = DType::FP32, int max_threads = 0);
+
+    // Cache file: one section per CPU model. load() only applies entries for
+    // this CPU; save() rewrites this CPU's section and keeps the others.
+    bool load(const std::string& path);
+    void save(const std::string& path) const;
+
+    void clear();
+    size_t size() const;
+
+    // Workers shared by tuned GEMMs, created on first use
+    ThreadPool* thread_pool();
+
+    static std::string cpu_model();
+
+private:
+    KernelAutotuner() = default;
+
+    static uint64_t key(int M, int K, int N, DType dtype);
+    double benchmark(int M, int K, int N, const GemmTiling& tiling, ThreadPool* pool);
+
+    struct Entry {
+        int M, K, N;
+        DType dtype;
+        GemmTiling tiling;
+    };
+
+    std::unordered_map<uint64_t, Entry> entries_;
+    std::unique_ptr<ThreadPool> pool_;
+    mutable std::mutex mutex_;
+};
+
+#endif // AUTOTUNE_HPP
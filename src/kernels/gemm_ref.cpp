@@ -1,4 +1,9 @@
 #include "gemm_ref.hpp"
+#include "half.hpp"
+#include "autotune.hpp"
+#include "optimized/specialized_kernels.hpp"
+#include "../util/profiler.hpp"
+#include <optional>
 #include <stdexcept>
 
 #ifdef USE_OPENBLAS
@@ -9,16 +14,50 @@ extern "C" {
 
 // Basic matrix operations for when Eigen is not available
 namespace {
-    void simple_matmul(const float* A, const float* B, float* C,
+    // Tiled kernel with the blocking the autotuner picked for this shape
+    void tuned_matmul(const float* A, const float* B, float* C,
                       int M, int K, int N, float alpha, float beta) {
-        for (int m = 0; m < M; ++m) {
-            for (int n = 0; n < N; ++n) {
-                float sum = 0.0f;
-                for (int k = 0; k < K; ++k) {
-                    sum += A[m * K + k] * B[k * N + n];
-                }
-                C[m * N + n] = alpha * sum + beta * C[m * N + n];
-            }
+        KernelAutotuner& tuner = KernelAutotuner::instance();
+        GemmTiling tiling = tuner.lookup(M, K, N, DType::FP32);
+        ThreadPool* pool = tiling.num_threads > 1 ? tuner.thread_pool() : nullptr;
+        matmul_tiled(A, B, C, M, K, N, alpha, beta, tiling, pool);
+    }
+
+    bool is_half(DType dtype) {
+        return dtype == DType::FP16 || dtype == DType::BF16;
+    }
+
+    // FP16/BF16 weights and/or BF16 activations. Weights are converted inside
+    // the kernels' inner loops; activations are staged through FP32.
+    void mixed_matmul(const Tensor& A, const Tensor& B, Tensor& C,
+                      int M, int K, int N, float alpha, float beta) {
+        // Only non-FP32 operands are staged, so FP32 calls allocate nothing
+        std::optional<Tensor> A_staged;
+        if (A.dtype() != DType::FP32) A_staged.emplace(A.to(DType::FP32));
+        const float* a = A_staged ? A_staged->data<float>() : A.data<float>();
+
+        std::optional<Tensor> C_staged;
+        if (C.dtype() != DType::FP32) C_staged.emplace(C.to(DType::FP32));
+        float* c = C_staged ? C_staged->data<float>() : C.data<float>();
+
+        switch (B.dtype()) {
+            case DType::FP32:
+                tuned_matmul(a, B.data<float>(), c, M, K, N, alpha, beta);
+                break;
+            case DType::FP16:
+                matmul_f16(a, B.data<uint16_t>(), c, M, K, N, alpha, beta);
+                break;
+            case DType::BF16:
+                matmul_bf16(a, B.data<uint16_t>(), c, M, K, N, alpha, beta);
+                break;
+            default:
+                throw std::runtime_error("GEMM: unsupported weight dtype");
+        }
+
+        if (C.dtype() == DType::FP16) {
+            fp32_to_fp16_row(c, C.data<uint16_t>(), C.numel());
+        } else if (C.dtype() == DType::BF16) {
+            fp32_to_bf16_row(c, C.data<uint16_t>(), C.numel());
         }
     }
 }
@@ -51,6 +90,13 @@ void GemmRef::matmul(const Tensor& A, const Tensor& B, Tensor& C,
     int M = shape_A[0];
     int K = shape_A[1];
     int N = shape_B[1];
+    PROFILE_SCOPE_WORK("gemm", 2ull * M * N * K,
+                       A.byte_size() + B.byte_size() + C.byte_size());
+
+    if (is_half(A.dtype()) || is_half(B.dtype()) || is_half(C.dtype())) {
+        mixed_matmul(A, B, C, M, K, N, alpha, beta);
+        return;
+    }
 
 #ifdef USE_EIGEN
     // Use Eigen for the actual computation
@@ -63,8 +109,8 @@ void GemmRef::matmul(const Tensor& A, const Tensor& B, Tensor& C,
 
     C_map = alpha * A_map * B_map + beta * C_map;
 #else
-    // Use simple fallback implementation
-    simple_matmul(A.data<float>(), B.data<float>(), C.data<float>(), M, K, N, alpha, beta);
+    // Use the tiled fallback implementation
+    tuned_matmul(A.data<float>(), B.data<float>(), C.data<float>(), M, K, N, alpha, beta);
 #endif
 }
 
@@ -85,6 +131,28 @@ void GemmRef::matvec(const Tensor& A, const Tensor& x, Tensor& y,
 
     int M = shape_A[0];
     int K = shape_A[1];
+    PROFILE_SCOPE_WORK("gemv", 2ull * M * K, A.byte_size() + x.byte_size() + y.byte_size());
+
+    // Half-precision weights: convert in the kernel's inner loop
+    if (is_half(A.dtype())) {
+        std::optional<Tensor> x_staged;
+        if (x.dtype() != DType::FP32) x_staged.emplace(x.to(DType::FP32));
+        const float* x_data = x_staged ? x_staged->data<float>() : x.data<float>();
+        float* y_data = y.data<float>();
+
+        // Per-thread scratch, so steady-state decode doesn't allocate
+        thread_local std::vector<float> result;
+        result.resize(M);
+        if (A.dtype() == DType::FP16) {
+            matvec_f16(A.data<uint16_t>(), x_data, result.data(), M, K);
+        } else {
+            matvec_bf16(A.data<uint16_t>(), x_data, result.data(), M, K);
+        }
+        for (int m = 0; m < M; ++m) {
+            y_data[m] = alpha * result[m] + beta * y_data[m];
+        }
+        return;
+    }
 
 #ifdef USE_EIGEN
     // Use Eigen for computation
@@ -102,12 +170,20 @@ void GemmRef::matvec(const Tensor& A, const Tensor& x, Tensor& y,
     const float* x_data = x.data<float>();
     float* y_data = y.data<float>();
 
-    for (int m = 0; m < M; ++m) {
-        float sum = 0.0f;
-        for (int k = 0; k < K; ++k) {
-            sum += A_data[m * K + k] * x_data[k];
+    // K-tiled kernel chosen for this K; alpha/beta applied afterwards
+    if (beta == 0.0f) {
+        specialized::matvec(A_data, x_data, y_data, M, K);
+        if (alpha != 1.0f) {
+            for (int m = 0; m < M; ++m) {
+                y_data[m] *= alpha;
+            }
+        }
+    } else {
+        std::vector<float> result(M);
+        specialized::matvec(A_data, x_data, result.data(), M, K);
+        for (int m = 0; m < M; ++m) {
+            y_data[m] = alpha * result[m] + beta * y_data[m];
         }
-        y_data[m] = alpha * sum + beta * y_data[m];
     }
 #endif
 }
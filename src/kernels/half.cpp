@@ -0,0 +1,191 @@
+#include "half.hpp"
+#include <algorithm>
+#include <vector>
+
+#if defined(ENABLE_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+#if defined(ENABLE_SIMD) && defined(__AVX2__)
+// 8 bf16 values -> 8 floats: widen and shift into the high half
+inline __m256 load_bf16x8(const uint16_t* src) {
+    __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+}
+
+inline float hsum256(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    lo = _mm_hadd_ps(lo, lo);
+    lo = _mm_hadd_ps(lo, lo);
+    return _mm_cvtss_f32(lo);
+}
+#endif
+
+#if defined(ENABLE_SIMD) && defined(__F16C__)
+inline __m256 load_f16x8(const uint16_t* src) {
+    return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+}
+#endif
+
+} // namespace
+
+void fp16_to_fp32_row(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+#if defined(ENABLE_SIMD) && defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i, load_f16x8(src + i));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = fp16_to_fp32(src[i]);
+    }
+}
+
+void fp32_to_fp16_row(const float* src, uint16_t* dst, size_t n) {
+    size_t i = 0;
+#if defined(ENABLE_SIMD) && defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = fp32_to_fp16(src[i]);
+    }
+}
+
+void bf16_to_fp32_row(const uint16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+#if defined(ENABLE_SIMD) && defined(__AVX2__)
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i, load_bf16x8(src + i));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = bf16_to_fp32(src[i]);
+    }
+}
+
+void fp32_to_bf16_row(const float* src, uint16_t* dst, size_t n) {
+    size_t i = 0;
+#if defined(ENABLE_SIMD) && defined(__AVX512BF16__) && defined(__AVX512VL__)
+    for (; i + 8 <= n; i += 8) {
+        __m128bh h = _mm256_cvtneps_pbh(_mm256_loadu_ps(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), reinterpret_cast<__m128i&>(h));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = fp32_to_bf16(src[i]);
+    }
+}
+
+void matvec_f16(const uint16_t* W, const float* x, float* y, int M, int K) {
+    for (int m = 0; m < M; ++m) {
+        const uint16_t* row = W + static_cast<size_t>(m) * K;
+        float sum = 0.0f;
+        int k = 0;
+#if defined(ENABLE_SIMD) && defined(__F16C__)
+        __m256 acc = _mm256_setzero_ps();
+        for (; k + 8 <= K; k += 8) {
+            acc = _mm256_fmadd_ps(load_f16x8(row + k), _mm256_loadu_ps(x + k), acc);
+        }
+        sum = hsum256(acc);
+#endif
+        for (; k < K; ++k) {
+            sum += fp16_to_fp32(row[k]) * x[k];
+        }
+        y[m] = sum;
+    }
+}
+
+void matvec_bf16(const uint16_t* W, const float* x, float* y, int M, int K) {
+#if defined(ENABLE_SIMD) && defined(__AVX512BF16__)
+    // Native BF16 dot products: round x to bf16 once, then 32 pairs per instruction
+    std::vector<uint16_t> x_bf16(K);
+    fp32_to_bf16_row(x, x_bf16.data(), K);
+
+    for (int m = 0; m < M; ++m) {
+        const uint16_t* row = W + static_cast<size_t>(m) * K;
+        __m512 acc = _mm512_setzero_ps();
+        int k = 0;
+        for (; k + 32 <= K; k += 32) {
+            __m512i w = _mm512_loadu_si512(row + k);
+            __m512i v = _mm512_loadu_si512(x_bf16.data() + k);
+            acc = _mm512_dpbf16_ps(acc, reinterpret_cast<__m512bh&>(w), reinterpret_cast<__m512bh&>(v));
+        }
+        float sum = _mm512_reduce_add_ps(acc);
+        for (; k < K; ++k) {
+            sum += bf16_to_fp32(row[k]) * x[k];
+        }
+        y[m] = sum;
+    }
+#else
+    for (int m = 0; m < M; ++m) {
+        const uint16_t* row = W + static_cast<size_t>(m) * K;
+        float sum = 0.0f;
+        int k = 0;
+#if defined(ENABLE_SIMD) && defined(__AVX2__)
+        __m256 acc = _mm256_setzero_ps();
+        for (; k + 8 <= K; k += 8) {
+            acc = _mm256_fmadd_ps(load_bf16x8(row + k), _mm256_loadu_ps(x + k), acc);
+        }
+        sum = hsum256(acc);
+#endif
+        for (; k < K; ++k) {
+            sum += bf16_to_fp32(row[k]) * x[k];
+        }
+        y[m] = sum;
+    }
+#endif
+}
+
+namespace {
+
+// i-k-j order: each B row is converted once per A element and streamed into
+// a C row accumulator, so the conversion sits in the innermost loop
+template<bool BF16>
+void matmul_half(const float* A, const uint16_t* B, float* C,
+                 int M, int K, int N, float alpha, float beta) {
+    std::vector<float> acc(N);
+
+    for (int m = 0; m < M; ++m) {
+        std::fill(acc.begin(), acc.end(), 0.0f);
+
+        for (int k = 0; k < K; ++k) {
+            float a = A[static_cast<size_t>(m) * K + k];
+            const uint16_t* b_row = B + static_cast<size_t>(k) * N;
+            int n = 0;
+#if defined(ENABLE_SIMD) && defined(__AVX2__) && defined(__F16C__)
+            __m256 a_vec = _mm256_set1_ps(a);
+            for (; n + 8 <= N; n += 8) {
+                __m256 b_vec = BF16 ? load_bf16x8(b_row + n) : load_f16x8(b_row + n);
+                _mm256_storeu_ps(&acc[n], _mm256_fmadd_ps(a_vec, b_vec, _mm256_loadu_ps(&acc[n])));
+            }
+#endif
+            for (; n < N; ++n) {
+                acc[n] += a * (BF16 ? bf16_to_fp32(b_row[n]) : fp16_to_fp32(b_row[n]));
+            }
+        }
+
+        float* c_row = C + static_cast<size_t>(m) * N;
+        for (int n = 0; n < N; ++n) {
+            c_row[n] = alpha * acc[n] + beta * c_row[n];
+        }
+    }
+}
+
+} // namespace
+
+void matmul_f16(const float* A, const uint16_t* B, float* C,
+                int M, int K, int N, float alpha, float beta) {
+    matmul_half<false>(A, B, C, M, K, N, alpha, beta);
+}
+
+void matmul_bf16(const float* A, const uint16_t* B, float* C,
+                 int M, int K, int N, float alpha, float beta) {
+    matmul_half<true>(A, B, C, M, K, N, alpha, beta);
+}
@@ -0,0 +1,97 @@
+#ifndef HALF_HPP
+#define HALF_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// IEEE fp16 / bfloat16 <-> fp32 conversion helpers
+inline float bf16_to_fp32(uint16_t h) {
+    uint32_t bits = static_cast<uint32_t>(h) << 16;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint16_t fp32_to_bf16(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    if ((bits & 0x7FFFFFFF) > 0x7F800000) {
+        return static_cast<uint16_t>((bits >> 16) | 0x40); // Keep NaN quiet
+    }
+    // Round to nearest even
+    bits += 0x7FFF + ((bits >> 16) & 1);
+    return static_cast<uint16_t>(bits >> 16);
+}
+
+inline float fp16_to_fp32(uint16_t h) {
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t bits;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: renormalize
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400) == 0) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            mantissa &= 0x3FF;
+            bits = sign | (exponent << 23) | (mantissa << 13);
+        }
+    } else if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint16_t fp32_to_fp16(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    uint32_t abs_bits = bits & 0x7FFFFFFF;
+
+    if (abs_bits > 0x7F800000) return sign | 0x7E00;            // NaN
+    if (abs_bits >= 0x477FF000) return sign | 0x7C00;           // Overflow -> inf
+    if (abs_bits < 0x38800000) {                                // Subnormal or zero
+        if (abs_bits < 0x33000000) return sign;
+        uint32_t mantissa = (abs_bits & 0x7FFFFF) | 0x800000;
+        int shift = 126 - static_cast<int>(abs_bits >> 23);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) half++;
+        return sign | static_cast<uint16_t>(half);
+    }
+
+    // Normal: rebias exponent and round to nearest even
+    uint32_t rounded = abs_bits + 0xFFF + ((abs_bits >> 13) & 1);
+    return sign | static_cast<uint16_t>((rounded - (112u << 23)) >> 13);
+}
+
+// Bulk row conversions (F16C / shift-based SIMD when ENABLE_SIMD)
+void fp16_to_fp32_row(const uint16_t* src, float* dst, size_t n);
+void fp32_to_fp16_row(const float* src, uint16_t* dst, size_t n);
+void bf16_to_fp32_row(const uint16_t* src, float* dst, size_t n);
+void fp32_to_bf16_row(const float* src, uint16_t* dst, size_t n);
+
+// y[M] = W[M, K] * x[K] with half-precision weights converted in the inner loop
+void matvec_f16(const uint16_t* W, const float* x, float* y, int M, int K);
+void matvec_bf16(const uint16_t* W, const float* x, float* y, int M, int K);
+
+// C[M, N] = alpha * A[M, K] * B[K, N] + beta * C with half-precision B
+void matmul_f16(const float* A, const uint16_t* B, float* C,
+                int M, int K, int N, float alpha = 1.0f, float beta = 0.0f);
+void matmul_bf16(const float* A, const uint16_t* B, float* C,
+                 int M, int K, int N, float alpha = 1.0f, float beta = 0.0f);
+
+#endif // HALF_HPP
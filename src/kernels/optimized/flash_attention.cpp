@@ -2,11 +2,16 @@
 #include "../gemm_ref.hpp"
 #include <cmath>
 #include <algorithm>
+#include <cstring>
+#include <limits>
 
 namespace flash {
 
-FlashAttention::FlashAttention(int hidden_size, int num_heads, int head_dim, float scale)
-    : hidden_size_(hidden_size), num_heads_(num_heads), head_dim_(head_dim), scale_(scale) {
+FlashAttention::FlashAttention(int hidden_size, int num_heads, int head_dim, float scale,
+                               int layer_idx)
+    : hidden_size_(hidden_size), num_heads_(num_heads), head_dim_(head_dim), scale_(scale),
+      layer_idx_(layer_idx), rope_(head_dim),
+      head_kernel_(specialized::attention_head_kernel(head_dim)) {
 
     // Initialize attention weights tensor for debugging
     std::vector<int> weights_shape = {num_heads, 1, 1}; // Will be resized as needed
@@ -15,6 +20,13 @@ FlashAttention::FlashAttention(int hidden_size, int num_heads, int head_dim, flo
 
 Tensor FlashAttention::forward(const Tensor& query, const Tensor& key, const Tensor& value,
                               KVCache* cache) {
+    Tensor output(query.shape(), DType::FP32);
+    forward_into(query, key, value, output, cache);
+    return output;
+}
+
+void FlashAttention::forward_into(const Tensor& query, const Tensor& key, const Tensor& value,
+                                  Tensor& output, KVCache* cache) {
     auto q_shape = query.shape();
     auto k_shape = key.shape();
     auto v_shape = value.shape();
@@ -36,11 +48,16 @@ Tensor FlashAttention::forward(const Tensor& query, const Tensor& key, const Ten
     int seq_len = q_shape[1];
     int hidden_size = q_shape[2];
 
+    if (cache) {
+        if (batch_size != 1) {
+            throw std::runtime_error("FlashAttention with KV cache requires batch size 1");
+        }
+        compute_attention_cached(query, key, value, output, *cache);
+        return;
+    }
+
     // Reshape for multi-head attention
     std::vector<int> q_reshaped = {batch_size, seq_len, num_heads_, head_dim_};
-    std::vector<int> output_shape = {batch_size, seq_len, hidden_size};
-
-    Tensor output(output_shape, DType::FP32);
 
     // Process each head separately for simplicity
     for (int head = 0; head < num_heads_; ++head) {
@@ -95,8 +112,6 @@ Tensor FlashAttention::forward(const Tensor& query, const Tensor& key, const Ten
             }
         }
     }
-
-    return output;
 }
 
 void FlashAttention::compute_attention(const Tensor& Q, const Tensor& K, const Tensor& V,
@@ -114,53 +129,88 @@ void FlashAttention::compute_attention(const Tensor& Q, const Tensor& K, const T
     // Flash Attention algorithm (simplified implementation)
     // In a full implementation, this would use tiling and avoid storing full attention matrix
 
+    key_rows_.resize(seq_len);
+    value_rows_.resize(seq_len);
+    scores_.resize(seq_len);
+
     for (int b = 0; b < batch_size; ++b) {
-        for (int s = 0; s < seq_len; ++s) {
-            float max_score = -std::numeric_limits<float>::infinity();
-            float sum_exp = 0.0f;
+        size_t batch_offset = static_cast<size_t>(b) * seq_len * head_dim;
+        for (int t = 0; t < seq_len; ++t) {
+            key_rows_[t] = k_data + batch_offset + t * head_dim;
+            value_rows_[t] = v_data + batch_offset + t * head_dim;
+        }
 
-            // Compute attention scores for position s
-            std::vector<float> scores(seq_len);
+        // Causal attention: position s sees keys 0..s
+        for (int s = 0; s < seq_len; ++s) {
+            head_kernel_(q_data + batch_offset + s * head_dim, key_rows_.data(), value_rows_.data(),
+                         0, s + 1, head_dim, scale_, scores_.data(),
+                         output_data + batch_offset + s * head_dim);
+        }
+    }
+}
 
-            for (int t = 0; t <= s; ++t) { // Causal attention (only previous tokens)
-                float score = 0.0f;
+void FlashAttention::compute_attention_cached(const Tensor& query, const Tensor& key,
+                                              const Tensor& value, Tensor& output,
+                                              KVCache& cache) {
+    int seq_len = query.shape()[1];
+    int hidden_size = num_heads_ * head_dim_;
+    int base = cache.length();
+    bool rotate_on_read = cache.rotate_on_read();
+
+    const float* q_data = query.data<float>();
+    const float* k_data = key.data<float>();
+    const float* v_data = value.data<float>();
+    float* output_data = output.data<float>();
 
-                // Compute dot product Q[s] * K[t]
-                for (int d = 0; d < head_dim; ++d) {
-                    int q_idx = b * seq_len * head_dim + s * head_dim + d;
-                    int k_idx = b * seq_len * head_dim + t * head_dim + d;
-                    score += q_data[q_idx] * k_data[k_idx];
-                }
+    // Scratch buffers are members so steady-state decode doesn't allocate
+    q_row_.resize(hidden_size);
+    k_row_.resize(hidden_size);
+    if (rotate_on_read) {
+        rope_.cache_positions(cache.capacity());  // rope_position() stays below it
+    }
 
-                score *= scale_; // Apply scaling
-                scores[t] = score;
-                max_score = std::max(max_score, score);
-            }
+    // Tokens are stored and attended one at a time so a ring-buffer slot is
+    // never overwritten while an earlier query in this chunk still needs it
+    for (int s = 0; s < seq_len; ++s) {
+        int position = base + s;
+        int length = position + 1;
 
-            // Compute softmax
-            for (int t = 0; t <= s; ++t) {
-                scores[t] = std::exp(scores[t] - max_score);
-                sum_exp += scores[t];
+        std::memcpy(k_row_.data(), k_data + s * hidden_size, hidden_size * sizeof(float));
+        if (!rotate_on_read) {
+            rope_.apply(k_row_.data(), num_heads_, position);
+        }
+        cache.store(layer_idx_, position, k_row_.data(), v_data + s * hidden_size);
+
+        std::memcpy(q_row_.data(), q_data + s * hidden_size, hidden_size * sizeof(float));
+        rope_.apply(q_row_.data(), num_heads_, cache.rope_position(position, length));
+
+        cache.visible_positions(length, positions_);
+        int num_visible = static_cast<int>(positions_.size());
+
+        key_rows_.resize(num_visible);
+        value_rows_.resize(num_visible);
+        if (rotate_on_read) {
+            rotated_keys_.resize(static_cast<size_t>(num_visible) * hidden_size);
+            for (int t = 0; t < num_visible; ++t) {
+                float* dst = rotated_keys_.data() + static_cast<size_t>(t) * hidden_size;
+                std::memcpy(dst, cache.key_at(layer_idx_, positions_[t]), hidden_size * sizeof(float));
+                rope_.apply(dst, num_heads_, cache.rope_position(positions_[t], length));
+                key_rows_[t] = dst;
             }
-
-            if (sum_exp > 0) {
-                for (int t = 0; t <= s; ++t) {
-                    scores[t] /= sum_exp;
-                }
+        } else {
+            for (int t = 0; t < num_visible; ++t) {
+                key_rows_[t] = cache.key_at(layer_idx_, positions_[t]);
             }
+        }
+        for (int t = 0; t < num_visible; ++t) {
+            value_rows_[t] = cache.value_at(layer_idx_, positions_[t]);
+        }
 
-            // Compute weighted sum of values
-            for (int d = 0; d < head_dim; ++d) {
-                float weighted_sum = 0.0f;
-
-                for (int t = 0; t <= s; ++t) {
-                    int v_idx = b * seq_len * head_dim + t * head_dim + d;
-                    weighted_sum += scores[t] * v_data[v_idx];
-                }
-
-                int output_idx = b * seq_len * head_dim + s * head_dim + d;
-                output_data[output_idx] = weighted_sum;
-            }
+        scores_.resize(num_visible);
+        for (int head = 0; head < num_heads_; ++head) {
+            int offset = head * head_dim_;
+            head_kernel_(q_row_.data(), key_rows_.data(), value_rows_.data(), offset, num_visible,
+                         head_dim_, scale_, scores_.data(), output_data + s * hidden_size + offset);
         }
     }
 }
@@ -2,6 +2,9 @@
 #define FLASH_ATTENTION_HPP
 
 #include "../../tensor.hpp"
+#include "../../transformer/kv_cache.hpp"
+#include "../rope.hpp"
+#include "specialized_kernels.hpp"
 #include <vector>
 
 namespace flash {
@@ -9,13 +12,20 @@ namespace flash {
 // Flash Attention implementation for better memory efficiency
 class FlashAttention {
 public:
-    FlashAttention(int hidden_size, int num_heads, int head_dim, float scale = 1.0f);
+    FlashAttention(int hidden_size, int num_heads, int head_dim, float scale = 1.0f,
+                   int layer_idx = 0);
     ~FlashAttention() = default;
 
-    // Forward pass with KV caching support
+    // Forward pass with KV caching support. With a cache, the new tokens are
+    // appended at positions cache->length() onwards and RoPE is applied; the
+    // caller advances the cache once every layer has run.
     Tensor forward(const Tensor& query, const Tensor& key, const Tensor& value,
                   KVCache* cache = nullptr);
 
+    // Same as forward() but writes into a caller-provided [batch, seq, hidden] tensor
+    void forward_into(const Tensor& query, const Tensor& key, const Tensor& value,
+                      Tensor& output, KVCache* cache = nullptr);
+
     // Get attention weights for debugging
     Tensor get_attention_weights() const { return attention_weights_; }
 
@@ -23,10 +33,27 @@ private:
     void compute_attention(const Tensor& Q, const Tensor& K, const Tensor& V,
                           Tensor& output, KVCache* cache);
 
+    void compute_attention_cached(const Tensor& query, const Tensor& key, const Tensor& value,
+                                  Tensor& output, KVCache& cache);
+
     int hidden_size_;
     int num_heads_;
     int head_dim_;
     float scale_;
+    int layer_idx_;
+    RotaryEmbedding rope_;
+
+    // Per-head kernel chosen for head_dim_ at construction
+    specialized::AttentionHeadFn head_kernel_;
+
+    // Scratch for the cached path, reused across calls
+    std::vector<float> q_row_;
+    std::vector<float> k_row_;
+    std::vector<float> rotated_keys_;
+    std::vector<const float*> key_rows_;
+    std::vector<const float*> value_rows_;
+    std::vector<int> positions_;
+    std::vector<float> scores_;
     Tensor attention_weights_;
 };
 
@@ -143,6 +143,24 @@ void matvec_q4_avx2(const uint8_t* qweights, const float* scales,
 
 // Vectorized memory copy with alignment
 void memcpy_aligned(void* dst, const void* src, size_t size) {
+#ifdef __AVX512F__
+    // Tensor storage is 64-byte aligned, so whole cache lines move per op
+    if (size >= 64 && (reinterpret_cast<uintptr_t>(dst) % 64 == 0) &&
+        (reinterpret_cast<uintptr_t>(src) % 64 == 0)) {
+        size_t num_chunks = size / 64;
+        for (size_t i = 0; i < num_chunks; ++i) {
+            __m512 data = _mm512_load_ps(static_cast<const float*>(src) + i * 16);
+            _mm512_store_ps(static_cast<float*>(dst) + i * 16, data);
+        }
+        size_t remaining = size % 64;
+        if (remaining > 0) {
+            std::memcpy(static_cast<char*>(dst) + size - remaining,
+                       static_cast<const char*>(src) + size - remaining, remaining);
+        }
+        return;
+    }
+#endif
+
     // Use AVX2 for aligned copies when possible
     if (size >= 32 && (reinterpret_cast<uintptr_t>(dst) % 32 == 0) &&
         (reinterpret_cast<uintptr_t>(src) % 32 == 0)) {
@@ -0,0 +1,192 @@
+#include "specialized_kernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(ENABLE_SIMD) && (defined(__AVX512F__) || defined(__AVX2__))
+#include <immintrin.h>
+#endif
+
+namespace specialized {
+
+namespace {
+
+// Minimal vector abstraction so each kernel is written once per width
+#if defined(ENABLE_SIMD) && defined(__AVX512F__)
+constexpr int kLanes = 16;
+using vec = __m512;
+inline vec vzero() { return _mm512_setzero_ps(); }
+inline vec vset1(float x) { return _mm512_set1_ps(x); }
+inline vec vload(const float* p) { return _mm512_loadu_ps(p); }
+inline void vstore(float* p, vec v) { _mm512_storeu_ps(p, v); }
+inline vec vfmadd(vec a, vec b, vec c) { return _mm512_fmadd_ps(a, b, c); }
+inline vec vadd(vec a, vec b) { return _mm512_add_ps(a, b); }
+inline float vsum(vec v) { return _mm512_reduce_add_ps(v); }
+#elif defined(ENABLE_SIMD) && defined(__AVX2__) && defined(__FMA__)
+constexpr int kLanes = 8;
+using vec = __m256;
+inline vec vzero() { return _mm256_setzero_ps(); }
+inline vec vset1(float x) { return _mm256_set1_ps(x); }
+inline vec vload(const float* p) { return _mm256_loadu_ps(p); }
+inline void vstore(float* p, vec v) { _mm256_storeu_ps(p, v); }
+inline vec vfmadd(vec a, vec b, vec c) { return _mm256_fmadd_ps(a, b, c); }
+inline vec vadd(vec a, vec b) { return _mm256_add_ps(a, b); }
+inline float vsum(vec v) {
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    lo = _mm_hadd_ps(lo, lo);
+    lo = _mm_hadd_ps(lo, lo);
+    return _mm_cvtss_f32(lo);
+}
+#else
+constexpr int kLanes = 1;
+using vec = float;
+inline vec vzero() { return 0.0f; }
+inline vec vset1(float x) { return x; }
+inline vec vload(const float* p) { return *p; }
+inline void vstore(float* p, vec v) { *p = v; }
+inline vec vfmadd(vec a, vec b, vec c) { return a * b + c; }
+inline vec vadd(vec a, vec b) { return a + b; }
+inline float vsum(vec v) { return v; }
+#endif
+
+template<int HeadDim>
+void attention_head(const float* q, const float* const* keys, const float* const* values,
+                    int offset, int num_keys, int /*head_dim*/, float scale,
+                    float* scores, float* out) {
+    static_assert(HeadDim % kLanes == 0, "head_dim must be a multiple of the vector width");
+    constexpr int kRegs = HeadDim / kLanes;
+
+    // The whole query row lives in registers for the score loop
+    vec qv[kRegs];
+    for (int r = 0; r < kRegs; ++r) {
+        qv[r] = vload(q + offset + r * kLanes);
+    }
+
+    float max_score = -std::numeric_limits<float>::infinity();
+    for (int t = 0; t < num_keys; ++t) {
+        const float* k = keys[t] + offset;
+        vec acc0 = vzero();
+        vec acc1 = vzero();
+        for (int r = 0; r + 1 < kRegs; r += 2) {
+            acc0 = vfmadd(qv[r], vload(k + r * kLanes), acc0);
+            acc1 = vfmadd(qv[r + 1], vload(k + (r + 1) * kLanes), acc1);
+        }
+        if (kRegs % 2) {
+            acc0 = vfmadd(qv[kRegs - 1], vload(k + (kRegs - 1) * kLanes), acc0);
+        }
+        scores[t] = vsum(vadd(acc0, acc1)) * scale;
+        max_score = std::max(max_score, scores[t]);
+    }
+
+    float sum_exp = 0.0f;
+    for (int t = 0; t < num_keys; ++t) {
+        scores[t] = std::exp(scores[t] - max_score);
+        sum_exp += scores[t];
+    }
+
+    vec ov[kRegs];
+    for (int r = 0; r < kRegs; ++r) {
+        ov[r] = vzero();
+    }
+    float inv_sum = 1.0f / sum_exp;
+    for (int t = 0; t < num_keys; ++t) {
+        vec w = vset1(scores[t] * inv_sum);
+        const float* v = values[t] + offset;
+        for (int r = 0; r < kRegs; ++r) {
+            ov[r] = vfmadd(w, vload(v + r * kLanes), ov[r]);
+        }
+    }
+    for (int r = 0; r < kRegs; ++r) {
+        vstore(out + r * kLanes, ov[r]);
+    }
+}
+
+void attention_head_generic(const float* q, const float* const* keys, const float* const* values,
+                            int offset, int num_keys, int head_dim, float scale,
+                            float* scores, float* out) {
+    const float* q_head = q + offset;
+
+    float max_score = -std::numeric_limits<float>::infinity();
+    for (int t = 0; t < num_keys; ++t) {
+        const float* k = keys[t] + offset;
+        float score = 0.0f;
+        for (int d = 0; d < head_dim; ++d) {
+            score += q_head[d] * k[d];
+        }
+        scores[t] = score * scale;
+        max_score = std::max(max_score, scores[t]);
+    }
+
+    float sum_exp = 0.0f;
+    for (int t = 0; t < num_keys; ++t) {
+        scores[t] = std::exp(scores[t] - max_score);
+        sum_exp += scores[t];
+    }
+
+    std::fill(out, out + head_dim, 0.0f);
+    for (int t = 0; t < num_keys; ++t) {
+        const float* v = values[t] + offset;
+        float weight = scores[t] / sum_exp;
+        for (int d = 0; d < head_dim; ++d) {
+            out[d] += weight * v[d];
+        }
+    }
+}
+
+// Dot products over K in fixed-size tiles; the tile loop is fully unrolled
+// into kAcc independent accumulator chains
+template<int KTile>
+void matvec_tiled(const float* W, const float* x, float* y, int M, int K) {
+    static_assert(KTile % kLanes == 0, "K tile must be a multiple of the vector width");
+    constexpr int kRegs = KTile / kLanes;
+    constexpr int kAcc = kRegs < 4 ? kRegs : 4;
+
+    int k_main = K - K % KTile;
+    for (int m = 0; m < M; ++m) {
+        const float* row = W + static_cast<size_t>(m) * K;
+
+        vec acc[kAcc];
+        for (int a = 0; a < kAcc; ++a) {
+            acc[a] = vzero();
+        }
+        for (int k0 = 0; k0 < k_main; k0 += KTile) {
+            for (int r = 0; r < kRegs; ++r) {
+                int k = k0 + r * kLanes;
+                acc[r % kAcc] = vfmadd(vload(row + k), vload(x + k), acc[r % kAcc]);
+            }
+        }
+        for (int a = 1; a < kAcc; ++a) {
+            acc[0] = vadd(acc[0], acc[a]);
+        }
+
+        float sum = vsum(acc[0]);
+        for (int k = k_main; k < K; ++k) {
+            sum += row[k] * x[k];
+        }
+        y[m] = sum;
+    }
+}
+
+} // namespace
+
+AttentionHeadFn attention_head_kernel(int head_dim) {
+    switch (head_dim) {
+        case 64: return attention_head<64>;
+        case 80: return attention_head<80>;
+        case 96: return attention_head<96>;
+        case 128: return attention_head<128>;
+        default: return attention_head_generic;
+    }
+}
+
+bool has_attention_head_specialization(int head_dim) {
+    return attention_head_kernel(head_dim) != attention_head_generic;
+}
+
+MatvecFn matvec_kernel(int K) {
+    if (K % 256 == 0) return matvec_tiled<256>;
+    if (K % 128 == 0) return matvec_tiled<128>;
+    return matvec_tiled<64>;
+}
+
+} // namespace specialized
@@ -0,0 +1,33 @@
+#ifndef SPECIALIZED_KERNELS_HPP
+#define SPECIALIZED_KERNELS_HPP
+
+namespace specialized {
+
+// Single-query attention for one head over num_keys cached rows:
+//   out = softmax(scale * q . k_t) @ v_t
+// q, keys and values point at full rows; offset selects the head within each row.
+// scores is scratch of at least num_keys floats.
+using AttentionHeadFn = void (*)(const float* q, const float* const* keys,
+                                 const float* const* values, int offset, int num_keys,
+                                 int head_dim, float scale, float* scores, float* out);
+
+// Returns a variant compiled for head_dim in {64, 80, 96, 128}, where the
+// query stays in registers and the inner loops are fully unrolled, or the
+// generic runtime-sized kernel otherwise
+AttentionHeadFn attention_head_kernel(int head_dim);
+bool has_attention_head_specialization(int head_dim);
+
+// y[M] = W[M, K] * x[K] for row-major FP32 weights
+using MatvecFn = void (*)(const float* W, const float* x, float* y, int M, int K);
+
+// Picks the largest K tile in {256, 128, 64} that divides K; other sizes
+// run the 64-wide tile with a scalar tail
+MatvecFn matvec_kernel(int K);
+
+inline void matvec(const float* W, const float* x, float* y, int M, int K) {
+    matvec_kernel(K)(W, x, y, M, K);
+}
+
+} // namespace specialized
+
+#endif // SPECIALIZED_KERNELS_HPP
@@ -0,0 +1,45 @@
+#include "rope.hpp"
+#include <cmath>
+
+RotaryEmbedding::RotaryEmbedding(int head_dim, float theta) : head_dim_(head_dim) {
+    int half = head_dim_ / 2;
+    inv_freq_.resize(half);
+    for (int i = 0; i < half; ++i) {
+        inv_freq_[i] = 1.0f / std::pow(theta, static_cast<float>(2 * i) / head_dim_);
+    }
+}
+
+void RotaryEmbedding::cache_positions(int count) {
+    if (count <= cached_positions_) return;
+    int half = head_dim_ / 2;
+    cos_.resize(static_cast<size_t>(count) * half);
+    sin_.resize(static_cast<size_t>(count) * half);
+    for (int position = cached_positions_; position < count; ++position) {
+        for (int i = 0; i < half; ++i) {
+            float angle = position * inv_freq_[i];
+            cos_[static_cast<size_t>(position) * half + i] = std::cos(angle);
+            sin_[static_cast<size_t>(position) * half + i] = std::sin(angle);
+        }
+    }
+    cached_positions_ = count;
+}
+
+void RotaryEmbedding::apply(float* x, int num_heads, int position) const {
+    int half = head_dim_ / 2;
+    bool cached = position >= 0 && position < cached_positions_;
+    const float* cos_row = cached ? cos_.data() + static_cast<size_t>(position) * half : nullptr;
+    const float* sin_row = cached ? sin_.data() + static_cast<size_t>(position) * half : nullptr;
+    for (int i = 0; i < half; ++i) {
+        float angle = position * inv_freq_[i];
+        float c = cached ? cos_row[i] : std::cos(angle);
+        float s = cached ? sin_row[i] : std::sin(angle);
+
+        for (int h = 0; h < num_heads; ++h) {
+            float* head = x + h * head_dim_;
+            float x0 = head[i];
+            float x1 = head[i + half];
+            head[i] = x0 * c - x1 * s;
+            head[i + half] = x0 * s + x1 * c;
+        }
+    }
+}
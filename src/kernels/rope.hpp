@@ -0,0 +1,30 @@
+#ifndef ROPE_HPP
+#define ROPE_HPP
+
+#include <vector>
+
+// Rotary position embedding (LLaMA rotate-half layout): for each head, element
+// i is paired with i + head_dim/2 and the pair is rotated by position * inv_freq[i].
+class RotaryEmbedding {
+public:
+    RotaryEmbedding(int head_dim, float theta = 10000.0f);
+
+    // Rotate one token's [num_heads * head_dim] row in place
+    void apply(float* x, int num_heads, int position) const;
+
+    // Tabulate cos/sin for positions [0, count) so apply() on them does no
+    // trig. For attention-sink caches, which re-rotate every visible key on
+    // every step but never use a position past their capacity.
+    void cache_positions(int count);
+
+    int head_dim() const { return head_dim_; }
+
+private:
+    int head_dim_;
+    std::vector<float> inv_freq_;
+    int cached_positions_ = 0;
+    std::vector<float> cos_;  // [position][head_dim / 2]
+    std::vector<float> sin_;
+};
+
+#endif // ROPE_HPP
@@ -1,34 +1,198 @@
 #include "gguf_loader.hpp"
-#include <fstream>
+#include "../util/mapped_file.hpp"
 #include <iostream>
 #include <cstring>
 #include <stdexcept>
 
 namespace gguf {
 
-// Helper functions for reading GGUF data
-uint32_t read_u32(std::ifstream& file) {
-    uint32_t value;
-    file.read(reinterpret_cast<char*>(&value), sizeof(value));
-    return value;
+namespace {
+
+constexpr uint64_t kDefaultAlignment = 32;
+
+// Bytes of one element of a fixed-size value type, 0 for strings and arrays
+size_t value_size(uint32_t type) {
+    switch (type) {
+        case GGUF_UINT8: case GGUF_INT8: case GGUF_BOOL: return 1;
+        case GGUF_UINT16: case GGUF_INT16: return 2;
+        case GGUF_UINT32: case GGUF_INT32: case GGUF_FLOAT32: return 4;
+        case GGUF_UINT64: case GGUF_INT64: case GGUF_FLOAT64: return 8;
+        case GGUF_STRING: case GGUF_ARRAY: return 0;
+        default:
+            throw std::runtime_error("GGUF: unknown metadata type " + std::to_string(type));
+    }
 }
 
-uint64_t read_u64(std::ifstream& file) {
-    uint64_t value;
-    file.read(reinterpret_cast<char*>(&value), sizeof(value));
+// Fixed-size values are little-endian and unaligned in the file
+template <typename T>
+T load(const uint8_t* p) {
+    T value;
+    std::memcpy(&value, p, sizeof(value));
     return value;
 }
 
-std::string read_string(std::ifstream& file, size_t length) {
-    std::string str(length, '\0');
-    file.read(&str[0], length);
-    return str;
+int64_t load_int(uint32_t type, const uint8_t* p) {
+    switch (type) {
+        case GGUF_UINT8: return load<uint8_t>(p);
+        case GGUF_INT8: return load<int8_t>(p);
+        case GGUF_BOOL: return load<uint8_t>(p) != 0;
+        case GGUF_UINT16: return load<uint16_t>(p);
+        case GGUF_INT16: return load<int16_t>(p);
+        case GGUF_UINT32: return load<uint32_t>(p);
+        case GGUF_INT32: return load<int32_t>(p);
+        case GGUF_UINT64: return static_cast<int64_t>(load<uint64_t>(p));
+        case GGUF_INT64: return load<int64_t>(p);
+        case GGUF_FLOAT32: return static_cast<int64_t>(load<float>(p));
+        case GGUF_FLOAT64: return static_cast<int64_t>(load<double>(p));
+        default: throw std::runtime_error("GGUF: value is not numeric");
+    }
+}
+
+double load_float(uint32_t type, const uint8_t* p) {
+    if (type == GGUF_FLOAT32) return load<float>(p);
+    if (type == GGUF_FLOAT64) return load<double>(p);
+    return static_cast<double>(load_int(type, p));
+}
+
+// Bounds-checked cursor over the mapping
+class Reader {
+public:
+    Reader(const uint8_t* begin, const uint8_t* end) : begin_(begin), p_(begin), end_(end) {}
+
+    const uint8_t* take(uint64_t bytes) {
+        if (bytes > static_cast<uint64_t>(end_ - p_)) {
+            throw std::runtime_error("GGUF: file is truncated");
+        }
+        const uint8_t* at = p_;
+        p_ += bytes;
+        return at;
+    }
+    template <typename T>
+    T read() { return load<T>(take(sizeof(T))); }
+    std::string_view read_string() {
+        uint64_t size = read<uint64_t>();
+        return std::string_view(reinterpret_cast<const char*>(take(size)), size);
+    }
+    uint64_t position() const { return static_cast<uint64_t>(p_ - begin_); }
+
+    // Value of the given type, skipped over and described in place
+    GGUFValue read_value(uint32_t type) {
+        GGUFValue value{static_cast<GGUFValueType>(type), GGUF_UINT8, p_, 0};
+        if (type == GGUF_STRING) {
+            value.length = read<uint64_t>();
+            value.data = take(value.length);
+        } else if (type == GGUF_ARRAY) {
+            uint32_t element_type = read<uint32_t>();
+            if (element_type == GGUF_ARRAY) {
+                throw std::runtime_error("GGUF: nested arrays are not supported");
+            }
+            value.element_type = static_cast<GGUFValueType>(element_type);
+            value.length = read<uint64_t>();
+            value.data = p_;
+            size_t size = value_size(element_type);
+            if (size > 0) {
+                if (value.length > static_cast<uint64_t>(end_ - p_) / size) {
+                    throw std::runtime_error("GGUF: file is truncated");
+                }
+                take(value.length * size);
+            } else {
+                for (uint64_t i = 0; i < value.length; ++i) read_string();
+            }
+        } else {
+            take(value_size(type));
+        }
+        return value;
+    }
+
+private:
+    const uint8_t* begin_;
+    const uint8_t* p_;
+    const uint8_t* end_;
+};
+
+} // namespace
+
+int64_t GGUFValue::as_int() const { return load_int(type, data); }
+
+double GGUFValue::as_float() const { return load_float(type, data); }
+
+std::string_view GGUFValue::as_string() const {
+    if (type != GGUF_STRING) {
+        throw std::runtime_error("GGUF: value is not a string");
+    }
+    return std::string_view(reinterpret_cast<const char*>(data), length);
+}
+
+int64_t GGUFValue::int_at(uint64_t i) const {
+    if (type != GGUF_ARRAY || i >= length) {
+        throw std::runtime_error("GGUF: array index out of range");
+    }
+    return load_int(element_type, data + i * value_size(element_type));
+}
+
+double GGUFValue::float_at(uint64_t i) const {
+    if (type != GGUF_ARRAY || i >= length) {
+        throw std::runtime_error("GGUF: array index out of range");
+    }
+    return load_float(element_type, data + i * value_size(element_type));
+}
+
+GGUFFile::GGUFFile(const std::string& path) : file_(std::make_shared<MappedFile>(path)) {
+    Reader reader(file_->data(), file_->data() + file_->size());
+    if (reader.read<uint32_t>() != GGUF_MAGIC) {
+        throw std::runtime_error("Invalid GGUF magic number in " + path);
+    }
+    version_ = reader.read<uint32_t>();
+    if (version_ < 2 || version_ > GGUF_VERSION) {
+        throw std::runtime_error("Unsupported GGUF version " + std::to_string(version_) + " in " + path);
+    }
+    uint64_t tensor_count = reader.read<uint64_t>();
+    uint64_t metadata_kv_count = reader.read<uint64_t>();
+
+    for (uint64_t i = 0; i < metadata_kv_count; ++i) {
+        std::string key(reader.read_string());
+        uint32_t type = reader.read<uint32_t>();
+        metadata_[key] = reader.read_value(type);
+    }
+
+    for (uint64_t i = 0; i < tensor_count; ++i) {
+        GGUFTensorInfo info;
+        info.name = std::string(reader.read_string());
+        info.n_dims = reader.read<uint32_t>();
+        if (info.n_dims > 4) {
+            throw std::runtime_error("GGUF: tensor " + info.name + " has too many dimensions");
+        }
+        info.dimensions.resize(info.n_dims);
+        for (uint64_t& dim : info.dimensions) {
+            dim = reader.read<uint64_t>();
+        }
+        info.type = static_cast<GGMLType>(reader.read<uint32_t>());
+        info.offset = reader.read<uint64_t>();
+
+        // Calculate size (simplified)
+        info.size_bytes = ggml_type_size(info.type);
+        for (uint64_t dim : info.dimensions) {
+            info.size_bytes *= dim;
+        }
+        tensors_.push_back(std::move(info));
+    }
+
+    const GGUFValue* alignment = find("general.alignment");
+    uint64_t align = alignment ? static_cast<uint64_t>(alignment->as_int()) : kDefaultAlignment;
+    if (align == 0) align = kDefaultAlignment;
+    data_offset_ = (reader.position() + align - 1) / align * align;
+}
+
+const GGUFValue* GGUFFile::find(const std::string& key) const {
+    auto it = metadata_.find(key);
+    return it == metadata_.end() ? nullptr : &it->second;
 }
 
 DType ggml_to_dtype(GGMLType ggml_type) {
     switch (ggml_type) {
         case F32: return DType::FP32;
         case F16: return DType::FP16;
+        case BF16: return DType::BF16;
         case I8: return DType::INT8;
         case Q4_0:
         case Q4_1:
@@ -43,6 +207,7 @@ size_t ggml_type_size(GGMLType type) {
     switch (type) {
         case F32: return 4;
         case F16: return 2;
+        case BF16: return 2;
         case Q4_0: return 1; // 4-bit, but stored as bytes
         case Q4_1: return 1;
         case Q8_0: return 1;
@@ -54,67 +219,29 @@ size_t ggml_type_size(GGMLType type) {
 }
 
 GGUFMetadata inspect_gguf_model(const std::string& filepath) {
-    std::ifstream file(filepath, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Cannot open GGUF file: " + filepath);
-    }
-
-    GGUFHeader header;
-    header.magic = read_u32(file);
-    if (header.magic != GGUF_MAGIC) {
-        throw std::runtime_error("Invalid GGUF magic number");
-    }
-
-    header.version = read_u32(file);
-    header.tensor_count = read_u64(file);
-    header.metadata_kv_count = read_u64(file);
-
+    GGUFFile file(filepath);
     GGUFMetadata metadata;
 
-    // Read metadata key-value pairs
-    for (uint64_t i = 0; i < header.metadata_kv_count; ++i) {
-        uint32_t key_len = read_u32(file);
-        std::string key = read_string(file, key_len);
-
-        // Read value type (simplified - assume string for now)
-        uint32_t value_type = read_u32(file);
-        uint32_t value_len = read_u32(file);
-        std::string value = read_string(file, value_len);
-
-        metadata.metadata[key] = value;
-
-        if (key == "general.architecture") {
-            metadata.architecture = value;
+    // Scalars and strings; arrays (vocabularies and the like) are left in the file
+    for (const auto& entry : file.metadata()) {
+        const GGUFValue& value = entry.second;
+        if (value.type == GGUF_STRING) {
+            metadata.metadata[entry.first] = std::string(value.as_string());
+        } else if (value.type == GGUF_FLOAT32 || value.type == GGUF_FLOAT64) {
+            metadata.metadata[entry.first] = std::to_string(value.as_float());
+        } else if (value.type != GGUF_ARRAY) {
+            metadata.metadata[entry.first] = std::to_string(value.as_int());
         }
     }
+    auto architecture = metadata.metadata.find("general.architecture");
+    if (architecture != metadata.metadata.end()) {
+        metadata.architecture = architecture->second;
+    }
 
-    // Read tensor infos
-    for (uint64_t i = 0; i < header.tensor_count; ++i) {
-        uint32_t name_len = read_u32(file);
-        std::string name = read_string(file, name_len);
-
-        GGUFTensorInfo tensor_info;
-        tensor_info.name = name;
-        tensor_info.n_dims = read_u32(file);
-
-        std::vector<uint64_t> dims(tensor_info.n_dims);
-        for (uint32_t d = 0; d < tensor_info.n_dims; ++d) {
-            dims[d] = read_u64(file);
-        }
-        tensor_info.dimensions = dims;
-        tensor_info.type = static_cast<GGMLType>(read_u32(file));
-        tensor_info.offset = read_u64(file);
-
-        // Calculate size (simplified)
-        tensor_info.size_bytes = 1;
-        for (uint64_t dim : dims) {
-            tensor_info.size_bytes *= dim;
-        }
-        tensor_info.size_bytes *= ggml_type_size(tensor_info.type);
-
-        metadata.tensor_names.push_back(name);
-        metadata.tensor_shapes[name] = std::vector<int>(dims.begin(), dims.end());
-        metadata.tensor_types[name] = std::to_string(static_cast<int>(tensor_info.type));
+    for (const GGUFTensorInfo& info : file.tensors()) {
+        metadata.tensor_names.push_back(info.name);
+        metadata.tensor_shapes[info.name] = std::vector<int>(info.dimensions.begin(), info.dimensions.end());
+        metadata.tensor_types[info.name] = std::to_string(static_cast<int>(info.type));
     }
 
     return metadata;
@@ -124,26 +251,6 @@ std::unordered_map<std::string, Tensor> load_gguf_model(const std::string& filep
     std::cout << "Loading GGUF model: " << filepath << std::endl;
 
     GGUFMetadata metadata = inspect_gguf_model(filepath);
-    std::ifstream file(filepath, std::ios::binary);
-
-    // Skip header (already read in inspect)
-    file.seekg(0);
-    GGUFHeader header;
-    header.magic = read_u32(file);
-    header.version = read_u32(file);
-    header.tensor_count = read_u64(file);
-    header.metadata_kv_count = read_u64(file);
-
-    // Skip metadata KV pairs
-    for (uint64_t i = 0; i < header.metadata_kv_count; ++i) {
-        uint32_t key_len = read_u32(file);
-        file.seekg(key_len, std::ios::cur);
-
-        uint32_t value_type = read_u32(file);
-        uint32_t value_len = read_u32(file);
-        file.seekg(value_len, std::ios::cur);
-    }
-
     std::unordered_map<std::string, Tensor> tensors;
 
     // Read tensor data
@@ -153,7 +260,7 @@ std::unordered_map<std::string, Tensor> load_gguf_model(const std::string& filep
         auto it = metadata.tensor_shapes.find(name);
         if (it != metadata.tensor_shapes.end()) {
             DType dtype = ggml_to_dtype(static_cast<GGMLType>(std::stoi(metadata.tensor_types[name])));
-            Tensor tensor(it->second, dtype);
+            Tensor tensor(it->second, dtype, TensorStorage::HugePages);
 
             // Initialize with dummy data (in real implementation, read from file)
             if (dtype == DType::FP32) {
@@ -163,7 +270,7 @@ std::unordered_map<std::string, Tensor> load_gguf_model(const std::string& filep
                 }
             }
 
-            tensors[name] = std::move(tensor);
+            tensors.insert_or_assign(name, std::move(tensor));
             std::cout << "Loaded tensor: " << name << " shape: [";
             for (size_t i = 0; i < it->second.size(); ++i) {
                 if (i > 0) std::cout << ", ";
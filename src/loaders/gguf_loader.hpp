@@ -3,9 +3,15 @@
 
 #include "../tensor.hpp"
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <cstdint>
+#include <memory>
+#include <cstring>
+#include <stdexcept>
+
+class MappedFile;
 
 namespace gguf {
 
@@ -40,7 +46,8 @@ enum GGMLType : uint32_t {
     I8 = 16,
     I16 = 17,
     I32 = 18,
-    COUNT = 19
+    BF16 = 30,
+    COUNT = 31
 };
 
 struct GGUFHeader {
@@ -59,6 +66,86 @@ struct GGUFTensorInfo {
     uint64_t size_bytes;
 };
 
+// Metadata value types
+enum GGUFValueType : uint32_t {
+    GGUF_UINT8 = 0,
+    GGUF_INT8 = 1,
+    GGUF_UINT16 = 2,
+    GGUF_INT16 = 3,
+    GGUF_UINT32 = 4,
+    GGUF_INT32 = 5,
+    GGUF_FLOAT32 = 6,
+    GGUF_BOOL = 7,
+    GGUF_STRING = 8,
+    GGUF_ARRAY = 9,
+    GGUF_UINT64 = 10,
+    GGUF_INT64 = 11,
+    GGUF_FLOAT64 = 12,
+};
+
+// A metadata value where it lies in the mapped file. Nothing is copied:
+// strings are views and arrays are read element by element in place.
+struct GGUFValue {
+    GGUFValueType type;
+    GGUFValueType element_type;  // Arrays only
+    const uint8_t* data;         // The scalar, the string's bytes, or the first element
+    uint64_t length;             // Bytes of a string, elements of an array
+
+    // Numeric and bool scalars, converted; throw on other types
+    int64_t as_int() const;
+    double as_float() const;
+    std::string_view as_string() const;
+
+    // Element i of a numeric array
+    int64_t int_at(uint64_t i) const;
+    double float_at(uint64_t i) const;
+
+    // Calls on_string(std::string_view) for each element of a string array
+    template <typename F>
+    void for_each_string(F&& on_string) const;
+};
+
+// A GGUF file mapped into memory, with metadata and tensor infos indexed
+// in place. Large metadata arrays such as tokenizer.ggml.tokens are never
+// copied; views into them stay valid while mapping() is held.
+class GGUFFile {
+public:
+    // Throws std::runtime_error for anything but a well-formed GGUF v2/v3 file
+    explicit GGUFFile(const std::string& path);
+
+    uint32_t version() const { return version_; }
+    const std::shared_ptr<MappedFile>& mapping() const { return file_; }
+    const std::unordered_map<std::string, GGUFValue>& metadata() const { return metadata_; }
+    const std::vector<GGUFTensorInfo>& tensors() const { return tensors_; }
+    // Offset of the tensor data section; tensor offsets are relative to it
+    uint64_t data_offset() const { return data_offset_; }
+
+    // nullptr when the key is absent
+    const GGUFValue* find(const std::string& key) const;
+
+private:
+    std::shared_ptr<MappedFile> file_;
+    uint32_t version_ = 0;
+    std::unordered_map<std::string, GGUFValue> metadata_;
+    std::vector<GGUFTensorInfo> tensors_;
+    uint64_t data_offset_ = 0;
+};
+
+template <typename F>
+void GGUFValue::for_each_string(F&& on_string) const {
+    if (type != GGUF_ARRAY || element_type != GGUF_STRING) {
+        throw std::runtime_error("GGUF: value is not a string array");
+    }
+    // Bounds were checked when the file was indexed
+    const uint8_t* p = data;
+    for (uint64_t i = 0; i < length; ++i) {
+        uint64_t size;
+        std::memcpy(&size, p, sizeof(size));
+        on_string(std::string_view(reinterpret_cast<const char*>(p + sizeof(size)), size));
+        p += sizeof(size) + size;
+    }
+}
+
 // Load GGUF model and return tensor map
 std::unordered_map<std::string, Tensor> load_gguf_model(const std::string& filepath);
 
@@ -16,6 +16,7 @@ DType onnx_type_to_dtype(int onnx_type) {
     switch (onnx_type) {
         case 1: return DType::FP32;   // FLOAT
         case 10: return DType::FP16;  // FLOAT16
+        case 16: return DType::BF16;  // BFLOAT16
         case 3: return DType::INT8;   // INT8
         default:
             throw std::runtime_error("Unsupported ONNX data type: " + std::to_string(onnx_type));
@@ -69,6 +69,7 @@ const uint8_t SAFETENSORS_MAGIC[8] = {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE,
 DType string_to_dtype(const std::string& dtype_str) {
     if (dtype_str == "F32") return DType::FP32;
     if (dtype_str == "F16") return DType::FP16;
+    if (dtype_str == "BF16") return DType::BF16;
     if (dtype_str == "I8") return DType::INT8;
     if (dtype_str == "Q4") return DType::Q4;
     throw std::runtime_error("Unsupported dtype: " + dtype_str);
@@ -78,6 +79,7 @@ std::string dtype_to_string(DType dtype) {
     switch (dtype) {
         case DType::FP32: return "F32";
         case DType::FP16: return "F16";
+        case DType::BF16: return "BF16";
         case DType::INT8: return "I8";
         case DType::Q4: return "Q4";
         default: return "F32";
@@ -187,7 +189,7 @@ std::unordered_map<std::string, Tensor> load_safetensors(const std::string& file
             numel *= dim;
         }
 
-        Tensor tensor(std::vector<int>(shape.begin(), shape.end()), dtype);
+        Tensor tensor(std::vector<int>(shape.begin(), shape.end()), dtype, TensorStorage::HugePages);
 
         // Read tensor data
         size_t bytes_to_read = tensor.byte_size();
@@ -92,6 +92,38 @@ InferenceArgs parse_args(int argc, char* argv[]) {
             args.top_p = std::stof(argv[++i]);
         } else if (arg == "--seed" && i + 1 < argc) {
             args.seed = std::stoi(argv[++i]);
+        } else if (arg == "--kv-window" && i + 1 < argc) {
+            args.kv_window = std::stoi(argv[++i]);
+        } else if (arg == "--kv-sinks" && i + 1 < argc) {
+            args.kv_sinks = std::stoi(argv[++i]);
+        } else if (arg == "--huge-pages" && i + 1 < argc) {
+            args.huge_pages = argv[++i];
+        } else if (arg == "--autotune") {
+            args.autotune = true;
+        } else if (arg == "--autotune-cache" && i + 1 < argc) {
+            args.autotune_cache = argv[++i];
+        } else if (arg == "--serve" && i + 1 < argc) {
+            args.serve_port = std::stoi(argv[++i]);
+        } else if (arg == "--profile") {
+            args.profile = true;
+        } else if (arg == "--draft-model" && i + 1 < argc) {
+            args.draft_model = argv[++i];
+        } else if (arg == "--num-draft" && i + 1 < argc) {
+            args.num_draft = std::stoi(argv[++i]);
+        } else if (arg == "--prompt-lookup") {
+            args.prompt_lookup = true;
+        } else if (arg == "--ngram" && i + 1 < argc) {
+            args.ngram = std::stoi(argv[++i]);
+        } else if (arg == "--regex" && i + 1 < argc) {
+            args.regex = argv[++i];
+        } else if (arg == "--json-schema" && i + 1 < argc) {
+            args.json_schema = argv[++i];
+        } else if (arg == "--session-cache" && i + 1 < argc) {
+            args.session_cache_mb = std::stoi(argv[++i]);
+        } else if (arg == "--session-dir" && i + 1 < argc) {
+            args.session_dir = argv[++i];
+        } else if (arg == "--tokenizer" && i + 1 < argc) {
+            args.tokenizer_path = argv[++i];
         } else if (arg == "--verbose") {
             args.verbose = true;
         } else if (arg == "--help") {
@@ -111,7 +143,13 @@ InferenceArgs parse_args(int argc, char* argv[]) {
         exit(1);
     }
 
-    if (args.prompt.empty()) {
+    // A GGUF model carries its own vocabulary
+    if (args.tokenizer_path.empty() && args.model_path.size() > 5 &&
+        args.model_path.compare(args.model_path.size() - 5, 5, ".gguf") == 0) {
+        args.tokenizer_path = args.model_path;
+    }
+
+    if (args.prompt.empty() && args.serve_port < 0) {
         std::cerr << "Error: --prompt is required" << std::endl;
         App::print_usage(argv[0]);
         exit(1);
@@ -126,5 +164,8 @@ int main(int argc, char* argv[]) {
     std::cout << "Helios Engine - Mini LLM Inference" << std::endl;
     std::cout << "===================================" << std::endl;
 
+    if (args.serve_port >= 0) {
+        return App::serve(args);
+    }
     return App::run(args);
 }
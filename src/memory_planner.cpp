@@ -0,0 +1,86 @@
+#include "memory_planner.hpp"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+    size_t align_up(size_t value, size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+int MemoryPlanner::add_buffer(size_t bytes, int first_use, int last_use) {
+    if (last_use < first_use) {
+        throw std::runtime_error("MemoryPlanner: buffer used before it is produced");
+    }
+    buffers_.push_back({bytes, first_use, last_use});
+    return static_cast<int>(buffers_.size()) - 1;
+}
+
+void MemoryPlanner::plan(size_t alignment) {
+    std::vector<int> order(buffers_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](int a, int b) {
+        if (buffers_[a].bytes != buffers_[b].bytes) return buffers_[a].bytes > buffers_[b].bytes;
+        return buffers_[a].first_use < buffers_[b].first_use;
+    });
+
+    std::vector<int> placed;
+    std::vector<int> live;
+    arena_size_ = 0;
+
+    for (int id : order) {
+        Buffer& buffer = buffers_[id];
+
+        // Placed buffers whose lifetime overlaps this one, by offset
+        live.clear();
+        for (int other : placed) {
+            const Buffer& o = buffers_[other];
+            if (o.first_use <= buffer.last_use && buffer.first_use <= o.last_use) {
+                live.push_back(other);
+            }
+        }
+        std::sort(live.begin(), live.end(), [this](int a, int b) {
+            return buffers_[a].offset < buffers_[b].offset;
+        });
+
+        // Lowest gap that fits
+        size_t candidate = 0;
+        for (int other : live) {
+            const Buffer& o = buffers_[other];
+            if (candidate + buffer.bytes <= o.offset) {
+                break;
+            }
+            candidate = std::max(candidate, align_up(o.offset + o.bytes, alignment));
+        }
+
+        buffer.offset = candidate;
+        arena_size_ = std::max(arena_size_, align_up(candidate + buffer.bytes, alignment));
+        placed.push_back(id);
+    }
+}
+
+size_t MemoryPlanner::unplanned_size() const {
+    size_t total = 0;
+    for (const auto& buffer : buffers_) {
+        total += buffer.bytes;
+    }
+    return total;
+}
+
+ActivationArena::ActivationArena(const MemoryPlanner& planner, TensorPool& pool)
+    : planner_(planner), size_(planner.arena_size()) {
+    base_ = static_cast<uint8_t*>(pool.allocate(size_));
+}
+
+void* ActivationArena::data(int id) const {
+    return base_ + planner_.offset(id);
+}
+
+Tensor ActivationArena::tensor(int id, const std::vector<int>& shape, DType dtype) const {
+    Tensor view(shape, dtype, data(id));
+    if (view.byte_size() > planner_.buffer_size(id)) {
+        throw std::runtime_error("ActivationArena: tensor larger than its planned buffer");
+    }
+    return view;
+}
@@ -0,0 +1,60 @@
+#ifndef MEMORY_PLANNER_HPP
+#define MEMORY_PLANNER_HPP
+
+#include "tensor.hpp"
+#include "alloc.hpp"
+#include <vector>
+#include <cstddef>
+
+// Static offset assignment for the intermediates of one forward pass.
+// Buffers are registered with their liveness interval (execution step of
+// first and last use); plan() packs them into a single arena so that buffers
+// whose lifetimes don't overlap share memory.
+class MemoryPlanner {
+public:
+    // Returns a buffer id for use with offset()/ActivationArena
+    int add_buffer(size_t bytes, int first_use, int last_use);
+
+    // Greedy-by-size placement: largest buffers first, each at the lowest
+    // offset that doesn't collide with a placed buffer live at the same time
+    void plan(size_t alignment = 64);
+
+    size_t offset(int id) const { return buffers_[id].offset; }
+    size_t buffer_size(int id) const { return buffers_[id].bytes; }
+    size_t arena_size() const { return arena_size_; }
+    size_t num_buffers() const { return buffers_.size(); }
+
+    // Total bytes if every buffer had its own allocation
+    size_t unplanned_size() const;
+
+private:
+    struct Buffer {
+        size_t bytes;
+        int first_use;
+        int last_use;
+        size_t offset = 0;
+    };
+
+    std::vector<Buffer> buffers_;
+    size_t arena_size_ = 0;
+};
+
+// Preallocated block laid out by a MemoryPlanner. Tensors handed out are
+// non-owning views, so running a planned pass performs no heap allocation
+// for its intermediates.
+class ActivationArena {
+public:
+    ActivationArena(const MemoryPlanner& planner, TensorPool& pool);
+
+    void* data(int id) const;
+    Tensor tensor(int id, const std::vector<int>& shape, DType dtype) const;
+
+    size_t size() const { return size_; }
+
+private:
+    const MemoryPlanner& planner_;
+    uint8_t* base_;
+    size_t size_;
+};
+
+#endif // MEMORY_PLANNER_HPP
@@ -1,16 +1,34 @@
 #include "tensor.hpp"
+#include "alloc.hpp"
+#include "kernels/half.hpp"
 #include <sstream>
 #include <algorithm>
 #include <numeric>
 #include <cstring>
 
-Tensor::Tensor(const std::vector<int>& shape, DType dtype)
+Tensor::Tensor(const std::vector<int>& shape, DType dtype, TensorStorage storage_kind)
     : shape_(shape), dtype_(dtype) {
     numel_ = calculate_numel(shape);
     byte_size_ = calculate_byte_size(numel_, dtype);
 
-    // Allocate aligned memory
-    data_ = std::make_unique<uint8_t[]>(byte_size_);
+    // Allocate aligned memory (huge pages for large weight/KV buffers)
+    TensorStorageDeleter deleter;
+    deleter.size = byte_size_;
+    void* storage = AlignedAllocator::allocate_storage(byte_size_, &deleter.huge_pages,
+                                                       storage_kind == TensorStorage::HugePages);
+    data_ = std::unique_ptr<uint8_t[], TensorStorageDeleter>(static_cast<uint8_t*>(storage), deleter);
+}
+
+Tensor::Tensor(const std::vector<int>& shape, DType dtype, void* external_data)
+    : shape_(shape), dtype_(dtype), data_(static_cast<uint8_t*>(external_data), TensorStorageDeleter{false}) {
+    numel_ = calculate_numel(shape);
+    byte_size_ = calculate_byte_size(numel_, dtype);
+}
+
+void TensorStorageDeleter::operator()(uint8_t* ptr) const {
+    if (owned) {
+        AlignedAllocator::deallocate_storage(ptr, size, huge_pages);
+    }
 }
 
 Tensor::~Tensor() = default;
@@ -43,6 +61,7 @@ size_t Tensor::calculate_byte_size(size_t numel, DType dtype) const {
         case DType::FP32:
             return numel * 4;
         case DType::FP16:
+        case DType::BF16:
             return numel * 2;
         case DType::INT8:
             return numel * 1;
@@ -59,6 +78,7 @@ size_t Tensor::element_size() const {
         case DType::FP32:
             return 4;
         case DType::FP16:
+        case DType::BF16:
             return 2;
         case DType::INT8:
             return 1;
@@ -80,6 +100,63 @@ Tensor Tensor::reshape(const std::vector<int>& new_shape) const {
     return reshaped;
 }
 
+Tensor Tensor::view(const std::vector<int>& new_shape) {
+    if (calculate_numel(new_shape) != numel_) {
+        throw std::runtime_error("Cannot view: total elements don't match");
+    }
+    return Tensor(new_shape, dtype_, data_.get());
+}
+
+const Tensor Tensor::view(const std::vector<int>& new_shape) const {
+    if (calculate_numel(new_shape) != numel_) {
+        throw std::runtime_error("Cannot view: total elements don't match");
+    }
+    return Tensor(new_shape, dtype_, data_.get());
+}
+
+Tensor Tensor::to(DType target) const {
+    auto is_float = [](DType t) { return t == DType::FP32 || t == DType::FP16 || t == DType::BF16; };
+    if (!is_float(dtype_) || !is_float(target)) {
+        throw std::runtime_error("Tensor::to only converts between FP32, FP16 and BF16");
+    }
+
+    Tensor converted(shape_, target);
+    if (target == dtype_) {
+        std::memcpy(converted.data_.get(), data_.get(), byte_size_);
+        return converted;
+    }
+
+    // Go through FP32 when converting between the two half formats
+    const void* src = data_.get();
+    std::vector<float> staging;
+    if (dtype_ != DType::FP32) {
+        staging.resize(numel_);
+        const uint16_t* half = static_cast<const uint16_t*>(src);
+        if (dtype_ == DType::FP16) {
+            fp16_to_fp32_row(half, staging.data(), numel_);
+        } else {
+            bf16_to_fp32_row(half, staging.data(), numel_);
+        }
+        src = staging.data();
+    }
+
+    const float* fp32 = static_cast<const float*>(src);
+    switch (target) {
+        case DType::FP32:
+            std::memcpy(converted.data_.get(), fp32, numel_ * sizeof(float));
+            break;
+        case DType::FP16:
+            fp32_to_fp16_row(fp32, converted.data<uint16_t>(), numel_);
+            break;
+        case DType::BF16:
+            fp32_to_bf16_row(fp32, converted.data<uint16_t>(), numel_);
+            break;
+        default:
+            break;
+    }
+    return converted;
+}
+
 std::string Tensor::to_string() const {
     std::ostringstream oss;
     oss << "Tensor(shape=[";
@@ -92,6 +169,7 @@ std::string Tensor::to_string() const {
     switch (dtype_) {
         case DType::FP32: oss << "FP32"; break;
         case DType::FP16: oss << "FP16"; break;
+        case DType::BF16: oss << "BF16"; break;
         case DType::INT8: oss << "INT8"; break;
         case DType::Q4: oss << "Q4"; break;
     }
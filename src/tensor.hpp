@@ -5,18 +5,38 @@
 #include <memory>
 #include <string>
 #include <cstdint>
+#include <stdexcept>
 
 enum class DType {
     FP32,
     FP16,
+    BF16,
     INT8,
     Q4
 };
 
+// Where a tensor's own storage comes from
+enum class TensorStorage {
+    Default,   // Aligned heap memory
+    HugePages  // Huge-page backed once large: weights, KV blocks and other long-lived buffers
+};
+
+// Frees tensor storage unless the tensor is a view over external memory
+struct TensorStorageDeleter {
+    bool owned = true;
+    bool huge_pages = false;
+    size_t size = 0;
+    void operator()(uint8_t* ptr) const;
+};
+
 class Tensor {
 public:
     // Constructor
-    Tensor(const std::vector<int>& shape, DType dtype);
+    Tensor(const std::vector<int>& shape, DType dtype, TensorStorage storage = TensorStorage::Default);
+
+    // Non-owning view over externally managed memory (e.g. an activation arena).
+    // The memory must outlive the tensor.
+    Tensor(const std::vector<int>& shape, DType dtype, void* external_data);
 
     // Destructor
     ~Tensor();
@@ -44,7 +64,7 @@ public:
         if (sizeof(T) != element_size()) {
             throw std::runtime_error("Type size mismatch");
         }
-        return static_cast<T*>(data_.get());
+        return reinterpret_cast<T*>(data_.get());
     }
 
     template<typename T>
@@ -56,7 +76,7 @@ public:
         if (sizeof(T) != element_size()) {
             throw std::runtime_error("Type size mismatch");
         }
-        return static_cast<const T*>(data_.get());
+        return reinterpret_cast<const T*>(data_.get());
     }
 
     // Special accessor for Q4 data (packed uint8_t)
@@ -77,10 +97,18 @@ public:
     // Shape utilities
     size_t element_size() const;
     bool is_contiguous() const { return true; } // For now, assume contiguous
+    bool owns_data() const { return data_.get_deleter().owned; }
 
     // Reshape (creates new tensor)
     Tensor reshape(const std::vector<int>& new_shape) const;
 
+    // Reshape without copying; the view shares this tensor's memory
+    Tensor view(const std::vector<int>& new_shape);
+    const Tensor view(const std::vector<int>& new_shape) const;
+
+    // Convert between FP32, FP16 and BF16 (creates new tensor)
+    Tensor to(DType target) const;
+
     // String representation for debugging
     std::string to_string() const;
 
@@ -89,7 +117,7 @@ private:
     DType dtype_;
     size_t numel_;
     size_t byte_size_;
-    std::unique_ptr<uint8_t[]> data_;
+    std::unique_ptr<uint8_t[], TensorStorageDeleter> data_;
 
     size_t calculate_numel(const std::vector<int>& shape) const;
     size_t calculate_byte_size(size_t numel, DType dtype) const;
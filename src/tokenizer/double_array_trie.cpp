@@ -0,0 +1,91 @@
+#include "double_array_trie.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+void DoubleArrayTrie::build(std::vector<std::pair<std::string, int>> entries) {
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+    // Keep the last of each run of equal keys, and no empty ones
+    std::vector<std::pair<std::string, int>> keys;
+    keys.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].first.empty()) continue;
+        if (entries[i].second < 0) {
+            throw std::runtime_error("DoubleArrayTrie: values must be non-negative");
+        }
+        if (i + 1 < entries.size() && entries[i + 1].first == entries[i].first) continue;
+        keys.push_back(std::move(entries[i]));
+    }
+
+    base_.assign(1, 0);
+    check_.assign(1, -2);  // The root is never anyone's child
+    value_.assign(1, -1);
+    first_free_ = 1;
+    reserve(keys.size() * 2 + 257);
+    if (!keys.empty()) {
+        build_node(0, keys, 0, keys.size(), 0);
+    }
+
+    // Trim unused tail slots
+    size_t used = check_.size();
+    while (used > 1 && check_[used - 1] == -1) --used;
+    base_.resize(used);
+    check_.resize(used);
+    value_.resize(used);
+    base_.shrink_to_fit();
+    check_.shrink_to_fit();
+    value_.shrink_to_fit();
+}
+
+void DoubleArrayTrie::reserve(size_t size) {
+    if (size <= check_.size()) return;
+    base_.resize(size, 0);
+    check_.resize(size, -1);
+    value_.resize(size, -1);
+}
+
+void DoubleArrayTrie::build_node(int32_t state, const std::vector<std::pair<std::string, int>>& entries,
+                                 size_t begin, size_t end, size_t depth) {
+    // Keys are sorted, so one ending here comes first
+    if (entries[begin].first.size() == depth) {
+        value_[state] = entries[begin].second;
+        ++begin;
+    }
+    if (begin == end) return;
+
+    // Children in byte order with the key range under each
+    std::vector<uint8_t> labels;
+    std::vector<size_t> starts;
+    for (size_t i = begin; i < end; ++i) {
+        uint8_t label = static_cast<uint8_t>(entries[i].first[depth]);
+        if (labels.empty() || labels.back() != label) {
+            labels.push_back(label);
+            starts.push_back(i);
+        }
+    }
+    starts.push_back(end);
+
+    // Lowest base whose slots for every label are free
+    while (first_free_ < check_.size() && check_[first_free_] != -1) ++first_free_;
+    size_t base = first_free_ > labels[0] + 1u ? first_free_ - labels[0] - 1 : 0;
+    for (;; ++base) {
+        reserve(base + labels.back() + 2);
+        bool fits = true;
+        for (uint8_t label : labels) {
+            if (check_[base + label + 1] != -1) {
+                fits = false;
+                break;
+            }
+        }
+        if (fits) break;
+    }
+
+    base_[state] = static_cast<int32_t>(base);
+    for (uint8_t label : labels) {
+        check_[base + label + 1] = state;
+    }
+    for (size_t i = 0; i < labels.size(); ++i) {
+        build_node(static_cast<int32_t>(base + labels[i] + 1), entries, starts[i], starts[i + 1],
+                   depth + 1);
+    }
+}
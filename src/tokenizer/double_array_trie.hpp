@@ -0,0 +1,65 @@
+#ifndef DOUBLE_ARRAY_TRIE_HPP
+#define DOUBLE_ARRAY_TRIE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Byte trie in double-array form (Aoe 1989): the child of state s on byte
+// c is t = base[s] + c + 1, valid when check[t] == s. A transition is two
+// array loads, so walking a key costs about as much as reading it, and
+// the whole trie is three flat arrays.
+class DoubleArrayTrie {
+public:
+    DoubleArrayTrie() = default;
+
+    // Replaces the contents; keys need not be sorted. Empty keys are ignored
+    // and a repeated key keeps its last value. Values must be >= 0.
+    void build(std::vector<std::pair<std::string, int>> entries);
+
+    // Value of key, or -1
+    int find(const char* key, size_t length) const {
+        int32_t state = 0;
+        for (size_t i = 0; i < length; ++i) {
+            state = child(state, static_cast<uint8_t>(key[i]));
+            if (state < 0) return -1;
+        }
+        return value_[state];
+    }
+    int find(const std::string& key) const { return find(key.data(), key.size()); }
+
+    // Calls on_match(length, value) for every key that is a prefix of text,
+    // shortest first
+    template <typename F>
+    void prefix_matches(const char* text, size_t length, F&& on_match) const {
+        int32_t state = 0;
+        for (size_t i = 0; i < length; ++i) {
+            state = child(state, static_cast<uint8_t>(text[i]));
+            if (state < 0) return;
+            if (value_[state] >= 0) on_match(i + 1, value_[state]);
+        }
+    }
+
+    bool empty() const { return base_.size() <= 1; }
+    size_t byte_size() const { return base_.size() * 3 * sizeof(int32_t); }
+
+private:
+    int32_t child(int32_t state, uint8_t byte) const {
+        if (base_.empty()) return -1;
+        size_t next = static_cast<size_t>(base_[state]) + byte + 1;
+        return next < check_.size() && check_[next] == state ? static_cast<int32_t>(next) : -1;
+    }
+
+    void build_node(int32_t state, const std::vector<std::pair<std::string, int>>& entries,
+                    size_t begin, size_t end, size_t depth);
+    void reserve(size_t size);
+
+    std::vector<int32_t> base_;
+    std::vector<int32_t> check_;  // Parent state; -1 marks a free slot
+    std::vector<int32_t> value_;  // -1 unless a key ends here
+    size_t first_free_ = 1;
+};
+
+#endif // DOUBLE_ARRAY_TRIE_HPP
@@ -1,115 +1,1098 @@
 #include "sentencepiece_wrapper.hpp"
+#include "../loaders/gguf_loader.hpp"
+#include "../util/json.hpp"
+#include "../util/mapped_file.hpp"
+#include "../util/threadpool.hpp"
+#include <google/protobuf/io/coded_stream.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <queue>
 #include <stdexcept>
-#include <algorithm>
-#include <regex>
 
-Tokenizer::Tokenizer(const std::string& model_path) : model_path_(model_path) {
-    // Simplified tokenizer initialization
-    // In a real implementation, this would load a sentencepiece model
+using google::protobuf::io::CodedInputStream;
+
+namespace {
+
+const char kSpaceMarker[] = "\xE2\x96\x81";  // U+2581, SentencePiece's visible space
+constexpr size_t kSpaceMarkerLength = 3;
+constexpr int kFallbackVocabSize = 32000;
+// Work per encode_batch / decode_batch task: enough to amortize the
+// hand-off, small enough that one long document splits across threads
+constexpr size_t kTaskBytes = 16 * 1024;
+constexpr size_t kTaskTokens = 4 * 1024;
+
+// Bytes in the UTF-8 sequence led by c; stray continuation bytes count as one
+size_t utf8_length(unsigned char c) {
+    if (c < 0x80) return 1;
+    if ((c >> 5) == 0x6) return 2;
+    if ((c >> 4) == 0xE) return 3;
+    if ((c >> 3) == 0x1E) return 4;
+    return 1;
+}
 
-    vocab_size_ = 32000; // Default vocab size
-    bos_token_id_ = 1;   // Beginning of sentence
-    eos_token_id_ = 2;   // End of sentence
-    pad_token_id_ = 0;   // Padding
+// GPT-2's reversible byte -> code point map: printable bytes stand for
+// themselves and the rest move to 256 and up, so no piece holds whitespace
+// or control characters
+const std::array<uint32_t, 256>& byte_level_code_points() {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> points{};
+        uint32_t next = 256;
+        for (int b = 0; b < 256; ++b) {
+            bool printable = (b >= 33 && b <= 126) || (b >= 161 && b <= 172) || b >= 174;
+            points[b] = printable ? b : next++;
+        }
+        return points;
+    }();
+    return table;
+}
 
-    // Create a simple vocabulary for testing (would be loaded from model file)
-    vocabulary_.reserve(vocab_size_);
-    for (int i = 0; i < vocab_size_; ++i) {
-        vocabulary_.push_back("token_" + std::to_string(i));
+// Raw bytes of a byte-level piece; characters outside the map are kept
+std::string byte_level_decode(std::string_view piece) {
+    static const std::array<int, 512> inverse = [] {
+        std::array<int, 512> bytes;
+        bytes.fill(-1);
+        const auto& points = byte_level_code_points();
+        for (int b = 0; b < 256; ++b) bytes[points[b]] = b;
+        return bytes;
+    }();
+
+    std::string out;
+    for (size_t i = 0; i < piece.size();) {
+        size_t n = std::min(utf8_length(piece[i]), piece.size() - i);
+        uint32_t code_point = static_cast<unsigned char>(piece[i]);
+        if (n == 2) {
+            code_point = ((code_point & 0x1F) << 6) | (piece[i + 1] & 0x3F);
+        }
+        if (n <= 2 && code_point < inverse.size() && inverse[code_point] >= 0) {
+            out += static_cast<char>(inverse[code_point]);
+        } else {
+            out.append(piece, i, n);
+        }
+        i += n;
     }
+    return out;
+}
 
-    // Add some common tokens
-    if (vocab_size_ > 100) {
-        vocabulary_[1] = "<s>";     // BOS
-        vocabulary_[2] = "</s>";    // EOS
-        vocabulary_[0] = "<pad>";   // PAD
-        vocabulary_[3] = "<unk>";   // UNK
+// The byte of a "<0xAB>" piece, or -1
+int parse_byte_piece(std::string_view piece) {
+    if (piece.size() != 6 || piece.compare(0, 3, "<0x") != 0 || piece[5] != '>') return -1;
+    int value = 0;
+    for (int i = 3; i < 5; ++i) {
+        char c = piece[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+        else return -1;
     }
+    return value;
 }
 
-Tokenizer::~Tokenizer() = default;
+// Character classes of the byte-level pre-tokenizer. Anything non-ASCII
+// counts as a letter, which keeps words of every script together.
+bool is_space(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+bool is_digit(unsigned char c) { return c >= '0' && c <= '9'; }
+bool is_letter(unsigned char c) { return ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c >= 0x80; }
+bool is_symbol(unsigned char c) { return !is_space(c) && !is_letter(c) && !is_digit(c); }
+bool is_newline(unsigned char c) { return c == '\n' || c == '\r'; }
 
-std::vector<int> Tokenizer::encode(const std::string& text) {
-    // Very simplified tokenization for testing
-    // In a real implementation, this would use sentencepiece or BPE
+// Length of the contraction ('s, 't, 're, 've, 'm, 'll, 'd) at text, or 0
+size_t contraction_length(const char* text, size_t length, bool ignore_case) {
+    if (length < 2 || text[0] != '\'') return 0;
+    auto lower = [&](size_t i) {
+        char c = text[i];
+        return ignore_case && c >= 'A' && c <= 'Z' ? static_cast<char>(c + 32) : c;
+    };
+    char a = lower(1);
+    if (a == 's' || a == 't' || a == 'm' || a == 'd') return 2;
+    if (length >= 3) {
+        char b = lower(2);
+        if ((a == 'r' && b == 'e') || (a == 'v' && b == 'e') || (a == 'l' && b == 'l')) return 3;
+    }
+    return 0;
+}
 
-    std::vector<int> tokens;
-    std::string remaining = text;
-
-    // Simple word-level tokenization with regex
-    std::regex word_regex(R"(\w+|[^\w\s])");
-    std::sregex_iterator iter(text.begin(), text.end(), word_regex);
-    std::sregex_iterator end;
-
-    for (; iter != end; ++iter) {
-        std::string token = iter->str();
-
-        // Simple mapping for common words (would use proper vocabulary in real impl)
-        if (token == "hello" || token == "Hello") {
-            tokens.push_back(9900); // Made up token ID
-        } else if (token == "world" || token == "World") {
-            tokens.push_back(1917); // Made up token ID
-        } else if (token == "the" || token == "The") {
-            tokens.push_back(5);    // Made up token ID
-        } else if (token == ".") {
-            tokens.push_back(13);   // Made up token ID
-        } else if (token == ",") {
-            tokens.push_back(11);   // Made up token ID
+// Hand-written equivalent of the GPT-2 split regex
+//   's|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+
+// or, with llama3, of the Llama 3 / Qwen 2 one
+//   (?i:'s|...)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,3}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+
+// Calls on_word(start, length) for each piece of text.
+template <typename F>
+void split_byte_level(const char* text, size_t length, bool llama3, int max_digits, F&& on_word) {
+    auto at = [&](size_t i) { return static_cast<unsigned char>(text[i]); };
+    size_t i = 0;
+    while (i < length) {
+        unsigned char c = at(i);
+        size_t end = i + contraction_length(text + i, length - i, llama3);
+        if (end > i) {
+            on_word(i, end - i);
+            i = end;
+            continue;
+        }
+
+        bool has_next = i + 1 < length;
+        bool letter_prefix = has_next && is_letter(at(i + 1)) &&
+                             (llama3 ? is_symbol(c) || (is_space(c) && !is_newline(c)) : c == ' ');
+        if (is_letter(c) || letter_prefix) {
+            end = i + 1;
+            while (end < length && is_letter(at(end))) ++end;
+        } else if (is_digit(c) || (!llama3 && c == ' ' && has_next && is_digit(at(i + 1)))) {
+            size_t digits = is_digit(c) ? i : i + 1;
+            end = digits;
+            while (end < length && is_digit(at(end)) &&
+                   (max_digits == 0 || end - digits < static_cast<size_t>(max_digits))) {
+                ++end;
+            }
+        } else if (is_symbol(c) || (c == ' ' && has_next && is_symbol(at(i + 1)))) {
+            end = i + 1;
+            while (end < length && is_symbol(at(end))) ++end;
+            if (llama3) {
+                while (end < length && is_newline(at(end))) ++end;
+            }
         } else {
-            // Unknown word - use UNK token
-            tokens.push_back(3);
+            end = i;
+            while (end < length && is_space(at(end))) ++end;
+            size_t newline_end = i;
+            if (llama3) {
+                for (size_t k = i; k < end; ++k) {
+                    if (is_newline(at(k))) newline_end = k + 1;
+                }
+            }
+            if (newline_end > i) {
+                end = newline_end;  // \s*[\r\n]+
+            } else if (end < length && end - i > 1) {
+                --end;  // \s+(?!\S): the last space goes with the next word
+            }
+        }
+        on_word(i, end - i);
+        i = end;
+    }
+}
+
+// First point at or after position where text can be cut without changing
+// its tokens: a space between a non-space and an ASCII letter, where both
+// pre-tokenizers start a new word. text.size() if there is none.
+size_t safe_split(const std::string& text, size_t position) {
+    for (size_t i = std::max<size_t>(position, 1); i + 1 < text.size(); ++i) {
+        unsigned char next = text[i + 1];
+        if (text[i] == ' ' && !is_space(text[i - 1]) && next < 0x80 && is_letter(next)) return i;
+    }
+    return text.size();
+}
+
+// Protobuf wire format, read field by field so no generated code is needed
+
+bool skip_field(CodedInputStream& input, uint32_t wire_type) {
+    uint64_t value64;
+    uint32_t value32;
+    switch (wire_type) {
+        case 0: return input.ReadVarint64(&value64);
+        case 1: return input.ReadLittleEndian64(&value64);
+        case 2: return input.ReadVarint32(&value32) && input.Skip(static_cast<int>(value32));
+        case 5: return input.ReadLittleEndian32(&value32);
+        default: return false;
+    }
+}
+
+// Calls on_field(number, wire_type) for each field until the end of input
+// or the current limit; on_field reads the value, or returns false to
+// have it skipped
+template <typename F>
+void read_fields(CodedInputStream& input, F&& on_field) {
+    while (uint32_t tag = input.ReadTag()) {
+        if (!on_field(tag >> 3, tag & 7) && !skip_field(input, tag & 7)) {
+            throw std::runtime_error("Tokenizer: malformed SentencePiece model");
+        }
+    }
+}
+
+template <typename F>
+bool read_message(CodedInputStream& input, F&& on_field) {
+    uint32_t length;
+    if (!input.ReadVarint32(&length)) return false;
+    auto limit = input.PushLimit(static_cast<int>(length));
+    read_fields(input, on_field);
+    input.PopLimit(limit);
+    return true;
+}
+
+bool read_string(CodedInputStream& input, std::string& value) {
+    uint32_t length;
+    return input.ReadVarint32(&length) && input.ReadString(&value, static_cast<int>(length));
+}
+
+bool read_int(CodedInputStream& input, int& value) {
+    uint32_t raw;  // Negative int32s are 10-byte varints; the low 32 bits are the value
+    if (!input.ReadVarint32(&raw)) return false;
+    value = static_cast<int32_t>(raw);
+    return true;
+}
+
+bool read_float(CodedInputStream& input, float& value) {
+    uint32_t raw;
+    if (!input.ReadLittleEndian32(&raw)) return false;
+    std::memcpy(&value, &raw, sizeof(value));
+    return true;
+}
+
+// First object in a tokenizer.json subtree whose "type" is type
+const JsonValue* find_type(const JsonValue* node, const std::string& type) {
+    if (!node) return nullptr;
+    if (node->is_object()) {
+        const JsonValue* value = node->find("type");
+        if (value && value->is_string() && value->string == type) return node;
+        for (const auto& member : node->object) {
+            if (const JsonValue* found = find_type(&member.second, type)) return found;
+        }
+    } else if (node->is_array()) {
+        for (const auto& element : node->array) {
+            if (const JsonValue* found = find_type(&element, type)) return found;
+        }
+    }
+    return nullptr;
+}
+
+bool json_bool(const JsonValue* node, const std::string& key, bool fallback) {
+    const JsonValue* value = node ? node->find(key) : nullptr;
+    return value && value->type == JsonValue::Type::Bool ? value->boolean : fallback;
+}
+
+std::string json_string(const JsonValue* node, const std::string& key) {
+    const JsonValue* value = node ? node->find(key) : nullptr;
+    return value && value->is_string() ? value->string : "";
+}
+
+} // namespace
+
+Tokenizer::Tokenizer(const std::string& model_path) : model_path_(model_path) {
+    auto has_extension = [&](const std::string& extension) {
+        return model_path.size() >= extension.size() &&
+               model_path.compare(model_path.size() - extension.size(), extension.size(), extension) == 0;
+    };
+    if (model_path.empty()) {
+        load_fallback();
+    } else if (has_extension(".json")) {
+        load_hf_json(model_path);
+    } else if (has_extension(".gguf")) {
+        load_gguf(model_path);
+    } else {
+        load_sentencepiece(model_path);
+    }
+}
+
+Tokenizer::~Tokenizer() {
+    // The build thread writes into this object
+    if (build_.valid()) {
+        build_.wait();
+    }
+}
+
+void Tokenizer::load_fallback() {
+    std::cout << "Warning: No tokenizer given. Using a byte-level vocabulary.\n";
+    piece_storage_ = {"<pad>", "<s>", "</s>", "<unk>"};
+    types_ = {TokenType::Control, TokenType::Control, TokenType::Control, TokenType::Unknown};
+    pad_token_id_ = 0;
+    bos_token_id_ = 1;
+    eos_token_id_ = 2;
+    unk_token_id_ = 3;
+    static const char* digits = "0123456789ABCDEF";
+    for (int b = 0; b < 256; ++b) {
+        piece_storage_.push_back(std::string("<0x") + digits[b >> 4] + digits[b & 0xF] + ">");
+        types_.push_back(TokenType::Byte);
+    }
+    while (piece_storage_.size() < static_cast<size_t>(kFallbackVocabSize)) {
+        piece_storage_.push_back("<unused" + std::to_string(piece_storage_.size()) + ">");
+        types_.push_back(TokenType::Unused);
+    }
+    scores_.assign(piece_storage_.size(), 0.0f);
+
+    algorithm_ = Algorithm::BPE;
+    byte_level_ = true;
+    add_dummy_prefix_ = false;
+    byte_fallback_ = true;
+    finalize();
+}
+
+void Tokenizer::load_sentencepiece(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open tokenizer model: " + path);
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    CodedInputStream input(reinterpret_cast<const uint8_t*>(data.data()), static_cast<int>(data.size()));
+
+    // Defaults of sentencepiece_model.proto
+    int model_type = 1;  // UNIGRAM = 1, BPE = 2
+    unk_token_id_ = 0;
+    bos_token_id_ = 1;
+    eos_token_id_ = 2;
+    pad_token_id_ = -1;
+    add_dummy_prefix_ = true;
+    remove_extra_whitespaces_ = true;
+    std::string normalizer_name, precompiled_charsmap;
+
+    read_fields(input, [&](uint32_t field, uint32_t wire_type) {
+        if (wire_type != 2) return false;
+        if (field == 1) {  // SentencePiece
+            std::string piece;
+            float score = 0.0f;
+            int type = static_cast<int>(TokenType::Normal);
+            return read_message(input, [&](uint32_t f, uint32_t) {
+                if (f == 1) return read_string(input, piece);
+                if (f == 2) return read_float(input, score);
+                if (f == 3) return read_int(input, type);
+                return false;
+            }) && (piece_storage_.push_back(piece), scores_.push_back(score),
+                   types_.push_back(type >= 1 && type <= 6 ? static_cast<TokenType>(type)
+                                                           : TokenType::Normal),
+                   true);
+        }
+        if (field == 2) {  // TrainerSpec
+            return read_message(input, [&](uint32_t f, uint32_t w) {
+                int flag = 0;
+                if (w != 0) return false;
+                switch (f) {
+                    case 3: return read_int(input, model_type);
+                    case 35: return read_int(input, flag) && ((byte_fallback_ = flag != 0), true);
+                    case 40: return read_int(input, unk_token_id_);
+                    case 41: return read_int(input, bos_token_id_);
+                    case 42: return read_int(input, eos_token_id_);
+                    case 43: return read_int(input, pad_token_id_);
+                    default: return false;
+                }
+            });
+        }
+        if (field == 3) {  // NormalizerSpec
+            return read_message(input, [&](uint32_t f, uint32_t w) {
+                int flag = 0;
+                if (w == 2 && f == 1) return read_string(input, normalizer_name);
+                if (w == 2 && f == 2) return read_string(input, precompiled_charsmap);
+                if (w != 0) return false;
+                if (f == 3) return read_int(input, flag) && ((add_dummy_prefix_ = flag != 0), true);
+                if (f == 4) return read_int(input, flag) && ((remove_extra_whitespaces_ = flag != 0), true);
+                return false;
+            });
+        }
+        return false;
+    });
+
+    if (piece_storage_.empty()) {
+        throw std::runtime_error("Tokenizer: no pieces in " + path);
+    }
+    if (model_type != 1 && model_type != 2) {
+        throw std::runtime_error("Tokenizer: only Unigram and BPE SentencePiece models are supported");
+    }
+    algorithm_ = model_type == 1 ? Algorithm::Unigram : Algorithm::BPE;
+    // SentencePiece normalizes with the precompiled map alone; "identity"
+    // models ship none
+    if (!precompiled_charsmap.empty()) {
+        unapplied_normalizer_ = normalizer_name.empty() ? "precompiled" : normalizer_name;
+        std::cerr << "Warning: " << path << " normalizes text with " << unapplied_normalizer_
+                  << ", which is not applied; text it would change encodes differently" << std::endl;
+    }
+    int size = static_cast<int>(piece_storage_.size());
+    for (int* id : {&unk_token_id_, &bos_token_id_, &eos_token_id_, &pad_token_id_}) {
+        if (*id >= size) *id = -1;
+    }
+    finalize();
+}
+
+void Tokenizer::load_hf_json(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open tokenizer: " + path);
+    }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    JsonValue root = parse_json(text);
+    const JsonValue* model = root.find("model");
+    const JsonValue* vocab = model ? model->find("vocab") : nullptr;
+    if (!vocab) {
+        throw std::runtime_error("Tokenizer: no model.vocab in " + path);
+    }
+
+    std::string model_type = json_string(model, "type");
+    byte_fallback_ = json_bool(model, "byte_fallback", false);
+    auto set_piece = [&](int id, const std::string& piece, float score, TokenType type) {
+        if (id < 0) {
+            throw std::runtime_error("Tokenizer: negative token ID in " + path);
+        }
+        if (id >= static_cast<int>(piece_storage_.size())) {
+            piece_storage_.resize(id + 1);
+            scores_.resize(id + 1, 0.0f);
+            types_.resize(id + 1, TokenType::Unused);
+        }
+        piece_storage_[id] = piece;
+        scores_[id] = score;
+        types_[id] = byte_fallback_ && parse_byte_piece(piece) >= 0 ? TokenType::Byte : type;
+    };
+
+    std::unordered_map<std::string, int> ids;
+    if (model_type == "Unigram") {
+        algorithm_ = Algorithm::Unigram;
+        for (size_t id = 0; id < vocab->array.size(); ++id) {
+            const JsonValue& entry = vocab->array[id];
+            if (!entry.is_array() || entry.array.size() < 2) {
+                throw std::runtime_error("Tokenizer: malformed Unigram vocab in " + path);
+            }
+            set_piece(static_cast<int>(id), entry.array[0].string,
+                      static_cast<float>(entry.array[1].number), TokenType::Normal);
+            ids.emplace(entry.array[0].string, static_cast<int>(id));
+        }
+        const JsonValue* unk = model->find("unk_id");
+        if (unk && unk->type == JsonValue::Type::Number) unk_token_id_ = static_cast<int>(unk->number);
+    } else if (model_type == "BPE" || model_type.empty()) {
+        algorithm_ = Algorithm::BPE;
+        for (const auto& entry : vocab->object) {
+            set_piece(static_cast<int>(entry.second.number), entry.first, 0.0f, TokenType::Normal);
+            ids.emplace(entry.first, static_cast<int>(entry.second.number));
+        }
+    } else {
+        throw std::runtime_error("Tokenizer: unsupported model type " + model_type + " in " + path);
+    }
+
+    // Added tokens: special ones are control tokens, and all are matched
+    // verbatim in the input
+    std::vector<std::pair<std::string, int>> verbatim;
+    if (const JsonValue* added = root.find("added_tokens")) {
+        for (const JsonValue& token : added->array) {
+            const JsonValue* id = token.find("id");
+            std::string content = json_string(&token, "content");
+            if (!id || content.empty()) continue;
+            int token_id = static_cast<int>(id->number);
+            bool special = json_bool(&token, "special", false);
+            set_piece(token_id, content, 0.0f, special ? TokenType::Control : TokenType::UserDefined);
+            ids[content] = token_id;
+            if (special) verbatim.emplace_back(content, token_id);
+        }
+    }
+
+    if (algorithm_ == Algorithm::BPE) {
+        const JsonValue* merges = model->find("merges");
+        int rank = 0;
+        for (const JsonValue& merge : merges ? merges->array : std::vector<JsonValue>()) {
+            // "left right", or ["left", "right"] in newer files
+            std::string left, right;
+            if (merge.is_string()) {
+                size_t space = merge.string.find(' ', 1);
+                if (space == std::string::npos) continue;
+                left = merge.string.substr(0, space);
+                right = merge.string.substr(space + 1);
+            } else if (merge.is_array() && merge.array.size() == 2) {
+                left = merge.array[0].string;
+                right = merge.array[1].string;
+            }
+            auto a = ids.find(left), b = ids.find(right), merged = ids.find(left + right);
+            if (a != ids.end() && b != ids.end() && merged != ids.end()) {
+                uint64_t key = static_cast<uint64_t>(a->second) << 32 | static_cast<uint32_t>(b->second);
+                merges_.emplace(key, std::make_pair(rank, merged->second));
+            }
+            ++rank;
         }
     }
 
-    // Add BOS and EOS tokens
-    tokens.insert(tokens.begin(), bos_token_id_);
-    tokens.push_back(eos_token_id_);
+    std::string unk = json_string(model, "unk_token");
+    if (!unk.empty() && ids.count(unk)) unk_token_id_ = ids[unk];
+
+    const JsonValue* pre_tokenizer = root.find("pre_tokenizer");
+    const JsonValue* normalizer = root.find("normalizer");
+    const JsonValue* byte_level = find_type(pre_tokenizer, "ByteLevel");
+    byte_level_ = byte_level || find_type(root.find("decoder"), "ByteLevel");
+    if (byte_level_) {
+        add_dummy_prefix_ = json_bool(byte_level, "add_prefix_space", false);
+        ignore_merges_ = json_bool(model, "ignore_merges", false);
+        const JsonValue* split = find_type(pre_tokenizer, "Split");
+        const JsonValue* pattern = split ? split->find("pattern") : nullptr;
+        std::string regex = json_string(pattern, "Regex");
+        llama3_split_ = regex.find("[^\\r\\n\\p{L}\\p{N}]?\\p{L}+") != std::string::npos;
+        if (regex.find("\\p{N}{1,3}") != std::string::npos) {
+            max_digits_ = 3;
+        } else if (regex.find("|\\p{N}|") != std::string::npos ||
+                   json_bool(find_type(pre_tokenizer, "Digits"), "individual_digits", false)) {
+            max_digits_ = 1;
+        }
+    } else {
+        // Metaspace pre-tokenizer, or Prepend and Replace normalizers
+        const JsonValue* metaspace = find_type(pre_tokenizer, "Metaspace");
+        std::string scheme = json_string(metaspace, "prepend_scheme");
+        add_dummy_prefix_ = find_type(normalizer, "Prepend") != nullptr ||
+                            (metaspace && (scheme.empty() ? json_bool(metaspace, "add_prefix_space", true)
+                                                          : scheme != "never"));
+    }
+    remove_extra_whitespaces_ = false;
+
+    // The model file does not name its specials; the post-processor's
+    // template and the usual names do
+    auto lookup = [&](std::initializer_list<const char*> names) {
+        for (const char* name : names) {
+            auto it = ids.find(name);
+            if (it != ids.end()) return it->second;
+        }
+        return -1;
+    };
+    if (const JsonValue* processor = find_type(root.find("post_processor"), "TemplateProcessing")) {
+        const JsonValue* single = processor->find("single");
+        const JsonValue* first = single && !single->array.empty() ? single->array[0].find("SpecialToken") : nullptr;
+        std::string name = json_string(first, "id");
+        if (ids.count(name)) bos_token_id_ = ids[name];
+    }
+    if (bos_token_id_ < 0) bos_token_id_ = lookup({"<s>", "<|begin_of_text|>", "<bos>"});
+    eos_token_id_ = lookup({"</s>", "<|end_of_text|>", "<|endoftext|>", "<eos>", "<|im_end|>"});
+    pad_token_id_ = lookup({"<pad>", "<|pad|>"});
+
+    finalize(std::move(verbatim));
+}
+
+void Tokenizer::load_gguf(const std::string& path) {
+    gguf::GGUFFile file(path);
+    const gguf::GGUFValue* tokens = file.find("tokenizer.ggml.tokens");
+    if (!tokens || tokens->type != gguf::GGUF_ARRAY || tokens->element_type != gguf::GGUF_STRING) {
+        throw std::runtime_error("Tokenizer: no tokenizer.ggml.tokens in " + path);
+    }
+    auto string_value = [&](const char* key) {
+        const gguf::GGUFValue* value = file.find(key);
+        return value && value->type == gguf::GGUF_STRING ? std::string(value->as_string()) : std::string();
+    };
+    auto int_value = [&](const char* key, int64_t fallback) {
+        const gguf::GGUFValue* value = file.find(key);
+        return value && value->type != gguf::GGUF_ARRAY && value->type != gguf::GGUF_STRING
+                   ? value->as_int() : fallback;
+    };
+
+    // Pieces and merges are views into the mapping, which this keeps alive
+    mapping_ = file.mapping();
+    pieces_.reserve(tokens->length);
+    tokens->for_each_string([&](std::string_view piece) { pieces_.push_back(piece); });
+    if (const gguf::GGUFValue* merges = file.find("tokenizer.ggml.merges")) {
+        pending_merges_.reserve(merges->length);
+        merges->for_each_string([&](std::string_view merge) { pending_merges_.push_back(merge); });
+    }
+    size_t size = pieces_.size();
+    scores_.assign(size, 0.0f);
+    types_.assign(size, TokenType::Normal);
+    const gguf::GGUFValue* scores = file.find("tokenizer.ggml.scores");
+    for (size_t id = 0; scores && id < std::min<uint64_t>(size, scores->length); ++id) {
+        scores_[id] = static_cast<float>(scores->float_at(id));
+    }
+    const gguf::GGUFValue* types = file.find("tokenizer.ggml.token_type");
+    for (size_t id = 0; types && id < std::min<uint64_t>(size, types->length); ++id) {
+        int64_t type = types->int_at(id);
+        types_[id] = type >= 1 && type <= 6 ? static_cast<TokenType>(type) : TokenType::Normal;
+    }
 
+    // tokenizer.ggml.model names llama.cpp's vocabulary kinds
+    std::string model = string_value("tokenizer.ggml.model");
+    bool spm = model == "llama" || model == "t5";
+    if (model == "gpt2") {
+        algorithm_ = Algorithm::BPE;
+        byte_level_ = true;
+        std::string pre = string_value("tokenizer.ggml.pre");
+        llama3_split_ = pre == "llama3" || pre == "llama-bpe" || pre == "smaug-bpe" || pre == "qwen2";
+        ignore_merges_ = pre == "llama3" || pre == "llama-bpe";
+        max_digits_ = pre == "qwen2" ? 1 : llama3_split_ ? 3 : 0;
+    } else if (spm) {
+        algorithm_ = model == "llama" ? Algorithm::BPE : Algorithm::Unigram;
+        byte_fallback_ = true;
+        remove_extra_whitespaces_ = model == "t5";
+    } else {
+        throw std::runtime_error("Tokenizer: unsupported GGUF tokenizer model \"" + model + "\" in " + path);
+    }
+    add_dummy_prefix_ = int_value("tokenizer.ggml.add_space_prefix", spm) != 0;
+
+    auto special = [&](const char* key, int fallback) {
+        int64_t id = int_value(key, fallback);
+        return id >= 0 && static_cast<size_t>(id) < size ? static_cast<int>(id) : -1;
+    };
+    bos_token_id_ = special("tokenizer.ggml.bos_token_id", spm ? 1 : -1);
+    eos_token_id_ = special("tokenizer.ggml.eos_token_id", spm ? 2 : -1);
+    unk_token_id_ = special("tokenizer.ggml.unknown_token_id", spm ? 0 : -1);
+    pad_token_id_ = special("tokenizer.ggml.padding_token_id", -1);
+
+    // Byte-level models mark added tokens as control; like tokenizer.json
+    // they are matched in the input
+    std::vector<std::pair<std::string, int>> verbatim;
+    for (size_t id = 0; byte_level_ && id < size; ++id) {
+        if (types_[id] == TokenType::Control && !pieces_[id].empty()) {
+            verbatim.emplace_back(std::string(pieces_[id]), static_cast<int>(id));
+        }
+    }
+    finalize(std::move(verbatim));
+}
+
+void Tokenizer::finalize(std::vector<std::pair<std::string, int>> verbatim) {
+    if (pieces_.empty()) {
+        pieces_.assign(piece_storage_.begin(), piece_storage_.end());
+    }
+    vocab_size_ = static_cast<int>(pieces_.size());
+    scores_.resize(vocab_size_, 0.0f);
+    types_.resize(vocab_size_, TokenType::Normal);
+    build_ = std::async(std::launch::async, [this, verbatim = std::move(verbatim)]() mutable {
+        build_tables(std::move(verbatim));
+    }).share();
+}
+
+void Tokenizer::wait_until_built() const {
+    if (built_.load(std::memory_order_acquire)) return;
+    build_.get();  // Rethrows if the build failed, on every call
+    built_.store(true, std::memory_order_release);
+}
+
+void Tokenizer::build_tables(std::vector<std::pair<std::string, int>> verbatim) {
+    std::fill(std::begin(byte_tokens_), std::end(byte_tokens_), -1);
+    token_bytes_.assign(vocab_size_, std::string());
+
+    std::vector<std::pair<std::string, int>> entries;
+    entries.reserve(vocab_size_);
+    min_score_ = std::numeric_limits<float>::max();
+    for (int id = 0; id < vocab_size_; ++id) {
+        std::string_view piece = pieces_[id];
+        switch (types_[id]) {
+            case TokenType::Byte: {
+                int byte = parse_byte_piece(piece);
+                if (byte >= 0) {
+                    if (byte_tokens_[byte] < 0) byte_tokens_[byte] = id;
+                    token_bytes_[id] = std::string(1, static_cast<char>(byte));
+                }
+                break;
+            }
+            case TokenType::Normal:
+            case TokenType::UserDefined: {
+                std::string bytes;
+                if (types_[id] == TokenType::UserDefined) {
+                    bytes = piece;
+                    verbatim.emplace_back(bytes, id);
+                } else if (byte_level_) {
+                    bytes = byte_level_decode(piece);
+                } else {
+                    for (size_t i = 0; i < piece.size(); ++i) {
+                        if (piece.compare(i, kSpaceMarkerLength, kSpaceMarker) == 0) {
+                            bytes += ' ';
+                            i += kSpaceMarkerLength - 1;
+                        } else {
+                            bytes += piece[i];
+                        }
+                    }
+                }
+                entries.emplace_back(byte_level_ ? bytes : std::string(piece), id);
+                token_bytes_[id] = std::move(bytes);
+                if (types_[id] == TokenType::Normal) min_score_ = std::min(min_score_, scores_[id]);
+                break;
+            }
+            default:
+                break;  // Control, unknown and unused pieces decode to nothing
+        }
+    }
+    if (min_score_ == std::numeric_limits<float>::max()) min_score_ = 0.0f;
+
+    trie_.build(std::move(entries));
+    user_defined_.build(std::move(verbatim));
+
+    // GGUF merges name their pieces; the trie finds them by bytes
+    auto lookup = [&](std::string_view piece) {
+        return byte_level_ ? trie_.find(byte_level_decode(piece)) : trie_.find(piece.data(), piece.size());
+    };
+    for (size_t rank = 0; rank < pending_merges_.size(); ++rank) {
+        std::string_view merge = pending_merges_[rank];
+        size_t space = merge.find(' ', 1);
+        if (space == std::string_view::npos) continue;
+        std::string_view left = merge.substr(0, space), right = merge.substr(space + 1);
+        int a = lookup(left), b = lookup(right);
+        int merged = lookup(std::string(left) + std::string(right));
+        if (a >= 0 && b >= 0 && merged >= 0) {
+            uint64_t key = static_cast<uint64_t>(a) << 32 | static_cast<uint32_t>(b);
+            merges_.emplace(key, std::make_pair(static_cast<int>(rank), merged));
+        }
+    }
+    pending_merges_ = std::vector<std::string_view>();
+}
+
+const std::string& Tokenizer::token_bytes(int id) const {
+    static const std::string none;
+    if (id < 0 || id >= vocab_size_) {
+        return none;
+    }
+    wait_until_built();
+    return token_bytes_[id];
+}
+
+std::vector<int> Tokenizer::encode(const std::string& text, bool add_bos, bool add_eos) const {
+    wait_until_built();
+    std::vector<int> tokens;
+    tokens.reserve(text.size() / 3 + 2);
+    if (add_bos && bos_token_id_ >= 0) {
+        tokens.push_back(bos_token_id_);
+    }
+    encode_range(text.data(), text.size(), true, true, tokens);
+    if (add_eos && eos_token_id_ >= 0) {
+        tokens.push_back(eos_token_id_);
+    }
     return tokens;
 }
 
-std::string Tokenizer::decode(const std::vector<int>& tokens) {
-    // Simplified decoding (reverse of encoding)
-    std::string result;
+TokenBatch Tokenizer::encode_batch(const std::vector<std::string>& texts, ThreadPool* pool,
+                                   bool add_bos, bool add_eos) const {
+    wait_until_built();
+    // Tasks of about kTaskBytes each, in text order
+    struct Chunk {
+        size_t text;
+        size_t begin;
+        size_t end;
+    };
+    std::vector<std::vector<Chunk>> tasks(1);
+    size_t task_bytes = 0;
+    for (size_t t = 0; t < texts.size(); ++t) {
+        const std::string& text = texts[t];
+        size_t begin = 0;
+        do {
+            size_t end = text.size() - begin > kTaskBytes ? safe_split(text, begin + kTaskBytes) : text.size();
+            if (task_bytes > 0 && task_bytes + (end - begin) > kTaskBytes) {
+                tasks.emplace_back();
+                task_bytes = 0;
+            }
+            tasks.back().push_back({t, begin, end});
+            task_bytes += end - begin;
+            begin = end;
+        } while (begin < text.size());
+    }
 
-    for (size_t i = 0; i < tokens.size(); ++i) {
-        int token_id = tokens[i];
+    std::vector<std::vector<int>> ids(tasks.size());
+    std::vector<std::vector<size_t>> counts(tasks.size());  // Tokens per chunk
+    auto run = [&](size_t task) {
+        std::vector<int>& out = ids[task];
+        for (const Chunk& chunk : tasks[task]) {
+            size_t before = out.size();
+            const std::string& text = texts[chunk.text];
+            bool at_start = chunk.begin == 0, at_end = chunk.end == text.size();
+            if (at_start && add_bos && bos_token_id_ >= 0) {
+                out.push_back(bos_token_id_);
+            }
+            encode_range(text.data() + chunk.begin, chunk.end - chunk.begin, at_start, at_end, out);
+            if (at_end && add_eos && eos_token_id_ >= 0) {
+                out.push_back(eos_token_id_);
+            }
+            counts[task].push_back(out.size() - before);
+        }
+    };
+    if (pool && tasks.size() > 1) {
+        std::vector<std::future<void>> done;
+        for (size_t task = 0; task < tasks.size(); ++task) {
+            done.push_back(pool->submit(run, task));
+        }
+        for (auto& future : done) future.get();
+    } else {
+        for (size_t task = 0; task < tasks.size(); ++task) run(task);
+    }
 
-        // Skip special tokens in output (except for spacing)
-        if (token_id == bos_token_id_ && i == 0) {
-            continue; // Skip BOS at beginning
+    // Chunks are in text order, so the flat buffer is the task buffers end to end
+    TokenBatch batch;
+    batch.offsets.assign(texts.size() + 1, 0);
+    size_t total = 0;
+    for (size_t task = 0; task < tasks.size(); ++task) {
+        for (size_t i = 0; i < tasks[task].size(); ++i) {
+            batch.offsets[tasks[task][i].text + 1] += counts[task][i];
         }
-        if (token_id == eos_token_id_) {
-            break; // Stop at EOS
+        total += ids[task].size();
+    }
+    for (size_t t = 0; t < texts.size(); ++t) {
+        batch.offsets[t + 1] += batch.offsets[t];
+    }
+    batch.ids.reserve(total);
+    for (size_t task = 0; task < tasks.size(); ++task) {
+        batch.ids.insert(batch.ids.end(), ids[task].begin(), ids[task].end());
+        std::vector<int>().swap(ids[task]);
+    }
+    return batch;
+}
+
+void Tokenizer::encode_range(const char* text, size_t length, bool at_start, bool at_end,
+                             std::vector<int>& out) const {
+    // User-defined and added tokens are found verbatim and never split
+    size_t segment = 0;
+    if (!user_defined_.empty()) {
+        for (size_t i = 0; i < length;) {
+            size_t match = 0;
+            int id = -1;
+            user_defined_.prefix_matches(text + i, length - i, [&](size_t n, int value) {
+                match = n;
+                id = value;
+            });
+            if (match == 0) {
+                ++i;
+                continue;
+            }
+            encode_text(text + segment, i - segment, at_start && segment == 0, false, out);
+            out.push_back(id);
+            i += match;
+            segment = i;
         }
-        if (token_id == pad_token_id_) {
-            continue; // Skip padding
-        }
-
-        // Simple reverse mapping (would use proper vocabulary in real impl)
-        if (token_id == 9900) {
-            result += "hello";
-        } else if (token_id == 1917) {
-            result += "world";
-        } else if (token_id == 5) {
-            result += "the";
-        } else if (token_id == 13) {
-            result += ".";
-        } else if (token_id == 11) {
-            result += ",";
-        } else {
-            result += "<unk>";
+    }
+    encode_text(text + segment, length - segment, at_start && segment == 0, at_end, out);
+}
+
+void Tokenizer::encode_text(const char* text, size_t length, bool at_start, bool at_end,
+                            std::vector<int>& out) const {
+    if (length == 0) return;
+
+    if (byte_level_) {
+        std::string prefixed;
+        if (at_start && add_dummy_prefix_ && text[0] != ' ') {
+            prefixed = " " + std::string(text, length);
+            text = prefixed.data();
+            length = prefixed.size();
         }
+        split_byte_level(text, length, llama3_split_, max_digits_, [&](size_t start, size_t n) {
+            encode_word(text + start, n, out);
+        });
+        return;
+    }
 
-        // Add space between tokens (except for punctuation)
-        if (i < tokens.size() - 1) {
-            int next_token = tokens[i + 1];
-            if (next_token != 13 && next_token != 11 && next_token != eos_token_id_) {
-                result += " ";
+    size_t begin = 0, end = length;
+    if (remove_extra_whitespaces_) {
+        while (at_start && begin < end && text[begin] == ' ') ++begin;
+        while (at_end && end > begin && text[end - 1] == ' ') --end;
+    }
+    std::string normalized;
+    normalized.reserve(end - begin + (end - begin) / 4 + kSpaceMarkerLength);
+    if (at_start && add_dummy_prefix_) {
+        normalized += kSpaceMarker;
+    }
+    for (size_t i = begin; i < end; ++i) {
+        if (text[i] != ' ') {
+            normalized += text[i];
+        } else if (!remove_extra_whitespaces_ || i == begin || text[i - 1] != ' ') {
+            normalized += kSpaceMarker;
+        }
+    }
+
+    // Words start at each run of spaces, so "▁▁▁▁def" stays whole for
+    // models with indentation pieces
+    size_t word = 0;
+    bool after_marker = false;
+    for (size_t i = 0; i < normalized.size();) {
+        bool marker = normalized.compare(i, kSpaceMarkerLength, kSpaceMarker) == 0;
+        if (marker && !after_marker && i > word) {
+            encode_word(normalized.data() + word, i - word, out);
+            word = i;
+        }
+        after_marker = marker;
+        i += marker ? kSpaceMarkerLength : 1;
+    }
+    encode_word(normalized.data() + word, normalized.size() - word, out);
+}
+
+void Tokenizer::encode_word(const char* word, size_t length, std::vector<int>& out) const {
+    if (length == 0) return;
+    if (algorithm_ == Algorithm::Unigram) {
+        encode_unigram(word, length, out);
+    } else {
+        encode_bpe(word, length, out);
+    }
+}
+
+void Tokenizer::encode_unigram(const char* word, size_t length, std::vector<int>& out) const {
+    // Viterbi: best[i] is the highest scoring segmentation of the first i bytes
+    struct Node {
+        float score;
+        int id;  // Last piece, or -1 for an unknown character
+        size_t start;
+    };
+    const float unknown_score = min_score_ - 10.0f;
+    std::vector<Node> best(length + 1, {-std::numeric_limits<float>::infinity(), -1, 0});
+    best[0].score = 0.0f;
+
+    size_t char_length = 0;
+    for (size_t i = 0; i < length; i += char_length) {
+        char_length = std::min(utf8_length(word[i]), length - i);
+        if (best[i].score == -std::numeric_limits<float>::infinity()) continue;
+        bool covered = false;
+        trie_.prefix_matches(word + i, length - i, [&](size_t n, int id) {
+            float score = best[i].score + scores_[id];
+            if (score > best[i + n].score) best[i + n] = {score, id, i};
+            covered |= n == char_length;
+        });
+        if (!covered && best[i].score + unknown_score > best[i + char_length].score) {
+            best[i + char_length] = {best[i].score + unknown_score, -1, i};
+        }
+    }
+
+    std::vector<size_t> path;  // End offsets, last first
+    for (size_t end = length; end > 0; end = best[end].start) {
+        path.push_back(end);
+    }
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        const Node& node = best[*it];
+        if (node.id >= 0) {
+            out.push_back(node.id);
+            continue;
+        }
+        // Consecutive unknown characters make one unknown piece
+        size_t end = *it;
+        while (std::next(it) != path.rend() && best[*std::next(it)].id < 0) {
+            end = *++it;
+        }
+        encode_unknown(word + node.start, end - node.start, out);
+    }
+}
+
+void Tokenizer::encode_bpe(const char* word, size_t length, std::vector<int>& out) const {
+    if (ignore_merges_) {
+        int id = trie_.find(word, length);
+        if (id >= 0) {
+            out.push_back(id);
+            return;
+        }
+    }
+
+    // Symbols start as bytes (byte-level) or characters, linked so merging
+    // a pair is O(1)
+    struct Symbol {
+        uint32_t start;
+        uint32_t length;  // 0 once merged into its left neighbour
+        int id;           // -1 if no piece covers it
+        int prev;
+        int next;
+    };
+    std::vector<Symbol> symbols;
+    symbols.reserve(length);
+    for (size_t i = 0; i < length;) {
+        size_t n = byte_level_ ? 1 : std::min(utf8_length(word[i]), length - i);
+        int index = static_cast<int>(symbols.size());
+        symbols.push_back({static_cast<uint32_t>(i), static_cast<uint32_t>(n),
+                           trie_.find(word + i, n), index - 1, index + 1});
+        i += n;
+    }
+    symbols.back().next = -1;
+
+    struct Pair {
+        float priority;   // Higher merges first: -rank, or the merged piece's score
+        int left;
+        uint32_t length;  // Combined length when queued; differs once either side changed
+        int id;
+    };
+    auto lower = [](const Pair& a, const Pair& b) {
+        return a.priority < b.priority || (a.priority == b.priority && a.left > b.left);
+    };
+    std::priority_queue<Pair, std::vector<Pair>, decltype(lower)> queue(lower);
+    auto consider = [&](int left) {
+        if (left < 0 || symbols[left].next < 0) return;
+        const Symbol& a = symbols[left];
+        const Symbol& b = symbols[a.next];
+        if (!merges_.empty()) {
+            if (a.id < 0 || b.id < 0) return;
+            auto it = merges_.find(static_cast<uint64_t>(a.id) << 32 | static_cast<uint32_t>(b.id));
+            if (it != merges_.end()) {
+                queue.push({-static_cast<float>(it->second.first), left, a.length + b.length,
+                            it->second.second});
             }
+        } else {
+            int id = trie_.find(word + a.start, a.length + b.length);
+            if (id >= 0) queue.push({scores_[id], left, a.length + b.length, id});
         }
+    };
+    for (int i = 0; i + 1 < static_cast<int>(symbols.size()); ++i) {
+        consider(i);
     }
 
+    while (!queue.empty()) {
+        Pair pair = queue.top();
+        queue.pop();
+        Symbol& a = symbols[pair.left];
+        if (a.length == 0 || a.next < 0) continue;
+        Symbol& b = symbols[a.next];
+        if (a.length + b.length != pair.length) continue;  // Stale
+
+        a.length += b.length;
+        a.id = pair.id;
+        b.length = 0;
+        a.next = b.next;
+        if (a.next >= 0) symbols[a.next].prev = pair.left;
+        consider(a.prev);
+        consider(pair.left);
+    }
+
+    for (int i = 0; i >= 0; i = symbols[i].next) {
+        if (symbols[i].id >= 0) {
+            out.push_back(symbols[i].id);
+            continue;
+        }
+        // Consecutive unknown symbols make one unknown piece
+        uint32_t start = symbols[i].start;
+        while (symbols[i].next >= 0 && symbols[symbols[i].next].id < 0) {
+            i = symbols[i].next;
+        }
+        encode_unknown(word + start, symbols[i].start + symbols[i].length - start, out);
+    }
+}
+
+void Tokenizer::encode_unknown(const char* text, size_t length, std::vector<int>& out) const {
+    if (!byte_fallback_) {
+        if (unk_token_id_ >= 0) out.push_back(unk_token_id_);
+        return;
+    }
+    for (size_t i = 0; i < length; ++i) {
+        int id = byte_tokens_[static_cast<unsigned char>(text[i])];
+        if (id >= 0) {
+            out.push_back(id);
+        } else if (unk_token_id_ >= 0) {
+            out.push_back(unk_token_id_);
+        }
+    }
+}
+
+std::vector<std::string> Tokenizer::decode_batch(const TokenBatch& batch, ThreadPool* pool) const {
+    std::vector<std::string> texts(batch.size());
+    // Runs of whole texts with about kTaskTokens between them
+    std::vector<size_t> starts = {0};
+    for (size_t t = 0; t < batch.size(); ++t) {
+        if (batch.offsets[t + 1] - batch.offsets[starts.back()] >= kTaskTokens) starts.push_back(t + 1);
+    }
+    if (starts.back() != batch.size()) starts.push_back(batch.size());
+
+    auto run = [&](size_t task) {
+        for (size_t t = starts[task]; t < starts[task + 1]; ++t) {
+            texts[t] = decode(batch.data(t), batch.length(t));
+        }
+    };
+    size_t num_tasks = starts.size() - 1;
+    if (pool && num_tasks > 1) {
+        std::vector<std::future<void>> done;
+        for (size_t task = 0; task < num_tasks; ++task) {
+            done.push_back(pool->submit(run, task));
+        }
+        for (auto& future : done) future.get();
+    } else {
+        for (size_t task = 0; task < num_tasks; ++task) run(task);
+    }
+    return texts;
+}
+
+std::string Tokenizer::decode(const std::vector<int>& tokens) const {
+    return decode(tokens.data(), tokens.size());
+}
+
+std::string Tokenizer::decode(const int* tokens, size_t count) const {
+    wait_until_built();
+    std::string result;
+    for (size_t i = 0; i < count; ++i) {
+        int token_id = tokens[i];
+        if (token_id == eos_token_id_) {
+            break; // Stop at EOS
+        }
+        if (token_id >= 0 && token_id < vocab_size_) {
+            result += token_bytes_[token_id];
+        }
+    }
+
+    // SentencePiece drops the space it added in front of the text
+    if (add_dummy_prefix_ && count > 0 && tokens[0] == bos_token_id_ &&
+        !result.empty() && result[0] == ' ') {
+        result.erase(0, 1);
+    }
     return result;
 }
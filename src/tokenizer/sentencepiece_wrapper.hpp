@@ -1,38 +1,185 @@
 #ifndef SENTENCEPIECE_WRAPPER_HPP
 #define SENTENCEPIECE_WRAPPER_HPP
 
+#include "double_array_trie.hpp"
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
-#include <memory>
 
+class MappedFile;
+class ThreadPool;
+
+// Piece kinds, numbered as in SentencePiece's ModelProto
+enum class TokenType : uint8_t {
+    Normal = 1,
+    Unknown = 2,
+    Control = 3,      // <s>, </s>, chat markers: never produced from text
+    UserDefined = 4,  // Matched verbatim in the input before segmentation
+    Unused = 5,
+    Byte = 6,         // <0xAB>, for byte fallback
+};
+
+// Token IDs of many texts in one buffer: text i is
+// ids[offsets[i]] .. ids[offsets[i + 1] - 1]
+struct TokenBatch {
+    std::vector<int> ids;
+    std::vector<size_t> offsets;  // One more than the number of texts
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    const int* data(size_t i) const { return ids.data() + offsets[i]; }
+    size_t length(size_t i) const { return offsets[i + 1] - offsets[i]; }
+};
+
+// Text <-> token IDs for SentencePiece models (Unigram or BPE), Hugging
+// Face tokenizer.json files (BPE with merges, byte-level or Metaspace, and
+// Unigram) and the tokenizer.ggml.* metadata of GGUF models. Vocabulary
+// lookups go through a DoubleArrayTrie and BPE merges through a priority
+// queue over a linked list of symbols, so encoding is O(n log n) in the
+// text with no regex anywhere. Encoding and decoding are const and safe to
+// call from several threads.
+//
+// SentencePiece normalization rules (e.g. nmt_nfkc) are not applied: text
+// is segmented as given, so a model whose precompiled normalizer would
+// change it encodes differently. Such models load with a warning and
+// report the rule through unapplied_normalizer().
+//
+// The constructor only reads the vocabulary; tries and decoded bytes are
+// built on a background thread, and the first encode or decode waits for
+// them. That keeps tokenizer setup off the model startup path.
 class Tokenizer {
 public:
+    // A path ending in .json is read as tokenizer.json, one ending in .gguf
+    // as a GGUF model's metadata (pieces stay in the mapped file), anything
+    // else as a SentencePiece .model. An empty path gives a byte-level
+    // vocabulary of 32000 (special tokens, one token per byte, the rest
+    // unused) so the dummy model runs without files.
     Tokenizer(const std::string& model_path);
     ~Tokenizer();
 
+    Tokenizer(const Tokenizer&) = delete;
+    Tokenizer& operator=(const Tokenizer&) = delete;
+
     // Encode text to token IDs
-    std::vector<int> encode(const std::string& text);
+    std::vector<int> encode(const std::string& text, bool add_bos = true,
+                            bool add_eos = false) const;
+
+    // Decode token IDs back to text. Stops at EOS and skips other special
+    // tokens; a sequence starting with BOS loses the space the tokenizer
+    // prepended to its first word.
+    std::string decode(const std::vector<int>& tokens) const;
+    std::string decode(const int* tokens, size_t count) const;
 
-    // Decode token IDs back to text
-    std::string decode(const std::vector<int>& tokens);
+    // Encode many texts at once, spread over pool (inline without one).
+    // Short texts are grouped into tasks and long ones cut at word
+    // boundaries, so one long document also uses every thread; the result
+    // is identical to encoding each text alone.
+    TokenBatch encode_batch(const std::vector<std::string>& texts, ThreadPool* pool = nullptr,
+                            bool add_bos = true, bool add_eos = false) const;
+    std::vector<std::string> decode_batch(const TokenBatch& batch, ThreadPool* pool = nullptr) const;
+
+    // Bytes token id appends to the text, for constrained decoding; empty
+    // for special tokens
+    const std::string& token_bytes(int id) const;
+
+    // Whether encode() puts a space before the first word, which decoding
+    // from BOS then drops
+    bool adds_dummy_prefix() const { return add_dummy_prefix_; }
+
+    // Name of the SentencePiece normalizer the model asks for but encode()
+    // skips; empty when text is meant to be used as is
+    const std::string& unapplied_normalizer() const { return unapplied_normalizer_; }
+
+    // Vocabulary entry as stored in the model, e.g. "▁the" or "Ġthe"
+    std::string_view piece(int id) const { return pieces_[id]; }
+    TokenType token_type(int id) const { return types_[id]; }
 
     // Get vocab size
     int vocab_size() const { return vocab_size_; }
 
-    // Get special tokens
+    // Get special tokens; -1 where the model has none
     int bos_token_id() const { return bos_token_id_; }
     int eos_token_id() const { return eos_token_id_; }
     int pad_token_id() const { return pad_token_id_; }
+    int unk_token_id() const { return unk_token_id_; }
 
 private:
+    enum class Algorithm { Unigram, BPE };
+
+    void load_sentencepiece(const std::string& path);
+    void load_hf_json(const std::string& path);
+    void load_gguf(const std::string& path);
+    void load_fallback();
+    // Once pieces_ (or piece_storage_), scores_ and types_ are set: starts
+    // build_tables() in the background. verbatim adds pieces matched in raw
+    // text besides user-defined ones.
+    void finalize(std::vector<std::pair<std::string, int>> verbatim = {});
+    // Tries, byte tables, decoded bytes and pending merges
+    void build_tables(std::vector<std::pair<std::string, int>> verbatim);
+    // Blocks until build_tables() has finished; cheap once it has
+    void wait_until_built() const;
+
+    // Text without BOS or EOS; at_start and at_end say whether it begins
+    // or ends the input, for the dummy prefix and whitespace trimming
+    void encode_range(const char* text, size_t length, bool at_start, bool at_end,
+                      std::vector<int>& out) const;
+    // Text between two user-defined tokens
+    void encode_text(const char* text, size_t length, bool at_start, bool at_end,
+                     std::vector<int>& out) const;
+    // One pre-tokenized word, already normalized
+    void encode_word(const char* word, size_t length, std::vector<int>& out) const;
+    void encode_unigram(const char* word, size_t length, std::vector<int>& out) const;
+    void encode_bpe(const char* word, size_t length, std::vector<int>& out) const;
+    // Byte tokens for text no piece covers, or one UNK for the whole run
+    // without byte fallback
+    void encode_unknown(const char* text, size_t length, std::vector<int>& out) const;
+
     std::string model_path_;
-    int vocab_size_;
-    int bos_token_id_;
-    int eos_token_id_;
-    int pad_token_id_;
+    int vocab_size_ = 0;
+    int bos_token_id_ = -1;
+    int eos_token_id_ = -1;
+    int pad_token_id_ = -1;
+    int unk_token_id_ = -1;
+
+    Algorithm algorithm_ = Algorithm::BPE;
+    // GPT-2 style: words split at letters, digits and punctuation, then BPE
+    // over their bytes. Otherwise SentencePiece style: spaces become U+2581
+    // and words start at each run of them.
+    bool byte_level_ = false;
+    bool llama3_split_ = false;       // Letters take any one symbol before them, not just a space
+    int max_digits_ = 0;              // Byte-level numbers split every N digits; 0 keeps them whole
+    bool ignore_merges_ = false;      // Byte-level words already in the vocabulary skip BPE
+    bool add_dummy_prefix_ = true;    // A space before the first word
+    bool remove_extra_whitespaces_ = false;
+    bool byte_fallback_ = false;
+    std::string unapplied_normalizer_;
+
+    std::vector<std::string_view> pieces_;     // Into piece_storage_ or mapping_
+    std::vector<std::string> piece_storage_;  // Pieces of parsed (not mapped) files
+    std::shared_ptr<MappedFile> mapping_;     // GGUF file the pieces live in
+    std::vector<std::string_view> pending_merges_;  // GGUF "left right" merges, resolved by build_tables()
+    std::vector<float> scores_;
+    std::vector<TokenType> types_;
+    float min_score_ = 0.0f;
+
+    std::vector<std::string> token_bytes_;  // What each ID decodes to
+    int byte_tokens_[256];                  // <0xAB> pieces, or -1
+    // Normal and user-defined pieces, keyed by their bytes for byte-level
+    // models so raw text is looked up without mapping it first
+    DoubleArrayTrie trie_;
+    DoubleArrayTrie user_defined_;          // Pieces matched verbatim in raw text
+    // (left << 32 | right) -> (rank, merged ID) for models with a merge list;
+    // without one, BPE merges the pair whose concatenation scores highest
+    std::unordered_map<uint64_t, std::pair<int, int>> merges_;
 
-    // Simplified tokenizer state (would use sentencepiece in real implementation)
-    std::vector<std::string> vocabulary_;
+    // Shared so a failed build stays valid and rethrows on every wait
+    std::shared_future<void> build_;
+    mutable std::atomic<bool> built_{false};
 };
 
 #endif // SENTENCEPIECE_WRAPPER_HPP
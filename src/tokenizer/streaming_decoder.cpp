@@ -0,0 +1,93 @@
+#include "streaming_decoder.hpp"
+
+namespace {
+
+const char kReplacement[] = "\xEF\xBF\xBD";  // U+FFFD
+
+bool is_continuation(unsigned char c) { return (c & 0xC0) == 0x80; }
+
+// Bytes in the character led by c, or 0 if c cannot lead one
+size_t sequence_length(unsigned char c) {
+    if (c < 0x80) return 1;
+    if (c >= 0xC2 && c <= 0xDF) return 2;
+    if ((c >> 4) == 0xE) return 3;
+    if (c >= 0xF0 && c <= 0xF4) return 4;
+    return 0;
+}
+
+// Whether c can be byte index of the character led by lead. The second
+// byte's range rules out overlong forms, surrogates and code points past
+// U+10FFFF.
+bool continues(unsigned char lead, size_t index, unsigned char c) {
+    if (index == 1) {
+        switch (lead) {
+            case 0xE0: return c >= 0xA0 && c <= 0xBF;
+            case 0xED: return c >= 0x80 && c <= 0x9F;
+            case 0xF0: return c >= 0x90 && c <= 0xBF;
+            case 0xF4: return c >= 0x80 && c <= 0x8F;
+        }
+    }
+    return is_continuation(c);
+}
+
+} // namespace
+
+std::string StreamingDecoder::push(int token) {
+    bool first = first_token_;
+    first_token_ = false;
+    if (first && token == tokenizer_.bos_token_id()) {
+        strip_space_ = tokenizer_.adds_dummy_prefix();
+        return "";
+    }
+
+    const std::string& bytes = tokenizer_.token_bytes(token);
+    if (bytes.empty()) {
+        return "";
+    }
+    size_t skip = 0;
+    if (strip_space_) {
+        strip_space_ = false;
+        skip = bytes[0] == ' ' ? 1 : 0;
+    }
+
+    // Only the held-back bytes and this token's are examined
+    std::string text = std::move(pending_);
+    pending_.clear();
+    text.append(bytes, skip, std::string::npos);
+
+    std::string out;
+    out.reserve(text.size());
+    size_t i = 0;
+    while (i < text.size()) {
+        unsigned char lead = static_cast<unsigned char>(text[i]);
+        size_t n = sequence_length(lead);
+        size_t valid = n > 0 ? 1 : 0;
+        while (valid < n && i + valid < text.size() &&
+               continues(lead, valid, static_cast<unsigned char>(text[i + valid]))) {
+            ++valid;
+        }
+        if (n > 0 && valid == n) {
+            out.append(text, i, n);
+            i += n;
+        } else if (n > 0 && i + valid == text.size()) {
+            pending_.assign(text, i, std::string::npos);  // Rest arrives with later tokens
+            break;
+        } else {
+            out += kReplacement;
+            i += valid > 0 ? valid : 1;
+        }
+    }
+    return out;
+}
+
+std::string StreamingDecoder::flush() {
+    std::string out = pending_.empty() ? "" : kReplacement;
+    pending_.clear();
+    return out;
+}
+
+void StreamingDecoder::reset() {
+    pending_.clear();
+    first_token_ = true;
+    strip_space_ = false;
+}
@@ -0,0 +1,37 @@
+#ifndef STREAMING_DECODER_HPP
+#define STREAMING_DECODER_HPP
+
+#include "sentencepiece_wrapper.hpp"
+#include <string>
+
+// Detokenizes a sequence one token at a time, for streaming. Each push
+// returns only the text the token completes: bytes of a character split
+// across tokens (byte fallback, or byte-level BPE cutting through UTF-8)
+// are held back until the character is whole. Work per token is
+// proportional to the token's bytes, not to the sequence so far.
+//
+// Output is always valid UTF-8: bytes that cannot start or continue a
+// character come out as U+FFFD. The tokenizer must outlive the decoder.
+class StreamingDecoder {
+public:
+    explicit StreamingDecoder(const Tokenizer& tokenizer) : tokenizer_(tokenizer) {}
+
+    // Text newly completed by token; empty while a character is still
+    // partial. Pushing BOS first drops the space the tokenizer put before
+    // the first word, as decode() does.
+    std::string push(int token);
+
+    // Held-back bytes of a sequence that ended mid-character, as U+FFFD
+    std::string flush();
+
+    // Start a new sequence
+    void reset();
+
+private:
+    const Tokenizer& tokenizer_;
+    std::string pending_;       // Start of an incomplete character, at most 3 bytes
+    bool first_token_ = true;
+    bool strip_space_ = false;  // The next text starts with the dummy prefix
+};
+
+#endif // STREAMING_DECODER_HPP
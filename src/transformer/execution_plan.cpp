@@ -0,0 +1,138 @@
+#include "execution_plan.hpp"
+#include "../util/threadpool.hpp"
+#include "../util/profiler.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+
+void ExecutionPlan::add_fill_random(const char* name, float* dst, size_t count) {
+    PlanStep step;
+    step.op = PlanOp::FillRandom;
+    step.name = name;
+    step.dst = dst;
+    step.count = count;
+    steps_.push_back(std::move(step));
+}
+
+void ExecutionPlan::add_copy(const char* name, const float* src, float* dst, size_t count) {
+    PlanStep step;
+    step.op = PlanOp::Copy;
+    step.name = name;
+    step.src = src;
+    step.dst = dst;
+    step.count = count;
+    steps_.push_back(std::move(step));
+}
+
+void ExecutionPlan::add_cached_attention(const char* name, flash::FlashAttention* attention,
+                                         float* src, float* dst, const std::vector<int>& shape) {
+    PlanStep step;
+    step.op = PlanOp::CachedAttention;
+    step.name = name;
+    step.src = src;
+    step.dst = dst;
+    step.attention = attention;
+    step.src_view = std::make_unique<Tensor>(shape, DType::FP32, src);
+    step.dst_view = std::make_unique<Tensor>(shape, DType::FP32, dst);
+    step.count = step.dst_view->numel();
+    steps_.push_back(std::move(step));
+}
+
+bool ExecutionPlan::is_live_after(size_t step_idx, const float* buffer) const {
+    for (size_t i = step_idx + 1; i < steps_.size(); ++i) {
+        if (steps_[i].src == buffer) return true;
+        if (steps_[i].dst == buffer) return false;
+    }
+    return false;
+}
+
+void ExecutionPlan::optimize() {
+    std::vector<PlanStep> fused;
+    fused.reserve(steps_.size());
+
+    for (size_t i = 0; i < steps_.size(); ++i) {
+        PlanStep& step = steps_[i];
+
+        // Only Fill/Copy producers can be redirected; attention writes
+        // through a view bound at build time
+        if (step.op == PlanOp::Copy && !fused.empty()) {
+            PlanStep& producer = fused.back();
+            bool redirectable = producer.op != PlanOp::CachedAttention;
+            if (redirectable && producer.dst == step.src && producer.src != step.dst &&
+                producer.count == step.count && !is_live_after(i, step.src)) {
+                producer.dst = step.dst;
+                continue;
+            }
+        }
+        fused.push_back(std::move(step));
+    }
+
+    steps_ = std::move(fused);
+}
+
+void ExecutionPlan::partition(size_t num_threads, size_t min_chunk) {
+    for (PlanStep& step : steps_) {
+        step.partitions.clear();
+
+        // Attention is sequential over tokens and the fill draws from rand(),
+        // so only copies are split
+        size_t parts = 1;
+        if (step.op == PlanOp::Copy && num_threads > 1) {
+            parts = std::max<size_t>(1, std::min(num_threads, step.count / min_chunk));
+        }
+
+        size_t chunk = std::max<size_t>(1, (step.count + parts - 1) / parts);
+        for (size_t begin = 0; begin < step.count; begin += chunk) {
+            step.partitions.emplace_back(begin, std::min(step.count, begin + chunk));
+        }
+    }
+}
+
+void ExecutionPlan::run_range(const PlanStep& step, size_t begin, size_t end) {
+    // Copies are pure bandwidth: one read and one write per element
+    PROFILE_SCOPE_WORK(step.op == PlanOp::Copy ? "plan_copy" : "plan_fill_random", 0,
+                       (step.op == PlanOp::Copy ? 2 : 1) * (end - begin) * sizeof(float));
+
+    switch (step.op) {
+        case PlanOp::FillRandom:
+            for (size_t i = begin; i < end; ++i) {
+                step.dst[i] = 0.01f * (rand() % 100 - 50) / 50.0f; // Small random values
+            }
+            break;
+        case PlanOp::Copy:
+            std::memcpy(step.dst + begin, step.src + begin, (end - begin) * sizeof(float));
+            break;
+        case PlanOp::CachedAttention:
+            break;
+    }
+}
+
+void ExecutionPlan::run(KVCache* cache, ThreadPool* pool) const {
+    std::vector<std::future<void>> pending;
+
+    for (const PlanStep& step : steps_) {
+        if (step.op == PlanOp::CachedAttention) {
+            PROFILE_SCOPE("plan_cached_attention");
+            step.attention->forward_into(*step.src_view, *step.src_view, *step.src_view,
+                                         *step.dst_view, cache);
+            continue;
+        }
+
+        if (!pool || step.partitions.size() <= 1) {
+            run_range(step, 0, step.count);
+            continue;
+        }
+
+        // Caller thread takes the first range; steps are barriers
+        pending.clear();
+        for (size_t p = 1; p < step.partitions.size(); ++p) {
+            auto range = step.partitions[p];
+            pending.push_back(pool->submit([&step, range]() {
+                run_range(step, range.first, range.second);
+            }));
+        }
+        run_range(step, step.partitions[0].first, step.partitions[0].second);
+        for (auto& f : pending) f.get();
+    }
+}
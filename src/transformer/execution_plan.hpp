@@ -0,0 +1,71 @@
+#ifndef EXECUTION_PLAN_HPP
+#define EXECUTION_PLAN_HPP
+
+#include "../tensor.hpp"
+#include "../kernels/optimized/flash_attention.hpp"
+#include "kv_cache.hpp"
+#include <memory>
+#include <utility>
+#include <vector>
+
+class ThreadPool;
+
+enum class PlanOp {
+    FillRandom,       // Placeholder embeddings: small random values
+    Copy,             // Identity layers
+    CachedAttention   // FlashAttention over the KV cache
+};
+
+// One lowered kernel invocation. Pointers, sizes and thread partitions are
+// resolved when the plan is built, so replaying it does no shape checks,
+// allocation or virtual dispatch.
+struct PlanStep {
+    PlanOp op;
+    const char* name;
+    const float* src = nullptr;
+    float* dst = nullptr;
+    size_t count = 0;
+
+    // CachedAttention: views over the arena buffers behind src/dst
+    flash::FlashAttention* attention = nullptr;
+    std::unique_ptr<Tensor> src_view;
+    std::unique_ptr<Tensor> dst_view;
+
+    // [begin, end) element ranges, one per worker
+    std::vector<std::pair<size_t, size_t>> partitions;
+};
+
+// Flat list of kernel invocations for one forward pass at a fixed shape
+class ExecutionPlan {
+public:
+    void add_fill_random(const char* name, float* dst, size_t count);
+    void add_copy(const char* name, const float* src, float* dst, size_t count);
+    void add_cached_attention(const char* name, flash::FlashAttention* attention,
+                              float* src, float* dst, const std::vector<int>& shape);
+
+    // Fuse away copies whose source is only produced to be copied: a
+    // producer writing X followed by a copy X -> Y writes Y directly, as
+    // long as X is overwritten before anything else reads it. Liveness,
+    // not pointer identity, decides, since arena buffers are reused
+    // every other layer.
+    void optimize();
+
+    // Split copies into contiguous ranges, one per thread
+    void partition(size_t num_threads, size_t min_chunk = 16384);
+
+    void run(KVCache* cache, ThreadPool* pool = nullptr) const;
+
+    // Buffer holding the final hidden states after run()
+    const float* output() const { return steps_.empty() ? nullptr : steps_.back().dst; }
+    size_t num_steps() const { return steps_.size(); }
+    const std::vector<PlanStep>& steps() const { return steps_; }
+
+private:
+    // Whether a step after step_idx reads buffer before one overwrites it
+    bool is_live_after(size_t step_idx, const float* buffer) const;
+    static void run_range(const PlanStep& step, size_t begin, size_t end);
+
+    std::vector<PlanStep> steps_;
+};
+
+#endif // EXECUTION_PLAN_HPP
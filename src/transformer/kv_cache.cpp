@@ -0,0 +1,264 @@
+#include "kv_cache.hpp"
+#include "../util/mapped_file.hpp"
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+
+const char kFileMagic[8] = {'K', 'V', 'C', 'A', 'C', 'H', 'E', '1'};
+constexpr size_t kFileAlignment = 64;
+
+struct FileHeader {
+    char magic[8];
+    int32_t mode;
+    int32_t max_seq_len;
+    int32_t window_size;
+    int32_t num_sink_tokens;
+    int32_t lookahead;
+    int32_t block_size;
+    int32_t num_layers;
+    int32_t kv_dim;
+    int32_t current_length;
+    int32_t written_length;
+    uint32_t num_blocks;
+    uint32_t reserved;
+};
+
+size_t align_up(size_t offset) {
+    return (offset + kFileAlignment - 1) / kFileAlignment * kFileAlignment;
+}
+
+void pad_to_alignment(std::ostream& out) {
+    static const char zeros[kFileAlignment] = {};
+    size_t position = static_cast<size_t>(out.tellp());
+    out.write(zeros, align_up(position) - position);
+}
+
+} // namespace
+
+KVCache::KVCache(int num_layers, int kv_dim, const KVCacheConfig& config)
+    : config_(config), kv_dim_(kv_dim) {
+    switch (config_.mode) {
+        case KVCacheMode::Full:
+            capacity_ = config_.max_seq_len;
+            break;
+        case KVCacheMode::SlidingWindow:
+            capacity_ = config_.window_size + config_.lookahead;
+            break;
+        case KVCacheMode::AttentionSink:
+            capacity_ = config_.num_sink_tokens + config_.window_size + config_.lookahead;
+            break;
+    }
+
+    if (capacity_ <= 0 || kv_dim_ <= 0 || config_.lookahead < 0) {
+        throw std::runtime_error("KVCache: capacity and kv_dim must be positive");
+    }
+    if (config_.block_size <= 0 || (config_.block_size & (config_.block_size - 1)) != 0) {
+        throw std::runtime_error("KVCache: block_size must be a power of two");
+    }
+
+    // Small rings (short windows) need no more than one block
+    while (config_.block_size > 1 && config_.block_size / 2 >= capacity_) {
+        config_.block_size /= 2;
+    }
+    num_layers_ = num_layers;
+    while ((1 << block_shift_) < config_.block_size) ++block_shift_;
+    blocks_.resize((capacity_ + config_.block_size - 1) / config_.block_size);
+}
+
+int KVCache::slot_for(int position) const {
+    switch (config_.mode) {
+        case KVCacheMode::Full:
+            if (position >= capacity_) {
+                throw std::runtime_error("KVCache: sequence exceeds max_seq_len");
+            }
+            return position;
+        case KVCacheMode::SlidingWindow:
+            return position % capacity_;
+        case KVCacheMode::AttentionSink: {
+            int sinks = config_.num_sink_tokens;
+            if (position < sinks) return position;
+            return sinks + (position - sinks) % (capacity_ - sinks);
+        }
+    }
+    return position;
+}
+
+float* KVCache::writable_block(int slot) {
+    BlockRef& block = blocks_[slot >> block_shift_];
+    if (!block) {
+        block = BlockRef(new Block(Tensor(std::vector<int>{num_layers_, 2, config_.block_size, kv_dim_},
+                                          DType::FP32, TensorStorage::HugePages)));
+    } else if (block.shared()) {
+        // Shared with a fork: copy before the first write diverges them
+        BlockRef copy(new Block(Tensor(block->shape(), DType::FP32, TensorStorage::HugePages)));
+        std::memcpy(copy->raw(), block->data<float>(), block->byte_size());
+        block = std::move(copy);
+    }
+    return block->data<float>();
+}
+
+void KVCache::store(int layer, int position, const float* key, const float* value) {
+    int slot = slot_for(position);
+    written_length_ = std::max(written_length_, position + 1);
+    float* block = writable_block(slot);
+    std::memcpy(block + row_offset(layer, 0, slot), key, kv_dim_ * sizeof(float));
+    std::memcpy(block + row_offset(layer, 1, slot), value, kv_dim_ * sizeof(float));
+}
+
+const float* KVCache::key_at(int layer, int position) const {
+    int slot = slot_for(position);
+    return blocks_[slot >> block_shift_]->data<float>() + row_offset(layer, 0, slot);
+}
+
+const float* KVCache::value_at(int layer, int position) const {
+    int slot = slot_for(position);
+    return blocks_[slot >> block_shift_]->data<float>() + row_offset(layer, 1, slot);
+}
+
+void KVCache::visible_positions(int length, std::vector<int>& positions) const {
+    positions.clear();
+
+    int window_start = 0;
+    if (config_.mode == KVCacheMode::SlidingWindow) {
+        window_start = std::max(0, length - config_.window_size);
+    } else if (config_.mode == KVCacheMode::AttentionSink) {
+        int sinks = std::min(config_.num_sink_tokens, length);
+        for (int p = 0; p < sinks; ++p) {
+            positions.push_back(p);
+        }
+        window_start = std::max(sinks, length - config_.window_size);
+    }
+
+    for (int p = window_start; p < length; ++p) {
+        positions.push_back(p);
+    }
+}
+
+int KVCache::rope_position(int position, int length) const {
+    if (config_.mode != KVCacheMode::AttentionSink || position < config_.num_sink_tokens) {
+        return position;
+    }
+    int window_start = std::max(config_.num_sink_tokens, length - config_.window_size);
+    return config_.num_sink_tokens + (position - window_start);
+}
+
+void KVCache::truncate(int length) {
+    if (length < 0 || length > current_length_) {
+        throw std::runtime_error("KVCache: truncate length out of range");
+    }
+    // A stale row at position p shares a slot with p - ring size; it stays
+    // invisible while p < length + lookahead
+    if (config_.mode != KVCacheMode::Full && written_length_ - length > config_.lookahead) {
+        throw std::runtime_error("KVCache: cannot roll back further than the lookahead");
+    }
+    current_length_ = length;
+}
+
+size_t KVCache::byte_size() const {
+    size_t total = 0;
+    for (const auto& block : blocks_) {
+        if (block) total += block->byte_size();
+    }
+    return total;
+}
+
+size_t KVCache::private_byte_size() const {
+    size_t total = 0;
+    for (const auto& block : blocks_) {
+        if (block && !block.shared()) total += block->byte_size();
+    }
+    return total;
+}
+
+size_t KVCache::byte_size(const std::vector<const KVCache*>& caches) {
+    std::unordered_set<const Block*> seen;
+    size_t total = 0;
+    for (const KVCache* cache : caches) {
+        for (const auto& block : cache->blocks_) {
+            if (block && seen.insert(block.get()).second) total += block->byte_size();
+        }
+    }
+    return total;
+}
+
+void KVCache::write(std::ostream& out) const {
+    FileHeader header{};
+    std::memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+    header.mode = static_cast<int32_t>(config_.mode);
+    header.max_seq_len = config_.max_seq_len;
+    header.window_size = config_.window_size;
+    header.num_sink_tokens = config_.num_sink_tokens;
+    header.lookahead = config_.lookahead;
+    header.block_size = config_.block_size;
+    header.num_layers = num_layers_;
+    header.kv_dim = kv_dim_;
+    header.current_length = current_length_;
+    header.written_length = written_length_;
+    header.num_blocks = static_cast<uint32_t>(blocks_.size());
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<uint8_t> present(blocks_.size());
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        present[i] = blocks_[i] ? 1 : 0;
+    }
+    out.write(reinterpret_cast<const char*>(present.data()), present.size());
+
+    for (const auto& block : blocks_) {
+        if (!block) continue;
+        pad_to_alignment(out);
+        out.write(reinterpret_cast<const char*>(block->data<float>()), block->byte_size());
+    }
+    if (!out) {
+        throw std::runtime_error("KVCache: write failed");
+    }
+}
+
+KVCache KVCache::map(const std::shared_ptr<MappedFile>& file, size_t offset, size_t* end) {
+    auto truncated = [&file]() {
+        return std::runtime_error("KVCache: truncated cache in " + file->path());
+    };
+    if (offset + sizeof(FileHeader) > file->size()) throw truncated();
+    FileHeader header;
+    std::memcpy(&header, file->data() + offset, sizeof(header));
+    if (std::memcmp(header.magic, kFileMagic, sizeof(kFileMagic)) != 0) {
+        throw std::runtime_error("KVCache: not a saved cache: " + file->path());
+    }
+
+    KVCacheConfig config;
+    config.mode = static_cast<KVCacheMode>(header.mode);
+    config.max_seq_len = header.max_seq_len;
+    config.window_size = header.window_size;
+    config.num_sink_tokens = header.num_sink_tokens;
+    config.lookahead = header.lookahead;
+    config.block_size = header.block_size;
+    KVCache cache(header.num_layers, header.kv_dim, config);
+    if (cache.blocks_.size() != header.num_blocks) {
+        throw std::runtime_error("KVCache: inconsistent block count in " + file->path());
+    }
+    cache.current_length_ = header.current_length;
+    cache.written_length_ = header.written_length;
+
+    size_t position = offset + sizeof(header);
+    if (position + header.num_blocks > file->size()) throw truncated();
+    const uint8_t* present = file->data() + position;
+    position += header.num_blocks;
+
+    std::vector<int> shape = {cache.num_layers_, 2, cache.config_.block_size, cache.kv_dim_};
+    size_t block_bytes = static_cast<size_t>(cache.num_layers_) * 2 * cache.config_.block_size *
+                         cache.kv_dim_ * sizeof(float);
+    for (uint32_t i = 0; i < header.num_blocks; ++i) {
+        if (!present[i]) continue;
+        position = align_up(position);
+        if (position + block_bytes > file->size()) throw truncated();
+        // The block's copy of file keeps the mapping alive
+        cache.blocks_[i] = BlockRef(new Block(Tensor(shape, DType::FP32, file->data() + position), file));
+        position += block_bytes;
+    }
+
+    if (end) *end = position;
+    return cache;
+}
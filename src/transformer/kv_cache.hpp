@@ -0,0 +1,165 @@
+#ifndef KV_CACHE_HPP
+#define KV_CACHE_HPP
+
+#include "../tensor.hpp"
+#include <atomic>
+#include <iosfwd>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class MappedFile;
+
+// How the cache retains past tokens once a sequence grows long
+enum class KVCacheMode {
+    Full,           // Keep every token up to max_seq_len
+    SlidingWindow,  // Keep only the last window_size tokens (Mistral-style)
+    AttentionSink   // Keep the first num_sink_tokens plus a rolling window (StreamingLLM)
+};
+
+struct KVCacheConfig {
+    KVCacheMode mode = KVCacheMode::Full;
+    int max_seq_len = 2048;   // Capacity in Full mode
+    int window_size = 1024;   // Rolling window for SlidingWindow/AttentionSink
+    int num_sink_tokens = 4;  // Pinned leading tokens for AttentionSink
+    int lookahead = 0;        // Extra ring slots so up to this many tokens can be rolled back
+    int block_size = 16;      // Slots per block, the unit of allocation and sharing; a power of two
+};
+
+// Per-sequence key/value storage. Slots form a ring: positions are absolute
+// token indices and are mapped onto slots, so windowed modes run at
+// constant memory however long the sequence gets. Slots live in blocks of
+// block_size rows covering every layer, allocated on first write.
+//
+// Blocks are reference counted, so fork() (or a copy) shares the whole
+// cache in O(blocks) without copying rows; a block is copied only when a
+// sequence writes into one it shares (copy-on-write). n samples or beams
+// of one prompt thus share its prefill. Forks may be used from different
+// threads, but not concurrently with the fork() call itself; block
+// ownership is counted with acquire/release so that is safe.
+class KVCache {
+public:
+    KVCache() = default;
+    KVCache(int num_layers, int kv_dim, const KVCacheConfig& config = KVCacheConfig());
+
+    // New sequence continuing from this one's tokens
+    KVCache fork() const { return *this; }
+
+    // Write one token's key/value rows for a layer
+    void store(int layer, int position, const float* key, const float* value);
+
+    const float* key_at(int layer, int position) const;
+    const float* value_at(int layer, int position) const;
+
+    // Absolute positions a query at position (length - 1) may attend to, in order
+    void visible_positions(int length, std::vector<int>& positions) const;
+
+    // Position used for RoPE. AttentionSink re-indexes tokens by their place
+    // in the cache, so keys are kept unrotated and rotated on read.
+    int rope_position(int position, int length) const;
+    bool rotate_on_read() const { return config_.mode == KVCacheMode::AttentionSink; }
+
+    // Called once per forward pass, after every layer has stored its rows
+    void advance(int num_tokens) { current_length_ += num_tokens; }
+    void clear() { current_length_ = 0; written_length_ = 0; }
+
+    // Roll back to the first `length` tokens, e.g. draft tokens rejected by
+    // speculative decoding. In windowed modes the rolled-back rows may
+    // already have overwritten older ones in the ring; that is only safe
+    // within config().lookahead tokens of the furthest write, so beyond it
+    // this throws.
+    void truncate(int length);
+
+    int length() const { return current_length_; }
+    int capacity() const { return capacity_; }
+    int num_layers() const { return num_layers_; }
+    int kv_dim() const { return kv_dim_; }
+    bool initialized() const { return num_layers_ > 0; }
+    const KVCacheConfig& config() const { return config_; }
+
+    // Key and value bytes of one token across all layers
+    size_t bytes_per_token() const { return 2 * static_cast<size_t>(num_layers_) * kv_dim_ * sizeof(float); }
+
+    // Bytes of the blocks this cache references, shared ones included
+    size_t byte_size() const;
+
+    // Bytes of the blocks no other fork references
+    size_t private_byte_size() const;
+
+    // Bytes of the distinct blocks referenced by any of caches: the real
+    // footprint of a group of forks
+    static size_t byte_size(const std::vector<const KVCache*>& caches);
+
+    // Serialize config, lengths and every allocated block. Block data is
+    // 64-byte aligned relative to the start of the stream, so map() can
+    // use it in place.
+    void write(std::ostream& out) const;
+
+    // Cache written by write() at offset into file, without copying: its
+    // blocks are views into the mapping (which they keep alive), so pages
+    // are read on first use. Writes copy-on-write as with any shared
+    // block. Sets *end, if given, to the offset just past the cache.
+    static KVCache map(const std::shared_ptr<MappedFile>& file, size_t offset,
+                       size_t* end = nullptr);
+
+private:
+    // Rows of one block, and how many caches reference it
+    struct Block {
+        Block(Tensor rows, std::shared_ptr<MappedFile> file = nullptr)
+            : rows(std::move(rows)), file(std::move(file)) {}
+        Tensor rows;
+        std::shared_ptr<MappedFile> file;  // Keeps a mapped block's pages alive
+        std::atomic<int> owners{1};
+    };
+
+    // Counted reference to a Block; copies share it. Dropping one releases
+    // and the sharing check acquires, so a fork that finds itself the only
+    // owner also sees other forks' reads of the block finished before it
+    // writes in place.
+    class BlockRef {
+    public:
+        BlockRef() = default;
+        explicit BlockRef(Block* block) : block_(block) {}
+        BlockRef(const BlockRef& other) : block_(other.block_) {
+            if (block_) block_->owners.fetch_add(1, std::memory_order_relaxed);
+        }
+        BlockRef(BlockRef&& other) noexcept : block_(std::exchange(other.block_, nullptr)) {}
+        BlockRef& operator=(BlockRef other) noexcept {
+            std::swap(block_, other.block_);
+            return *this;
+        }
+        ~BlockRef() {
+            if (block_ && block_->owners.fetch_sub(1, std::memory_order_acq_rel) == 1) delete block_;
+        }
+
+        bool shared() const { return block_->owners.load(std::memory_order_acquire) > 1; }
+        const Block* get() const { return block_; }
+        Tensor* operator->() const { return &block_->rows; }
+        explicit operator bool() const { return block_ != nullptr; }
+
+    private:
+        Block* block_ = nullptr;
+    };
+
+    int slot_for(int position) const;
+
+    // Row of one layer's keys (kv = 0) or values (kv = 1) within a block
+    size_t row_offset(int layer, int kv, int slot) const {
+        return ((static_cast<size_t>(layer) * 2 + kv) * config_.block_size +
+                (slot & (config_.block_size - 1))) * kv_dim_;
+    }
+    float* writable_block(int slot);
+
+    KVCacheConfig config_;
+    int kv_dim_ = 0;
+    int capacity_ = 0;
+    int current_length_ = 0;
+    int written_length_ = 0;  // One past the furthest position stored since clear()
+    int num_layers_ = 0;
+    int block_shift_ = 0;     // log2(block_size)
+
+    // [num_layers, 2, block_size, kv_dim] each; null until first written
+    std::vector<BlockRef> blocks_;
+};
+
+#endif // KV_CACHE_HPP
@@ -0,0 +1,115 @@
+#include "sampling.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#if defined(ENABLE_SIMD) && (defined(__AVX512F__) || defined(__AVX2__))
+#include <immintrin.h>
+#endif
+
+void token_probabilities(const float* logits, int vocab_size, const SamplingParams& params,
+                         std::vector<float>& probs) {
+    probs.assign(vocab_size, 0.0f);
+
+    if (params.temperature <= 0.0f) {
+        probs[std::max_element(logits, logits + vocab_size) - logits] = 1.0f;
+        return;
+    }
+
+    // Candidates in descending logit order; only as many as top-k needs
+    std::vector<int> order(vocab_size);
+    std::iota(order.begin(), order.end(), 0);
+    int keep = params.top_k > 0 && params.top_k < vocab_size ? params.top_k : vocab_size;
+    auto by_logit = [logits](int a, int b) { return logits[a] > logits[b]; };
+    if (keep < vocab_size || params.top_p < 1.0f) {
+        std::partial_sort(order.begin(), order.begin() + keep, order.end(), by_logit);
+    }
+
+    float max_logit = *std::max_element(logits, logits + vocab_size);
+    double sum = 0.0;
+    for (int i = 0; i < keep; ++i) {
+        float p = std::exp((logits[order[i]] - max_logit) / params.temperature);
+        probs[order[i]] = p;
+        sum += p;
+    }
+
+    // Smallest prefix whose mass reaches top_p
+    if (params.top_p < 1.0f) {
+        double cumulative = 0.0;
+        int cutoff = keep;
+        for (int i = 0; i < keep; ++i) {
+            cumulative += probs[order[i]] / sum;
+            if (cumulative >= params.top_p) {
+                cutoff = i + 1;
+                break;
+            }
+        }
+        for (int i = cutoff; i < keep; ++i) {
+            sum -= probs[order[i]];
+            probs[order[i]] = 0.0f;
+        }
+        keep = cutoff;
+    }
+
+    for (int i = 0; i < keep; ++i) {
+        probs[order[i]] = static_cast<float>(probs[order[i]] / sum);
+    }
+}
+
+int sample_token(const std::vector<float>& probs, std::mt19937& rng) {
+    double total = 0.0;
+    for (float p : probs) total += p;
+
+    double target = std::uniform_real_distribution<double>(0.0, total)(rng);
+    double cumulative = 0.0;
+    int last_nonzero = 0;
+    for (size_t i = 0; i < probs.size(); ++i) {
+        if (probs[i] <= 0.0f) continue;
+        cumulative += probs[i];
+        last_nonzero = static_cast<int>(i);
+        if (target < cumulative) return last_nonzero;
+    }
+    return last_nonzero;  // Rounding left target just past the end
+}
+
+void log_softmax(const float* logits, int vocab_size, std::vector<float>& log_probs) {
+    float max_logit = *std::max_element(logits, logits + vocab_size);
+    double sum = 0.0;
+    for (int i = 0; i < vocab_size; ++i) {
+        sum += std::exp(logits[i] - max_logit);
+    }
+    float log_sum = max_logit + static_cast<float>(std::log(sum));
+    log_probs.resize(vocab_size);
+    for (int i = 0; i < vocab_size; ++i) {
+        log_probs[i] = logits[i] - log_sum;
+    }
+}
+
+void apply_token_mask(float* logits, const uint64_t* mask, int vocab_size) {
+    const float neg_inf = -std::numeric_limits<float>::infinity();
+    int i = 0;
+#if defined(ENABLE_SIMD) && defined(__AVX512F__)
+    // Each 16-bit slice of the mask is directly a lane mask
+    const __m512 fill = _mm512_set1_ps(neg_inf);
+    for (; i + 16 <= vocab_size; i += 16) {
+        __mmask16 keep = static_cast<__mmask16>(mask[i >> 6] >> (i & 63));
+        __m512 kept = _mm512_mask_mov_ps(fill, keep, _mm512_loadu_ps(logits + i));
+        _mm512_storeu_ps(logits + i, kept);
+    }
+#elif defined(ENABLE_SIMD) && defined(__AVX2__)
+    // Spread 8 mask bits over the lanes and blend
+    const __m256 fill = _mm256_set1_ps(neg_inf);
+    const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    for (; i + 8 <= vocab_size; i += 8) {
+        int bits = static_cast<int>((mask[i >> 6] >> (i & 63)) & 0xFF);
+        __m256i selected = _mm256_and_si256(_mm256_set1_epi32(bits), lane_bits);
+        __m256 keep = _mm256_castsi256_ps(_mm256_cmpeq_epi32(selected, lane_bits));
+        __m256 kept = _mm256_blendv_ps(fill, _mm256_loadu_ps(logits + i), keep);
+        _mm256_storeu_ps(logits + i, kept);
+    }
+#endif
+    for (; i < vocab_size; ++i) {
+        if (!((mask[i >> 6] >> (i & 63)) & 1)) logits[i] = neg_inf;
+    }
+}
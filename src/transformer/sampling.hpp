@@ -0,0 +1,31 @@
+#ifndef SAMPLING_HPP
+#define SAMPLING_HPP
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Logit warping applied before sampling. Speculative decoding is exact
+// with respect to the warped target distribution, so draft and target
+// must use the same parameters.
+struct SamplingParams {
+    float temperature = 0.8f;  // <= 0 is greedy
+    int top_k = 40;            // <= 0 keeps every token
+    float top_p = 0.9f;        // >= 1 keeps every token
+};
+
+// Full-vocabulary probabilities after temperature, top-k and top-p, with
+// filtered tokens at zero. Greedy parameters give a one-hot argmax.
+void token_probabilities(const float* logits, int vocab_size, const SamplingParams& params,
+                         std::vector<float>& probs);
+
+int sample_token(const std::vector<float>& probs, std::mt19937& rng);
+
+// Natural-log probabilities of the raw logits (no warping), for beam scores
+void log_softmax(const float* logits, int vocab_size, std::vector<float>& log_probs);
+
+// Constrained decoding: set logits of tokens whose bit is clear in mask
+// (bit t of word t / 64) to -inf, 16 or 8 lanes at a time with SIMD
+void apply_token_mask(float* logits, const uint64_t* mask, int vocab_size);
+
+#endif // SAMPLING_HPP
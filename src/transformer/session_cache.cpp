@@ -0,0 +1,308 @@
+#include "session_cache.hpp"
+#include "../util/mapped_file.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char kSessionMagic[8] = {'S', 'E', 'S', 'S', 'I', 'O', 'N', '1'};
+const char* kSessionExtension = ".session";
+
+// File names are the hex of the ID, so any ID is a safe name
+std::string hex_encode(const std::string& id) {
+    static const char* digits = "0123456789abcdef";
+    std::string out;
+    for (unsigned char c : id) {
+        out += digits[c >> 4];
+        out += digits[c & 0xF];
+    }
+    return out;
+}
+
+bool hex_decode(const std::string& hex, std::string& id) {
+    if (hex.size() % 2 != 0) return false;
+    id.clear();
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        int value = 0;
+        for (char c : {hex[i], hex[i + 1]}) {
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else return false;
+        }
+        id += static_cast<char>(value);
+    }
+    return true;
+}
+
+} // namespace
+
+SessionCache::SessionCache(const SessionCacheConfig& config) : config_(config) {
+    if (!config_.spill_dir.empty()) {
+        fs::create_directories(config_.spill_dir);
+        load_spill_dir();
+    }
+}
+
+std::string SessionCache::path_for(const std::string& id) const {
+    return (fs::path(config_.spill_dir) / (hex_encode(id) + kSessionExtension)).string();
+}
+
+void SessionCache::load_spill_dir() {
+    // Oldest first, so the most recently written end up most recently used
+    std::vector<std::pair<fs::file_time_type, fs::path>> files;
+    for (const auto& file : fs::directory_iterator(config_.spill_dir)) {
+        if (file.is_regular_file() && file.path().extension() == kSessionExtension) {
+            files.emplace_back(file.last_write_time(), file.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    for (const auto& file : files) {
+        Entry entry;
+        if (!hex_decode(file.second.stem().string(), entry.id) || index_.count(entry.id)) {
+            continue;
+        }
+        entry.path = file.second.string();
+        entry.disk_bytes = fs::file_size(file.second);
+        entry.generation = next_generation_++;
+        stats_.disk_bytes += entry.disk_bytes;
+        lru_.push_front(std::move(entry));
+        index_[lru_.front().id] = lru_.begin();
+    }
+    std::vector<Spill> spills;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        spills = enforce_limits();
+    }
+    spill(std::move(spills));
+}
+
+void SessionCache::save(const std::string& id, const std::vector<int>& tokens,
+                        const KVCache& cache) {
+    if (id.empty() || id.size() > kMaxIdLength) {
+        throw std::runtime_error("SessionCache: session IDs must be 1 to " +
+                                 std::to_string(kMaxIdLength) + " bytes");
+    }
+    if (cache.length() > static_cast<int>(tokens.size())) {
+        throw std::runtime_error("SessionCache: cache holds more tokens than the history");
+    }
+
+    std::vector<Spill> spills;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(id);
+        if (it != index_.end()) {
+            remove(it->second);
+        }
+
+        Entry entry;
+        entry.id = id;
+        entry.tokens = tokens;
+        entry.cache = cache.fork();
+        entry.memory_bytes = entry.cache.byte_size();
+        entry.generation = next_generation_++;
+        stats_.memory_bytes += entry.memory_bytes;
+        lru_.push_front(std::move(entry));
+        index_[id] = lru_.begin();
+        spills = enforce_limits();
+    }
+    spill(std::move(spills));
+}
+
+bool SessionCache::restore(const std::string& id, std::vector<int>& tokens, KVCache& cache) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = index_.find(id);
+    if (it == index_.end()) {
+        stats_.misses++;
+        return false;
+    }
+    Entry& entry = *it->second;
+
+    if (!entry.cache.initialized()) {
+        // Spilled: map the snapshot back in; rows are read as attention touches them
+        try {
+            auto file = std::make_shared<MappedFile>(entry.path);
+            size_t header = sizeof(kSessionMagic) + sizeof(uint64_t);
+            uint64_t num_tokens = 0;
+            if (file->size() < header || std::memcmp(file->data(), kSessionMagic, sizeof(kSessionMagic)) != 0) {
+                throw std::runtime_error("not a session file");
+            }
+            std::memcpy(&num_tokens, file->data() + sizeof(kSessionMagic), sizeof(num_tokens));
+            if (header + num_tokens * sizeof(int32_t) > file->size()) {
+                throw std::runtime_error("truncated session file");
+            }
+            entry.tokens.resize(num_tokens);
+            std::memcpy(entry.tokens.data(), file->data() + header, num_tokens * sizeof(int32_t));
+            entry.cache = KVCache::map(file, header + num_tokens * sizeof(int32_t));
+        } catch (const std::exception&) {
+            // A corrupt or vanished file is just a miss
+            remove(it->second);
+            stats_.misses++;
+            return false;
+        }
+        entry.memory_bytes = entry.cache.byte_size();
+        stats_.memory_bytes += entry.memory_bytes;
+    }
+
+    lru_.splice(lru_.begin(), lru_, it->second);
+    tokens = entry.tokens;
+    cache = entry.cache.fork();
+    stats_.hits++;
+    std::vector<Spill> spills = enforce_limits();
+    lock.unlock();
+    spill(std::move(spills));
+    return true;
+}
+
+void SessionCache::erase(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(id);
+    if (it != index_.end()) {
+        remove(it->second);
+    }
+}
+
+void SessionCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (!lru_.empty()) {
+        remove(lru_.begin());
+    }
+}
+
+SessionCache::Stats SessionCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.sessions = lru_.size();
+    return stats;
+}
+
+void SessionCache::remove(Iterator entry) {
+    remove_file(*entry);
+    stats_.memory_bytes -= entry->memory_bytes;
+    index_.erase(entry->id);
+    lru_.erase(entry);
+}
+
+void SessionCache::remove_file(Entry& entry) {
+    if (entry.path.empty()) return;
+    std::error_code ignored;
+    fs::remove(entry.path, ignored);
+    stats_.disk_bytes -= entry.disk_bytes;
+    entry.path.clear();
+    entry.disk_bytes = 0;
+}
+
+void SessionCache::write_file(Spill& spill) {
+    std::ofstream out(spill.temporary, std::ios::binary | std::ios::trunc);
+    uint64_t num_tokens = spill.tokens.size();
+    out.write(kSessionMagic, sizeof(kSessionMagic));
+    out.write(reinterpret_cast<const char*>(&num_tokens), sizeof(num_tokens));
+    out.write(reinterpret_cast<const char*>(spill.tokens.data()), num_tokens * sizeof(int32_t));
+    spill.cache.write(out);
+    if (!out.flush()) {
+        throw std::runtime_error("SessionCache: cannot write " + spill.temporary);
+    }
+}
+
+void SessionCache::spill(std::vector<Spill> spills) {
+    while (!spills.empty()) {
+        for (Spill& snapshot : spills) {
+            try {
+                write_file(snapshot);
+                snapshot.written = true;
+            } catch (const std::exception&) {
+                // Disk full or unwritable: the entry is dropped below
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (Spill& snapshot : spills) {
+            std::error_code error;
+            auto it = index_.find(snapshot.id);
+            if (it == index_.end() || it->second->generation != snapshot.generation) {
+                fs::remove(snapshot.temporary, error);  // Erased or replaced meanwhile
+                continue;
+            }
+            Entry& entry = *it->second;
+            entry.spilling = false;
+
+            // Renamed under the lock, so readers only ever see complete files
+            // of the current entry
+            std::string path = path_for(snapshot.id);
+            if (snapshot.written) {
+                fs::rename(snapshot.temporary, path, error);
+            }
+            if (!snapshot.written || error) {
+                fs::remove(snapshot.temporary, error);
+                remove(it->second);
+                stats_.evictions++;
+                continue;
+            }
+            entry.path = path;
+            entry.disk_bytes = fs::file_size(path, error);
+            stats_.disk_bytes += entry.disk_bytes;
+            stats_.spills++;
+        }
+        // Spilled entries now have their snapshot and leave memory
+        spills = enforce_limits();
+    }
+}
+
+std::vector<SessionCache::Spill> SessionCache::enforce_limits() {
+    std::vector<Spill> spills;
+    size_t spilling_bytes = 0;  // Freed once the pending writes land
+
+    // Least recently used first
+    for (auto it = lru_.end();
+         stats_.memory_bytes - spilling_bytes > config_.max_memory_bytes && it != lru_.begin();) {
+        Entry& entry = *--it;
+        if (!entry.cache.initialized()) continue;
+        if (entry.spilling) {
+            spilling_bytes += entry.memory_bytes;
+            continue;
+        }
+
+        if (!config_.spill_dir.empty()) {
+            if (entry.path.empty()) {
+                Spill snapshot;
+                snapshot.id = entry.id;
+                snapshot.generation = entry.generation;
+                snapshot.tokens = entry.tokens;
+                snapshot.cache = entry.cache.fork();
+                snapshot.temporary = path_for(entry.id) + "." + std::to_string(entry.generation) + ".tmp";
+                spills.push_back(std::move(snapshot));
+                entry.spilling = true;
+                spilling_bytes += entry.memory_bytes;
+                continue;
+            }
+            stats_.memory_bytes -= entry.memory_bytes;
+            entry.memory_bytes = 0;
+            entry.cache = KVCache();
+            entry.tokens.clear();
+            entry.tokens.shrink_to_fit();
+            continue;
+        }
+        auto dropped = it++;
+        remove(dropped);
+        stats_.evictions++;
+    }
+
+    for (auto it = lru_.end(); stats_.disk_bytes > config_.max_disk_bytes && it != lru_.begin();) {
+        Entry& entry = *--it;
+        if (entry.path.empty()) continue;
+        if (entry.cache.initialized()) {
+            remove_file(entry);  // Still resident; only the snapshot goes
+            continue;
+        }
+        auto dropped = it++;
+        remove(dropped);
+        stats_.evictions++;
+    }
+    return spills;
+}
@@ -0,0 +1,107 @@
+#ifndef SESSION_CACHE_HPP
+#define SESSION_CACHE_HPP
+
+#include "kv_cache.hpp"
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct SessionCacheConfig {
+    size_t max_memory_bytes = size_t{1} << 30;  // KV bytes kept resident across sessions
+    std::string spill_dir;                      // Empty drops evicted sessions instead of spilling
+    size_t max_disk_bytes = size_t{16} << 30;   // Oldest spilled sessions are deleted past this
+};
+
+// KV caches of finished requests kept under a session ID, so the next
+// turn of a conversation prefills only its new tokens instead of the
+// whole history. Entries are LRU: past max_memory_bytes the least recently
+// used are written to spill_dir (or dropped) and mapped back in on their
+// next restore, so a restored session costs page faults, not a prefill.
+// Sessions found in spill_dir at construction are picked up again.
+//
+// Stored caches are forks, so saving and restoring share blocks instead of
+// copying rows. Thread safe; spill files are written without the lock
+// held, so other sessions are served while one is written out.
+class SessionCache {
+public:
+    static constexpr size_t kMaxIdLength = 128;
+
+    explicit SessionCache(const SessionCacheConfig& config = SessionCacheConfig());
+
+    // Keep tokens (the session's whole history) and a fork of the cache
+    // holding a prefix of them, replacing any earlier entry for id. IDs are
+    // at most kMaxIdLength bytes; longer ones throw.
+    void save(const std::string& id, const std::vector<int>& tokens, const KVCache& cache);
+
+    // History and a fork of the cache saved under id, resident or mapped
+    // back from disk; false if there is none
+    bool restore(const std::string& id, std::vector<int>& tokens, KVCache& cache);
+
+    void erase(const std::string& id);
+
+    // Drop every session, spilled ones included (e.g. the model changed)
+    void clear();
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t spills = 0;     // Sessions written to disk on eviction
+        uint64_t evictions = 0;  // Sessions dropped entirely
+        size_t sessions = 0;
+        size_t memory_bytes = 0;
+        size_t disk_bytes = 0;
+    };
+    Stats stats() const;
+
+private:
+    struct Entry {
+        std::string id;
+        std::vector<int> tokens;  // Empty until loaded for sessions found on disk
+        KVCache cache;            // Uninitialized unless resident
+        size_t memory_bytes = 0;
+        std::string path;         // Non-empty while a snapshot is on disk
+        size_t disk_bytes = 0;
+        uint64_t generation = 0;  // Tells a replaced entry from its successor
+        bool spilling = false;    // A snapshot is being written
+    };
+    using Iterator = std::list<Entry>::iterator;
+
+    // Resident entry being written to spill_dir: a fork of its cache and a
+    // copy of its history, so the write needs no lock
+    struct Spill {
+        std::string id;
+        uint64_t generation = 0;
+        std::vector<int> tokens;
+        KVCache cache;
+        std::string temporary;  // Renamed into place once recorded
+        bool written = false;
+    };
+
+    std::string path_for(const std::string& id) const;
+    void load_spill_dir();
+
+    // With mutex_ held
+    void remove(Iterator entry);
+    void remove_file(Entry& entry);
+
+    // Frees memory from the least recently used entries that need no write
+    // and returns the ones that must be spilled first
+    std::vector<Spill> enforce_limits();
+
+    // Without mutex_ held: writes the snapshots, then records them and
+    // enforces the limits again
+    void spill(std::vector<Spill> spills);
+    static void write_file(Spill& spill);
+
+    SessionCacheConfig config_;
+    std::list<Entry> lru_;  // Most recently used first
+    std::unordered_map<std::string, Iterator> index_;
+    Stats stats_;
+    uint64_t next_generation_ = 0;
+    mutable std::mutex mutex_;
+};
+
+#endif // SESSION_CACHE_HPP
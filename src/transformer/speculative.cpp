@@ -0,0 +1,183 @@
+#include "speculative.hpp"
+#include "../util/profiler.hpp"
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+namespace {
+
+Tensor make_input_ids(const std::vector<int>& ids) {
+    Tensor input_ids(std::vector<int>{1, static_cast<int>(ids.size())}, DType::FP32);
+    float* data = input_ids.data<float>();
+    for (size_t i = 0; i < ids.size(); ++i) {
+        data[i] = static_cast<float>(ids[i]);
+    }
+    return input_ids;
+}
+
+// Tokens past length a cache can still take; windowed caches never fill
+int room_in(const KVCache& cache, size_t length) {
+    if (cache.config().mode != KVCacheMode::Full) return INT_MAX / 2;
+    return cache.capacity() - static_cast<int>(length);
+}
+
+} // namespace
+
+VerifyResult verify_draft(const std::vector<int>& draft_tokens,
+                          const std::vector<std::vector<float>>& draft_probs,
+                          const std::vector<std::vector<float>>& target_probs,
+                          std::mt19937& rng) {
+    int num_draft = static_cast<int>(draft_tokens.size());
+    if (static_cast<int>(target_probs.size()) != num_draft + 1 ||
+        (!draft_probs.empty() && static_cast<int>(draft_probs.size()) != num_draft)) {
+        throw std::runtime_error("verify_draft: need one target row per draft token plus one");
+    }
+
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (int i = 0; i < num_draft; ++i) {
+        int token = draft_tokens[i];
+        const std::vector<float>& p = target_probs[i];
+        double q_token = draft_probs.empty() ? 1.0 : draft_probs[i][token];
+
+        // Keep with probability min(1, p / q)
+        if (q_token > 0.0 && uniform(rng) * q_token < p[token]) {
+            continue;
+        }
+
+        // Rejected: resample from the part of p the draft under-covers
+        std::vector<float> residual(p.size());
+        double mass = 0.0;
+        for (size_t v = 0; v < p.size(); ++v) {
+            float q = draft_probs.empty() ? (static_cast<int>(v) == token ? 1.0f : 0.0f)
+                                          : draft_probs[i][v];
+            residual[v] = std::max(0.0f, p[v] - q);
+            mass += residual[v];
+        }
+        // p == q up to rounding; any sample from p is then exact
+        int next = mass > 0.0 ? sample_token(residual, rng) : sample_token(p, rng);
+        return {i, next};
+    }
+
+    return {num_draft, sample_token(target_probs[num_draft], rng)};
+}
+
+std::vector<int> prompt_lookup(const std::vector<int>& tokens, int max_ngram, int min_ngram,
+                               int max_tokens) {
+    int size = static_cast<int>(tokens.size());
+    for (int n = std::min(max_ngram, size - 1); n >= std::max(1, min_ngram); --n) {
+        const int* suffix = tokens.data() + size - n;
+        // Most recent occurrence first, so the guess follows the latest context
+        for (int start = size - n - 1; start >= 0; --start) {
+            if (std::equal(suffix, suffix + n, tokens.data() + start)) {
+                int from = start + n;
+                int count = std::min(max_tokens, size - from);
+                return std::vector<int>(tokens.begin() + from, tokens.begin() + from + count);
+            }
+        }
+    }
+    return {};
+}
+
+SpeculativeDecoder::SpeculativeDecoder(Transformer& target, Transformer& draft,
+                                       const KVCacheConfig& cache_config,
+                                       const SpeculativeConfig& config)
+    : SpeculativeDecoder(target, cache_config, config) {
+    if (target.vocab_size() != draft.vocab_size()) {
+        throw std::runtime_error("SpeculativeDecoder: draft and target vocabularies differ");
+    }
+    draft_ = &draft;
+
+    KVCacheConfig draft_config = target_cache_.config();
+    draft_config.max_seq_len = std::min(draft_config.max_seq_len, draft.max_seq_len());
+    draft_cache_ = draft.create_cache(draft_config);
+}
+
+SpeculativeDecoder::SpeculativeDecoder(Transformer& target, const KVCacheConfig& cache_config,
+                                       const SpeculativeConfig& config)
+    : target_(target), draft_(nullptr), config_(config) {
+    if (config_.num_draft_tokens < 1) {
+        throw std::runtime_error("SpeculativeDecoder: num_draft_tokens must be positive");
+    }
+
+    KVCacheConfig target_config = cache_config;
+    target_config.lookahead = std::max(target_config.lookahead, config_.num_draft_tokens);
+    target_config.max_seq_len = std::min(target_config.max_seq_len, target.max_seq_len());
+    target_cache_ = target.create_cache(target_config);
+}
+
+void SpeculativeDecoder::logits_to_probs(const Tensor& logits, int rows,
+                                         std::vector<std::vector<float>>& probs) {
+    int seq_len = logits.shape()[1];
+    int vocab_size = logits.shape().back();
+    const float* data = logits.data<float>();
+    probs.resize(rows);
+    for (int r = 0; r < rows; ++r) {
+        const float* row = data + static_cast<size_t>(seq_len - rows + r) * vocab_size;
+        token_probabilities(row, vocab_size, config_.sampling, probs[r]);
+    }
+}
+
+std::vector<int> SpeculativeDecoder::propose_with_draft(const std::vector<int>& tokens, int k,
+                                                        std::mt19937& rng,
+                                                        std::vector<std::vector<float>>& draft_probs) {
+    // k cheap sequential forwards, starting from whatever the draft cache
+    // hasn't seen (a bonus token can leave it two behind)
+    std::vector<int> proposal;
+    std::vector<int> input(tokens.begin() + draft_cache_.length(), tokens.end());
+    for (int i = 0; i < k; ++i) {
+        Tensor logits = draft_->forward(make_input_ids(input), &draft_cache_);
+        std::vector<std::vector<float>> row;
+        logits_to_probs(logits, 1, row);
+        draft_probs.push_back(std::move(row[0]));
+        proposal.push_back(sample_token(draft_probs.back(), rng));
+        input.assign(1, proposal.back());
+    }
+    return proposal;
+}
+
+int SpeculativeDecoder::step(std::vector<int>& tokens, std::mt19937& rng) {
+    // The target stores every proposal; a draft model all but the last
+    int k = std::min(config_.num_draft_tokens, room_in(target_cache_, tokens.size()));
+    if (draft_) {
+        k = std::min(k, room_in(draft_cache_, tokens.size()) + 1);
+    }
+    k = std::max(k, 0);
+
+    // Empty draft_probs marks prompt-lookup proposals as deterministic
+    std::vector<int> proposal;
+    std::vector<std::vector<float>> draft_probs;
+    if (k > 0) {
+        PROFILE_SCOPE("speculative_draft");
+        proposal = draft_ ? propose_with_draft(tokens, k, rng, draft_probs)
+                          : prompt_lookup(tokens, config_.max_ngram, config_.min_ngram, k);
+        k = static_cast<int>(proposal.size());
+    }
+
+    // Target: one forward over the unseen tokens plus every proposal,
+    // giving a distribution after each proposal prefix
+    VerifyResult result;
+    {
+        PROFILE_SCOPE("speculative_verify");
+        std::vector<int> input(tokens.begin() + target_cache_.length(), tokens.end());
+        input.insert(input.end(), proposal.begin(), proposal.end());
+        Tensor logits = target_.forward(make_input_ids(input), &target_cache_);
+        std::vector<std::vector<float>> target_probs;
+        logits_to_probs(logits, k + 1, target_probs);
+        result = verify_draft(proposal, draft_probs, target_probs, rng);
+    }
+
+    tokens.insert(tokens.end(), proposal.begin(), proposal.begin() + result.accepted);
+    tokens.push_back(result.next_token);
+
+    // Drop rejected rows; the new token is fed at the start of the next round
+    int committed = static_cast<int>(tokens.size()) - 1;
+    target_cache_.truncate(std::min(target_cache_.length(), committed));
+    if (draft_) {
+        draft_cache_.truncate(std::min(draft_cache_.length(), committed));
+    }
+
+    stats_.rounds++;
+    stats_.proposed += k;
+    stats_.accepted += result.accepted;
+    return result.accepted + 1;
+}
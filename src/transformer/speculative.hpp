@@ -0,0 +1,101 @@
+#ifndef SPECULATIVE_HPP
+#define SPECULATIVE_HPP
+
+#include "transformer.hpp"
+#include "kv_cache.hpp"
+#include "sampling.hpp"
+#include <cstdint>
+#include <random>
+#include <vector>
+
+struct VerifyResult {
+    int accepted;    // Leading draft tokens kept
+    int next_token;  // Correction for the first rejected token, or a bonus token if none was
+};
+
+// Rejection step of speculative sampling (Leviathan et al. 2023; Chen et
+// al. 2023). Draft token i is kept with probability min(1, p_i(x) / q_i(x));
+// the first rejection is replaced by a sample from max(0, p_i - q_i), and
+// if all are kept a bonus token is drawn from p_k. The output is then
+// distributed exactly as sampling from the target token by token.
+// target_probs has one row per draft token plus one. Empty draft_probs
+// means deterministic proposals (q is one-hot).
+VerifyResult verify_draft(const std::vector<int>& draft_tokens,
+                          const std::vector<std::vector<float>>& draft_probs,
+                          const std::vector<std::vector<float>>& target_probs,
+                          std::mt19937& rng);
+
+// Prompt-lookup proposal (n-gram speculation): find the most recent
+// earlier occurrence of the last n tokens, trying n = max_ngram down to
+// min_ngram, and return up to max_tokens tokens that followed it. Empty
+// when nothing matches. Extractive outputs (summaries, code edits) copy
+// long spans of their prompt, so these guesses are often right and need
+// no draft model.
+std::vector<int> prompt_lookup(const std::vector<int>& tokens, int max_ngram, int min_ngram,
+                               int max_tokens);
+
+struct SpeculativeConfig {
+    int num_draft_tokens = 4;  // k proposals per round
+    SamplingParams sampling;
+
+    // Without a draft model, proposals come from prompt_lookup()
+    int max_ngram = 3;
+    int min_ngram = 1;
+};
+
+// Speculative decoding: a small draft model (or prompt lookup) proposes
+// k tokens, the target scores all of them in a single batched forward
+// pass, and verify_draft() decides how many to keep. Decode is bound by
+// streaming the target's weights, so verifying k tokens costs about as
+// much as generating one. Rejected tokens are rolled back in the KV
+// caches.
+class SpeculativeDecoder {
+public:
+    // Both models must share a vocabulary. cache_config sizes both caches;
+    // its lookahead is raised to k so windowed modes can roll back.
+    SpeculativeDecoder(Transformer& target, Transformer& draft, const KVCacheConfig& cache_config,
+                       const SpeculativeConfig& config);
+
+    // Prompt-lookup speculation: no draft model, no extra weights
+    SpeculativeDecoder(Transformer& target, const KVCacheConfig& cache_config,
+                       const SpeculativeConfig& config);
+
+    // Run one draft-and-verify round over tokens (prompt plus everything
+    // generated so far) and append 1 to k + 1 new tokens. Returns how many
+    // were appended.
+    int step(std::vector<int>& tokens, std::mt19937& rng);
+
+    struct Stats {
+        uint64_t rounds = 0;
+        uint64_t proposed = 0;  // Draft tokens sent to the target
+        uint64_t accepted = 0;  // Draft tokens the target kept
+
+        double acceptance_rate() const {
+            return proposed > 0 ? static_cast<double>(accepted) / proposed : 0.0;
+        }
+        // Tokens appended per target forward pass; plain decoding gets 1
+        double tokens_per_round() const {
+            return rounds > 0 ? static_cast<double>(accepted + rounds) / rounds : 0.0;
+        }
+    };
+    const Stats& stats() const { return stats_; }
+
+    KVCache& target_cache() { return target_cache_; }
+    KVCache& draft_cache() { return draft_cache_; }  // Unused with prompt lookup
+
+private:
+    std::vector<int> propose_with_draft(const std::vector<int>& tokens, int k, std::mt19937& rng,
+                                        std::vector<std::vector<float>>& draft_probs);
+
+    // Probability rows for the last `rows` positions of logits [1, seq, vocab]
+    void logits_to_probs(const Tensor& logits, int rows, std::vector<std::vector<float>>& probs);
+
+    Transformer& target_;
+    Transformer* draft_;  // nullptr for prompt lookup
+    SpeculativeConfig config_;
+    KVCache target_cache_;
+    KVCache draft_cache_;
+    Stats stats_;
+};
+
+#endif // SPECULATIVE_HPP
@@ -1,6 +1,10 @@
 #include "transformer.hpp"
 #include "../kernels/gemm_ref.hpp"
+#include "../util/threadpool.hpp"
+#include "../util/profiler.hpp"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <stdexcept>
 
 // Linear layer implementation
@@ -52,39 +56,100 @@ Tensor Linear::forward(const Tensor& input) {
     return output_2d.reshape(output_shape);
 }
 
+void Linear::forward_into(const Tensor& input, Tensor& output) {
+    auto weight_shape = weight_.shape();
+    int hidden_size = weight_shape[0];
+    int output_size = weight_shape[1];
+    int rows = static_cast<int>(input.numel()) / hidden_size;
+
+    if (input.shape().back() != hidden_size || output.shape().back() != output_size ||
+        static_cast<int>(output.numel()) != rows * output_size) {
+        throw std::runtime_error("Linear: input/output shape doesn't match weight");
+    }
+
+    // 2D views share memory with input/output, so nothing is copied
+    const Tensor input_2d = input.view({rows, hidden_size});
+    Tensor output_2d = output.view({rows, output_size});
+
+    GemmRef::matmul(input_2d, weight_, output_2d, 1.0f, 0.0f);
+
+    if (bias_.numel() > 0) {
+        float* out = output_2d.data<float>();
+        const float* bias = bias_.data<float>();
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < output_size; ++j) {
+                out[i * output_size + j] += bias[j];
+            }
+        }
+    }
+}
+
 // Attention implementation (simplified)
-Attention::Attention(const std::string& name, int hidden_size, int num_heads)
+Attention::Attention(const std::string& name, int hidden_size, int num_heads, int layer_idx)
     : name_(name), hidden_size_(hidden_size), num_heads_(num_heads) {
     head_dim_ = hidden_size / num_heads;
+    flash_ = std::make_unique<flash::FlashAttention>(
+        hidden_size, num_heads, head_dim_, 1.0f / std::sqrt(static_cast<float>(head_dim_)), layer_idx);
 }
 
 Tensor Attention::forward(const Tensor& hidden_states, KVCache* cache) {
+    Tensor output(hidden_states.shape(), DType::FP32);
+    forward_into(hidden_states, output, cache);
+    return output;
+}
+
+void Attention::forward_into(const Tensor& hidden_states, Tensor& output, KVCache* cache) {
     // Simplified attention implementation
-    // In a real implementation, this would compute Q, K, V projections,
-    // attention scores, and output projection
+    // In a real implementation, this would compute Q, K, V projections
+    // and the output projection
+
+    // Without a cache, pass the input through (identity attention)
+    if (!cache) {
+        std::memcpy(output.raw(), hidden_states.data<float>(), hidden_states.byte_size());
+        return;
+    }
 
-    // For now, return the input as-is (identity attention)
-    return hidden_states;
+    // Projections are not wired up yet, so Q = K = V = hidden_states; this
+    // still exercises the cache layout and RoPE positions end to end
+    flash_->forward_into(hidden_states, hidden_states, hidden_states, output, cache);
+}
+
+void Attention::lower(ExecutionPlan& plan, float* input, float* output,
+                      const std::vector<int>& shape, bool with_cache) {
+    if (!with_cache) {
+        size_t count = static_cast<size_t>(shape[0]) * shape[1] * shape[2];
+        plan.add_copy(name_.c_str(), input, output, count);
+        return;
+    }
+    plan.add_cached_attention(name_.c_str(), flash_.get(), input, output, shape);
 }
 
 // Transformer block implementation
-TransformerBlock::TransformerBlock(const std::string& name, int hidden_size, int num_heads)
+TransformerBlock::TransformerBlock(const std::string& name, int hidden_size, int num_heads,
+                                   int layer_idx)
     : name_(name) {
-    attention_ = std::make_unique<Attention>(name + ".attention", hidden_size, num_heads);
+    attention_ = std::make_unique<Attention>(name + ".attention", hidden_size, num_heads, layer_idx);
     // ff1_ and ff2_ would be initialized from weights
 }
 
 Tensor TransformerBlock::forward(const Tensor& hidden_states, KVCache* cache) {
+    Tensor output(hidden_states.shape(), DType::FP32);
+    forward_into(hidden_states, output, cache);
+    return output;
+}
+
+void TransformerBlock::forward_into(const Tensor& hidden_states, Tensor& output, KVCache* cache) {
     // Simplified transformer block: attention -> residual -> feedforward -> residual
 
-    // Self-attention with residual
-    Tensor attn_output = attention_->forward(hidden_states, cache);
-    // Residual connection (simplified - just return attention output for now)
-    Tensor residual = attn_output;
+    // Self-attention (residual connection simplified - the attention output is the block output)
+    attention_->forward_into(hidden_states, output, cache);
 
     // In a real implementation, you'd add the residual and apply layer norm
+}
 
-    return residual;
+void TransformerBlock::lower(ExecutionPlan& plan, float* input, float* output,
+                             const std::vector<int>& shape, bool with_cache) {
+    attention_->lower(plan, input, output, shape, with_cache);
 }
 
 // Main Transformer implementation
@@ -105,34 +170,130 @@ void Transformer::load_weights(const ModelWeights& weights) {
     // Initialize layers (simplified)
     for (int i = 0; i < num_layers_; ++i) {
         layers_.push_back(std::make_unique<TransformerBlock>(
-            "model.layers." + std::to_string(i), hidden_size_, num_heads_));
+            "model.layers." + std::to_string(i), hidden_size_, num_heads_, i));
+    }
+}
+
+std::vector<std::array<int, 3>> Transformer::gemm_shapes(int rows) const {
+    int ffn_size = 4 * hidden_size_;
+    return {
+        {rows, hidden_size_, hidden_size_},  // q/k/v/o projections
+        {rows, hidden_size_, ffn_size},      // ff1
+        {rows, ffn_size, hidden_size_},      // ff2
+        {rows, hidden_size_, vocab_size_},   // lm_head
+    };
+}
+
+KVCache Transformer::create_cache(const KVCacheConfig& config) const {
+    return KVCache(num_layers_, hidden_size_, config);
+}
+
+Transformer::ForwardPlan& Transformer::plan_for(int batch_size, int seq_len) {
+    // Round seq_len up to a power of two so decode and similar-length
+    // prefills share one plan
+    int bucket = 1;
+    while (bucket < seq_len) bucket <<= 1;
+
+    uint64_t key = (static_cast<uint64_t>(batch_size) << 32) | static_cast<uint32_t>(bucket);
+    auto it = plans_.find(key);
+    if (it != plans_.end()) {
+        return *it->second;
+    }
+
+    auto plan = std::make_unique<ForwardPlan>();
+    size_t hidden_bytes = static_cast<size_t>(batch_size) * bucket * hidden_size_ * sizeof(float);
+
+    // Step 0 produces the embeddings, step i + 1 runs layer i; each hidden
+    // state lives until the next layer has consumed it
+    for (int step = 0; step <= num_layers_; ++step) {
+        plan->hidden_ids.push_back(plan->planner.add_buffer(hidden_bytes, step, step + 1));
+    }
+    // Logits live across the whole pass so nothing else overwrites them;
+    // the placeholder lm_head only writes the first hidden_size of each
+    // row, so the rest is zeroed once here
+    size_t logits_bytes = static_cast<size_t>(batch_size) * bucket * vocab_size_ * sizeof(float);
+    plan->logits_id = plan->planner.add_buffer(logits_bytes, 0, num_layers_ + 1);
+    plan->planner.plan();
+    plan->arena = std::make_unique<ActivationArena>(plan->planner, activation_pool_);
+    std::memset(plan->arena->data(plan->logits_id), 0, logits_bytes);
+
+    auto& result = *plan;
+    plans_.emplace(key, std::move(plan));
+    return result;
+}
+
+ExecutionPlan& Transformer::compile(int batch_size, int seq_len, bool with_cache) {
+    ForwardPlan& arena_plan = plan_for(batch_size, seq_len);
+
+    uint64_t key = (static_cast<uint64_t>(seq_len) << 1) | (with_cache ? 1u : 0u);
+    auto it = arena_plan.compiled.find(key);
+    if (it != arena_plan.compiled.end()) {
+        return *it->second;
+    }
+
+    auto plan = std::make_unique<ExecutionPlan>();
+    std::vector<int> hidden_shape = {batch_size, seq_len, hidden_size_};
+    auto buffer = [&](int step) {
+        return static_cast<float*>(arena_plan.arena->data(arena_plan.hidden_ids[step]));
+    };
+
+    // Embedding lookup is a placeholder fill until embed_tokens_ is wired up
+    size_t count = static_cast<size_t>(batch_size) * seq_len * hidden_size_;
+    plan->add_fill_random("embed_tokens", buffer(0), count);
+
+    for (int i = 0; i < num_layers_; ++i) {
+        layers_[i]->lower(*plan, buffer(i), buffer(i + 1), hidden_shape, with_cache);
+    }
+
+    plan->optimize();
+    plan->partition(thread_pool_ ? thread_pool_->size() + 1 : 1);
+
+    auto& result = *plan;
+    arena_plan.compiled.emplace(key, std::move(plan));
+    return result;
+}
+
+void Transformer::set_thread_pool(ThreadPool* pool) {
+    thread_pool_ = pool;
+
+    // Partitions depend on the worker count
+    size_t num_threads = pool ? pool->size() + 1 : 1;
+    for (auto& entry : plans_) {
+        for (auto& compiled : entry.second->compiled) {
+            compiled.second->partition(num_threads);
+        }
     }
 }
 
 Tensor Transformer::forward(const Tensor& input_ids, KVCache* cache) {
-    // input_ids: [batch_size, seq_len]
+    PROFILE_SCOPE("forward");
 
-    // Embedding lookup (simplified - would need actual embedding table)
+    // input_ids: [batch_size, seq_len]
     auto shape = input_ids.shape();
     int batch_size = shape[0];
     int seq_len = shape[1];
 
-    // For now, create dummy hidden states (in reality, this would be embed_tokens(input_ids))
-    std::vector<int> hidden_shape = {batch_size, seq_len, hidden_size_};
-    Tensor hidden_states(hidden_shape, DType::FP32);
+    // Shapes and buffers are resolved once per shape; later calls only replay
+    ForwardPlan& arena_plan = plan_for(batch_size, seq_len);
+    ExecutionPlan& plan = compile(batch_size, seq_len, cache != nullptr);
+    plan.run(cache, thread_pool_);
 
-    // Initialize with small random values for testing
-    float* data = hidden_states.data<float>();
-    for (int i = 0; i < hidden_states.numel(); ++i) {
-        data[i] = 0.01f * (rand() % 100 - 50) / 50.0f; // Small random values
+    if (cache) {
+        cache->advance(seq_len);
     }
 
-    // Forward pass through transformer layers
-    for (auto& layer : layers_) {
-        hidden_states = layer->forward(hidden_states, cache);
-    }
+    PROFILE_SCOPE("lm_head");
 
     // Final linear layer (lm_head)
-    // For now, return the hidden states as logits (simplified)
-    return hidden_states.reshape({batch_size, seq_len, vocab_size_});
+    // For now, each position's hidden state fills the first hidden_size
+    // logits and the rest are zero (simplified)
+    Tensor logits = arena_plan.arena->tensor(arena_plan.logits_id, {batch_size, seq_len, vocab_size_},
+                                             DType::FP32);
+    float* logits_data = logits.data<float>();
+    const float* hidden = plan.output();
+    for (int row = 0; row < batch_size * seq_len; ++row) {
+        std::memcpy(logits_data + static_cast<size_t>(row) * vocab_size_,
+                    hidden + static_cast<size_t>(row) * hidden_size_, hidden_size_ * sizeof(float));
+    }
+    return logits;
 }
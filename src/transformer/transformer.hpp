@@ -2,15 +2,15 @@
 #define TRANSFORMER_HPP
 
 #include "../tensor.hpp"
+#include "../alloc.hpp"
+#include "../memory_planner.hpp"
+#include "../kernels/optimized/flash_attention.hpp"
+#include "kv_cache.hpp"
+#include "execution_plan.hpp"
 #include <vector>
 #include <unordered_map>
 #include <memory>
-
-struct KVCache {
-    std::vector<Tensor> keys;
-    std::vector<Tensor> values;
-    int current_length = 0;
-};
+#include <array>
 
 struct ModelWeights {
     std::unordered_map<std::string, Tensor> weights;
@@ -23,6 +23,10 @@ public:
 
     Tensor forward(const Tensor& input);
 
+    // Writes into a preallocated output of shape [..., output_size] without
+    // allocating intermediates
+    void forward_into(const Tensor& input, Tensor& output);
+
 private:
     std::string name_;
     Tensor weight_;
@@ -31,10 +35,15 @@ private:
 
 class Attention {
 public:
-    Attention(const std::string& name, int hidden_size, int num_heads);
+    Attention(const std::string& name, int hidden_size, int num_heads, int layer_idx = 0);
     ~Attention() = default;
 
     Tensor forward(const Tensor& hidden_states, KVCache* cache = nullptr);
+    void forward_into(const Tensor& hidden_states, Tensor& output, KVCache* cache = nullptr);
+
+    // Append this layer's kernels to a plan for a [batch, seq, hidden] input
+    void lower(ExecutionPlan& plan, float* input, float* output,
+               const std::vector<int>& shape, bool with_cache);
 
 private:
     std::string name_;
@@ -42,6 +51,7 @@ private:
     int num_heads_;
     int head_dim_;
 
+    std::unique_ptr<flash::FlashAttention> flash_;
     std::unique_ptr<Linear> q_proj_;
     std::unique_ptr<Linear> k_proj_;
     std::unique_ptr<Linear> v_proj_;
@@ -50,10 +60,13 @@ private:
 
 class TransformerBlock {
 public:
-    TransformerBlock(const std::string& name, int hidden_size, int num_heads);
+    TransformerBlock(const std::string& name, int hidden_size, int num_heads, int layer_idx = 0);
     ~TransformerBlock() = default;
 
     Tensor forward(const Tensor& hidden_states, KVCache* cache = nullptr);
+    void forward_into(const Tensor& hidden_states, Tensor& output, KVCache* cache = nullptr);
+    void lower(ExecutionPlan& plan, float* input, float* output,
+               const std::vector<int>& shape, bool with_cache);
 
 private:
     std::string name_;
@@ -67,16 +80,45 @@ public:
     Transformer(const ModelWeights& weights);
     ~Transformer() = default;
 
+    // With a cache, input_ids holds only the tokens not yet cached. The
+    // logits are a view into this model's arena, valid until the next
+    // forward() call.
     Tensor forward(const Tensor& input_ids, KVCache* cache = nullptr);
 
+    // Build (or fetch) the flattened kernel list for one input shape.
+    // forward() replays it; exposed so callers can warm up shapes ahead of time.
+    ExecutionPlan& compile(int batch_size, int seq_len, bool with_cache);
+
+    // Elementwise plan steps are split across this pool; nullptr runs inline
+    void set_thread_pool(ThreadPool* pool);
+
+    // (M, K, N) of every distinct GEMM a forward pass over `rows` tokens runs
+    std::vector<std::array<int, 3>> gemm_shapes(int rows) const;
+
+    // Allocate a KV cache sized for this model
+    KVCache create_cache(const KVCacheConfig& config = KVCacheConfig()) const;
+
     // Configuration
     int vocab_size() const { return vocab_size_; }
     int hidden_size() const { return hidden_size_; }
     int num_layers() const { return num_layers_; }
     int num_heads() const { return num_heads_; }
+    int max_seq_len() const { return max_seq_len_; }
 
 private:
+    // Arena layout of the forward-pass intermediates for one shape class
+    struct ForwardPlan {
+        MemoryPlanner planner;
+        std::unique_ptr<ActivationArena> arena;
+        std::vector<int> hidden_ids; // Embedding output, then one per layer
+        int logits_id = -1;          // [batch, bucket, vocab]
+
+        // Compiled plans sharing this arena, keyed by exact seq_len and cache use
+        std::unordered_map<uint64_t, std::unique_ptr<ExecutionPlan>> compiled;
+    };
+
     void load_weights(const ModelWeights& weights);
+    ForwardPlan& plan_for(int batch_size, int seq_len);
 
     ModelWeights weights_;
     int vocab_size_;
@@ -88,6 +130,11 @@ private:
     std::unique_ptr<Linear> embed_tokens_;
     std::vector<std::unique_ptr<TransformerBlock>> layers_;
     std::unique_ptr<Linear> lm_head_;
+
+    // Plans keyed by (batch, seq rounded up to a power of two)
+    TensorPool activation_pool_;
+    std::unordered_map<uint64_t, std::unique_ptr<ForwardPlan>> plans_;
+    ThreadPool* thread_pool_ = nullptr;
 };
 
 #endif // TRANSFORMER_HPP
@@ -0,0 +1,120 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Log-bucketed histogram over non-negative integer values (nanoseconds for
+// latencies), in the style of HdrHistogram: values below 32 are exact, and
+// every power of two above that is split into 32 linear sub-buckets, so
+// any recorded value is reported within ~3% across the whole uint64 range
+// in 1920 fixed buckets. Histograms merge by adding counts.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr uint64_t kSubBuckets = 1ull << kSubBucketBits;
+    static constexpr size_t kNumBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    LatencyHistogram() : counts_(kNumBuckets, 0) {}
+
+    void record(uint64_t value) {
+        counts_[bucket_index(value)]++;
+        count_++;
+        sum_ += static_cast<double>(value);
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+
+    void record_seconds(double seconds) {
+        record(static_cast<uint64_t>(std::max(0.0, seconds) * 1e9 + 0.5));
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < kNumBuckets; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    void reset() {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        count_ = 0;
+        sum_ = 0.0;
+        min_ = std::numeric_limits<uint64_t>::max();
+        max_ = 0;
+    }
+
+    // Value at percentile p in [0, 100]: the midpoint of the bucket holding
+    // that rank, clamped to the exact min and max
+    uint64_t percentile(double p) const {
+        if (count_ == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * count_));
+        rank = std::max<uint64_t>(1, std::min(rank, count_));
+        if (rank == count_) return max_;
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kNumBuckets; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                uint64_t mid = bucket_lower(i) + (bucket_width(i) - 1) / 2;
+                return std::max(min_, std::min(max_, mid));
+            }
+        }
+        return max_;
+    }
+
+    uint64_t count() const { return count_; }
+    double sum() const { return sum_; }
+    double mean() const { return count_ > 0 ? sum_ / count_ : 0.0; }
+    uint64_t min() const { return count_ > 0 ? min_ : 0; }
+    uint64_t max() const { return max_; }
+
+    // Recorded values known to be <= value: buckets that lie entirely at
+    // or below it. Cumulative "le" buckets for Prometheus; a bucket that
+    // straddles the bound counts toward the next one.
+    uint64_t count_at_or_below(uint64_t value) const {
+        uint64_t total = 0;
+        for (size_t i = 0; i < kNumBuckets; ++i) {
+            if (bucket_lower(i) + (bucket_width(i) - 1) > value) break;
+            total += counts_[i];
+        }
+        return total;
+    }
+
+    // Raw buckets, for exporters (e.g. Prometheus cumulative buckets)
+    const std::vector<uint64_t>& counts() const { return counts_; }
+
+    static size_t bucket_index(uint64_t value) {
+        if (value < kSubBuckets) return static_cast<size_t>(value);
+        int exponent = 63 - __builtin_clzll(value);
+        int shift = exponent - kSubBucketBits;
+        uint64_t top = value >> shift;  // In [kSubBuckets, 2 * kSubBuckets)
+        return static_cast<size_t>((shift + 1) * kSubBuckets + (top - kSubBuckets));
+    }
+
+    static uint64_t bucket_lower(size_t index) {
+        if (index < kSubBuckets) return index;
+        uint64_t group = index / kSubBuckets;
+        uint64_t top = index % kSubBuckets + kSubBuckets;
+        return top << (group - 1);
+    }
+
+    static uint64_t bucket_width(size_t index) {
+        return index < kSubBuckets ? 1 : 1ull << (index / kSubBuckets - 1);
+    }
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    double sum_ = 0.0;
+    uint64_t min_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ = 0;
+};
+
+#endif // HISTOGRAM_HPP
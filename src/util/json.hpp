@@ -0,0 +1,34 @@
+#ifndef JSON_HPP
+#define JSON_HPP
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal JSON document tree. Objects keep their members in source order,
+// which schema-driven generation relies on. Numbers are kept as doubles.
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+
+    bool is_object() const { return type == Type::Object; }
+    bool is_array() const { return type == Type::Array; }
+    bool is_string() const { return type == Type::String; }
+
+    // Object member, or nullptr when absent or this is not an object
+    const JsonValue* find(const std::string& key) const;
+};
+
+// Throws std::runtime_error on malformed input
+JsonValue parse_json(const std::string& text);
+
+// Quoted, escaped JSON string literal
+std::string json_quote(const std::string& text);
+
+#endif // JSON_HPP
@@ -0,0 +1,31 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Whole file mapped private and writable: pages are read on first touch,
+// and writes go to private copies, never back to the file. Hold it in a
+// shared_ptr and capture that in whatever views into it, so the mapping
+// lives as long as any of them.
+class MappedFile {
+public:
+    // Throws std::runtime_error if the file cannot be opened or mapped
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+#endif // MAPPED_FILE_HPP
@@ -0,0 +1,122 @@
+#include "perf_counters.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::atomic<bool> g_unavailable{false};
+std::mutex g_reason_mutex;
+std::string g_reason;
+
+void mark_unavailable(const std::string& reason) {
+    std::lock_guard<std::mutex> lock(g_reason_mutex);
+    if (!g_unavailable.exchange(true)) {
+        g_reason = reason;
+    }
+}
+
+#ifdef __linux__
+
+int open_counter(uint32_t type, uint64_t config, int group_fd) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd == -1;  // Leader starts disabled, enabled once the group is built
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+class CounterGroup {
+public:
+    CounterGroup() {
+        leader_ = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+        if (leader_ < 0) {
+            mark_unavailable(std::string("perf_event_open: ") + std::strerror(errno));
+            return;
+        }
+        instructions_ = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, leader_);
+        llc_misses_ = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, leader_);
+        if (instructions_ < 0 || llc_misses_ < 0) {
+            mark_unavailable(std::string("perf_event_open: ") + std::strerror(errno));
+            close_all();
+            return;
+        }
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    ~CounterGroup() { close_all(); }
+
+    bool read(CounterValues& values) {
+        if (leader_ < 0) return false;
+
+        // nr, time_enabled, time_running, then one value per counter
+        uint64_t buffer[3 + 3];
+        if (::read(leader_, buffer, sizeof(buffer)) != static_cast<ssize_t>(sizeof(buffer))) {
+            return false;
+        }
+        uint64_t enabled = buffer[1];
+        uint64_t running = buffer[2];
+        // The PMU was shared with other groups; extrapolate to the full window
+        double scale = running > 0 && running < enabled
+                           ? static_cast<double>(enabled) / running : 1.0;
+        values.cycles = static_cast<uint64_t>(buffer[3] * scale);
+        values.instructions = static_cast<uint64_t>(buffer[4] * scale);
+        values.llc_misses = static_cast<uint64_t>(buffer[5] * scale);
+        return true;
+    }
+
+private:
+    void close_all() {
+        for (int* fd : {&llc_misses_, &instructions_, &leader_}) {
+            if (*fd >= 0) close(*fd);
+            *fd = -1;
+        }
+    }
+
+    int leader_ = -1;
+    int instructions_ = -1;
+    int llc_misses_ = -1;
+};
+
+#endif
+
+} // namespace
+
+bool PerfCounters::read(CounterValues& values) {
+#ifdef __linux__
+    if (g_unavailable.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    thread_local CounterGroup group;
+    return group.read(values);
+#else
+    (void)values;
+    mark_unavailable("hardware counters need Linux perf_event_open");
+    return false;
+#endif
+}
+
+bool PerfCounters::available() {
+    CounterValues values;
+    return read(values);
+}
+
+std::string PerfCounters::unavailable_reason() {
+    std::lock_guard<std::mutex> lock(g_reason_mutex);
+    return g_reason;
+}
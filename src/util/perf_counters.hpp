@@ -0,0 +1,29 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <cstdint>
+#include <string>
+
+// Hardware counter readings, scaled for multiplexing
+struct CounterValues {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t llc_misses = 0;  // Last-level cache misses, i.e. lines fetched from DRAM
+};
+
+// Per-thread perf_event_open group (cycles leader, instructions, LLC
+// misses) counting user-space work of the calling thread. Linux only; the
+// group is opened on a thread's first read(). Without a PMU or permission
+// (perf_event_paranoid, containers) read() just returns false and
+// unavailable_reason() says why.
+class PerfCounters {
+public:
+    // Current totals for the calling thread
+    static bool read(CounterValues& values);
+
+    // Try to open a group on the calling thread
+    static bool available();
+    static std::string unavailable_reason();
+};
+
+#endif // PERF_COUNTERS_HPP
@@ -1,66 +1,482 @@
 #include "profiler.hpp"
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
-#include <mutex>
+#include <map>
+#include <set>
+#include <thread>
+
+namespace {
+
+// Raw events kept for trace export, whatever history_seconds allows
+constexpr size_t kMaxHistoryEvents = 1 << 20;
+
+void write_json_string(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) >= 0x20) {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+} // namespace
 
 Profiler& Profiler::instance() {
     static Profiler instance;
     return instance;
 }
 
-void Profiler::start(const std::string& name) {
+Profiler::Profiler() : anchor_time_(std::chrono::steady_clock::now()), anchor_ticks_(now()) {}
+
+Profiler::~Profiler() {
+    stop_collector();
+}
+
+Profiler::ThreadHandle::~ThreadHandle() {
+    if (buffer) {
+        buffer->retired.store(true, std::memory_order_release);
+    }
+}
+
+Profiler::ThreadBuffer& Profiler::thread_buffer() {
+    thread_local ThreadHandle handle;
+    if (!handle.buffer) {
+        // Once per thread
+        std::lock_guard<std::mutex> lock(mutex_);
+        handle.buffer = std::make_shared<ThreadBuffer>(next_thread_id_++);
+        buffers_.push_back(handle.buffer);
+    }
+    return *handle.buffer;
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end) {
+    ThreadBuffer& buffer = thread_buffer();
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    ThreadBuffer::Slot& slot = buffer.slots[head & (kBufferCapacity - 1)];
+    // Pairs with the fence in drain(): a collector that sees this slot's
+    // new contents also sees the head that makes it an overwrite
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.request_id.store(current_request_id_, std::memory_order_relaxed);
+
+    // Once this thread has counted anything, every slot gets counters so a
+    // reused slot never shows a stale count
+    ThreadBuffer::CounterSlot* counters = buffer.counters.load(std::memory_order_relaxed);
+    if (counters) {
+        ThreadBuffer::CounterSlot& c = counters[head & (kBufferCapacity - 1)];
+        c.cycles.store(0, std::memory_order_relaxed);
+        c.instructions.store(0, std::memory_order_relaxed);
+        c.llc_misses.store(0, std::memory_order_relaxed);
+        c.flops.store(0, std::memory_order_relaxed);
+        c.bytes.store(0, std::memory_order_relaxed);
+    }
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end,
+                      const EventCounters& counters) {
+    ThreadBuffer& buffer = thread_buffer();
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    ThreadBuffer::CounterSlot* slots = buffer.counters.load(std::memory_order_relaxed);
+    if (!slots) {
+        // First counted event on this thread; later ones don't allocate
+        buffer.counter_storage.reset(new ThreadBuffer::CounterSlot[kBufferCapacity]);
+        slots = buffer.counter_storage.get();
+        buffer.counters.store(slots, std::memory_order_release);
+    }
+
+    ThreadBuffer::Slot& slot = buffer.slots[head & (kBufferCapacity - 1)];
+    ThreadBuffer::CounterSlot& c = slots[head & (kBufferCapacity - 1)];
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.request_id.store(current_request_id_, std::memory_order_relaxed);
+    c.cycles.store(counters.cycles, std::memory_order_relaxed);
+    c.instructions.store(counters.instructions, std::memory_order_relaxed);
+    c.llc_misses.store(counters.llc_misses, std::memory_order_relaxed);
+    c.flops.store(counters.flops, std::memory_order_relaxed);
+    c.bytes.store(counters.bytes, std::memory_order_relaxed);
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+bool Profiler::enable_hardware_counters(bool enable) {
+    if (enable && !PerfCounters::available()) {
+        std::cerr << "Hardware counters unavailable: " << PerfCounters::unavailable_reason()
+                  << std::endl;
+        enable = false;
+    }
+    hardware_counters_enabled_.store(enable, std::memory_order_relaxed);
+    return enable;
+}
+
+void Profiler::drain(ThreadBuffer& buffer, std::vector<ProfileEvent>& events,
+                     std::vector<EventCounters>& counters) {
+    uint64_t head = buffer.head.load(std::memory_order_acquire);
+    if (head - buffer.read > kBufferCapacity) {
+        dropped_events_ += head - kBufferCapacity - buffer.read;
+        buffer.read = head - kBufferCapacity;
+    }
+
+    const ThreadBuffer::CounterSlot* counter_slots =
+        buffer.counters.load(std::memory_order_acquire);
+    size_t first = events.size();
+    for (uint64_t i = buffer.read; i < head; ++i) {
+        const ThreadBuffer::Slot& slot = buffer.slots[i & (kBufferCapacity - 1)];
+        events.push_back({slot.name.load(std::memory_order_relaxed),
+                          slot.start.load(std::memory_order_relaxed),
+                          slot.end.load(std::memory_order_relaxed),
+                          buffer.thread_id,
+                          slot.request_id.load(std::memory_order_relaxed)});
+
+        EventCounters c;
+        if (counter_slots) {
+            const ThreadBuffer::CounterSlot& cs = counter_slots[i & (kBufferCapacity - 1)];
+            c.cycles = cs.cycles.load(std::memory_order_relaxed);
+            c.instructions = cs.instructions.load(std::memory_order_relaxed);
+            c.llc_misses = cs.llc_misses.load(std::memory_order_relaxed);
+            c.flops = cs.flops.load(std::memory_order_relaxed);
+            c.bytes = cs.bytes.load(std::memory_order_relaxed);
+        }
+        counters.push_back(c);
+    }
+
+    // The writer may have lapped us while copying; those slots are suspect
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t new_head = buffer.head.load(std::memory_order_relaxed);
+    if (new_head - buffer.read > kBufferCapacity) {
+        uint64_t overwritten = std::min<uint64_t>(new_head - kBufferCapacity - buffer.read,
+                                                  head - buffer.read);
+        events.erase(events.begin() + first, events.begin() + first + overwritten);
+        counters.erase(counters.begin() + first, counters.begin() + first + overwritten);
+        dropped_events_ += overwritten;
+    }
+    buffer.read = head;
+}
+
+void Profiler::collect() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<ProfileEvent> events;
+    std::vector<EventCounters> counters;
+    for (auto& buffer : buffers_) {
+        drain(*buffer, events, counters);
+    }
+
+    // Exited threads cannot record again; their drained buffers can go, and
+    // their names once history no longer holds their events
+    uint64_t retired_at = now();
+    buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(),
+                                  [&](const std::shared_ptr<ThreadBuffer>& b) {
+                                      bool done = b->retired.load(std::memory_order_acquire) &&
+                                                  b->read == b->head.load(std::memory_order_acquire);
+                                      if (done && thread_names_.count(b->thread_id)) {
+                                          retired_names_.emplace_back(retired_at, b->thread_id);
+                                      }
+                                      return done;
+                                  }),
+                   buffers_.end());
+
+    double seconds_per_tick = 1.0 / calibrate();
+    for (size_t i = 0; i < events.size(); ++i) {
+        const ProfileEvent& event = events[i];
+        const EventCounters& c = counters[i];
+        Timing& timing = timings_[event.name];
+        double duration = (event.end - event.start) * seconds_per_tick;
+        timing.total_time += duration;
+        timing.count++;
+        timing.histogram.record_seconds(duration);
+
+        timing.flops += c.flops;
+        timing.bytes += c.bytes;
+        if (c.cycles > 0) {
+            timing.cycles += c.cycles;
+            timing.instructions += c.instructions;
+            timing.llc_misses += c.llc_misses;
+            timing.counted_time += duration;
+        }
+    }
+
+    history_.insert(history_.end(), events.begin(), events.end());
+    prune_history();
+}
+
+void Profiler::prune_history() {
+    if (history_.empty() && retired_names_.empty()) {
+        return;
+    }
+    // Each thread's events arrive in end order, so the front is only
+    // roughly the oldest; export filters exactly
+    uint64_t horizon = static_cast<uint64_t>(history_seconds_ * calibrate());
+    uint64_t latest = now();
+    uint64_t cutoff = latest > horizon ? latest - horizon : 0;
+    while (!retired_names_.empty() && retired_names_.front().first < cutoff) {
+        thread_names_.erase(retired_names_.front().second);
+        retired_names_.pop_front();
+    }
+    while (!history_.empty() &&
+           (history_.front().end < cutoff || history_.size() > kMaxHistoryEvents)) {
+        history_.pop_front();
+    }
+}
+
+void Profiler::set_history_seconds(double seconds) {
     std::lock_guard<std::mutex> lock(mutex_);
-    start_times_[name] = std::chrono::high_resolution_clock::now();
+    history_seconds_ = seconds;
+    prune_history();
 }
 
-void Profiler::stop(const std::string& name) {
-    auto end_time = std::chrono::high_resolution_clock::now();
+void Profiler::set_thread_name(const std::string& name) {
+    ThreadBuffer& buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread_names_[buffer.thread_id] = name;
+}
 
+size_t Profiler::named_threads() {
+    collect();
     std::lock_guard<std::mutex> lock(mutex_);
+    return thread_names_.size();
+}
+
+void Profiler::start_collector(double interval_seconds) {
+    std::lock_guard<std::mutex> lock(collector_mutex_);
+    if (collector_running_) {
+        return;
+    }
+    collector_running_ = true;
+    auto interval = std::chrono::duration<double>(interval_seconds);
+    collector_ = std::thread([this, interval]() {
+        set_thread_name("profiler collector");
+        std::unique_lock<std::mutex> lock(collector_mutex_);
+        while (!collector_cv_.wait_for(lock, interval, [this]() { return !collector_running_; })) {
+            lock.unlock();
+            collect();
+            lock.lock();
+        }
+    });
+}
 
-    auto it = start_times_.find(name);
-    if (it != start_times_.end()) {
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
-            end_time - it->second
-        ).count() / 1e6; // Convert to seconds
+void Profiler::stop_collector() {
+    {
+        std::lock_guard<std::mutex> lock(collector_mutex_);
+        if (!collector_running_) {
+            return;
+        }
+        collector_running_ = false;
+    }
+    collector_cv_.notify_all();
+    collector_.join();
+}
 
-        timings_[name].total_time += duration;
-        timings_[name].count++;
-        start_times_.erase(it);
+void Profiler::write_chrome_trace(std::ostream& out, double last_seconds) {
+    collect();
+
+    std::vector<ProfileEvent> events;
+    std::unordered_map<int, std::string> thread_names;
+    double ticks_per_us;
+    uint64_t origin;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ticks_per_us = calibrate() / 1e6;
+        uint64_t latest = now();
+        uint64_t window = static_cast<uint64_t>(last_seconds * ticks_per_us * 1e6);
+        uint64_t cutoff = last_seconds > 0.0 && latest > window ? latest - window : 0;
+        for (const ProfileEvent& event : history_) {
+            if (event.end >= cutoff) events.push_back(event);
+        }
+        thread_names = thread_names_;
+        origin = anchor_ticks_;
+    }
+
+    // Parents before children at equal start, as trace viewers expect
+    std::sort(events.begin(), events.end(), [](const ProfileEvent& a, const ProfileEvent& b) {
+        return a.start != b.start ? a.start < b.start : a.end > b.end;
+    });
+
+    auto timestamp = [&](uint64_t ticks) {
+        return static_cast<double>(static_cast<int64_t>(ticks - origin)) / ticks_per_us;
+    };
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    auto separator = [&]() -> std::ostream& {
+        out << (first ? "  " : ",\n  ");
+        first = false;
+        return out;
+    };
+
+    std::set<int> threads;
+    for (const ProfileEvent& event : events) threads.insert(event.thread_id);
+    for (int thread_id : threads) {
+        auto name = thread_names.find(thread_id);
+        separator() << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": "
+                    << thread_id << ", \"args\": {\"name\": ";
+        write_json_string(out, name != thread_names.end() ? name->second
+                                                          : "thread " + std::to_string(thread_id));
+        out << "}}";
+    }
+
+    for (const ProfileEvent& event : events) {
+        separator() << "{\"ph\": \"X\", \"name\": ";
+        write_json_string(out, event.name);
+        out << ", \"pid\": 1, \"tid\": " << event.thread_id
+            << ", \"ts\": " << timestamp(event.start)
+            << ", \"dur\": " << (event.end - event.start) / ticks_per_us;
+        if (event.request_id != 0) {
+            out << ", \"args\": {\"request\": " << event.request_id << "}";
+        }
+        out << "}";
+    }
+
+    // One flow per request through its outermost slices on each thread
+    std::map<uint64_t, std::vector<const ProfileEvent*>> flows;
+    std::unordered_map<int, std::unordered_map<uint64_t, uint64_t>> covered_until;
+    for (const ProfileEvent& event : events) {
+        if (event.request_id == 0) continue;
+        uint64_t& until = covered_until[event.thread_id][event.request_id];
+        if (event.start >= until) {
+            flows[event.request_id].push_back(&event);
+            until = event.end;
+        }
+    }
+    for (const auto& [request_id, slices] : flows) {
+        if (slices.size() < 2) continue;
+        for (size_t i = 0; i < slices.size(); ++i) {
+            const char* phase = i == 0 ? "s" : (i + 1 == slices.size() ? "f" : "t");
+            separator() << "{\"ph\": \"" << phase << "\", \"name\": \"request\", "
+                        << "\"cat\": \"request\", \"id\": " << request_id
+                        << ", \"pid\": 1, \"tid\": " << slices[i]->thread_id
+                        << ", \"ts\": " << timestamp(slices[i]->start)
+                        << (phase[0] == 'f' ? ", \"bp\": \"e\"" : "") << "}";
+        }
     }
+    out << "\n]}\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+std::unordered_map<std::string, Profiler::Timing> Profiler::get_timings() {
+    collect();
+    std::lock_guard<std::mutex> lock(mutex_);
+    return timings_;
+}
+
+std::unordered_map<std::string, Profiler::Timing> Profiler::take_timings() {
+    collect();
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<std::string, Timing> timings;
+    timings.swap(timings_);
+    return timings;
 }
 
 void Profiler::reset() {
     std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& buffer : buffers_) {
+        buffer->read = buffer->head.load(std::memory_order_acquire);
+    }
     timings_.clear();
-    start_times_.clear();
+    history_.clear();
+    dropped_events_ = 0;
 }
 
-void Profiler::print_summary() const {
+double Profiler::ticks_per_second() {
     std::lock_guard<std::mutex> lock(mutex_);
+    return calibrate();
+}
+
+double Profiler::calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+    // Calibrate the (invariant) TSC against steady_clock over the longest
+    // span seen so far, waiting briefly the first time if it is too short
+    auto elapsed = std::chrono::steady_clock::now() - anchor_time_;
+    if (ticks_per_second_ == 0.0 && elapsed < std::chrono::milliseconds(10)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10) - elapsed);
+    }
+    uint64_t ticks = now();
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - anchor_time_).count();
+    if (seconds >= 0.01) {
+        ticks_per_second_ = (ticks - anchor_ticks_) / seconds;
+    }
+    return ticks_per_second_;
+#else
+    return 1e9;
+#endif
+}
+
+void Profiler::print_summary() {
+    auto timings = get_timings();
+
+    std::vector<std::pair<std::string, Timing>> sorted(timings.begin(), timings.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const auto& a, const auto& b) { return a.second.total_time > b.second.total_time; });
 
     std::cout << "\n=== Profiling Summary ===\n";
     std::cout << std::setw(30) << std::left << "Operation"
               << std::setw(12) << "Count"
               << std::setw(12) << "Total(s)"
               << std::setw(12) << "Avg(s)"
+              << std::setw(12) << "p50(us)"
+              << std::setw(12) << "p90(us)"
+              << std::setw(12) << "p99(us)"
+              << std::setw(12) << "p999(us)"
               << std::endl;
-    std::cout << std::string(66, '-') << std::endl;
+    std::cout << std::string(114, '-') << std::endl;
 
-    for (const auto& [name, timing] : timings_) {
+    for (const auto& [name, timing] : sorted) {
         std::cout << std::setw(30) << std::left << name
                   << std::setw(12) << timing.count
                   << std::setw(12) << std::fixed << std::setprecision(6) << timing.total_time
                   << std::setw(12) << std::fixed << std::setprecision(6) << timing.avg_time()
+                  << std::setprecision(1);
+        for (double p : {50.0, 90.0, 99.0, 99.9}) {
+            std::cout << std::setw(12) << timing.percentile(p) * 1e6;
+        }
+        std::cout << std::endl;
+    }
+
+    // Why it is slow: IPC says compute- vs stall-bound, DRAM GB/s against
+    // the machine's bandwidth says memory-bound
+    bool any_work = std::any_of(sorted.begin(), sorted.end(), [](const auto& entry) {
+        return entry.second.cycles > 0 || entry.second.flops > 0 || entry.second.bytes > 0;
+    });
+    if (any_work) {
+        std::cout << "\n" << std::setw(30) << std::left << "Operation"
+                  << std::setw(12) << "IPC"
+                  << std::setw(12) << "LLC miss"
+                  << std::setw(12) << "DRAM GB/s"
+                  << std::setw(12) << "GB/s"
+                  << std::setw(12) << "GFLOP/s"
+                  << std::endl;
+        std::cout << std::string(90, '-') << std::endl;
+        for (const auto& [name, timing] : sorted) {
+            if (timing.cycles == 0 && timing.flops == 0 && timing.bytes == 0) continue;
+            std::cout << std::setw(30) << std::left << name << std::setprecision(2)
+                      << std::setw(12) << timing.ipc()
+                      << std::setw(12) << timing.llc_misses
+                      << std::setw(12) << timing.dram_gbps()
+                      << std::setw(12) << timing.gbps()
+                      << std::setw(12) << timing.gflops()
+                      << std::endl;
+        }
+    }
+    if (hardware_counters_enabled()) {
+        std::cout << "(hardware counters on)" << std::endl;
+    } else if (!PerfCounters::unavailable_reason().empty()) {
+        std::cout << "Hardware counters unavailable: " << PerfCounters::unavailable_reason()
                   << std::endl;
     }
+    if (dropped_events_ > 0) {
+        std::cout << dropped_events_ << " events dropped; collect() more often" << std::endl;
+    }
     std::cout << std::endl;
 }
-
-ScopedTimer::ScopedTimer(const std::string& name) : name_(name) {
-    Profiler::instance().start(name_);
-}
-
-ScopedTimer::~ScopedTimer() {
-    Profiler::instance().stop(name_);
-}
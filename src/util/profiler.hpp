@@ -1,48 +1,307 @@
 #ifndef PROFILER_HPP
 #define PROFILER_HPP
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "histogram.hpp"
+#include "perf_counters.hpp"
+
+// One timed region. name must have static storage duration (a string
+// literal or __FUNCTION__): only the pointer is stored.
+struct ProfileEvent {
+    const char* name;
+    uint64_t start;  // Profiler::now() ticks
+    uint64_t end;
+    int thread_id;   // Sequential id of the recording thread
+    uint64_t request_id;  // ProfileRequestScope active when recorded, 0 if none
+};
+
+// Work done inside one timed region. Hardware counts are deltas and stay
+// zero when counters are off or unavailable; flops and bytes are what the
+// code declared via PROFILE_SCOPE_WORK.
+struct EventCounters {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t llc_misses = 0;
+    uint64_t flops = 0;
+    uint64_t bytes = 0;
+};
+
+// Low-overhead scope profiler. Each thread appends events to its own
+// fixed-size ring buffer without locks or allocation; collect() later
+// merges every thread's new events into per-name timings. A thread that
+// records faster than events are collected overwrites its oldest ones,
+// which are counted in dropped_events().
 class Profiler {
 public:
     static Profiler& instance();
 
-    void start(const std::string& name);
-    void stop(const std::string& name);
+    // Timestamp in ticks: the TSC on x86, steady_clock nanoseconds elsewhere
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    // Append an event to the calling thread's buffer. Lock-free.
+    void record(const char* name, uint64_t start, uint64_t end);
+    void record(const char* name, uint64_t start, uint64_t end, const EventCounters& counters);
+
+    // Read cycles/instructions/LLC misses around every ScopedTimer via
+    // perf_event_open. Returns false, leaving counters off, when the
+    // system doesn't allow it; see PerfCounters::unavailable_reason().
+    bool enable_hardware_counters(bool enable);
+    static bool hardware_counters_enabled() {
+        return hardware_counters_enabled_.load(std::memory_order_relaxed);
+    }
+
+    // Label the calling thread's track in exported traces. An exited
+    // thread's name is kept until its events leave the history.
+    void set_thread_name(const std::string& name);
+    size_t named_threads();
+
+    // Request whose work the calling thread is doing; see ProfileRequestScope
+    static uint64_t current_request_id() { return current_request_id_; }
 
     struct Timing {
         double total_time = 0.0;
         int count = 0;
+        LatencyHistogram histogram;  // Per-event durations, nanoseconds
+
+        // Summed EventCounters; counted_time covers the events that had
+        // hardware counts
+        uint64_t cycles = 0;
+        uint64_t instructions = 0;
+        uint64_t llc_misses = 0;
+        uint64_t flops = 0;
+        uint64_t bytes = 0;
+        double counted_time = 0.0;
+
         double avg_time() const { return count > 0 ? total_time / count : 0.0; }
+        double ipc() const { return cycles > 0 ? static_cast<double>(instructions) / cycles : 0.0; }
+        double gflops() const { return total_time > 0 ? flops / total_time * 1e-9 : 0.0; }
+
+        // Declared bytes moved, and DRAM traffic estimated as one cache line per LLC miss
+        double gbps() const { return total_time > 0 ? bytes / total_time * 1e-9 : 0.0; }
+        double dram_gbps() const {
+            return counted_time > 0 ? llc_misses * 64.0 / counted_time * 1e-9 : 0.0;
+        }
+
+        // Seconds at percentile p in [0, 100]
+        double percentile(double p) const { return histogram.percentile(p) * 1e-9; }
+
+        void merge(const Timing& other) {
+            total_time += other.total_time;
+            count += other.count;
+            histogram.merge(other.histogram);
+            cycles += other.cycles;
+            instructions += other.instructions;
+            llc_misses += other.llc_misses;
+            flops += other.flops;
+            bytes += other.bytes;
+            counted_time += other.counted_time;
+        }
     };
 
-    const std::unordered_map<std::string, Timing>& get_timings() const {
-        return timings_;
-    }
+    // Merge events recorded since the last call into the timings
+    void collect();
+
+    // Collects, then returns a snapshot
+    std::unordered_map<std::string, Timing> get_timings();
 
+    // Collects, returns the timings and starts a new interval; for reporting
+    // windowed percentiles instead of ones accumulated since startup
+    std::unordered_map<std::string, Timing> take_timings();
+
+    // Drop all timings and any events not yet collected
     void reset();
 
-    void print_summary() const;
+    void print_summary();
+
+    // Chrome/Perfetto trace-event JSON of the retained events: one track per
+    // thread, and a flow arrow per request joining its slices in time order.
+    // last_seconds > 0 keeps only events that ended within that window.
+    void write_chrome_trace(std::ostream& out, double last_seconds = 0.0);
+
+    // How far back collect() keeps raw events for write_chrome_trace
+    void set_history_seconds(double seconds);
+
+    // Collect on a background thread every interval, so per-thread rings
+    // don't overflow between exports. Idempotent.
+    void start_collector(double interval_seconds = 0.5);
+    void stop_collector();
+
+    double ticks_per_second();
+    uint64_t dropped_events() const { return dropped_events_; }
+
+    // Events each thread can hold between collections
+    static constexpr size_t kBufferCapacity = 1 << 14;
 
 private:
-    Profiler() = default;
-    std::unordered_map<std::string, std::chrono::high_resolution_clock::time_point> start_times_;
+    // Single-writer ring. Slots are relaxed atomics so the collector can
+    // read concurrently; it detects slots overwritten mid-read via head.
+    struct ThreadBuffer {
+        struct Slot {
+            std::atomic<const char*> name{nullptr};
+            std::atomic<uint64_t> start{0};
+            std::atomic<uint64_t> end{0};
+            std::atomic<uint64_t> request_id{0};
+        };
+
+        struct CounterSlot {
+            std::atomic<uint64_t> cycles{0};
+            std::atomic<uint64_t> instructions{0};
+            std::atomic<uint64_t> llc_misses{0};
+            std::atomic<uint64_t> flops{0};
+            std::atomic<uint64_t> bytes{0};
+        };
+
+        explicit ThreadBuffer(int id) : thread_id(id), slots(kBufferCapacity) {}
+
+        int thread_id;
+        std::vector<Slot> slots;
+        // Parallel to slots, allocated by the writer on its first counted event
+        std::unique_ptr<CounterSlot[]> counter_storage;
+        std::atomic<CounterSlot*> counters{nullptr};
+        std::atomic<uint64_t> head{0};      // Written only by the owning thread
+        std::atomic<bool> retired{false};   // Owning thread has exited
+        uint64_t read = 0;                  // Collector cursor, under mutex_
+    };
+
+    // Ends the buffer's life with its thread
+    struct ThreadHandle {
+        std::shared_ptr<ThreadBuffer> buffer;
+        ~ThreadHandle();
+    };
+
+    Profiler();
+    ~Profiler();
+    ThreadBuffer& thread_buffer();
+    void drain(ThreadBuffer& buffer, std::vector<ProfileEvent>& events,
+               std::vector<EventCounters>& counters);
+    double calibrate();
+    void prune_history();
+
+    std::mutex mutex_;  // Guards everything below; never taken by record()
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
     std::unordered_map<std::string, Timing> timings_;
-    mutable std::mutex mutex_;
+    std::deque<ProfileEvent> history_;  // Time-ordered per thread, for traces
+    std::unordered_map<int, std::string> thread_names_;
+    // (tick, thread ID) of named threads whose buffers are gone, oldest
+    // first; the name is dropped once history has aged past the tick
+    std::deque<std::pair<uint64_t, int>> retired_names_;
+    double history_seconds_ = 30.0;
+    int next_thread_id_ = 0;
+    std::atomic<uint64_t> dropped_events_{0};
+
+    // Pairs of (steady_clock, ticks) used to convert ticks to seconds
+    std::chrono::steady_clock::time_point anchor_time_;
+    uint64_t anchor_ticks_;
+    double ticks_per_second_ = 0.0;
+
+    std::thread collector_;
+    std::mutex collector_mutex_;
+    std::condition_variable collector_cv_;
+    bool collector_running_ = false;
+
+    static inline thread_local uint64_t current_request_id_ = 0;
+    static inline std::atomic<bool> hardware_counters_enabled_{false};
+    friend class ProfileRequestScope;
+};
+
+// Tags every event the calling thread records while in scope with a
+// request id, so traces can follow one request through the engine
+class ProfileRequestScope {
+public:
+    explicit ProfileRequestScope(uint64_t request_id) : previous_(Profiler::current_request_id_) {
+        Profiler::current_request_id_ = request_id;
+    }
+    ~ProfileRequestScope() { Profiler::current_request_id_ = previous_; }
+
+    ProfileRequestScope(const ProfileRequestScope&) = delete;
+    ProfileRequestScope& operator=(const ProfileRequestScope&) = delete;
+
+private:
+    uint64_t previous_;
 };
 
+// Times its enclosing scope. Construction and destruction only read the
+// clock (plus the counter group when hardware counters are on); the event
+// is written to the thread's buffer on destruction. flops and bytes declare
+// the work done, for GFLOP/s and GB/s in the summary.
 class ScopedTimer {
 public:
-    explicit ScopedTimer(const std::string& name);
-    ~ScopedTimer();
+    explicit ScopedTimer(const char* name, uint64_t flops = 0, uint64_t bytes = 0)
+        : name_(name), flops_(flops), bytes_(bytes) {
+        counting_ = Profiler::hardware_counters_enabled() && PerfCounters::read(start_counters_);
+        start_ = Profiler::now();
+    }
+
+    ~ScopedTimer() {
+        uint64_t end = Profiler::now();
+        if (!counting_ && flops_ == 0 && bytes_ == 0) {
+            Profiler::instance().record(name_, start_, end);
+            return;
+        }
+
+        EventCounters counters;
+        counters.flops = flops_;
+        counters.bytes = bytes_;
+        CounterValues end_counters;
+        if (counting_ && PerfCounters::read(end_counters)) {
+            counters.cycles = end_counters.cycles - start_counters_.cycles;
+            counters.instructions = end_counters.instructions - start_counters_.instructions;
+            counters.llc_misses = end_counters.llc_misses - start_counters_.llc_misses;
+        }
+        Profiler::instance().record(name_, start_, end, counters);
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
 
 private:
-    std::string name_;
+    const char* name_;
+    uint64_t flops_;
+    uint64_t bytes_;
+    bool counting_;
+    CounterValues start_counters_;
+    uint64_t start_;
 };
 
-#define PROFILE_SCOPE(name) ScopedTimer timer_##__LINE__(name)
+// Building without ENABLE_PROFILING compiles every PROFILE_* macro away
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef ENABLE_PROFILING
+#define PROFILE_SCOPE(name) ScopedTimer PROFILE_CONCAT(profile_timer_, __COUNTER__)(name)
 #define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_SCOPE_WORK(name, flops, bytes) \
+    ScopedTimer PROFILE_CONCAT(profile_timer_, __COUNTER__)(name, flops, bytes)
+#define PROFILE_REQUEST(id) ProfileRequestScope PROFILE_CONCAT(profile_request_, __COUNTER__)(id)
+#define PROFILE_THREAD_NAME(name) Profiler::instance().set_thread_name(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_SCOPE_WORK(name, flops, bytes) ((void)0)
+#define PROFILE_REQUEST(id) ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+#endif
 
 #endif // PROFILER_HPP
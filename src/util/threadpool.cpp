@@ -1,4 +1,5 @@
 #include "threadpool.hpp"
+#include "profiler.hpp"
 #include <stdexcept>
 
 ThreadPool::ThreadPool(size_t num_threads) : stop_(false) {
@@ -25,36 +26,14 @@ ThreadPool::~ThreadPool() {
     }
 }
 
-template<typename F, typename... Args>
-auto ThreadPool::submit(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
-    using return_type = decltype(f(args...));
-
-    auto task = std::make_shared<std::packaged_task<return_type()>>(
-        std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-    );
-
-    std::future<return_type> result = task->get_future();
-
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
-
-        if (stop_) {
-            throw std::runtime_error("Cannot submit task to stopped ThreadPool");
-        }
-
-        tasks_.emplace([task]() { (*task)(); });
-    }
-
-    condition_.notify_one();
-    return result;
-}
-
 void ThreadPool::wait() {
     std::unique_lock<std::mutex> lock(queue_mutex_);
     condition_.wait(lock, [this]() { return tasks_.empty(); });
 }
 
 void ThreadPool::worker_loop() {
+    PROFILE_THREAD_NAME("pool worker");
+
     while (true) {
         std::function<void()> task;
 
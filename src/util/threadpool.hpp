@@ -9,6 +9,8 @@
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <memory>
+#include <stdexcept>
 
 class ThreadPool {
 public:
@@ -41,4 +43,29 @@ private:
     std::atomic<bool> stop_;
 };
 
+// Defined in the header so callers in other translation units can instantiate it
+template<typename F, typename... Args>
+auto ThreadPool::submit(F&& f, Args&&... args) -> std::future<decltype(f(args...))> {
+    using return_type = decltype(f(args...));
+
+    auto task = std::make_shared<std::packaged_task<return_type()>>(
+        std::bind(std::forward<F>(f), std::forward<Args>(args)...)
+    );
+
+    std::future<return_type> result = task->get_future();
+
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+
+        if (stop_) {
+            throw std::runtime_error("Cannot submit task to stopped ThreadPool");
+        }
+
+        tasks_.emplace([task]() { (*task)(); });
+    }
+
+    condition_.notify_one();
+    return result;
+}
+
 #endif // THREADPOOL_HPP
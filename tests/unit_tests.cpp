@@ -1,12 +1,44 @@
 #include "../src/tensor.hpp"
+#include "../src/batch_processor.hpp"
+#include "../src/http_server.hpp"
 #include "../src/alloc.hpp"
+#include "../src/memory_planner.hpp"
 #include "../src/kernels/q4_rowwise.hpp"
 #include "../src/kernels/gemm_ref.hpp"
+#include "../src/kernels/autotune.hpp"
+#include "../src/kernels/optimized/specialized_kernels.hpp"
+#include "../src/kernels/half.hpp"
+#include "../src/kernels/rope.hpp"
+#include "../src/loaders/gguf_loader.hpp"
+#include "../src/tokenizer/double_array_trie.hpp"
 #include "../src/tokenizer/sentencepiece_wrapper.hpp"
+#include "../src/tokenizer/streaming_decoder.hpp"
+#include "../src/transformer/kv_cache.hpp"
+#include "../src/transformer/transformer.hpp"
+#include "../src/transformer/execution_plan.hpp"
+#include "../src/transformer/session_cache.hpp"
+#include "../src/transformer/speculative.hpp"
+#include "../src/grammar/json_schema.hpp"
+#include "../src/grammar/token_grammar.hpp"
+#include "../src/util/threadpool.hpp"
+#include "../src/util/profiler.hpp"
+#include "../src/util/histogram.hpp"
+#include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <random>
 #include <cassert>
 #include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <tuple>
 #include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 // Test Tensor class
 void test_tensor() {
@@ -33,6 +65,11 @@ void test_tensor() {
     Tensor t3 = std::move(t2);
     assert(t3.shape() == std::vector<int>{3, 2});
 
+    // Views of a const tensor share its memory
+    const Tensor& ct = t;
+    const Tensor flat = ct.view({6});
+    assert(flat.data<float>() == ct.data<float>() && !flat.owns_data());
+
     std::cout << "✓ Tensor tests passed" << std::endl;
 }
 
@@ -48,9 +85,160 @@ void test_allocator() {
     assert(addr % 32 == 0);
 
     AlignedAllocator::deallocate(ptr);
+
+    // Tensor storage is cache-line aligned
+    Tensor small({3, 5}, DType::FP32);
+    assert(reinterpret_cast<uintptr_t>(small.raw()) % AlignedAllocator::kDefaultAlignment == 0);
+    assert(small.data<float>()[14] == 0.0f);
+
+    // Large long-lived buffers are huge-page aligned; others stay on the heap
+    Tensor large({1024, 1024}, DType::FP32, TensorStorage::HugePages);
+    assert(reinterpret_cast<uintptr_t>(large.raw()) % AlignedAllocator::kHugePageSize == 0);
+    assert(large.data<float>()[1024 * 1024 - 1] == 0.0f);
+    bool huge_pages = true;
+    void* scratch = AlignedAllocator::allocate_storage(AlignedAllocator::kHugePageSize, &huge_pages);
+    assert(!huge_pages && static_cast<float*>(scratch)[0] == 0.0f);
+    AlignedAllocator::deallocate_storage(scratch, AlignedAllocator::kHugePageSize, huge_pages);
+
     std::cout << "✓ Allocator tests passed" << std::endl;
 }
 
+// Test TensorPool arena
+void test_tensor_pool() {
+    std::cout << "Testing TensorPool..." << std::endl;
+
+    TensorPool pool(4096, 64);
+
+    // Bump allocations are aligned and distinct
+    void* a = pool.allocate(100);
+    void* b = pool.allocate(100);
+    assert(a != b);
+    assert(reinterpret_cast<uintptr_t>(a) % 64 == 0);
+    assert(reinterpret_cast<uintptr_t>(b) % 64 == 0);
+
+    // Freed ranges are reused for the same size class
+    pool.deallocate(a, 100);
+    void* c = pool.allocate(110);
+    assert(c == a);
+    assert(pool.stats().free_list_hits == 1);
+
+    // Spilling past the first block grows the pool
+    void* big = pool.allocate(8192);
+    assert(big != nullptr);
+    assert(pool.stats().num_blocks == 2);
+    size_t high_water = pool.stats().high_water_mark;
+    assert(high_water >= 8192);
+
+    // Reset merges blocks and hands out memory from the start again
+    pool.reset();
+    assert(pool.stats().num_blocks == 1);
+    assert(pool.stats().bytes_in_use == 0);
+    assert(pool.stats().high_water_mark == high_water);
+    void* d = pool.allocate(8192);
+    void* e = pool.allocate(100);
+    assert(d != nullptr && e != nullptr);
+    assert(pool.stats().num_blocks == 1);
+
+    std::cout << "✓ TensorPool tests passed" << std::endl;
+}
+
+// Test activation memory planner
+void test_memory_planner() {
+    std::cout << "Testing MemoryPlanner..." << std::endl;
+
+    // A chain of layer outputs: each buffer dies once the next layer ran,
+    // so only two need to be resident at once
+    MemoryPlanner planner;
+    std::vector<int> ids;
+    for (int step = 0; step < 6; ++step) {
+        ids.push_back(planner.add_buffer(1000, step, step + 1));
+    }
+    planner.plan(64);
+
+    assert(planner.unplanned_size() == 6000);
+    assert(planner.arena_size() == 2 * 1024);
+
+    // Buffers live at the same time never overlap
+    for (size_t i = 0; i + 1 < ids.size(); ++i) {
+        size_t a = planner.offset(ids[i]);
+        size_t b = planner.offset(ids[i + 1]);
+        assert(a + 1000 <= b || b + 1000 <= a);
+    }
+
+    TensorPool pool;
+    ActivationArena arena(planner, pool);
+    Tensor view = arena.tensor(ids[0], {10, 25}, DType::FP32);
+    assert(!view.owns_data());
+    assert(view.raw() == arena.data(ids[0]));
+
+    std::cout << "✓ MemoryPlanner tests passed" << std::endl;
+}
+
+// Test execution plan
+void test_execution_plan() {
+    std::cout << "Testing ExecutionPlan..." << std::endl;
+
+    // Fill followed by a chain of identity copies collapses to one step
+    // writing straight into the last buffer
+    const size_t n = 50000;
+    std::vector<float> a(n), b(n), c(n);
+    ExecutionPlan plan;
+    plan.add_fill_random("fill", a.data(), n);
+    plan.add_copy("copy1", a.data(), b.data(), n);
+    plan.add_copy("copy2", b.data(), c.data(), n);
+    plan.optimize();
+    assert(plan.num_steps() == 1);
+    assert(plan.output() == c.data());
+
+    // Ping-ponged buffers fuse too: each is overwritten before it is read again
+    ExecutionPlan ping_pong;
+    ping_pong.add_fill_random("fill", a.data(), n);
+    ping_pong.add_copy("copy1", a.data(), b.data(), n);
+    ping_pong.add_copy("copy2", b.data(), a.data(), n);
+    ping_pong.add_copy("copy3", a.data(), b.data(), n);
+    ping_pong.optimize();
+    assert(ping_pong.num_steps() == 1 && ping_pong.output() == b.data());
+
+    // A source read again later keeps its copy
+    ExecutionPlan fan_out;
+    fan_out.add_fill_random("fill", a.data(), n);
+    fan_out.add_copy("copy1", a.data(), b.data(), n);
+    fan_out.add_copy("copy2", a.data(), c.data(), n);
+    fan_out.optimize();
+    assert(fan_out.num_steps() == 3);
+
+    // Partitioned copies replayed on a pool match the source
+    ExecutionPlan copy_plan;
+    copy_plan.add_copy("copy", c.data(), a.data(), n);
+    copy_plan.partition(4, 1000);
+    assert(copy_plan.steps()[0].partitions.size() == 4);
+
+    ThreadPool pool(3);
+    plan.run(nullptr);
+    copy_plan.run(nullptr, &pool);
+    for (size_t i = 0; i < n; ++i) {
+        assert(a[i] == c[i]);
+    }
+
+    // Without a cache the layers are identity copies over the arena's two
+    // alternating hidden buffers and fold into the embedding fill; attention
+    // steps stay
+    Transformer model(ModelWeights{});
+    assert(model.compile(1, 4, false).num_steps() == 1);
+    assert(model.compile(1, 4, true).num_steps() == static_cast<size_t>(model.num_layers()) + 1);
+
+    // Logits live in the shape's arena, so replaying a shape reuses them
+    Tensor ids(std::vector<int>{1, 1}, DType::FP32);
+    ids.data<float>()[0] = 0.0f;
+    const float* first = model.forward(ids).data<float>();
+    Tensor logits = model.forward(ids);
+    assert(logits.data<float>() == first && !logits.owns_data());
+    assert(logits.shape() == (std::vector<int>{1, 1, model.vocab_size()}));
+    assert(logits.data<float>()[model.vocab_size() - 1] == 0.0f);
+
+    std::cout << "✓ ExecutionPlan tests passed" << std::endl;
+}
+
 // Test Q4 quantization
 void test_q4_quantization() {
     std::cout << "Testing Q4 quantization..." << std::endl;
@@ -128,38 +316,1089 @@ void test_gemm() {
         assert(std::isfinite(c_data[i]));
     }
 
+    // Tilings that don't divide the shape, split over threads, match the
+    // reference, alpha and beta included
+    const int TM = 37, TK = 45, TN = 53;
+    Tensor TA({TM, TK}, DType::FP32), TB({TK, TN}, DType::FP32), TC({TM, TN}, DType::FP32);
+    for (int i = 0; i < TM * TK; ++i) TA.data<float>()[i] = static_cast<float>(i % 7) - 3.0f;
+    for (int i = 0; i < TK * TN; ++i) TB.data<float>()[i] = static_cast<float>(i % 5) * 0.5f;
+    for (int i = 0; i < TM * TN; ++i) TC.data<float>()[i] = static_cast<float>(i % 3);
+    std::vector<float> initial(TC.data<float>(), TC.data<float>() + TM * TN);
+    KernelAutotuner::instance().clear();
+    GemmRef::matmul(TA, TB, TC, 0.5f, 0.25f);
+    ThreadPool gemm_pool(3);
+    for (GemmTiling tiling : {GemmTiling{5, 7, 11, 4}, GemmTiling{16, 64, 64, 3}, GemmTiling{64, 256, 256, 1}}) {
+        std::vector<float> tiled = initial;
+        matmul_tiled(TA.data<float>(), TB.data<float>(), tiled.data(), TM, TK, TN, 0.5f, 0.25f,
+                     tiling, &gemm_pool);
+        for (int i = 0; i < TM * TN; ++i) {
+            assert(std::abs(tiled[i] - TC.data<float>()[i]) < 1e-3f);
+        }
+    }
+
+    // Tuned entries round-trip per CPU model; other machines' sections are
+    // kept but not applied
+    std::string tune_path = (std::filesystem::temp_directory_path() / "unit_test_autotune.txt").string();
+    {
+        std::ofstream out(tune_path);
+        out << "[Some Other CPU]\n1 2 3 0 16 64 64 1 5\n";
+        out << "[" << KernelAutotuner::cpu_model() << "]\n64 128 32 0 16 64 64 2 7.5\n8 8 8 0 64 256 256 1 1\n";
+    }
+    KernelAutotuner& tuner = KernelAutotuner::instance();
+    for (int round = 0; round < 2; ++round) {
+        tuner.clear();
+        assert(tuner.load(tune_path) && tuner.size() == 2);
+        assert(!tuner.has(1, 2, 3));
+        GemmTiling loaded = tuner.lookup(64, 128, 32);
+        assert(loaded.block_m == 16 && loaded.block_n == 64 && loaded.block_k == 64);
+        assert(loaded.num_threads == 2 && loaded.gflops == 7.5);
+        tuner.save(tune_path);
+    }
+    std::ifstream saved(tune_path);
+    std::string text((std::istreambuf_iterator<char>(saved)), std::istreambuf_iterator<char>());
+    assert(text.find("[Some Other CPU]\n1 2 3 0 16 64 64 1 5\n") != std::string::npos);
+    assert(text.find("[" + KernelAutotuner::cpu_model() + "]") == text.rfind("[" + KernelAutotuner::cpu_model() + "]"));
+    tuner.clear();
+    std::filesystem::remove(tune_path);
+
     std::cout << "✓ GEMM tests passed" << std::endl;
 }
 
+// Test specialized attention and matvec kernels
+void test_specialized_kernels() {
+    std::cout << "Testing specialized kernels..." << std::endl;
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    // Each head_dim variant, and the generic kernel, match softmax(q.k) @ v
+    // for a head in the middle of wider query, key and value rows
+    for (int head_dim : {64, 80, 96, 128, 48, 72}) {
+        bool specialized_size = head_dim == 64 || head_dim == 80 || head_dim == 96 || head_dim == 128;
+        assert(specialized::has_attention_head_specialization(head_dim) == specialized_size);
+        const int num_keys = 37, row = 3 * head_dim, offset = head_dim;
+        std::vector<float> q(row), k_rows(num_keys * row), v_rows(num_keys * row);
+        for (float& x : q) x = dist(rng);
+        for (float& x : k_rows) x = dist(rng);
+        for (float& x : v_rows) x = dist(rng);
+        std::vector<const float*> keys, values;
+        for (int t = 0; t < num_keys; ++t) {
+            keys.push_back(k_rows.data() + t * row);
+            values.push_back(v_rows.data() + t * row);
+        }
+        float scale = 1.0f / std::sqrt(static_cast<float>(head_dim));
+        std::vector<float> scores(num_keys), out(head_dim);
+        specialized::attention_head_kernel(head_dim)(q.data(), keys.data(), values.data(), offset,
+                                                     num_keys, head_dim, scale, scores.data(), out.data());
+
+        std::vector<double> weights(num_keys);
+        double max_score = -1e30, sum = 0.0;
+        for (int t = 0; t < num_keys; ++t) {
+            double dot = 0.0;
+            for (int d = 0; d < head_dim; ++d) dot += q[offset + d] * keys[t][offset + d];
+            weights[t] = dot * scale;
+            max_score = std::max(max_score, weights[t]);
+        }
+        for (double& w : weights) sum += (w = std::exp(w - max_score));
+        for (int d = 0; d < head_dim; ++d) {
+            double expected = 0.0;
+            for (int t = 0; t < num_keys; ++t) expected += weights[t] / sum * values[t][offset + d];
+            assert(std::abs(out[d] - expected) < 1e-5);
+        }
+    }
+
+    // Tiled matvec over each tile width and odd K tails
+    for (int K : {1, 7, 63, 64, 65, 128, 200, 256, 257, 300}) {
+        const int M = 9;
+        std::vector<float> W(M * K), x(K), y(M);
+        for (float& v : W) v = dist(rng);
+        for (float& v : x) v = dist(rng);
+        specialized::matvec(W.data(), x.data(), y.data(), M, K);
+        for (int m = 0; m < M; ++m) {
+            double expected = 0.0;
+            for (int k = 0; k < K; ++k) expected += static_cast<double>(W[m * K + k]) * x[k];
+            assert(std::abs(y[m] - expected) < 1e-4 * std::sqrt(static_cast<double>(K)));
+        }
+    }
+
+    std::cout << "✓ Specialized kernel tests passed" << std::endl;
+}
+
+// Test FP16/BF16 storage and compute
+void test_half_precision() {
+    std::cout << "Testing FP16/BF16..." << std::endl;
+
+    // Scalar conversions round-trip exactly representable values
+    for (float v : {0.0f, 1.0f, -2.5f, 0.125f, 65504.0f, 6.1035156e-05f}) {
+        assert(fp16_to_fp32(fp32_to_fp16(v)) == v);
+    }
+    for (float v : {0.0f, 1.0f, -2.5f, 0.125f, 3.0e38f}) {
+        assert(std::abs(bf16_to_fp32(fp32_to_bf16(v)) - v) <= std::abs(v) * 1e-2f);
+    }
+    assert(std::isinf(fp16_to_fp32(fp32_to_fp16(1e6f))));
+
+    const int M = 3;
+    const int K = 20;
+    const int N = 9;
+
+    Tensor A({M, K}, DType::FP32);
+    Tensor B({K, N}, DType::FP32);
+    for (int i = 0; i < M * K; ++i) A.data<float>()[i] = 0.1f * (i % 7) - 0.3f;
+    for (int i = 0; i < K * N; ++i) B.data<float>()[i] = 0.05f * (i % 11) - 0.25f;
+
+    Tensor C_ref({M, N}, DType::FP32);
+    GemmRef::matmul(A, B, C_ref, 1.0f, 0.0f);
+
+    // Half-precision weights match FP32 within rounding error
+    for (DType dtype : {DType::FP16, DType::BF16}) {
+        Tensor B_half = B.to(dtype);
+        assert(B_half.byte_size() == B.byte_size() / 2);
+
+        Tensor C({M, N}, DType::FP32);
+        GemmRef::matmul(A, B_half, C, 1.0f, 0.0f);
+        for (int i = 0; i < M * N; ++i) {
+            assert(std::abs(C.data<float>()[i] - C_ref.data<float>()[i]) < 2e-2f);
+        }
+    }
+
+    // BF16 activations
+    Tensor A_bf16 = A.to(DType::BF16);
+    Tensor C_bf16({M, N}, DType::BF16);
+    GemmRef::matmul(A_bf16, B, C_bf16, 1.0f, 0.0f);
+    Tensor C_back = C_bf16.to(DType::FP32);
+    for (int i = 0; i < M * N; ++i) {
+        assert(std::abs(C_back.data<float>()[i] - C_ref.data<float>()[i]) < 5e-2f);
+    }
+
+    // GEMV over FP16 weights
+    std::vector<uint16_t> w(M * K);
+    fp32_to_fp16_row(A.data<float>(), w.data(), M * K);
+    std::vector<float> x(K, 1.0f);
+    std::vector<float> y(M);
+    matvec_f16(w.data(), x.data(), y.data(), M, K);
+    for (int m = 0; m < M; ++m) {
+        float expected = 0.0f;
+        for (int k = 0; k < K; ++k) expected += A.data<float>()[m * K + k];
+        assert(std::abs(y[m] - expected) < 1e-2f);
+    }
+
+    std::cout << "✓ FP16/BF16 tests passed" << std::endl;
+}
+
 // Test tokenizer
 void test_tokenizer() {
     std::cout << "Testing Tokenizer..." << std::endl;
 
-    Tokenizer tokenizer("dummy.model");
+    DoubleArrayTrie trie;
+    trie.build({{"a", 1}, {"ab", 2}, {"abc", 3}, {"b", 4}, {"ab", 5}});
+    assert(trie.find("ab") == 5);
+    assert(trie.find("abcd") == -1 && trie.find("c") == -1);
+    std::vector<std::pair<size_t, int>> matches;
+    trie.prefix_matches("abcd", 4, [&](size_t length, int value) { matches.emplace_back(length, value); });
+    assert(matches.size() == 3 && matches[0].second == 1 && matches[2].first == 3);
+
+    // Without a model file: one token per byte
+    Tokenizer tokenizer("");
 
     std::string text = "hello world";
-    auto tokens = tokenizer.encode(text);
+    auto tokens = tokenizer.encode(text, true, true);
 
-    assert(!tokens.empty());
+    assert(tokens.size() == text.size() + 2);
     assert(tokens.front() == tokenizer.bos_token_id());
     assert(tokens.back() == tokenizer.eos_token_id());
+    assert(tokenizer.decode(tokens) == text);
+    std::string utf8 = "na\xC3\xAFve \xE6\x9D\xB1\xE4\xBA\xAC";
+    assert(tokenizer.decode(tokenizer.encode(utf8)) == utf8);
+
+    // Byte-level BPE from a tokenizer.json: merges apply by rank, "Ġ"
+    // stands for the space byte and added tokens are matched verbatim
+    std::string json_path = (std::filesystem::temp_directory_path() / "test_tokenizer.json").string();
+    {
+        std::ofstream out(json_path);
+        out << R"({"added_tokens": [{"id": 9, "content": "<|endoftext|>", "special": true}],
+                   "pre_tokenizer": {"type": "ByteLevel", "add_prefix_space": false},
+                   "model": {"type": "BPE",
+                             "vocab": {"h": 0, "e": 1, "l": 2, "o": 3, "Ġ": 4, "he": 5,
+                                       "ll": 6, "llo": 7, "hello": 8, "Ġhello": 10},
+                             "merges": ["h e", "l l", "ll o", "he llo", "Ġ hello"]}})";
+    }
+    Tokenizer bpe(json_path);
+    assert(bpe.vocab_size() == 11 && bpe.eos_token_id() == 9 && bpe.bos_token_id() == -1);
+    assert(bpe.encode("hello hello<|endoftext|>") == (std::vector<int>{8, 10, 9}));
+    assert(bpe.encode("hole") == (std::vector<int>{0, 3, 2, 1}));
+    assert(bpe.decode({8, 10, 9, 8}) == "hello hello");
+    assert(bpe.token_bytes(10) == " hello");
+    std::filesystem::remove(json_path);
+
+    // Batches match encoding each text alone, with long texts cut across tasks
+    std::vector<std::string> texts = {"hello hello", "", "hole  hello"};
+    std::string long_text;
+    while (long_text.size() < 100000) long_text += "hello hole  hello hello ";
+    texts.push_back(long_text);
+    ThreadPool pool(4);
+    for (ThreadPool* batch_pool : {static_cast<ThreadPool*>(nullptr), &pool}) {
+        TokenBatch batch = bpe.encode_batch(texts, batch_pool);
+        assert(batch.size() == texts.size() && batch.length(1) == 0);
+        for (size_t i = 0; i < texts.size(); ++i) {
+            assert(std::vector<int>(batch.data(i), batch.data(i) + batch.length(i)) == bpe.encode(texts[i]));
+        }
+        assert(bpe.decode_batch(batch, batch_pool) == texts);
+    }
+
+    // SentencePiece model, written field by field: Unigram and BPE over the
+    // same pieces agree here, and "c" falls back to its byte
+    auto varint = [](std::string& out, uint64_t value) {
+        for (; value >= 0x80; value >>= 7) out += static_cast<char>(value | 0x80);
+        out += static_cast<char>(value);
+    };
+    auto message = [&](std::string& out, int field, const std::string& bytes) {
+        varint(out, field << 3 | 2);
+        varint(out, bytes.size());
+        out += bytes;
+    };
+    auto write_model = [&](const std::string& path, int model_type, bool byte_fallback,
+                           const std::string& normalizer) {
+        std::string model;
+        const std::vector<std::tuple<std::string, float, int>> pieces = {
+            {"<unk>", 0.0f, 2}, {"<s>", 0.0f, 3}, {"</s>", 0.0f, 3}, {"\xE2\x96\x81", -2.0f, 1},
+            {"a", -3.0f, 1}, {"b", -3.0f, 1}, {"\xE2\x96\x81" "ab", -1.0f, 1}, {"ab", -2.5f, 1},
+            {"\xE2\x96\x81" "a", -1.5f, 1}, {"<0x63>", 0.0f, 6}};
+        for (const auto& [text, score, type] : pieces) {
+            std::string piece;
+            message(piece, 1, text);
+            varint(piece, 2 << 3 | 5);
+            piece.append(reinterpret_cast<const char*>(&score), sizeof(score));
+            varint(piece, 3 << 3);
+            varint(piece, type);
+            message(model, 1, piece);
+        }
+        std::string trainer;
+        varint(trainer, 3 << 3);
+        varint(trainer, model_type);
+        varint(trainer, 35 << 3);
+        varint(trainer, byte_fallback);
+        message(model, 2, trainer);
+        if (!normalizer.empty()) {
+            std::string spec;
+            message(spec, 1, normalizer);
+            message(spec, 2, std::string("\x01\x02\x03", 3));  // precompiled_charsmap
+            message(model, 3, spec);
+        }
+        std::ofstream(path, std::ios::binary) << model;
+    };
+    std::string model_path = (std::filesystem::temp_directory_path() / "test_tokenizer.model").string();
+    for (int model_type : {1, 2}) {
+        write_model(model_path, model_type, true, "");
+        Tokenizer spm(model_path);
+        assert(spm.vocab_size() == 10 && spm.bos_token_id() == 1 && spm.unk_token_id() == 0);
+        assert(spm.unapplied_normalizer().empty());
+        auto ids = spm.encode("ab  ab");
+        assert(ids == (std::vector<int>{1, 6, 6}));
+        assert(spm.decode(ids) == "ab ab");
+        assert(spm.encode("ba", false) == (std::vector<int>{3, 5, 4}));
+        assert(spm.encode("abc") == (std::vector<int>{1, 6, 9}));
+        assert(spm.decode(spm.encode("abc")) == "abc");
+        assert(spm.token_bytes(1).empty() && spm.token_bytes(8) == " a");
+        std::string long_spm;
+        while (long_spm.size() < 50000) long_spm += "ab  ab ba abc ";
+        TokenBatch batch = spm.encode_batch({long_spm, " ab "}, &pool, true, true);
+        assert(std::vector<int>(batch.data(0), batch.data(0) + batch.length(0)) == spm.encode(long_spm, true, true));
+        assert(std::vector<int>(batch.data(1), batch.data(1) + batch.length(1)) == (std::vector<int>{1, 6, 2}));
+        assert(spm.encode("acca") == (std::vector<int>{1, 8, 9, 9, 4}));
+
+        // Without byte fallback a run of unknown characters is one <unk>;
+        // a normalizer that is not applied is reported
+        write_model(model_path, model_type, false, "nmt_nfkc");
+        Tokenizer unk(model_path);
+        assert(unk.encode("acca") == (std::vector<int>{1, 8, 0, 4}));
+        assert(unk.encode("cc c") == (std::vector<int>{1, 3, 0, 3, 0}));
+        assert(unk.unapplied_normalizer() == "nmt_nfkc");
+    }
+    std::filesystem::remove(model_path);
 
-    std::string decoded = tokenizer.decode(tokens);
-    // Note: our simple tokenizer won't perfectly reconstruct, but should not crash
-    assert(!decoded.empty());
+    // GGUF tokenizer.ggml.* metadata: the same pieces as a llama model, then
+    // a gpt2 one whose merges are resolved in the background
+    struct GGUFWriter {
+        std::string out, kvs;
+        int count = 0;
+        void u32(std::string& to, uint32_t v) { to.append(reinterpret_cast<const char*>(&v), 4); }
+        void u64(std::string& to, uint64_t v) { to.append(reinterpret_cast<const char*>(&v), 8); }
+        void str(std::string& to, const std::string& v) { u64(to, v.size()); to += v; }
+        void key(const std::string& name, uint32_t type) { str(kvs, name); u32(kvs, type); ++count; }
+        void string(const std::string& name, const std::string& v) { key(name, 8); str(kvs, v); }
+        void uint32(const std::string& name, uint32_t v) { key(name, 4); u32(kvs, v); }
+        void strings(const std::string& name, const std::vector<std::string>& v) {
+            key(name, 9); u32(kvs, 8); u64(kvs, v.size());
+            for (const auto& e : v) str(kvs, e);
+        }
+        void floats(const std::string& name, const std::vector<float>& v) {
+            key(name, 9); u32(kvs, 6); u64(kvs, v.size());
+            kvs.append(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(float));
+        }
+        void ints(const std::string& name, const std::vector<int32_t>& v) {
+            key(name, 9); u32(kvs, 5); u64(kvs, v.size());
+            kvs.append(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(int32_t));
+        }
+        void write(const std::string& path) {
+            out = "GGUF";
+            u32(out, 3);
+            u64(out, 0);
+            u64(out, count);
+            std::ofstream(path, std::ios::binary) << out << kvs;
+        }
+    };
+    std::string gguf_path = (std::filesystem::temp_directory_path() / "test_tokenizer.gguf").string();
+    {
+        GGUFWriter llama;
+        llama.string("general.architecture", "llama");
+        llama.string("tokenizer.ggml.model", "llama");
+        llama.strings("tokenizer.ggml.tokens", {"<unk>", "<s>", "</s>", "\xE2\x96\x81", "a", "b",
+                                                "\xE2\x96\x81" "ab", "ab", "\xE2\x96\x81" "a", "<0x63>"});
+        llama.floats("tokenizer.ggml.scores", {0, 0, 0, -2, -3, -3, -1, -2.5f, -1.5f, 0});
+        llama.ints("tokenizer.ggml.token_type", {2, 3, 3, 1, 1, 1, 1, 1, 1, 6});
+        llama.uint32("tokenizer.ggml.bos_token_id", 1);
+        llama.uint32("tokenizer.ggml.eos_token_id", 2);
+        llama.write(gguf_path);
+
+        gguf::GGUFFile file(gguf_path);
+        assert(file.version() == 3 && file.tensors().empty());
+        assert(file.find("general.architecture")->as_string() == "llama");
+        assert(file.find("tokenizer.ggml.eos_token_id")->as_int() == 2);
+        assert(file.find("missing") == nullptr);
+
+        Tokenizer spm(gguf_path);
+        assert(spm.vocab_size() == 10 && spm.bos_token_id() == 1 && spm.unk_token_id() == 0);
+        assert(spm.piece(6) == "\xE2\x96\x81" "ab" && spm.token_type(9) == TokenType::Byte);
+        auto ids = spm.encode("ab ab");
+        assert(ids == (std::vector<int>{1, 6, 6}));
+        assert(spm.decode(ids) == "ab ab");
+        assert(spm.encode("abc") == (std::vector<int>{1, 6, 9}));
+    }
+    {
+        GGUFWriter gpt2;
+        gpt2.string("tokenizer.ggml.model", "gpt2");
+        gpt2.strings("tokenizer.ggml.tokens", {"a", "b", "ab", "\xC4\xA0", "\xC4\xA0" "ab", "<|end|>"});
+        gpt2.ints("tokenizer.ggml.token_type", {1, 1, 1, 1, 1, 3});
+        gpt2.strings("tokenizer.ggml.merges", {"a b", "\xC4\xA0 ab"});
+        gpt2.uint32("tokenizer.ggml.eos_token_id", 5);
+        gpt2.write(gguf_path);
+
+        Tokenizer bpe(gguf_path);
+        assert(bpe.bos_token_id() == -1 && bpe.eos_token_id() == 5);
+        assert(bpe.encode("ab ab<|end|>") == (std::vector<int>{2, 4, 5}));
+        assert(bpe.decode({2, 4}) == "ab ab");
+    }
+    std::filesystem::remove(gguf_path);
 
     std::cout << "✓ Tokenizer tests passed" << std::endl;
 }
 
+// Test incremental detokenization
+void test_streaming_decoder() {
+    std::cout << "Testing StreamingDecoder..." << std::endl;
+
+    // One token per byte: characters come out once their last byte arrives
+    Tokenizer bytes("");
+    StreamingDecoder decoder(bytes);
+    std::string text = "na\xC3\xAFve \xE6\x9D\xB1\xE4\xBA\xAC!";
+    std::vector<std::string> pieces;
+    std::string streamed;
+    for (int token : bytes.encode(text)) {
+        pieces.push_back(decoder.push(token));
+        streamed += pieces.back();
+    }
+    assert(streamed == text);
+    assert(pieces[3] == "" && pieces[4] == "\xC3\xAF");  // After BOS, n, a
+    assert(pieces[8] == "" && pieces[9] == "" && pieces[10] == "\xE6\x9D\xB1");
+    assert(decoder.flush().empty());
+
+    // Bytes that cannot form a character become U+FFFD
+    decoder.reset();
+    int e6 = bytes.encode("\xE6", false)[0];
+    int a = bytes.encode("A", false)[0];
+    assert(decoder.push(e6).empty());
+    assert(decoder.push(a) == "\xEF\xBF\xBD" "A");
+    assert(decoder.push(e6).empty());
+    assert(decoder.flush() == "\xEF\xBF\xBD");
+
+    // Overlong forms, surrogates and code points past U+10FFFF are not
+    // characters: each byte becomes U+FFFD; the boundary characters pass
+    auto stream_bytes = [&](const std::string& raw) {
+        decoder.reset();
+        std::string out;
+        for (int token : bytes.encode(raw, false)) out += decoder.push(token);
+        return out + decoder.flush();
+    };
+    const std::string fffd = "\xEF\xBF\xBD";
+    assert(stream_bytes("\xE0\x80\x80") == fffd + fffd + fffd);
+    assert(stream_bytes("\xED\xA0\x80") == fffd + fffd + fffd);
+    assert(stream_bytes("\xF4\x90\x80\x80") == fffd + fffd + fffd + fffd);
+    assert(stream_bytes("\xF0\x80\x80\x80") == fffd + fffd + fffd + fffd);
+    for (std::string valid : {"\xE0\xA0\x80", "\xED\x9F\xBF", "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF"}) {
+        assert(stream_bytes(valid) == valid);
+    }
+
+    // SentencePiece-style spaces, and the dummy prefix dropped after BOS
+    std::string json_path = (std::filesystem::temp_directory_path() / "test_streaming.json").string();
+    {
+        std::ofstream out(json_path);
+        out << R"({"added_tokens": [{"id": 0, "content": "<s>", "special": true}],
+                   "pre_tokenizer": {"type": "Metaspace", "replacement": "▁", "prepend_scheme": "first"},
+                   "model": {"type": "BPE", "vocab": {"<s>": 0, "▁": 1, "h": 2, "i": 3, "▁h": 4, "▁hi": 5},
+                             "merges": ["▁ h", "▁h i"]}})";
+    }
+    Tokenizer spm(json_path);
+    std::filesystem::remove(json_path);
+    auto tokens = spm.encode("hi hi");
+    assert(tokens == (std::vector<int>{0, 5, 5}));
+    StreamingDecoder words(spm);
+    assert(words.push(0).empty() && words.push(5) == "hi" && words.push(5) == " hi");
+    words.reset();
+    assert(words.push(5) == " hi");  // Continuing a sequence keeps its spaces
+
+    std::cout << "✓ StreamingDecoder tests passed" << std::endl;
+}
+
+// Test windowed KV cache modes
+void test_kv_cache_modes() {
+    std::cout << "Testing KVCache modes..." << std::endl;
+
+    const int kv_dim = 4;
+    std::vector<float> row(kv_dim);
+    std::vector<int> positions;
+
+    // Sliding window: only the last 4 tokens stay visible, memory is fixed
+    KVCacheConfig window_config;
+    window_config.mode = KVCacheMode::SlidingWindow;
+    window_config.window_size = 4;
+    KVCache window_cache(1, kv_dim, window_config);
+    size_t window_bytes = 0;
+
+    for (int pos = 0; pos < 10; ++pos) {
+        std::fill(row.begin(), row.end(), static_cast<float>(pos));
+        window_cache.store(0, pos, row.data(), row.data());
+        window_cache.advance(1);
+        if (pos == 3) window_bytes = window_cache.byte_size();
+    }
+    assert(window_bytes > 0 && window_cache.byte_size() == window_bytes);
+    window_cache.visible_positions(window_cache.length(), positions);
+    assert((positions == std::vector<int>{6, 7, 8, 9}));
+    assert(window_cache.key_at(0, 6)[0] == 6.0f);
+    assert(window_cache.value_at(0, 9)[0] == 9.0f);
+
+    // Attention sink: first 2 tokens pinned plus a rolling window of 3
+    KVCacheConfig sink_config;
+    sink_config.mode = KVCacheMode::AttentionSink;
+    sink_config.window_size = 3;
+    sink_config.num_sink_tokens = 2;
+    KVCache sink_cache(1, kv_dim, sink_config);
+    assert(sink_cache.capacity() == 5);
+
+    for (int pos = 0; pos < 10; ++pos) {
+        std::fill(row.begin(), row.end(), static_cast<float>(pos));
+        sink_cache.store(0, pos, row.data(), row.data());
+        sink_cache.advance(1);
+    }
+    sink_cache.visible_positions(sink_cache.length(), positions);
+    assert((positions == std::vector<int>{0, 1, 7, 8, 9}));
+    assert(sink_cache.key_at(0, 1)[0] == 1.0f);
+    assert(sink_cache.key_at(0, 7)[0] == 7.0f);
+
+    // RoPE positions are re-indexed by place in the cache
+    assert(sink_cache.rope_position(1, 10) == 1);
+    assert(sink_cache.rope_position(7, 10) == 2);
+    assert(sink_cache.rope_position(9, 10) == 4);
+
+    // Tabulated rotations match computed ones
+    RotaryEmbedding rope(8), tabulated_rope(8);
+    tabulated_rope.cache_positions(sink_cache.capacity());
+    for (int pos = 0; pos < sink_cache.capacity(); ++pos) {
+        std::vector<float> computed(16), tabulated(16);
+        for (int i = 0; i < 16; ++i) computed[i] = tabulated[i] = 0.1f * i - 0.7f;
+        rope.apply(computed.data(), 2, pos);
+        tabulated_rope.apply(tabulated.data(), 2, pos);
+        for (int i = 0; i < 16; ++i) assert(std::abs(computed[i] - tabulated[i]) < 1e-6f);
+    }
+
+    // Rollback: lookahead slots keep the window intact under rejected rows
+    KVCacheConfig spec_config = window_config;
+    spec_config.lookahead = 2;
+    KVCache spec_cache(1, kv_dim, spec_config);
+    for (int pos = 0; pos < 10; ++pos) {
+        std::fill(row.begin(), row.end(), static_cast<float>(pos));
+        spec_cache.store(0, pos, row.data(), row.data());
+        spec_cache.advance(1);
+    }
+    spec_cache.truncate(8);
+    spec_cache.visible_positions(spec_cache.length(), positions);
+    assert((positions == std::vector<int>{4, 5, 6, 7}));
+    assert(spec_cache.key_at(0, 4)[0] == 4.0f);
+    bool threw = false;
+    try {
+        spec_cache.truncate(7);  // Row 9 may now shadow position 3
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    // Forks share blocks until one of them writes into a shared block
+    KVCacheConfig fork_config;
+    fork_config.max_seq_len = 64;
+    fork_config.block_size = 4;
+    KVCache parent(2, kv_dim, fork_config);
+    for (int pos = 0; pos < 6; ++pos) {
+        std::fill(row.begin(), row.end(), static_cast<float>(pos));
+        parent.store(0, pos, row.data(), row.data());
+        parent.store(1, pos, row.data(), row.data());
+        parent.advance(1);
+    }
+    size_t prefix_bytes = parent.byte_size();
+    assert(prefix_bytes == 2 * 4 * parent.bytes_per_token());
+    KVCache child = parent.fork();
+    assert(child.byte_size() == prefix_bytes && child.private_byte_size() == 0);
+
+    for (KVCache* branch : {&child, &parent}) {
+        std::fill(row.begin(), row.end(), branch == &child ? 100.0f : 200.0f);
+        branch->store(0, 6, row.data(), row.data());
+        branch->store(1, 6, row.data(), row.data());
+        branch->advance(1);
+    }
+    assert(child.key_at(1, 6)[0] == 100.0f && parent.key_at(1, 6)[0] == 200.0f);
+    assert(child.value_at(1, 5)[0] == 5.0f);
+    assert(child.key_at(0, 2) == parent.key_at(0, 2));  // Full block still shared
+    assert(child.private_byte_size() == prefix_bytes / 2);
+
+    std::cout << "✓ KVCache mode tests passed" << std::endl;
+}
+
+// Test session KV cache persistence
+void test_session_cache() {
+    std::cout << "Testing SessionCache..." << std::endl;
+
+    const int kv_dim = 4;
+    std::vector<float> row(kv_dim);
+    KVCacheConfig config;
+    config.max_seq_len = 64;
+    config.block_size = 4;
+    KVCache cache(2, kv_dim, config);
+    std::vector<int> history;
+    for (int pos = 0; pos < 10; ++pos) {
+        std::fill(row.begin(), row.end(), static_cast<float>(pos));
+        cache.store(0, pos, row.data(), row.data());
+        cache.store(1, pos, row.data(), row.data());
+        cache.advance(1);
+        history.push_back(100 + pos);
+    }
+    history.push_back(110);  // Sampled last, not yet fed
+
+    // In memory: a restore is a fork of what was saved
+    SessionCacheConfig memory_config;
+    memory_config.max_memory_bytes = cache.byte_size();
+    SessionCache memory_sessions(memory_config);
+    memory_sessions.save("a", history, cache);
+    std::vector<int> tokens;
+    KVCache restored;
+    assert(memory_sessions.restore("a", tokens, restored));
+    assert(tokens == history && restored.length() == 10);
+    assert(restored.key_at(1, 7) == cache.key_at(1, 7));
+
+    // Past the budget the least recently used session goes
+    memory_sessions.save("b", history, cache);
+    assert(!memory_sessions.restore("a", tokens, restored));
+    assert(memory_sessions.restore("b", tokens, restored));
+    assert(memory_sessions.stats().evictions == 1);
+
+    // With a spill directory evicted sessions are mapped back from disk
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "unit_test_sessions";
+    std::filesystem::remove_all(dir);
+    SessionCacheConfig disk_config;
+    disk_config.max_memory_bytes = 0;
+    disk_config.spill_dir = dir.string();
+    {
+        SessionCache disk_sessions(disk_config);
+        disk_sessions.save("chat/1", history, cache);
+        assert(disk_sessions.stats().spills == 1 && disk_sessions.stats().memory_bytes == 0);
+        assert(disk_sessions.stats().disk_bytes > cache.byte_size());
+    }
+    SessionCache reopened(disk_config);  // Picks up the files left behind
+    assert(reopened.restore("chat/1", tokens, restored));
+    assert(tokens == history && restored.length() == 10);
+    for (int pos = 0; pos < 10; ++pos) {
+        assert(restored.key_at(0, pos)[0] == pos && restored.value_at(1, pos)[kv_dim - 1] == pos);
+    }
+
+    // The next turn continues the restored cache; the snapshot is untouched
+    std::fill(row.begin(), row.end(), -1.0f);
+    restored.store(0, 10, row.data(), row.data());
+    restored.store(1, 10, row.data(), row.data());
+    restored.advance(1);
+    restored.truncate(9);
+    restored.store(0, 9, row.data(), row.data());
+    KVCache again;
+    assert(reopened.restore("chat/1", tokens, again));
+    assert(again.key_at(0, 9)[0] == 9.0f && restored.key_at(0, 9)[0] == -1.0f);
+
+    // Spills are written outside the lock; concurrent turns all land
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&, t]() {
+            for (int i = 0; i < 8; ++i) {
+                reopened.save("thread" + std::to_string(t) + "/" + std::to_string(i), history, cache);
+            }
+        });
+    }
+    for (auto& writer : writers) writer.join();
+    assert(reopened.stats().sessions == 33 && reopened.stats().memory_bytes == 0);
+    for (int t = 0; t < 4; ++t) {
+        for (int i = 0; i < 8; ++i) {
+            assert(reopened.restore("thread" + std::to_string(t) + "/" + std::to_string(i), tokens, again));
+            assert(tokens == history && again.key_at(1, 9)[0] == 9.0f);
+        }
+    }
+
+    bool threw = false;
+    try {
+        reopened.save(std::string(SessionCache::kMaxIdLength + 1, 'x'), history, cache);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    reopened.clear();
+    assert(reopened.stats().sessions == 0 && std::filesystem::is_empty(dir));
+    std::filesystem::remove_all(dir);
+
+    std::cout << "✓ SessionCache tests passed" << std::endl;
+}
+
+// Test speculative decoding verification
+void test_speculative_sampling() {
+    std::cout << "Testing speculative sampling..." << std::endl;
+
+    // Top-k keeps the k most likely tokens, renormalized
+    std::vector<float> logits = {1.0f, 3.0f, 2.0f, 0.0f};
+    std::vector<float> probs;
+    token_probabilities(logits.data(), 4, SamplingParams{1.0f, 2, 1.0f}, probs);
+    assert(probs[0] == 0.0f && probs[3] == 0.0f);
+    assert(probs[1] > probs[2] && std::abs(probs[1] + probs[2] - 1.0f) < 1e-6f);
+    token_probabilities(logits.data(), 4, SamplingParams{0.0f, 0, 1.0f}, probs);
+    assert((probs == std::vector<float>{0.0f, 1.0f, 0.0f, 0.0f}));
+
+    // Whatever the draft proposes, the emitted token follows the target
+    std::vector<float> p = {0.1f, 0.2f, 0.3f, 0.4f};
+    std::vector<float> q = {0.4f, 0.3f, 0.2f, 0.1f};
+    std::mt19937 rng(7);
+    const int trials = 200000;
+    std::vector<int> from_draft(4, 0), from_lookup(4, 0);
+    int accepted = 0;
+    for (int t = 0; t < trials; ++t) {
+        int proposal = sample_token(q, rng);
+        VerifyResult r = verify_draft({proposal}, {q}, {p, p}, rng);
+        accepted += r.accepted;
+        from_draft[r.accepted ? proposal : r.next_token]++;
+
+        // Deterministic proposal, e.g. prompt lookup
+        r = verify_draft({0}, {}, {p, p}, rng);
+        from_lookup[r.accepted ? 0 : r.next_token]++;
+    }
+    for (int v = 0; v < 4; ++v) {
+        assert(std::abs(from_draft[v] / static_cast<double>(trials) - p[v]) < 0.01);
+        assert(std::abs(from_lookup[v] / static_cast<double>(trials) - p[v]) < 0.01);
+    }
+    // Acceptance rate is sum(min(p, q)) = 0.6
+    assert(std::abs(accepted / static_cast<double>(trials) - 0.6) < 0.01);
+
+    // Greedy: keep the matching prefix, then the target's choice
+    std::vector<float> pick1 = {0, 1, 0, 0}, pick2 = {0, 0, 1, 0}, pick3 = {0, 0, 0, 1};
+    VerifyResult greedy = verify_draft({1, 3}, {pick1, pick3}, {pick1, pick2, pick3}, rng);
+    assert(greedy.accepted == 1 && greedy.next_token == 2);
+
+    // Prompt lookup continues the latest earlier occurrence of the longest suffix
+    std::vector<int> text = {5, 1, 2, 3, 4, 9, 1, 2, 7, 8, 6, 1, 2};
+    assert((prompt_lookup(text, 3, 1, 3) == std::vector<int>{7, 8, 6}));
+    assert((prompt_lookup(text, 3, 1, 10) == std::vector<int>{7, 8, 6, 1, 2}));
+    text.push_back(3);  // Suffix 1 2 3 now only matches the prompt
+    assert((prompt_lookup(text, 3, 1, 2) == std::vector<int>{4, 9}));
+    assert(prompt_lookup({1, 2, 3}, 3, 1, 4).empty());
+
+    std::cout << "✓ Speculative sampling tests passed" << std::endl;
+}
+
+// Test parallel sampling and beam search
+void test_batch_decoding() {
+    std::cout << "Testing batch sampling and beam search..." << std::endl;
+
+    // Model stand-in: stores a row for the fed token and returns fixed logits
+    KVCacheConfig config;
+    config.max_seq_len = 64;
+    config.block_size = 4;
+    std::vector<float> row(4, 0.0f);
+    std::vector<float> next = {std::log(0.9f), std::log(0.07f), std::log(0.03f)};
+    int calls = 0;
+    auto next_logits = [&](int, KVCache& cache, std::vector<float>& logits) {
+        cache.store(0, cache.length(), row.data(), row.data());
+        cache.advance(1);
+        logits = next;
+        ++calls;
+    };
+    auto prefilled = [&](int length) {
+        KVCache cache(1, 4, config);
+        for (int p = 0; p < length; ++p) cache.store(0, p, row.data(), row.data());
+        cache.advance(length);
+        return cache;
+    };
+    std::vector<float> prompt_logits = {std::log(0.3f), std::log(0.2f), std::log(0.5f)};
+
+    // n samples fork one prefill: the prompt's blocks are counted once and
+    // each branch only owns the block it rewrote plus the one it added
+    BatchRequest request;
+    request.input_tokens = {1, 1, 1, 1, 1, 1};
+    request.max_tokens = 4;
+    request.n = 3;
+    request.seed = 5;
+    KVCache prompt = prefilled(6);
+    size_t block_bytes = prompt.byte_size() / 2;
+    BatchResult sampled = BatchProcessor::sample_completions(request, prompt, prompt_logits, next_logits);
+    assert(calls == request.n * (request.max_tokens - 1));
+    assert(sampled.completions.size() == 3 && sampled.scores.size() == 3);
+    for (const auto& tokens : sampled.completions) {
+        assert(tokens.size() == 10);
+        assert(std::equal(request.input_tokens.begin(), request.input_tokens.end(), tokens.begin()));
+    }
+    assert(sampled.memory_used_bytes == (2 + 3 * 2) * block_bytes);
+    assert(prompt.length() == 6 && prompt.private_byte_size() == prompt.byte_size());
+
+    // Beam search with eos = 2: stopping right away scores log(0.5) = -0.69
+    // over 1 token; the best beam 0 0 0 has log(0.3 * 0.9 * 0.9) = -1.41 over 3
+    request.n = 2;
+    request.beam_width = 2;
+    request.max_tokens = 3;
+    request.eos_token_id = 2;
+    request.length_penalty = 1.0f;
+    std::vector<int> long_beam = {1, 1, 1, 1, 1, 1, 0, 0, 0};
+    BatchResult beams = BatchProcessor::beam_search(request, prefilled(6), prompt_logits, next_logits);
+    assert(beams.completions.size() == 2 && beams.scores[0] >= beams.scores[1]);
+    assert(beams.completions[0] == long_beam);
+    assert(std::abs(beams.scores[0] - std::log(0.3f * 0.9f * 0.9f) / 3.0f) < 1e-4f);
+    assert(beams.completions[1] == request.input_tokens);
+
+    // Without length normalization the short finished beam wins
+    request.length_penalty = 0.0f;
+    beams = BatchProcessor::beam_search(request, prefilled(6), prompt_logits, next_logits);
+    assert(beams.completions[0] == request.input_tokens);
+    assert(std::abs(beams.scores[0] - std::log(0.5f)) < 1e-4f);
+    assert(beams.completions[1] == long_beam);
+
+    // Without eos, token 2 is an ordinary continuation and leads
+    request.eos_token_id = -1;
+    beams = BatchProcessor::beam_search(request, prefilled(6), prompt_logits, next_logits);
+    assert((beams.completions[0] == std::vector<int>{1, 1, 1, 1, 1, 1, 2, 0, 0}));
+    assert(std::abs(beams.scores[0] - std::log(0.5f * 0.9f * 0.9f)) < 1e-4f);
+
+    std::cout << "✓ Batch sampling and beam search tests passed" << std::endl;
+}
+
+// Test grammar-constrained decoding
+void test_constrained_decoding() {
+    std::cout << "Testing constrained decoding..." << std::endl;
+
+    // The whole text must match
+    RegexDFA number("-?(0|[1-9]\\d*)(\\.\\d+)?");
+    assert(number.matches("0") && number.matches("-12.50") && number.matches("907"));
+    assert(!number.matches("") && !number.matches("012") && !number.matches("1.") && !number.matches("1a"));
+    RegexDFA word("[^\\s\"]{2,3}|(?:ab)+");
+    assert(word.matches("xy") && word.matches("x-z") && word.matches("ababab"));
+    assert(!word.matches("x") && !word.matches("wxyz") && !word.matches("a\"b"));
+    // A live prefix can still be completed
+    assert(number.walk(number.initial_state(), "-") != RegexDFA::kDead);
+    assert(number.walk(number.initial_state(), "0") != RegexDFA::kDead);
+    assert(number.walk(number.initial_state(), "00") == RegexDFA::kDead);
+
+    bool threw = false;
+    try { RegexDFA bad("(a|b"); } catch (const std::runtime_error&) { threw = true; }
+    assert(threw);
+
+    // Members in schema order; optional ones may be skipped
+    RegexDFA person(json_schema_to_regex(R"({
+        "type": "object",
+        "properties": {
+            "name": {"type": "string", "maxLength": 8},
+            "age": {"type": "integer"},
+            "tags": {"type": "array", "items": {"enum": ["a", "b"]}, "maxItems": 2},
+            "ok": {"type": "boolean"}
+        },
+        "required": ["name", "ok"]
+    })"));
+    assert(person.matches(R"({"name": "Ann", "age": 41, "tags": ["a", "b"], "ok": true})"));
+    assert(person.matches(R"({"name":"Bo \"B\"","ok":false})"));
+    assert(!person.matches(R"({"name": "Ann", "ok": true, "age": 41})"));
+    assert(!person.matches(R"({"age": 41, "ok": true})"));
+    assert(!person.matches(R"({"name": "Ann", "tags": ["a", "b", "a"], "ok": true})"));
+    assert(!person.matches(R"({"name": "Annabella!", "ok": true})"));
+
+    // Strings are well-formed UTF-8, and maxLength counts characters
+    assert(person.matches("{\"name\": \"Zo\xC3\xAB \xE6\x9D\xB1\xF0\x9F\x98\x80\", \"ok\": true}"));
+    assert(person.matches("{\"name\": \"\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\", \"ok\": true}"));
+    assert(!person.matches("{\"name\": \"\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\", \"ok\": true}"));
+    for (const char* bad : {"\xD8]", "\x80", "\xC0\x80", "\xE0\x80\x80", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xFF"}) {
+        assert(!person.matches(std::string("{\"name\": \"") + bad + "\", \"ok\": true}"));
+    }
+    int in_name = person.walk(person.initial_state(), "{\"name\": \"\xD8");
+    assert(in_name != RegexDFA::kDead && person.walk(in_name, "]") == RegexDFA::kDead);
+
+    // Token masks: allowed exactly when the token's bytes keep a match alive
+    std::vector<std::string> vocab = {"", "", "1", "2", "11", ".", "1.5", "x", "5"};
+    const int eos = 1;
+    TokenGrammar grammar(RegexDFA("1+(\\.5)?"), vocab, eos);
+    int state = grammar.initial_state();
+    for (int id : {2, 4, 6}) assert(grammar.allows(state, id));
+    for (int id : {0, 1, 3, 5, 7, 8}) assert(!grammar.allows(state, id));
+    state = grammar.next_state(state, 2);
+    assert(grammar.allows(state, eos) && grammar.allows(state, 4) && grammar.allows(state, 5));
+    assert(!grammar.allows(state, 3));
+    state = grammar.next_state(state, 5);
+    assert(!grammar.allows(state, eos) && grammar.allows(state, 8) && !grammar.allows(state, 2));
+    state = grammar.next_state(state, 8);
+    assert(grammar.allows(state, eos) && !grammar.allows(state, 8));
+
+    // The SIMD mask matches the bit-by-bit rule over a vocabulary that is
+    // not a multiple of the vector width
+    const int vocab_size = 77;
+    std::vector<uint64_t> mask(2, 0);
+    std::vector<float> masked(vocab_size);
+    for (int i = 0; i < vocab_size; ++i) {
+        masked[i] = static_cast<float>(i);
+        if (i % 3 == 0 || i > 70) mask[i >> 6] |= uint64_t{1} << (i & 63);
+    }
+    apply_token_mask(masked.data(), mask.data(), vocab_size);
+    for (int i = 0; i < vocab_size; ++i) {
+        bool keep = i % 3 == 0 || i > 70;
+        assert(keep ? masked[i] == static_cast<float>(i) : std::isinf(masked[i]));
+    }
+
+    std::cout << "✓ Constrained decoding tests passed" << std::endl;
+}
+
+// Test latency histogram
+void test_latency_histogram() {
+    std::cout << "Testing LatencyHistogram..." << std::endl;
+
+    // Every bucket is contiguous and maps back to itself
+    for (size_t i = 1; i < LatencyHistogram::kNumBuckets; ++i) {
+        uint64_t lower = LatencyHistogram::bucket_lower(i);
+        uint64_t previous = LatencyHistogram::bucket_lower(i - 1);
+        assert(lower == previous + LatencyHistogram::bucket_width(i - 1));
+        assert(LatencyHistogram::bucket_index(lower) == i);
+    }
+    assert(LatencyHistogram::bucket_index(UINT64_MAX) == LatencyHistogram::kNumBuckets - 1);
+
+    // 1..100000 us: percentiles within the bucket resolution
+    LatencyHistogram a, b;
+    for (uint64_t us = 1; us <= 100000; ++us) {
+        (us % 2 ? a : b).record(us * 1000);
+    }
+    a.merge(b);
+    assert(a.count() == 100000);
+    for (double p : {50.0, 90.0, 99.0, 99.9}) {
+        double expected = p / 100.0 * 100000 * 1000;
+        assert(std::abs(a.percentile(p) - expected) / expected < 0.035);
+    }
+    assert(a.percentile(100) == a.max());
+
+    // A slow 1% tail shows up at p99 though the mean hardly moves
+    LatencyHistogram tail;
+    for (int i = 0; i < 990; ++i) tail.record(1000);
+    for (int i = 0; i < 10; ++i) tail.record(1000000);
+    assert(tail.percentile(50) == 1000);
+    assert(tail.percentile(99) == 1000);
+    assert(tail.percentile(99.9) > 900000);
+
+    // Cumulative counts for Prometheus "le" buckets never overcount, and
+    // miss values only within a bucket's width of the bound
+    assert(tail.count_at_or_below(999) == 0);
+    assert(tail.count_at_or_below(1040) == 990);
+    assert(tail.count_at_or_below(999999) == 990);
+    assert(tail.count_at_or_below(UINT64_MAX) == tail.count());
+
+    a.reset();
+    assert(a.count() == 0 && a.percentile(50) == 0);
+
+    std::cout << "✓ LatencyHistogram tests passed" << std::endl;
+}
+
+// Test profiler
+void test_profiler() {
+    std::cout << "Testing Profiler..." << std::endl;
+
+    Profiler& profiler = Profiler::instance();
+    profiler.reset();
+
+    // Threads timing the same scope each keep their own start times
+    const int num_threads = 4;
+    const int per_thread = 1000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([]() {
+            for (int i = 0; i < per_thread; ++i) {
+                ScopedTimer outer("test_outer");
+                ScopedTimer inner("test_inner");
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    auto timings = profiler.get_timings();
+    assert(timings["test_outer"].count == num_threads * per_thread);
+    assert(timings["test_inner"].count == num_threads * per_thread);
+    assert(timings["test_outer"].total_time >= timings["test_inner"].total_time);
+    assert(timings["test_outer"].histogram.count() == num_threads * per_thread);
+    assert(timings["test_outer"].percentile(99) >= timings["test_outer"].percentile(50));
+
+    // take_timings starts a fresh interval
+    assert(profiler.take_timings().count("test_outer") == 1);
+    assert(profiler.get_timings().count("test_outer") == 0);
+
+    // Overflowing a thread's ring keeps the newest events and counts the rest
+    profiler.reset();
+    const int overflow = 100;
+    for (size_t i = 0; i < Profiler::kBufferCapacity + overflow; ++i) {
+        ScopedTimer timer("test_overflow");
+    }
+    auto overflowed = profiler.get_timings()["test_overflow"];
+    assert(overflowed.count == static_cast<int>(Profiler::kBufferCapacity));
+    assert(profiler.dropped_events() == overflow);
+
+    // Declared work gives throughput; hardware counts appear only where
+    // perf_event_open is allowed, and are simply absent otherwise
+    profiler.reset();
+    bool counting = profiler.enable_hardware_counters(true);
+    std::vector<float> src(1 << 16, 1.0f), dst(1 << 16);
+    for (int i = 0; i < 10; ++i) {
+        ScopedTimer timer("test_copy", 0, 2 * src.size() * sizeof(float));
+        std::copy(src.begin(), src.end(), dst.begin());
+    }
+    auto work = profiler.get_timings()["test_copy"];
+    assert(work.bytes == 10 * 2 * src.size() * sizeof(float) && work.gbps() > 0.0);
+    assert(counting ? work.cycles > 0 && work.ipc() > 0.0 : work.cycles == 0);
+    profiler.enable_hardware_counters(false);
+
+    // Trace export: slices per thread and a flow joining one request's slices
+    profiler.reset();
+    {
+        ProfileRequestScope request(42);
+        { ScopedTimer step("test_prefill"); }
+        { ScopedTimer step("test_decode"); }
+    }
+    std::ostringstream trace;
+    profiler.write_chrome_trace(trace);
+    assert(trace.str().find("\"name\": \"test_prefill\"") != std::string::npos);
+    assert(trace.str().find("\"args\": {\"request\": 42}") != std::string::npos);
+    assert(trace.str().find("\"ph\": \"s\"") != std::string::npos);
+    assert(trace.str().find("\"ph\": \"f\"") != std::string::npos);
+
+    // Per-connection thread names don't pile up once their threads exit
+    profiler.set_history_seconds(0.0);
+    size_t named = profiler.named_threads();
+    for (int i = 0; i < 3; ++i) {
+        std::thread([&profiler]() { profiler.set_thread_name("test connection"); }).join();
+    }
+    profiler.collect();
+    assert(profiler.named_threads() == named);
+    profiler.set_history_seconds(30.0);
+
+    profiler.reset();
+    assert(profiler.get_timings().empty());
+
+    std::cout << "✓ Profiler tests passed" << std::endl;
+}
+
+// Sends one request to 127.0.0.1:port and returns the whole response; the
+// request must ask for "Connection: close"
+std::string http_exchange(int port, const std::string& request) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int connected = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    ssize_t sent = send(fd, request.data(), request.size(), 0);
+    assert(fd >= 0 && connected == 0 && sent == static_cast<ssize_t>(request.size()));
+    std::string response;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        response.append(buffer, n);
+    }
+    close(fd);
+    return response;
+}
+
+// Test /metrics after one /generate
+void test_http_metrics() {
+    std::cout << "Testing HTTP metrics..." << std::endl;
+
+    HTTPServer server(0);
+    server.load_model("dummy");
+    server.start();
+
+    const std::string body = R"({"prompt": "hi", "max_tokens": 4, "ignore_eos": true})";
+    std::string generated = http_exchange(server.port(),
+        "POST /generate HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n"
+        "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) +
+        "\r\n\r\n" + body);
+    assert(generated.rfind("HTTP/1.1 200", 0) == 0);
+
+    std::string metrics = http_exchange(server.port(),
+        "GET /metrics HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+    server.stop();
+    auto value = [&metrics](const std::string& name) {
+        size_t at = metrics.find("\n" + name + " ");
+        assert(at != std::string::npos);
+        return std::stod(metrics.substr(at + name.size() + 2));
+    };
+
+    // The prompt is prefilled in one pass, then each of the other three
+    // tokens takes a one-token decode pass
+    double prefill = value("llm_tokens_total{phase=\"prefill\"}");
+    double decode = value("llm_tokens_total{phase=\"decode\"}");
+    assert(value("llm_requests_total") == 1);
+    assert(prefill == Tokenizer("").encode("hi").size());
+    assert(decode == 3);
+    assert(value("llm_time_to_first_token_seconds_count") == 1);
+    assert(value("llm_time_per_output_token_seconds_count") == 1);
+    assert(value("llm_batch_size_tokens_count") == 4);
+    assert(value("llm_batch_size_tokens_sum") == prefill + decode);
+    assert(value("llm_batch_size_tokens_bucket{le=\"+Inf\"}") == 4);
+    assert(value("llm_queue_depth") == 0 && value("llm_active_sequences") == 0);
+
+    std::cout << "✓ HTTP metrics tests passed" << std::endl;
+}
+
 int main() {
     std::cout << "Running unit tests..." << std::endl;
 
     try {
         test_tensor();
         test_allocator();
+        test_tensor_pool();
+        test_memory_planner();
+        test_execution_plan();
         test_q4_quantization();
         test_gemm();
+        test_specialized_kernels();
+        test_half_precision();
         test_tokenizer();
+        test_streaming_decoder();
+        test_kv_cache_modes();
+        test_session_cache();
+        test_speculative_sampling();
+        test_batch_decoding();
+        test_constrained_decoding();
+        test_latency_histogram();
+        test_profiler();
+        test_http_metrics();
 
         std::cout << "\n🎉 All tests passed!" << std::endl;
         return 0;
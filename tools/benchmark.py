@@ -2,74 +2,73 @@
 """
 Performance benchmarking script for Helios Engine.
 
-This script runs performance tests on the inference engine and generates
-metrics for tokens/sec, latency, and memory usage.
+This script runs the C++ bench_e2e binary against the inference engine and
+reports measured tokens/sec, TTFT, time per output token and peak memory.
 """
 
 import argparse
-import time
-import psutil
 import json
+import shutil
 import subprocess
+import sys
+import tempfile
 from pathlib import Path
 
 
-def run_inference_benchmark(model_path: str, prompt: str, max_tokens: int = 50,
-                          num_runs: int = 5) -> dict:
+DEFAULT_BINARIES = ["build/bench_e2e", "_build/bench_e2e", "bench_e2e"]
+
+
+def find_bench_binary(explicit: str = None) -> str:
+    """Locate the bench_e2e binary built by CMake."""
+    if explicit:
+        return explicit
+    for candidate in DEFAULT_BINARIES:
+        if Path(candidate).is_file():
+            return candidate
+    found = shutil.which("bench_e2e")
+    if found:
+        return found
+    raise FileNotFoundError(
+        "bench_e2e not found; build it with CMake (ENABLE_BENCHMARKS=ON) or pass --binary"
+    )
+
+
+def run_inference_benchmark(binary: str, model_path: str, prompt_len: str, max_tokens: str,
+                            num_runs: int, batch_sizes: str, rate: float) -> dict:
     """
-    Run inference benchmarks and collect performance metrics.
+    Run bench_e2e and return its JSON results.
 
-    Note: This is a placeholder that would integrate with the actual
-    C++ inference engine binary.
+    Each configuration serves num_runs requests; lengths accept the same
+    specs as bench_e2e (N, uniform:A:B, normal:MEAN:STD).
     """
 
-    print(f"Benchmarking model: {model_path}")
-    print(f"Prompt: {prompt}")
+    print(f"Benchmarking model: {model_path or 'built-in dummy model'}")
+    print(f"Prompt length: {prompt_len}")
     print(f"Max tokens: {max_tokens}")
-    print(f"Number of runs: {num_runs}")
-
-    # Placeholder results - in real implementation would run the C++ binary
-    results = {
-        "model_path": model_path,
-        "prompt": prompt,
-        "max_tokens": max_tokens,
-        "runs": num_runs,
-        "results": []
-    }
-
-    # Simulate benchmark runs
-    for i in range(num_runs):
-        start_time = time.time()
-
-        # Simulate inference time (would be actual binary execution)
-        inference_time = 0.1 + (i * 0.05)  # Simulated variable time
-        time.sleep(inference_time)
-
-        end_time = time.time()
-
-        run_result = {
-            "run": i + 1,
-            "inference_time": inference_time,
-            "tokens_per_sec": max_tokens / inference_time,
-            "total_time": end_time - start_time,
-            "memory_mb": psutil.Process().memory_info().rss / 1024 / 1024
-        }
-
-        results["results"].append(run_result)
-        print(f"Run {i+1}: {inference_time".3f"}s, {run_result['tokens_per_sec']".1f"} tokens/sec")
-
-    # Calculate statistics
-    times = [r["inference_time"] for r in results["results"]]
-    token_rates = [r["tokens_per_sec"] for r in results["results"]]
-
-    results["stats"] = {
-        "avg_inference_time": sum(times) / len(times),
-        "avg_tokens_per_sec": sum(token_rates) / len(token_rates),
-        "min_tokens_per_sec": min(token_rates),
-        "max_tokens_per_sec": max(token_rates),
-        "memory_peak_mb": max([r["memory_mb"] for r in results["results"]])
-    }
-
+    print(f"Requests per configuration: {num_runs}")
+
+    with tempfile.NamedTemporaryFile(suffix=".json", delete=False) as tmp:
+        json_path = tmp.name
+
+    cmd = [
+        binary,
+        "--prompt-len", prompt_len,
+        "--output-len", max_tokens,
+        "--batch-sizes", batch_sizes,
+        "--requests", str(num_runs),
+        "--rate", str(rate),
+        "--json", json_path,
+    ]
+    if model_path:
+        cmd += ["--model", model_path]
+
+    subprocess.run(cmd, check=True)
+
+    with open(json_path) as f:
+        results = json.load(f)
+    Path(json_path).unlink()
+
+    results["model_path"] = model_path
     return results
 
 
@@ -78,26 +77,42 @@ def main():
     parser.add_argument(
         "--model",
         type=str,
-        required=True,
-        help="Path to ONNX model file"
+        help="Path to ONNX model file (default: built-in dummy model)"
     )
     parser.add_argument(
-        "--prompt",
+        "--prompt-len",
         type=str,
-        default="Hello world, this is a test prompt for benchmarking the inference engine.",
-        help="Input prompt for benchmarking"
+        default="128",
+        help="Prompt length spec(s), comma-separated: N, uniform:A:B, normal:MEAN:STD"
     )
     parser.add_argument(
         "--max-tokens",
-        type=int,
-        default=50,
-        help="Maximum tokens to generate per run"
+        type=str,
+        default="50",
+        help="Output length spec(s) per request, same format as --prompt-len"
     )
     parser.add_argument(
         "--runs",
         type=int,
         default=5,
-        help="Number of benchmark runs"
+        help="Number of requests per configuration"
+    )
+    parser.add_argument(
+        "--batch-sizes",
+        type=str,
+        default="1",
+        help="Comma-separated maximum concurrent sequences"
+    )
+    parser.add_argument(
+        "--rate",
+        type=float,
+        default=0.0,
+        help="Poisson arrival rate in requests/sec (0 = all requests at start)"
+    )
+    parser.add_argument(
+        "--binary",
+        type=str,
+        help="Path to the bench_e2e binary"
     )
     parser.add_argument(
         "--output",
@@ -108,22 +123,28 @@ def main():
     args = parser.parse_args()
 
     # Check if model file exists
-    if not Path(args.model).exists():
+    if args.model and not Path(args.model).exists():
         print(f"Error: Model file not found: {args.model}")
         return 1
 
-    # Run benchmarks
-    results = run_inference_benchmark(
-        args.model, args.prompt, args.max_tokens, args.runs
-    )
+    try:
+        binary = find_bench_binary(args.binary)
+        results = run_inference_benchmark(
+            binary, args.model, args.prompt_len, args.max_tokens, args.runs,
+            args.batch_sizes, args.rate
+        )
+    except (FileNotFoundError, subprocess.CalledProcessError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
 
     # Print summary
-    stats = results["stats"]
     print("\n=== Benchmark Summary ===")
-    print(f"Average inference time: {stats['avg_inference_time']".3f"}s")
-    print(f"Average tokens/sec: {stats['avg_tokens_per_sec']".1f"}")
-    print(f"Peak memory usage: {stats['memory_peak_mb']".1f"} MB")
-    print(f"Range: {stats['min_tokens_per_sec']".1f"} - {stats['max_tokens_per_sec']".1f"} tokens/sec")
+    for r in results["results"]:
+        print(f"prompt {r['prompt_len']}, output {r['output_len']}, batch {r['batch_size']}: "
+              f"{r['output_tokens_per_sec']:.1f} tokens/sec, "
+              f"TTFT p50 {r['ttft_ms']['p50']:.2f} ms, "
+              f"TPOT p50 {r['tpot_ms']['p50']:.2f} ms, "
+              f"peak RSS {r['peak_rss_bytes'] / 1024 / 1024:.1f} MB")
 
     # Save results if requested
     if args.output: